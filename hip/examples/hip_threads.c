@@ -0,0 +1,144 @@
+/*
+ * Stress test for decoders running in parallel.
+ *
+ * Decodes every file once as a reference, then decodes all of them over
+ * and over from several threads at the same time, each thread starting
+ * with another file.  Every decode has to give the same PCM data as the
+ * reference.
+ *
+ * usage: hip_threads [-t threads] [-r rounds] file.mp3 ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hip.h"
+
+
+typedef struct {
+    const char *name;
+    unsigned long long hash;    /* FNV-1a of the PCM data */
+    long    bytes;
+} ref_t;
+
+typedef struct {
+    pthread_t thread;
+    int     first;              /* file to start with */
+    int     errors;
+} worker_t;
+
+static ref_t *refs;
+static int n_refs;
+static int rounds = 20;
+
+
+static int
+decode_file(const char *name, unsigned long long *hash, long *bytes)
+{
+    HIP_File hf;
+    FILE   *f;
+    char    pcm[8192];
+    int     section;
+    long    ret;
+
+    f = fopen(name, "rb");
+    if (f == NULL)
+        return -1;
+    if (hip_open(f, &hf, NULL, 0) < 0) {
+        fclose(f);
+        return -1;
+    }
+    *hash = 14695981039346656037ULL;
+    *bytes = 0;
+    while ((ret = hip_read(&hf, pcm, sizeof(pcm), 0, 2, 1, &section)) != 0) {
+        long    i;
+        if (ret < 0)
+            continue;   /* a hole in the stream, as in hip_example */
+        for (i = 0; i < ret; i++) {
+            *hash ^= (unsigned char) pcm[i];
+            *hash *= 1099511628211ULL;
+        }
+        *bytes += ret;
+    }
+    hip_clear(&hf);
+    fclose(f);
+    return 0;
+}
+
+
+static void *
+worker(void *arg)
+{
+    worker_t *const w = arg;
+    int     r, i;
+
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < n_refs; i++) {
+            ref_t const *const ref = &refs[(w->first + i) % n_refs];
+            unsigned long long hash;
+            long    bytes;
+
+            if (decode_file(ref->name, &hash, &bytes) != 0 || hash != ref->hash
+                || bytes != ref->bytes) {
+                fprintf(stderr, "%s: different output in round %d\n", ref->name, r);
+                w->errors++;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    worker_t *workers;
+    int     threads = 8;
+    int     i, errors = 0;
+
+    while (argc > 2 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-t") == 0)
+            threads = atoi(argv[2]);
+        else if (strcmp(argv[1], "-r") == 0)
+            rounds = atoi(argv[2]);
+        else
+            break;
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2 || threads < 1) {
+        fprintf(stderr, "usage: hip_threads [-t threads] [-r rounds] file.mp3 ...\n");
+        return 1;
+    }
+
+    n_refs = argc - 1;
+    refs = calloc(n_refs, sizeof(ref_t));
+    workers = calloc(threads, sizeof(worker_t));
+    if (refs == NULL || workers == NULL)
+        return 1;
+    for (i = 0; i < n_refs; i++) {
+        refs[i].name = argv[i + 1];
+        if (decode_file(refs[i].name, &refs[i].hash, &refs[i].bytes) != 0) {
+            fprintf(stderr, "%s: can't decode\n", refs[i].name);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        workers[i].first = i % n_refs;
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i]) != 0) {
+            fprintf(stderr, "can't start thread %d\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        errors += workers[i].errors;
+    }
+
+    printf("%d threads, %d files, %d rounds: %d errors\n", threads, n_refs, rounds, errors);
+    free(workers);
+    free(refs);
+    return errors != 0;
+}
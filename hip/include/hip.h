@@ -170,26 +170,27 @@ extern void hip_decode_reset(HIP_File *hf);
 /* Returns the number of MP3 frames the audio data precedes the current frame, useful for noncontiguous decoding of frames. */
 extern int hip_audiodata_precedesframes(HIP_File *hf);
 
-/*
-
-extern int hip_open_callbacks(void *datasource, HIP_File *hf,
-		char *initial, long ibytes, hip_callbacks callbacks);
-
-extern int hip_test(FILE *f,HIP_File *hf,char *initial,long ibytes);
-extern int hip_test_callbacks(void *datasource, HIP_File *hf,
-		char *initial, long ibytes, hip_callbacks callbacks);
-extern int hip_test_open(HIP_File *hf);
-
-extern long hip_bitrate(HIP_File *hf,int i);
-extern long hip_bitrate_instant(HIP_File *hf);
 extern long hip_streams(HIP_File *hf);
 extern long hip_seekable(HIP_File *hf);
 
+/* Totals and seeking need a seekable file.  The pcm positions count the
+   samples per channel hip_read returns, from the first frame after a Xing
+   frame on.  The first seek to a position reads the frame headers up to
+   it, later ones decode no more than the few frames needed to prime the
+   decoder, and the output after a seek is the same as the output at that
+   position of a decode from the start.  hip_pcm_seek_page and
+   hip_time_seek_page go to the start of a frame; without an index that
+   far they may use the TOC of a Xing frame, which is quicker but only
+   lands near pos, and hip_pcm_tell is then an estimate as well.
+   hip_raw_seek goes to the first frame at pos or later, hip_raw_seek64
+   does the same for files larger than a long can address.  Free format
+   streams can only be seeked by decoding up to pos. */
 extern hip_int64_t hip_raw_total(HIP_File *hf,int i);
 extern hip_int64_t hip_pcm_total(HIP_File *hf,int i);
 extern double hip_time_total(HIP_File *hf,int i);
 
 extern int hip_raw_seek(HIP_File *hf,long pos);
+extern int hip_raw_seek64(HIP_File *hf,hip_int64_t pos);
 extern int hip_pcm_seek(HIP_File *hf,hip_int64_t pos);
 extern int hip_pcm_seek_page(HIP_File *hf,hip_int64_t pos);
 extern int hip_time_seek(HIP_File *hf,double pos);
@@ -198,6 +199,30 @@ extern int hip_time_seek_page(HIP_File *hf,double pos);
 extern hip_int64_t hip_raw_tell(HIP_File *hf);
 extern hip_int64_t hip_pcm_tell(HIP_File *hf);
 extern double hip_time_tell(HIP_File *hf);
+
+/* The frame index can be kept in a file next to the mp3 file ("x.mp3.hipidx"
+   for instance).  hip_index_save reads the headers of all frames, if the
+   seeks did not do that already, and writes the index to path.
+   hip_index_load, called after hip_open, maps the index from path; then
+   no seek or total has to read frame headers.  Every record is checked
+   against the file first; it fails with HIP_EINVAL if the index was made
+   for another file or does not fit this one, and the index built by hip
+   itself is used as before. */
+extern int hip_index_save(HIP_File *hf,const char *path);
+extern int hip_index_load(HIP_File *hf,const char *path);
+
+/*
+
+extern int hip_open_callbacks(void *datasource, HIP_File *hf,
+		char *initial, long ibytes, hip_callbacks callbacks);
+
+extern int hip_test(FILE *f,HIP_File *hf,char *initial,long ibytes);
+extern int hip_test_callbacks(void *datasource, HIP_File *hf,
+		char *initial, long ibytes, hip_callbacks callbacks);
+extern int hip_test_open(HIP_File *hf);
+
+extern long hip_bitrate(HIP_File *hf,int i);
+extern long hip_bitrate_instant(HIP_File *hf);
 */
 
 #ifdef __cplusplus
@@ -90,7 +90,7 @@ get_II_stuff(struct frame *fr)
 
     int     table, sblim;
     static const struct al_table2 *tables[5] = { alloc_0, alloc_1, alloc_2, alloc_3, alloc_4 };
-    static int sblims[5] = { 27, 30, 8, 12, 30 };
+    static const int sblims[5] = { 27, 30, 8, 12, 30 };
 
     if (fr->lsf)
         table = 4;
@@ -21,6 +21,7 @@
 #include <assert.h>
 #include "hip.h"
 #include "interface.h"
+#include "seek.h"
 
 #define HF_MP(hf)     ((PMPSTR)hf->mp)
 #define MAX_U_32_NUM  0xFFFFFFFF
@@ -90,6 +91,10 @@ hip_decode_init(HIP_File * hf)
        vs. one initialized for use with a memory region. 
      */
     hf->datasource = NULL;
+    hf->seekable = 0;
+    hf->end = 0;
+    hf->dataoffset = 0;
+    hf->pcm_offset = 0;
     return 0;
 }
 
@@ -98,6 +103,7 @@ hip_open(FILE * file, HIP_File * hf, char *initial, long ibytes)
 {
     unsigned char buf[100];
     int     ret, len;
+    hip_int64_t pos;
     char    out[4608];
 /*  short int pcm_l[1152], pcm_r[1152]; */
 
@@ -108,6 +114,13 @@ hip_open(FILE * file, HIP_File * hf, char *initial, long ibytes)
 
     hf->datasource = file;
 
+    /* pipes can't seek */
+    pos = hip_ftell(file);
+    if (pos >= 0 && hip_fseek(file, 0, SEEK_END) == 0) {
+        hf->end = hip_ftell(file);
+        hf->seekable = (hf->end >= pos && hip_fseek(file, pos, SEEK_SET) == 0);
+    }
+
     /* make sure we are looking at a mpeg audio file */
     len = 4;
     if (fread(&buf, 1, len, hf->datasource) != len)
@@ -121,6 +134,8 @@ hip_open(FILE * file, HIP_File * hf, char *initial, long ibytes)
         if (fread(buf + len - 1, 1, 1, hf->datasource) != 1)
             return HIP_ENOTMPEG;
     }
+    if (hf->seekable)
+        hf->dataoffset = hip_ftell(file) - len;
 
 
     /* now parse the current buffer looking for MP3 headers.   
@@ -200,7 +215,11 @@ wrap_decodeMP3(PMPSTR mp, unsigned char *inmemory, int inmemsize, char *outmemor
 void
 hip_decode_reset(HIP_File * hf)
 {
+    hip_index_t *const ix = HF_MP(hf)->index;
+
     decode_reset(HF_MP(hf));
+    if (ix != NULL)
+        ix->pending_pos = ix->pending_len = 0;
 }
 
 int
@@ -218,13 +237,22 @@ hip_read(HIP_File * hf, char *out_buffer, int out_buffer_len,
     int     processed_bytes;
     int     decode_status;
 
+    /* what is left of the frame a seek went to */
+    processed_bytes = hip_index_pending(hf, out_buffer, out_buffer_len);
+    if (processed_bytes > 0) {
+        hf->pcm_offset += processed_bytes / (2 * HF_MP(hf)->fr.stereo);
+        return (long) processed_bytes;
+    }
+
     memset(out_buffer, 0, out_buffer_len);
 
     /* first see if we still have data buffered in the decoder: */
     decode_status =
         wrap_decodeMP3(HF_MP(hf), in_buffer, in_buffer_len, out_buffer, out_buffer_len,
                        &processed_bytes);
-    if (decode_status == MP3_NEED_MORE || decode_status == MP3_OK) // LMS
+    if (decode_status == MP3_OK && processed_bytes > 0)
+        ;       /* a whole frame was buffered, don't overwrite its output */
+    else if (decode_status == MP3_NEED_MORE || decode_status == MP3_OK) // LMS
         // added check.
     {
         /* read until we get a valid output frame */
@@ -252,12 +280,15 @@ hip_read(HIP_File * hf, char *out_buffer, int out_buffer_len,
         }
     }
 
+    if (processed_bytes > 0)
+        hf->pcm_offset += processed_bytes / (2 * HF_MP(hf)->fr.stereo);
     return (long) processed_bytes;
 }
 
 int
 hip_clear(HIP_File * hf)
 {
+    hip_index_free(hf);
     ExitMP3(HF_MP(hf));
     free(hf->mp);
 
@@ -29,6 +29,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#include <pthread.h>
+#elif defined(_MSC_VER)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
 #include "common.h"
 #include "interface.h"
 #include "tabinit.h"
@@ -45,12 +52,68 @@
 
 /* #define HIP_DEBUG */
 
-int
-InitMP3(PMPSTR mp)
+
+/* the decoding tables are shared by all decoders of the process */
+static void
+init_tables(void)
 {
     hip_init_tables_layer1();
     hip_init_tables_layer2();
     hip_init_tables_layer3();
+    make_decode_tables(32767);
+}
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void
+hip_init_tables(void)
+{
+    pthread_once(&tables_once, init_tables);
+}
+
+#elif defined(_MSC_VER)
+
+static INIT_ONCE tables_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK
+init_tables_once(PINIT_ONCE once, PVOID param, PVOID * context)
+{
+    (void) once;
+    (void) param;
+    (void) context;
+    init_tables();
+    return TRUE;
+}
+
+static void
+hip_init_tables(void)
+{
+    InitOnceExecuteOnce(&tables_once, init_tables_once, NULL, NULL);
+}
+
+#else
+
+/* no threads */
+static int tables_ready = 0;
+
+static void
+hip_init_tables(void)
+{
+    if (!tables_ready) {
+        init_tables();
+        tables_ready = 1;
+    }
+}
+
+#endif
+
+
+int
+InitMP3(PMPSTR mp)
+{
+    hip_init_tables();
 
     memset(mp, 0, sizeof(MPSTR));
 
@@ -68,7 +131,8 @@ InitMP3(PMPSTR mp)
     mp->dsize = 0;
     mp->fsizeold = -1;
     mp->bsize = 0;
-    mp->head = mp->tail = NULL;
+    mp->in = mp->inbuf = NULL;
+    mp->in_pos = mp->inbuf_size = 0;
     mp->fr.single = -1;
     mp->bsnum = 0;
     mp->wordpointer = mp->bsspace[mp->bsnum] + 512;
@@ -76,102 +140,99 @@ InitMP3(PMPSTR mp)
     mp->synth_bo = 1;
     mp->sync_bitstream = 1;
 
-
-
-    make_decode_tables(32767);
-
     return 1;
 }
 
 void
 ExitMP3(PMPSTR mp)
 {
-    struct buf *b, *bn;
-
-    b = mp->tail;
-    while (b) {
-        free(b->pnt);
-        bn = b->next;
-        free(b);
-        b = bn;
-    }
+    free(mp->inbuf);
+    mp->in = mp->inbuf = NULL;
+    mp->in_pos = mp->inbuf_size = mp->bsize = 0;
 }
 
-static struct buf *
-addbuf(PMPSTR mp, unsigned char *buf, int size)
+/* makes room for size more bytes behind the input in inbuf */
+static int
+reserve_buf(PMPSTR mp, int size)
 {
-    struct buf *nbuf;
-
-    nbuf = (struct buf *) malloc(sizeof(struct buf));
-    if (!nbuf) {
-        fprintf(stderr, "hip: addbuf() Out of memory!\n");
-        return NULL;
-    }
-    nbuf->pnt = (unsigned char *) malloc((size_t) size);
-    if (!nbuf->pnt) {
-        free(nbuf);
-        return NULL;
+    if (mp->in_pos + mp->bsize + size > mp->inbuf_size && mp->in_pos > 0) {
+        /* drop what is parsed already */
+        memmove(mp->inbuf, mp->inbuf + mp->in_pos, (size_t) mp->bsize);
+        mp->in_pos = 0;
     }
-    nbuf->size = size;
-    memcpy(nbuf->pnt, buf, (size_t) size);
-    nbuf->next = NULL;
-    nbuf->prev = mp->head;
-    nbuf->pos = 0;
-
-    if (!mp->tail) {
-        mp->tail = nbuf;
-    }
-    else {
-        mp->head->next = nbuf;
+    if (mp->bsize + size > mp->inbuf_size) {
+        int     n = (mp->inbuf_size > 0) ? 2 * mp->inbuf_size : 4096;
+        unsigned char *nbuf;
+        while (n < mp->bsize + size)
+            n *= 2;
+        nbuf = (unsigned char *) realloc(mp->inbuf, (size_t) n);
+        if (!nbuf) {
+            fprintf(stderr, "hip: addbuf() Out of memory!\n");
+            return 0;
+        }
+        mp->inbuf = nbuf;
+        mp->inbuf_size = n;
     }
+    mp->in = mp->inbuf;
+    return 1;
+}
 
-    mp->head = nbuf;
+/*
+ * with nothing buffered the caller's input is parsed in place, keep_buf()
+ * copies what is left of it before decodeMP3 returns.
+ */
+static int
+addbuf(PMPSTR mp, unsigned char *buf, int size)
+{
+    if (mp->bsize == 0) {
+        mp->in = buf;
+        mp->in_pos = 0;
+        mp->bsize = size;
+        return 1;
+    }
+    if (!reserve_buf(mp, size))
+        return 0;
+    memcpy(mp->in + mp->in_pos + mp->bsize, buf, (size_t) size);
     mp->bsize += size;
-
-    return nbuf;
+    return 1;
 }
 
-void
-remove_buf(PMPSTR mp)
+static int
+keep_buf(PMPSTR mp)
 {
-    struct buf *buf = mp->tail;
-
-    mp->tail = buf->next;
-    if (mp->tail)
-        mp->tail->prev = NULL;
-    else {
-        mp->tail = mp->head = NULL;
+    unsigned char *const in = mp->in + mp->in_pos;
+
+    if (mp->in == mp->inbuf)
+        return 1;
+    if (mp->bsize == 0) {
+        mp->in = mp->inbuf;
+        mp->in_pos = 0;
+        return 1;
     }
-
-    free(buf->pnt);
-    free(buf);
-
+    mp->in_pos = 0;
+    if (mp->bsize > mp->inbuf_size) {
+        int const bsize = mp->bsize;
+        mp->bsize = 0;
+        if (!reserve_buf(mp, bsize)) {
+            mp->in = mp->inbuf;
+            return 0;
+        }
+        mp->bsize = bsize;
+    }
+    memcpy(mp->inbuf, in, (size_t) mp->bsize);
+    mp->in = mp->inbuf;
+    return 1;
 }
 
 static int
 read_buf_byte(PMPSTR mp)
 {
-    unsigned int b;
-
-    int     pos;
-
-
-    pos = mp->tail->pos;
-    while (pos >= mp->tail->size) {
-        remove_buf(mp);
-        if (!mp->tail) {
-            fprintf(stderr, "hip: Fatal error! tried to read past mp buffer\n");
-            exit(1);
-        }
-        pos = mp->tail->pos;
+    if (mp->bsize <= 0) {
+        fprintf(stderr, "hip: Fatal error! tried to read past mp buffer\n");
+        exit(1);
     }
-
-    b = mp->tail->pnt[pos];
     mp->bsize--;
-    mp->tail->pos++;
-
-
-    return b;
+    return mp->in[mp->in_pos++];
 }
 
 
@@ -179,17 +240,12 @@ read_buf_byte(PMPSTR mp)
 static void
 read_head(PMPSTR mp)
 {
-    unsigned long head;
-
-    head = read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
+    unsigned char const *const p = mp->in + mp->in_pos;
 
-    mp->header = head;
+    mp->header = ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+        ((unsigned long) p[2] << 8) | (unsigned long) p[3];
+    mp->in_pos += 4;
+    mp->bsize -= 4;
 }
 
 
@@ -198,25 +254,11 @@ read_head(PMPSTR mp)
 static void
 copy_mp(PMPSTR mp, int size, unsigned char *ptr)
 {
-    int     len = 0;
-
-    while (len < size && mp->tail) {
-        int     nlen;
-        int     blen = mp->tail->size - mp->tail->pos;
-        if ((size - len) <= blen) {
-            nlen = size - len;
-        }
-        else {
-            nlen = blen;
-        }
-        memcpy(ptr + len, mp->tail->pnt + mp->tail->pos, (size_t) nlen);
-        len += nlen;
-        mp->tail->pos += nlen;
-        mp->bsize -= nlen;
-        if (mp->tail->pos == mp->tail->size) {
-            remove_buf(mp);
-        }
-    }
+    if (size > mp->bsize)
+        size = mp->bsize;
+    memcpy(ptr, mp->in + mp->in_pos, (size_t) size);
+    mp->in_pos += size;
+    mp->bsize -= size;
 }
 
 /* number of bytes needed by hip_GetVbrTag to parse header */
@@ -237,36 +279,16 @@ copy_mp(PMPSTR mp, int size, unsigned char *ptr)
 static int
 check_vbr_header(PMPSTR mp, int bytes)
 {
-    int     i, pos;
-    struct buf *buf = mp->tail;
-    unsigned char xing[XING_HEADER_SIZE];
     VBRTAGDATA pTagData;
 
-    pos = buf->pos;
     /* skip to valid header */
-    for (i = 0; i < bytes; ++i) {
-        while (pos >= buf->size) {
-            buf = buf->next;
-            if (!buf)
-                return -1; /* fatal error */
-            pos = buf->pos;
-        }
-        ++pos;
-    }
-    /* now read header */
-    for (i = 0; i < XING_HEADER_SIZE; ++i) {
-        while (pos >= buf->size) {
-            buf = buf->next;
-            if (!buf)
-                return -1; /* fatal error */
-            pos = buf->pos;
-        }
-        xing[i] = buf->pnt[pos];
-        ++pos;
-    }
+    if (bytes < 0)
+        bytes = 0;
+    if (bytes + XING_HEADER_SIZE > mp->bsize)
+        return -1;      /* fatal error */
 
     /* check first bytes for Xing header */
-    mp->vbr_header = hip_GetVbrTag(&pTagData, xing);
+    mp->vbr_header = hip_GetVbrTag(&pTagData, mp->in + mp->in_pos + bytes);
     if (mp->vbr_header) {
         mp->num_frames = pTagData.frames;
         mp->enc_delay = pTagData.enc_delay;
@@ -295,41 +317,23 @@ sync_buffer(PMPSTR mp, int free_match)
      * return number of bytes in mp, before the header
      * return -1 if header is not found
      */
-    unsigned int b[4] = { 0, 0, 0, 0 };
-    int     i, h, pos;
-    struct buf *buf = mp->tail;
-    if (!buf)
-        return -1;
-
-    pos = buf->pos;
-    for (i = 0; i < mp->bsize; i++) {
-        /* get 4 bytes */
-
-        b[0] = b[1];
-        b[1] = b[2];
-        b[2] = b[3];
-        while (pos >= buf->size) {
-            buf = buf->next;
-            pos = buf->pos;
-            if (!buf) {
-                return -1;
-                /* not enough data to read 4 bytes */
-            }
+    unsigned char const *const p = mp->in + mp->in_pos;
+    unsigned char const *q;
+    int     i, h;
+
+    for (i = 0; i + 3 < mp->bsize; i++) {
+        /* a header starts with 11 bits set, let memchr find the first byte */
+        if (p[i] != 0xff) {
+            q = memchr(p + i, 0xff, (size_t) (mp->bsize - 3 - i));
+            if (q == NULL)
+                break;
+            i = (int) (q - p);
         }
-        b[3] = buf->pnt[pos];
-        ++pos;
-
-        if (i >= 3) {
+        if ((p[i + 1] & 0xe0) == 0xe0) {
             struct frame *fr = &mp->fr;
-            unsigned long head;
-
-            head = b[0];
-            head <<= 8;
-            head |= b[1];
-            head <<= 8;
-            head |= b[2];
-            head <<= 8;
-            head |= b[3];
+            unsigned long const head = ((unsigned long) p[i] << 24) | ((unsigned long) p[i + 1] << 16) |
+                ((unsigned long) p[i + 2] << 8) | (unsigned long) p[i + 3];
+
             h = head_check(head, fr->lay);
 
             if (h && free_match) {
@@ -357,7 +361,7 @@ sync_buffer(PMPSTR mp, int free_match)
             }
 
             if (h) {
-                return i - 3;
+                return i;
             }
         }
     }
@@ -368,20 +372,14 @@ sync_buffer(PMPSTR mp, int free_match)
 void
 decode_reset(PMPSTR mp)
 {
-#if 0
-    remove_buf(mp);
-    /* start looking for next frame */
-    /* mp->fsizeold = mp->framesize; */
-    mp->fsizeold = -1;
-    mp->old_free_format = mp->free_format;
-    mp->framesize = 0;
-    mp->header_parsed = 0;
-    mp->side_parsed = 0;
-    mp->data_parsed = 0;
-    mp->sync_bitstream = 1; /* TODO check if this is right */
-#else
+    unsigned char *const inbuf = mp->inbuf;
+    int const inbuf_size = mp->inbuf_size;
+    void   *const index = mp->index;
+
     InitMP3(mp);        /* Less error prone to just to reinitialise. */
-#endif
+    mp->in = mp->inbuf = inbuf; /* but keep the input buffer */
+    mp->inbuf_size = inbuf_size;
+    mp->index = index;  /* and the frame index of the file */
 }
 
 int
@@ -394,15 +392,12 @@ audiodata_precedesframes(PMPSTR mp)
 }
 
 static int
-decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *done,
-                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
-                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
+decode_buffered(PMPSTR mp, char *out, int *done,
+                int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
 {
     int     i, iret, bits, bytes;
 
-    if (in && isize && addbuf(mp, in, isize) == NULL)
-        return MP3_ERR;
-
     /* First decode header */
     if (!mp->header_parsed) {
 
@@ -666,6 +661,22 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
     return iret;
 }
 
+static int
+decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *done,
+                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
+{
+    int     ret;
+
+    if (in && isize && !addbuf(mp, in, isize))
+        return MP3_ERR;
+    ret = decode_buffered(mp, out, done, synth_1to1_mono_ptr, synth_1to1_ptr);
+    /* the caller may reuse in now */
+    if (!keep_buf(mp))
+        return MP3_ERR;
+    return ret;
+}
+
 int
 decodeMP3(PMPSTR mp, unsigned char *in, int isize, char *out, int osize, int *done)
 {
@@ -39,9 +39,6 @@ extern  "C" {
     int     decodeMP3_unclipped(PMPSTR mp, unsigned char *inmemory, int inmemsize, char *outmemory,
                                 int outmemsize, int *done);
 
-/* added remove_buf to support mpglib seeking */
-    void    remove_buf(PMPSTR mp);
-
 /* added audiodata_precedesframes to return the number of bitstream frames the audio data will precede the 
    current frame by for Layer 3 data. Aids seeking.
  */
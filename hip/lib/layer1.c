@@ -37,15 +37,10 @@
 
 #include "layer1.h"
 
-static int gd_are_hip_tables_layer1_initialized = 0;
-
+/* called once per process by hip_init_tables() */
 void
 hip_init_tables_layer1(void)
 {
-    if (gd_are_hip_tables_layer1_initialized) {
-        return;
-    }
-    gd_are_hip_tables_layer1_initialized = 1;
 }
 
 typedef struct sideinfo_layer_I_struct
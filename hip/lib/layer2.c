@@ -36,8 +36,6 @@
 #endif
 #include <assert.h>
 
-static int gd_are_hip_tables_layer2_initialized = 0;
-
 static unsigned char grp_3tab[32 * 3] = { 0, }; /* used: 27 */
 static unsigned char grp_5tab[128 * 3] = { 0, }; /* used: 125 */
 static unsigned char grp_9tab[1024 * 3] = { 0, }; /* used: 729 */
@@ -62,12 +60,8 @@ hip_init_tables_layer2(void)
     int     i, j, k, l, len;
     real   *table;
     static const int tablen[3] = { 3, 5, 9 };
-    static unsigned char *itable, *tables[3] = { grp_3tab, grp_5tab, grp_9tab };
-
-    if (gd_are_hip_tables_layer2_initialized) {
-        return;
-    }
-    gd_are_hip_tables_layer2_initialized = 1;
+    unsigned char *itable;
+    unsigned char *const tables[3] = { grp_3tab, grp_5tab, grp_9tab };
 
     for (i = 0; i < 3; i++) {
         itable = tables[i];
@@ -91,10 +85,10 @@ hip_init_tables_layer2(void)
 }
 
 
-static unsigned char*
+static unsigned char const*
 grp_table_select(short d1, unsigned int idx)
 {
-    static unsigned char dummy_table[] = { 0,0,0 };
+    static const unsigned char dummy_table[] = { 0,0,0 };
     unsigned int x;
     switch (d1) {
         case 3:
@@ -246,7 +240,7 @@ II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fra
                 }
                 else {
                     unsigned int idx = getbits(mp, k);
-                    unsigned char *tab = grp_table_select(d1, idx);
+                    unsigned char const *tab = grp_table_select(d1, idx);
                     unsigned char k0 = tab[0];
                     unsigned char k1 = tab[1];
                     unsigned char k2 = tab[2];
@@ -293,7 +287,7 @@ II_step_two(PMPSTR mp, sideinfo_layer_II* si, struct frame *fr, int gr, real fra
             }
             else {
                 unsigned int idx = getbits(mp, k);
-                unsigned char *tab = grp_table_select(d1, idx);
+                unsigned char const *tab = grp_table_select(d1, idx);
                 unsigned char k0 = tab[0];
                 unsigned char k1 = tab[1];
                 unsigned char k2 = tab[2];
@@ -38,8 +38,6 @@
 #endif
 
 
-static int gd_are_hip_tables_layer3_initialized = 0;
-
 static real ispow[8207];
 static real aa_ca[8], aa_cs[8];
 static real COS1[12][6];
@@ -148,11 +146,6 @@ hip_init_tables_layer3(void)
 {
     int     i, j, k;
 
-    if (gd_are_hip_tables_layer3_initialized) {
-        return;
-    }
-    gd_are_hip_tables_layer3_initialized = 1;
-
     for (i = -256; i < 118 + 4; i++)
         gainpow2[i + 256] = pow((double) 2.0, -0.25 * (double) (i + 210));
 
@@ -160,7 +153,7 @@ hip_init_tables_layer3(void)
         ispow[i] = pow((double) i, (double) 4.0 / 3.0);
 
     for (i = 0; i < 8; i++) {
-        static double Ci[8] = { -0.6, -0.535, -0.33, -0.185, -0.095, -0.041, -0.0142, -0.0037 };
+        static const double Ci[8] = { -0.6, -0.535, -0.33, -0.185, -0.095, -0.041, -0.0142, -0.0037 };
         double  sq = sqrt(1.0 + Ci[i] * Ci[i]);
         aa_cs[i] = 1.0 / sq;
         aa_ca[i] = Ci[i] / sq;
@@ -1679,8 +1672,8 @@ decode_layer3_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
     }
 
     for (gr = 0; gr < granules; gr++) {
-        static real hybridIn[2][SBLIMIT][SSLIMIT];
-        static real hybridOut[2][SSLIMIT][SBLIMIT];
+        real    (*const hybridIn)[SBLIMIT][SSLIMIT] = mp->hybrid_in;
+        real    (*const hybridOut)[SSLIMIT][SBLIMIT] = mp->hybrid_out;
 
         {
             struct gr_info_s *gr_infos = &(mp->sideinfo.ch[0].gr[gr]);
@@ -30,23 +30,11 @@ typedef struct plotting_data plotting_data;
 
 
 
-struct buf {
-    unsigned char *pnt;
-    long    size;
-    long    pos;
-    struct buf *next;
-    struct buf *prev;
-};
-
-struct framebuf {
-    struct buf *buf;
-    long    pos;
-    struct frame *next;
-    struct frame *prev;
-};
-
 typedef struct mpstr_tag {
-    struct buf *head, *tail; /* buffer linked list pointers, tail points to oldest buffer */
+    unsigned char *in;       /* input not parsed yet is in[in_pos] .. in[in_pos + bsize - 1] */
+    int     in_pos;
+    unsigned char *inbuf;    /* where in points to between calls, caller's input is used in place */
+    int     inbuf_size;
     int     vbr_header;      /* 1 if valid Xing vbr header detected */
     int     num_frames;      /* set if vbr header present */
     int     enc_delay;       /* set if vbr header present */
@@ -58,7 +46,7 @@ typedef struct mpstr_tag {
     int     data_parsed;
     int     free_format;     /* 1 = free format frame */
     int     old_free_format; /* 1 = last frame was free format */
-    int     bsize;
+    int     bsize;           /* bytes of input not parsed yet */
     int     framesize;
     int     ssize;           /* number of bytes used for side information, including 2 bytes for CRC-16 if present */
     int     dsize;
@@ -69,6 +57,8 @@ typedef struct mpstr_tag {
     unsigned char bsspace[2][MAXFRAMESIZE + 1024]; /* bit stream space used ???? *//* MAXFRAMESIZE */
     real    hybrid_block[2][2][SBLIMIT * SSLIMIT];
     int     hybrid_blc[2];
+    real    hybrid_in[2][SBLIMIT][SSLIMIT]; /* scratch space of a layer 3 granule */
+    real    hybrid_out[2][SSLIMIT][SBLIMIT];
     unsigned long header;
     int     bsnum;
     real    synth_buffs[2][2][0x110];
@@ -78,6 +68,7 @@ typedef struct mpstr_tag {
     int     bitindex;
     unsigned char *wordpointer;
     plotting_data *pinfo;
+    void   *index;           /* frame index of the seek functions, see seek.h */
 } MPSTR, *PMPSTR;
 
 
@@ -0,0 +1,910 @@
+/*
+ * Copyright (C) 1999-2010 The L.A.M.E. project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+/*
+ * Seeking in a HIP_File.
+ *
+ * The first seek reads the headers of the frames up to the target and
+ * keeps their offsets in a frame index, later seeks only read what the
+ * index does not cover yet.  A seek to sample P starts the decoder a few
+ * frames before the frame k holding P:  frames k-2 and k-1 fill the
+ * overlap and the synthesis filter, and enough frames before k-2 are
+ * decoded (and thrown away) to refill the bit reservoir that frame k-2
+ * reaches back into with its main_data_begin.  The output from P on is
+ * then the same as from a decode of the whole file.
+ *
+ * The _page seeks may use the TOC of a Xing frame instead, which needs no
+ * index but only lands close to the target.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include "common.h"
+#include "interface.h"
+#include "VbrTag.h"
+#include "seek.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+#define HF_MP(hf)     ((PMPSTR)hf->mp)
+
+/* version, layer and sample rate have to stay the same in a stream */
+#define HEAD_MASK     0xfffe0c00UL
+
+/* bytes looked at for the Xing frame */
+#define XING_SIZE     200
+
+/*
+ * index files: a header of INDEX_HEAD little endian fields
+ *
+ *    0  "HIPX"
+ *    4  INDEX_VERSION
+ *    8  head of the stream, masked with HEAD_MASK
+ *   12  samples per frame
+ *   16  size of the mp3 file (8 bytes)
+ *   24  offset of the first audio frame (8 bytes)
+ *   32  number of frames
+ *   36  INDEX_RECORD
+ *
+ * and a record of INDEX_RECORD bytes per frame: the offset (8 bytes),
+ * main data bytes, main_data_begin (2 bytes each), bitrate index (1 byte)
+ * and 3 zero bytes.  frame n starts at sample n * samples per frame.
+ */
+#define INDEX_VERSION 1
+#define INDEX_HEAD    40
+#define INDEX_RECORD  16
+
+/* fseek() and ftell() with 64 bit offsets, where the system has them */
+int
+hip_fseek(FILE * f, hip_int64_t offset, int whence)
+{
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return _fseeki64(f, offset, whence);
+#elif defined(HAVE_FSEEKO)
+    if ((off_t) offset != offset)
+        return -1;
+    return fseeko(f, (off_t) offset, whence);
+#else
+    if ((long) offset != offset)
+        return -1;
+    return fseek(f, (long) offset, whence);
+#endif
+}
+
+
+hip_int64_t
+hip_ftell(FILE * f)
+{
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return _ftelli64(f);
+#elif defined(HAVE_FSEEKO)
+    return ftello(f);
+#else
+    return ftell(f);
+#endif
+}
+
+
+typedef struct {
+    FILE   *f;
+    hip_int64_t pos;        /* file offset of buf[0] */
+    int     len;
+    unsigned char buf[8192];
+} reader_t;
+
+
+static const unsigned char *
+reader_get(reader_t * r, hip_int64_t offset, int n)
+{
+    if (offset < r->pos || offset + n > r->pos + r->len) {
+        if (hip_fseek(r->f, offset, SEEK_SET) != 0)
+            return NULL;
+        r->pos = offset;
+        r->len = (int) fread(r->buf, 1, sizeof(r->buf), r->f);
+    }
+    if (offset + n > r->pos + r->len)
+        return NULL;
+    return r->buf + (offset - r->pos);
+}
+
+
+static unsigned long
+get_head(const unsigned char *p)
+{
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+        ((unsigned long) p[2] << 8) | (unsigned long) p[3];
+}
+
+
+/*
+ * looks at the 8 bytes of a frame start.  returns the size of the frame
+ * with its header, 0 if this is no frame of the stream, or -1 for a free
+ * format frame.
+ */
+static int
+parse_frame(hip_index_t const *ix, const unsigned char *p, hip_frame_t * f)
+{
+    unsigned long const head = get_head(p);
+    struct frame fr;
+    int     ssize;
+
+    if (!head_check(head, 0) || (head & HEAD_MASK) != ix->head)
+        return 0;
+    if (((head >> 12) & 0xf) == 0)
+        return -1;
+
+    memset(&fr, 0, sizeof(fr));
+    decode_header(NULL, &fr, head);
+    f->bitrate_index = (unsigned char) fr.bitrate_index;
+    f->main_data = 0;
+    f->main_data_begin = 0;
+    if (fr.lay == 3) {
+        const unsigned char *const side = p + 4 + (fr.error_protection ? 2 : 0);
+
+        if (fr.lsf) {
+            ssize = (fr.stereo == 1) ? 9 : 17;
+            f->main_data_begin = side[0];
+        }
+        else {
+            ssize = (fr.stereo == 1) ? 17 : 32;
+            f->main_data_begin = (side[0] << 1) | (side[1] >> 7);
+        }
+        if (fr.error_protection)
+            ssize += 2;
+        f->main_data = (unsigned short) (fr.framesize - ssize);
+    }
+    return fr.framesize + 4;
+}
+
+
+/* creates the (still empty) index when it is first needed */
+static hip_index_t *
+get_index(HIP_File * hf)
+{
+    hip_index_t *ix = HF_MP(hf)->index;
+    reader_t r;
+    const unsigned char *p;
+    hip_frame_t f;
+    VBRTAGDATA tag;
+    hip_int64_t pos;
+    int     size;
+
+    if (ix != NULL || !hf->seekable || hf->datasource == NULL)
+        return ix;
+
+    pos = hip_ftell(hf->datasource);
+    r.f = hf->datasource;
+    r.pos = 0;
+    r.len = 0;
+    p = reader_get(&r, hf->dataoffset, 8);
+    if (p == NULL) {
+        hip_fseek(hf->datasource, pos, SEEK_SET);
+        return NULL;
+    }
+    ix = calloc(1, sizeof(hip_index_t));
+    if (ix == NULL) {
+        hip_fseek(hf->datasource, pos, SEEK_SET);
+        return NULL;
+    }
+    ix->head = get_head(p) & HEAD_MASK;
+    ix->spf = hf->framesize;
+    ix->first = hf->dataoffset;
+
+    size = parse_frame(ix, p, &f);
+    if (size < 0)
+        ix->free_format = 1;
+    else if ((p = reader_get(&r, hf->dataoffset, XING_SIZE)) != NULL
+             && hip_GetVbrTag(&tag, (unsigned char *) p)) {
+        /* mpglib does not decode the Xing frame */
+        ix->first += size;
+        if (tag.flags & FRAMES_FLAG)
+            ix->xing_frames = tag.frames;
+        if (tag.flags & BYTES_FLAG)
+            ix->xing_bytes = tag.bytes;
+        if ((tag.flags & TOC_FLAG) && ix->xing_frames > 0 && ix->xing_bytes > 0) {
+            memcpy(ix->toc, tag.toc, sizeof(ix->toc));
+            ix->has_toc = 1;
+        }
+    }
+    ix->next = ix->first;
+
+    hip_fseek(hf->datasource, pos, SEEK_SET);
+    HF_MP(hf)->index = ix;
+    return ix;
+}
+
+
+/* reads frame headers until the index holds frame upto, or the stream ends */
+static void
+index_extend(HIP_File * hf, hip_index_t * ix, int upto)
+{
+    reader_t r;
+    const unsigned char *p;
+    hip_frame_t f;
+    hip_int64_t pos;
+    int     size;
+
+    if (ix->complete || ix->free_format || ix->nframes > upto)
+        return;
+
+    pos = hip_ftell(hf->datasource);
+    r.f = hf->datasource;
+    r.pos = 0;
+    r.len = 0;
+    while (ix->nframes <= upto) {
+        p = reader_get(&r, ix->next, 8);
+        size = (p != NULL) ? parse_frame(ix, p, &f) : 0;
+        if (size <= 0 || ix->next + size > hf->end) {
+            /* a tag, garbage or a cut frame: the stream ends here */
+            ix->complete = 1;
+            break;
+        }
+        if (ix->nframes == ix->alloc) {
+            int const alloc = (ix->alloc > 0) ? 2 * ix->alloc : 1024;
+            hip_frame_t *const frame = realloc(ix->frame, alloc * sizeof(hip_frame_t));
+            if (frame == NULL)
+                break;
+            ix->frame = frame;
+            ix->alloc = alloc;
+        }
+        f.offset = ix->next;
+        ix->frame[ix->nframes++] = f;
+        ix->next += size;
+    }
+    hip_fseek(hf->datasource, pos, SEEK_SET);
+}
+
+
+/*
+ * restarts the decoder at offset and decodes frames+1 frames.  the output
+ * of the last one, without its first skip samples, is left for hip_read.
+ */
+static int
+decode_from(HIP_File * hf, hip_index_t * ix, hip_int64_t offset, int frames, int skip)
+{
+    PMPSTR const mp = HF_MP(hf);
+    unsigned char in[1024];
+    int     len, done, ret;
+
+    decode_reset(mp);
+    ix->pending_pos = 0;
+    ix->pending_len = 0;
+    if (hip_fseek(hf->datasource, offset, SEEK_SET) != 0)
+        return HIP_EREAD;
+
+    do {
+        len = (int) fread(in, 1, sizeof(in), hf->datasource);
+        ret = decodeMP3(mp, in, len, ix->pending, sizeof(ix->pending), &done);
+        while (ret == MP3_OK) {
+            if (frames-- == 0) {
+                int const bytes = skip * 2 * mp->fr.stereo;
+                ix->pending_len = done;
+                ix->pending_pos = (bytes < done) ? bytes : done;
+                return 0;
+            }
+            ret = decodeMP3(mp, NULL, 0, ix->pending, sizeof(ix->pending), &done);
+        }
+        if (ret == MP3_ERR)
+            return HIP_EBADPACKET;
+        if (mp->header_parsed && mp->fsizeold == -1 && offset != ix->first) {
+            /* the reservoir of the first frame is missing, and decoding it
+               is only to fill the reservoir for the next ones.  let it
+               read whatever is in the buffer instead of failing. */
+            mp->fsizeold = 0;
+        }
+    } while (len > 0);
+
+    /* the seek was to the end of the stream */
+    if (frames == 0 && skip == 0)
+        return 0;
+    return HIP_EINVAL;
+}
+
+
+/* positions the decoder behind the last frame */
+static int
+seek_end(HIP_File * hf, hip_index_t * ix, hip_int64_t pos)
+{
+    decode_reset(HF_MP(hf));
+    ix->pending_pos = 0;
+    ix->pending_len = 0;
+    if (hip_fseek(hf->datasource, hf->end, SEEK_SET) != 0)
+        return HIP_EREAD;
+    hf->pcm_offset = pos;
+    return 0;
+}
+
+
+/* seek to about pos with the Xing TOC.  returns 1 if the TOC was no help */
+static int
+seek_toc(HIP_File * hf, hip_index_t * ix, hip_int64_t pos)
+{
+    double const percent = 100.0 * pos / ((double) ix->xing_frames * ix->spf);
+    double  fa, fb, fx;
+    hip_int64_t offset, at, limit;
+    reader_t r;
+    const unsigned char *p;
+    hip_frame_t f;
+    long    back;
+    int     i, j, size = 0, ret;
+
+    if (percent >= 100.0)
+        return 1;
+    i = (int) percent;
+    fa = ix->toc[i];
+    fb = (i < 99) ? ix->toc[i + 1] : 256.0;
+    fx = fa + (fb - fa) * (percent - i);
+    offset = hf->dataoffset + (hip_int64_t) (fx / 256.0 * ix->xing_bytes);
+    if (offset < ix->first)
+        offset = ix->first;
+
+    /* the TOC points somewhere into a frame, look for the next two headers */
+    r.f = hf->datasource;
+    r.pos = 0;
+    r.len = 0;
+    for (limit = offset + 2 * MAXFRAMESIZE; offset < limit; offset++) {
+        p = reader_get(&r, offset, 8);
+        if (p == NULL)
+            return 1;
+        size = parse_frame(ix, p, &f);
+        if (size > 0 && (p = reader_get(&r, offset + size, 8)) != NULL
+            && parse_frame(ix, p, &f) > 0)
+            break;
+    }
+    if (offset >= limit)
+        return 1;
+
+    /* frame j is the first one with all of its reservoir behind offset */
+    back = 0;
+    at = offset;
+    for (j = 0; j < 64; j++) {
+        p = reader_get(&r, at, 8);
+        size = (p != NULL) ? parse_frame(ix, p, &f) : 0;
+        if (size <= 0)
+            return 1;
+        if (back >= f.main_data_begin)
+            break;
+        back += f.main_data;
+        at += size;
+    }
+
+    ret = decode_from(hf, ix, offset, j + 2, 0);
+    if (ret == 0)
+        hf->pcm_offset = ((hip_int64_t) (percent / 100.0 * ix->xing_frames + 0.5) + j + 2) * ix->spf;
+    return ret;
+}
+
+
+int
+hip_pcm_seek(HIP_File * hf, hip_int64_t pos)
+{
+    hip_index_t *const ix = get_index(hf);
+    hip_int64_t k;
+    long    back;
+    int     p, s, ret;
+
+    if (ix == NULL)
+        return HIP_ENOSEEK;
+    if (pos < 0 || ix->spf <= 0)
+        return HIP_EINVAL;
+    k = pos / ix->spf;
+    if (k >= INT_MAX)
+        return HIP_EINVAL;
+
+    if (ix->free_format) {
+        /* no frame sizes, so no index: decode everything before pos */
+        ret = decode_from(hf, ix, ix->first, (int) k, (int) (pos - k * ix->spf));
+        if (ret == 0)
+            hf->pcm_offset = pos;
+        return ret;
+    }
+
+    index_extend(hf, ix, (int) k);
+    if (k >= ix->nframes) {
+        if (pos == (hip_int64_t) ix->nframes * ix->spf)
+            return seek_end(hf, ix, pos);
+        return HIP_EINVAL;
+    }
+
+    /* frames k-2 and k-1 prime the overlap and synthesis filter, frames
+       s..p-1 only the bit reservoir of frame p */
+    p = (k >= 2) ? (int) k - 2 : 0;
+    s = p;
+    back = 0;
+    while (s > 0 && back < ix->frame[p].main_data_begin)
+        back += ix->frame[--s].main_data;
+
+    ret = decode_from(hf, ix, ix->frame[s].offset, (int) k - s, (int) (pos - k * ix->spf));
+    if (ret == 0)
+        hf->pcm_offset = pos;
+    return ret;
+}
+
+
+int
+hip_pcm_seek_page(HIP_File * hf, hip_int64_t pos)
+{
+    hip_index_t *const ix = get_index(hf);
+    hip_int64_t k;
+
+    if (ix == NULL)
+        return HIP_ENOSEEK;
+    if (pos < 0 || ix->spf <= 0)
+        return HIP_EINVAL;
+    k = pos / ix->spf;
+
+    /* the TOC is only worth it where the index would have to grow */
+    if (ix->has_toc && !ix->complete && !ix->free_format && k >= ix->nframes) {
+        int const ret = seek_toc(hf, ix, pos);
+        if (ret <= 0)
+            return ret;
+    }
+    return hip_pcm_seek(hf, k * ix->spf);
+}
+
+
+int
+hip_time_seek(HIP_File * hf, double pos)
+{
+    if (hf->samplerate <= 0)
+        return HIP_EINVAL;
+    return hip_pcm_seek(hf, (hip_int64_t) (pos * hf->samplerate + 0.5));
+}
+
+
+int
+hip_time_seek_page(HIP_File * hf, double pos)
+{
+    if (hf->samplerate <= 0)
+        return HIP_EINVAL;
+    return hip_pcm_seek_page(hf, (hip_int64_t) (pos * hf->samplerate + 0.5));
+}
+
+
+/* seeks to the first frame starting at pos or later */
+int
+hip_raw_seek64(HIP_File * hf, hip_int64_t pos)
+{
+    hip_index_t *const ix = get_index(hf);
+    int     lo, hi;
+
+    if (ix == NULL)
+        return HIP_ENOSEEK;
+    if (pos < 0 || pos > hf->end)
+        return HIP_EINVAL;
+    if (ix->free_format)
+        return HIP_ENOSEEK;
+
+    while (!ix->complete && (ix->nframes == 0 || ix->frame[ix->nframes - 1].offset < pos)) {
+        int const n = ix->nframes;
+        index_extend(hf, ix, n + 1023);
+        if (ix->nframes == n)
+            break;
+    }
+
+    lo = 0;
+    hi = ix->nframes;
+    while (lo < hi) {
+        int const mid = lo + (hi - lo) / 2;
+        if (ix->frame[mid].offset < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return hip_pcm_seek(hf, (hip_int64_t) lo * ix->spf);
+}
+
+
+int
+hip_raw_seek(HIP_File * hf, long pos)
+{
+    return hip_raw_seek64(hf, pos);
+}
+
+
+hip_int64_t
+hip_raw_total(HIP_File * hf, int i)
+{
+    (void) i;
+    if (!hf->seekable)
+        return HIP_EINVAL;
+    return hf->end;
+}
+
+
+hip_int64_t
+hip_pcm_total(HIP_File * hf, int i)
+{
+    hip_index_t *const ix = get_index(hf);
+
+    (void) i;
+    if (ix == NULL)
+        return HIP_EINVAL;
+    if (!ix->complete && ix->xing_frames > 0)
+        return (hip_int64_t) ix->xing_frames * ix->spf;
+    if (ix->free_format)
+        return HIP_EINVAL;
+    index_extend(hf, ix, INT_MAX - 1);
+    return (hip_int64_t) ix->nframes * ix->spf;
+}
+
+
+double
+hip_time_total(HIP_File * hf, int i)
+{
+    hip_int64_t const total = hip_pcm_total(hf, i);
+
+    if (total < 0 || hf->samplerate <= 0)
+        return HIP_EINVAL;
+    return (double) total / hf->samplerate;
+}
+
+
+hip_int64_t
+hip_raw_tell(HIP_File * hf)
+{
+    hip_int64_t const pos = hip_ftell(hf->datasource);
+
+    if (pos < 0)
+        return HIP_EINVAL;
+    /* minus what the decoder has read but not used yet */
+    return pos - HF_MP(hf)->bsize;
+}
+
+
+hip_int64_t
+hip_pcm_tell(HIP_File * hf)
+{
+    return hf->pcm_offset;
+}
+
+
+double
+hip_time_tell(HIP_File * hf)
+{
+    if (hf->samplerate <= 0)
+        return HIP_EINVAL;
+    return (double) hf->pcm_offset / hf->samplerate;
+}
+
+
+long
+hip_seekable(HIP_File * hf)
+{
+    return hf->seekable;
+}
+
+
+long
+hip_streams(HIP_File * hf)
+{
+    (void) hf;
+    return 1;
+}
+
+
+static void
+put_le(unsigned char *p, hip_int64_t v, int n)
+{
+    while (n-- > 0) {
+        *p++ = (unsigned char) (v & 0xff);
+        v >>= 8;
+    }
+}
+
+
+static hip_int64_t
+get_le(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+    while (n-- > 0)
+        v = (v << 8) | p[n];
+    return (hip_int64_t) v;
+}
+
+
+#ifdef USE_MMAP
+/* the records of an index file can be used in place */
+static int
+records_match_frames(void)
+{
+    static const unsigned short one = 1;
+    return sizeof(hip_frame_t) == INDEX_RECORD && *(const unsigned char *) &one == 1;
+}
+#endif
+
+
+/*
+ * checks every record of an index file against the stream:  each frame has
+ * to start where the size of the one before it says, the last one has to
+ * end inside the file, and the reservoir fields have to fit the frame and
+ * the layer.  the sample positions follow from the frame numbers.
+ */
+static int
+index_check_frames(HIP_File const *hf, hip_index_t const *ix, hip_frame_t const *frame, int n)
+{
+    struct frame fr;
+    int     size[16];
+    int     pad, max_begin, b, i;
+
+    memset(size, 0, sizeof(size));
+    for (b = 1; b < 15; b++) {
+        memset(&fr, 0, sizeof(fr));
+        decode_header(NULL, &fr, ix->head | ((unsigned long) b << 12));
+        size[b] = fr.framesize + 4;
+    }
+    pad = (fr.lay == 1) ? 4 : 1;
+    max_begin = (fr.lay != 3) ? 0 : fr.lsf ? 255 : 511;
+
+    if (frame[0].offset != ix->first)
+        return 0;
+    for (i = 0; i < n; i++) {
+        hip_frame_t const *const f = &frame[i];
+        int const fsize = size[f->bitrate_index & 0xf];
+
+        if (f->bitrate_index == 0 || f->bitrate_index >= 15
+            || f->main_data > fsize || f->main_data_begin > max_begin)
+            return 0;
+        if (i + 1 < n) {
+            hip_int64_t const step = frame[i + 1].offset - f->offset;
+            if (step != fsize && step != fsize + pad)
+                return 0;
+        }
+        else if (f->offset + fsize > hf->end)
+            return 0;
+    }
+    return 1;
+}
+
+
+static void
+index_drop_frames(hip_index_t * ix)
+{
+#ifdef USE_MMAP
+    if (ix->map != NULL)
+        munmap(ix->map, ix->map_size);
+    else
+#endif
+        free(ix->frame);
+    ix->map = NULL;
+    ix->frame = NULL;
+    ix->nframes = 0;
+    ix->alloc = 0;
+}
+
+
+/*
+ * writes the index of the whole file to path.  the file is written under
+ * another name first and renamed, so readers never see half of it.
+ */
+int
+hip_index_save(HIP_File * hf, const char *path)
+{
+    hip_index_t *const ix = get_index(hf);
+    unsigned char buf[256 * INDEX_RECORD];
+    char   *tmp;
+    FILE   *f;
+    int     i, n, ok;
+
+    if (ix == NULL || ix->free_format)
+        return HIP_ENOSEEK;
+    index_extend(hf, ix, INT_MAX - 1);
+    if (!ix->complete)
+        return HIP_EFAULT;
+
+    tmp = malloc(strlen(path) + 5);
+    if (tmp == NULL)
+        return HIP_EFAULT;
+    sprintf(tmp, "%s.tmp", path);
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        free(tmp);
+        return HIP_EFAULT;
+    }
+
+    memcpy(buf, "HIPX", 4);
+    put_le(buf + 4, INDEX_VERSION, 4);
+    put_le(buf + 8, ix->head, 4);
+    put_le(buf + 12, ix->spf, 4);
+    put_le(buf + 16, hf->end, 8);
+    put_le(buf + 24, ix->first, 8);
+    put_le(buf + 32, ix->nframes, 4);
+    put_le(buf + 36, INDEX_RECORD, 4);
+    ok = (fwrite(buf, 1, INDEX_HEAD, f) == INDEX_HEAD);
+
+    for (i = 0; ok && i < ix->nframes; i += n) {
+        int     j;
+        n = ix->nframes - i;
+        if (n > 256)
+            n = 256;
+        memset(buf, 0, n * INDEX_RECORD);
+        for (j = 0; j < n; j++) {
+            hip_frame_t const *const fr = &ix->frame[i + j];
+            unsigned char *const p = buf + j * INDEX_RECORD;
+            put_le(p, fr->offset, 8);
+            put_le(p + 8, fr->main_data, 2);
+            put_le(p + 10, fr->main_data_begin, 2);
+            p[12] = fr->bitrate_index;
+        }
+        ok = (fwrite(buf, INDEX_RECORD, n, f) == (size_t) n);
+    }
+    if (fclose(f) != 0)
+        ok = 0;
+#ifdef _WIN32
+    if (ok)
+        remove(path);
+#endif
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        free(tmp);
+        return HIP_EFAULT;
+    }
+    free(tmp);
+    return 0;
+}
+
+
+/*
+ * replaces the index with the one in path, which has to belong to this
+ * file.  seeks and totals then read no frame headers at all.
+ */
+int
+hip_index_load(HIP_File * hf, const char *path)
+{
+    hip_index_t *const ix = get_index(hf);
+    unsigned char head[INDEX_HEAD];
+    reader_t r;
+    const unsigned char *p;
+    hip_frame_t *frame = NULL, last;
+    void   *map = NULL;
+    hip_int64_t size = 0, pos;
+    int     i, n = 0, last_size = 0, ret = 0;
+    FILE   *f;
+
+    if (ix == NULL || ix->free_format)
+        return HIP_ENOSEEK;
+    f = fopen(path, "rb");
+    if (f == NULL)
+        return HIP_EREAD;
+
+    if (fread(head, 1, INDEX_HEAD, f) != INDEX_HEAD || memcmp(head, "HIPX", 4) != 0)
+        ret = HIP_EBADHEADER;
+    else if (get_le(head + 4, 4) != INDEX_VERSION || get_le(head + 36, 4) != INDEX_RECORD)
+        ret = HIP_EVERSION;
+    else if ((unsigned long) get_le(head + 8, 4) != ix->head || get_le(head + 12, 4) != ix->spf
+             || get_le(head + 16, 8) != hf->end || get_le(head + 24, 8) != ix->first)
+        ret = HIP_EINVAL; /* made for another file */
+    else
+        n = (int) get_le(head + 32, 4);
+    if (ret == 0 && (n <= 0 || hip_fseek(f, 0, SEEK_END) != 0
+                     || (size = hip_ftell(f)) != INDEX_HEAD + (hip_int64_t) n * INDEX_RECORD))
+        ret = HIP_EBADHEADER;
+    if (ret != 0) {
+        fclose(f);
+        return ret;
+    }
+
+#ifdef USE_MMAP
+    if (records_match_frames()) {
+        map = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (map == MAP_FAILED)
+            map = NULL;
+        else
+            frame = (hip_frame_t *) ((unsigned char *) map + INDEX_HEAD);
+    }
+#endif
+    if (frame == NULL) {
+        unsigned char buf[INDEX_RECORD];
+        frame = malloc(n * sizeof(hip_frame_t));
+        if (frame == NULL || hip_fseek(f, INDEX_HEAD, SEEK_SET) != 0)
+            ret = HIP_EFAULT;
+        for (i = 0; ret == 0 && i < n; i++) {
+            if (fread(buf, 1, INDEX_RECORD, f) != INDEX_RECORD) {
+                ret = HIP_EREAD;
+                break;
+            }
+            frame[i].offset = get_le(buf, 8);
+            frame[i].main_data = (unsigned short) get_le(buf + 8, 2);
+            frame[i].main_data_begin = (unsigned short) get_le(buf + 10, 2);
+            frame[i].bitrate_index = buf[12];
+        }
+    }
+    fclose(f);
+
+    if (ret == 0 && !index_check_frames(hf, ix, frame, n))
+        ret = HIP_EINVAL;
+
+    /* and the last frame has to be where the index says */
+    if (ret == 0) {
+        pos = hip_ftell(hf->datasource);
+        r.f = hf->datasource;
+        r.pos = 0;
+        r.len = 0;
+        p = reader_get(&r, frame[n - 1].offset, 8);
+        last_size = (p != NULL) ? parse_frame(ix, p, &last) : 0;
+        if (last_size <= 0 || frame[n - 1].offset + last_size > hf->end
+            || last.main_data_begin != frame[n - 1].main_data_begin)
+            ret = HIP_EINVAL;
+        hip_fseek(hf->datasource, pos, SEEK_SET);
+    }
+    if (ret != 0) {
+#ifdef USE_MMAP
+        if (map != NULL)
+            munmap(map, (size_t) size);
+        else
+#endif
+            free(frame);
+        return ret;
+    }
+
+    index_drop_frames(ix);
+    ix->frame = frame;
+    ix->nframes = n;
+    ix->map = map;
+    ix->map_size = (size_t) size;
+    ix->complete = 1;
+    ix->next = frame[n - 1].offset + last_size;
+    return 0;
+}
+
+
+/* hands out the rest of the frame a seek landed in */
+int
+hip_index_pending(HIP_File * hf, char *out, int len)
+{
+    hip_index_t *const ix = HF_MP(hf)->index;
+    int     n;
+
+    if (ix == NULL || ix->pending_pos >= ix->pending_len)
+        return 0;
+    n = ix->pending_len - ix->pending_pos;
+    if (n > len)
+        n = len;
+    memcpy(out, ix->pending + ix->pending_pos, n);
+    ix->pending_pos += n;
+    return n;
+}
+
+
+void
+hip_index_free(HIP_File * hf)
+{
+    hip_index_t *const ix = HF_MP(hf)->index;
+
+    if (ix != NULL) {
+        index_drop_frames(ix);
+        free(ix);
+        HF_MP(hf)->index = NULL;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 1999-2010 The L.A.M.E. project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SEEK_H_INCLUDED
+#define SEEK_H_INCLUDED
+
+#include "hip.h"
+
+#ifdef __cplusplus
+extern  "C" {
+#endif
+
+/* one audio frame of the file.  on little endian machines this is also
+   the layout of the records in an index file, see hip_index_save */
+    typedef struct {
+        hip_int64_t offset;  /* of the frame header in the file */
+        unsigned short main_data; /* layer III main data bytes in this frame */
+        unsigned short main_data_begin; /* layer III reservoir bytes it takes from earlier frames */
+        unsigned char bitrate_index;
+        unsigned char reserved[3];
+    } hip_frame_t;
+
+/* frame index of a HIP_File, built as far as the seeks need it */
+    typedef struct {
+        hip_frame_t *frame;  /* audio frames found so far */
+        int     nframes;
+        int     alloc;
+        int     complete;    /* frame[] covers the whole stream */
+        void   *map;         /* frame[] is mapped from an index file */
+        size_t  map_size;
+        int     free_format; /* frame sizes unknown, seeks decode from the start */
+        hip_int64_t next;    /* file offset of frame[nframes] */
+        hip_int64_t first;   /* first audio frame, behind a Xing frame if there is one */
+        unsigned long head;  /* version, layer and sample rate bits of the stream */
+        int     spf;         /* samples per frame */
+
+        /* from the Xing frame */
+        int     xing_frames;
+        int     xing_bytes;
+        int     has_toc;
+        unsigned char toc[100];
+
+        /* PCM left over from the frame a seek landed in, for hip_read */
+        char    pending[4608];
+        int     pending_pos;
+        int     pending_len;
+    } hip_index_t;
+
+    int     hip_fseek(FILE * f, hip_int64_t offset, int whence);
+    hip_int64_t hip_ftell(FILE * f);
+
+    int     hip_index_pending(HIP_File * hf, char *out, int len);
+    void    hip_index_free(HIP_File * hf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
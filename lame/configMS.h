@@ -117,4 +117,12 @@ void acm_Free( void * mem);
         #define HAVE_XMMINTRIN_H
 #endif
 
+#if defined(HAVE_XMMINTRIN_H) && defined(_MSC_VER) && (_MSC_VER >= 1910)
+        #define HAVE_IMMINTRIN_H
+#endif
+
+#if defined(_M_ARM64) && defined(_MSC_VER) && (_MSC_VER >= 1910)
+        #define HAVE_ARM_NEON_H
+#endif
+
 #endif
@@ -56,6 +56,9 @@ char   *strchr(), *strrchr();
 
 #if defined(_WIN32)
 # include <windows.h>
+# include <io.h>
+#elif defined(HAVE_UNISTD_H)
+# include <unistd.h>
 #endif
 
 
@@ -117,7 +120,14 @@ init_files(lame_global_flags * gf, char const *inPath, char const *outPath)
         error_printf("Can't init infile '%s'\n", inPath);
         return NULL;
     }
-    if ((outf = init_outfile(outPath, lame_get_decode_only(gf))) == NULL) {
+    if (global_writer.resume) {
+        /* the checkpoint says how much of it is valid already */
+        outf = lame_fopen(outPath, "r+b");
+    }
+    else {
+        outf = init_outfile(outPath, lame_get_decode_only(gf));
+    }
+    if (outf == NULL) {
         error_printf("Can't init outfile '%s'\n", outPath);
         return NULL;
     }
@@ -385,18 +395,201 @@ write_id3v1_tag(lame_t gf, FILE * outf)
 }
 
 
+/* the encoder hands every frame over as soon as it is formatted */
+static int
+write_mp3_output(void *outf, const unsigned char *data, int size)
+{
+    return (int) fwrite(data, 1, size, (FILE *) outf) == size ? 0 : -1;
+}
+
+
+/* A checkpoint file starts with "LAMECKPT" and these 32 bit little endian
+ * numbers: the version, the input samples read and the mp3 bytes written
+ * (low word first each) and the size of the encoder state which follows,
+ * see lame_save_state().
+ */
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEAD_SIZE (8 + 6 * 4)
+
+static void
+put_u32_low_high(unsigned char *bytes, unsigned long val)
+{
+    bytes[0] = (unsigned char) (val & 0xff);
+    bytes[1] = (unsigned char) ((val >> 8) & 0xff);
+    bytes[2] = (unsigned char) ((val >> 16) & 0xff);
+    bytes[3] = (unsigned char) ((val >> 24) & 0xff);
+}
+
+static unsigned long
+get_u32_low_high(unsigned char const *bytes)
+{
+    return (unsigned long) bytes[0] | ((unsigned long) bytes[1] << 8)
+        | ((unsigned long) bytes[2] << 16) | ((unsigned long) bytes[3] << 24);
+}
+
+
+/* written to a temporary file first, so a job killed while writing it
+ * still finds the previous checkpoint */
+static int
+write_checkpoint(lame_t gf, FILE * outf, unsigned long samples_read)
+{
+    char const *const path = global_writer.checkpoint_path;
+    char    tmp_path[PATH_MAX + 5];
+    size_t const state_size = lame_get_state_size(gf);
+    unsigned char *buf;
+    long    out_pos;
+    FILE   *f;
+    int     n, ok;
+
+    if (state_size == 0) {
+        return -1;
+    }
+    fflush(outf);
+    out_pos = ftell(outf);
+    if (out_pos < 0) {
+        return -1;
+    }
+    buf = malloc(CHECKPOINT_HEAD_SIZE + state_size);
+    if (buf == 0) {
+        return -1;
+    }
+    n = lame_save_state(gf, buf + CHECKPOINT_HEAD_SIZE, state_size);
+    if (n < 0) {
+        free(buf);
+        return -1;
+    }
+    memcpy(buf, "LAMECKPT", 8);
+    put_u32_low_high(buf + 8, CHECKPOINT_VERSION);
+    put_u32_low_high(buf + 12, samples_read & 0xffffffffUL);
+    put_u32_low_high(buf + 16, samples_read >> 16 >> 16);
+    put_u32_low_high(buf + 20, (unsigned long) out_pos & 0xffffffffUL);
+    put_u32_low_high(buf + 24, (unsigned long) out_pos >> 16 >> 16);
+    put_u32_low_high(buf + 28, (unsigned long) n);
+
+    sprintf(tmp_path, "%s.tmp", path);
+    f = lame_fopen(tmp_path, "wb");
+    ok = f != NULL && fwrite(buf, 1, CHECKPOINT_HEAD_SIZE + n, f) == CHECKPOINT_HEAD_SIZE + (size_t) n;
+    if (f != NULL && fclose(f) != 0) {
+        ok = 0;
+    }
+    free(buf);
+    if (ok) {
+#if defined(_WIN32)
+        remove(path);   /* rename doesn't replace files here */
+#endif
+        ok = rename(tmp_path, path) == 0;
+    }
+    return ok ? 0 : -1;
+}
+
+
+/* cuts the output off at pos, the frames after it are encoded again */
+static int
+truncate_output(FILE * outf, long pos)
+{
+    if (fflush(outf) != 0) {
+        return -1;
+    }
+#if defined(_WIN32)
+    return _chsize(_fileno(outf), pos);
+#elif defined(HAVE_UNISTD_H)
+    return ftruncate(fileno(outf), (off_t) pos);
+#else
+    (void) pos;
+    return 0;
+#endif
+}
+
+
+/* restores the encoder, skips the input and positions the output as they
+ * were when the checkpoint was written */
+static int
+resume_checkpoint(lame_t gf, FILE * outf, int Buffer[2][1152], unsigned long *samples_read)
+{
+    unsigned char head[CHECKPOINT_HEAD_SIZE];
+    unsigned char *state = 0;
+    unsigned long samples, hi, out_pos, state_size;
+    FILE   *f;
+    int     ok = 0;
+
+    f = lame_fopen(global_writer.checkpoint_path, "rb");
+    if (f == NULL) {
+        error_printf("Can't open checkpoint '%s'\n", global_writer.checkpoint_path);
+        return -1;
+    }
+    if (fread(head, 1, sizeof(head), f) == sizeof(head)
+        && memcmp(head, "LAMECKPT", 8) == 0
+        && get_u32_low_high(head + 8) == CHECKPOINT_VERSION) {
+        samples = get_u32_low_high(head + 12);
+        hi = get_u32_low_high(head + 16);
+        samples |= hi << 16 << 16;
+        ok = (samples >> 16 >> 16) == hi;
+        out_pos = get_u32_low_high(head + 20);
+        hi = get_u32_low_high(head + 24);
+        out_pos |= hi << 16 << 16;
+        ok = ok && (out_pos >> 16 >> 16) == hi && out_pos <= LONG_MAX;
+        state_size = get_u32_low_high(head + 28);
+        state = ok ? malloc(state_size) : 0;
+        ok = state != 0 && fread(state, 1, state_size, f) == state_size;
+    }
+    fclose(f);
+    if (!ok || lame_restore_state(gf, state, state_size) != 0) {
+        free(state);
+        error_printf("Can't resume from checkpoint '%s'\n", global_writer.checkpoint_path);
+        return -1;
+    }
+    free(state);
+
+    while (*samples_read < samples) {
+        int const iread = get_audio(gf, Buffer);
+        if (iread <= 0) {
+            break;
+        }
+        *samples_read += iread;
+    }
+    if (*samples_read != samples) {
+        error_printf("The input doesn't match checkpoint '%s'\n", global_writer.checkpoint_path);
+        return -1;
+    }
+    if (fseek(outf, (long) out_pos, SEEK_SET) != 0 || truncate_output(outf, (long) out_pos) != 0) {
+        error_printf("Can't continue the output of checkpoint '%s'\n", global_writer.checkpoint_path);
+        return -1;
+    }
+    return 0;
+}
+
+
 static int
 lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath, char *outPath)
 {
-    unsigned char mp3buffer[LAME_MAXMP3BUFFER];
     int     Buffer[2][1152];
-    int     iread, imp3, owrite, in_limit=0;
+    int     iread, imp3;
     size_t  id3v2_size;
+    unsigned long samples_read = 0, next_checkpoint = ULONG_MAX;
+
+    if (global_writer.checkpoint_path[0] != '\0') {
+        if (lame_get_state_size(gf) == 0) {
+            error_printf("Error: no checkpoints with segmented encoding or decoding on the fly\n");
+            return 1;
+        }
+        next_checkpoint = (unsigned long) global_writer.checkpoint_interval * lame_get_in_samplerate(gf);
+    }
+    if (global_writer.resume) {
+        if (resume_checkpoint(gf, outf, Buffer, &samples_read) != 0) {
+            return 1;
+        }
+        next_checkpoint += samples_read;
+    }
 
     encoder_progress_begin(gf, inPath, outPath);
 
     id3v2_size = lame_get_id3v2_tag(gf, 0, 0);
-    if (id3v2_size > 0) {
+    if (global_writer.resume) {
+        /* the tags are in the output already */
+        if (id3v2_size == 0)
+            id3v2_size = sizeOfOldTag(gf);
+    }
+    else if (id3v2_size > 0) {
         unsigned char *id3v2tag = malloc(id3v2_size);
         if (id3v2tag != 0) {
             size_t  n_bytes = lame_get_id3v2_tag(gf, id3v2tag, id3v2_size);
@@ -425,12 +618,8 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
         fflush(outf);
     }
 
-    /* do not feed more than in_limit PCM samples in one encode call
-       otherwise the mp3buffer is likely too small
-     */
-    in_limit = lame_get_maximum_number_of_samples(gf, sizeof(mp3buffer));
-    if (in_limit < 1)
-        in_limit = 1;
+    /* the mp3 data goes straight from the encoder into outf */
+    lame_set_output_function(gf, &write_mp3_output, outf);
 
     /* encode until we hit eof */
     do {
@@ -438,35 +627,28 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
         iread = get_audio(gf, Buffer);
 
         if (iread >= 0) {
-            const int* buffer_l = Buffer[0];
-            const int* buffer_r = Buffer[1];
-            int     rest = iread;
-            do {
-                int const chunk = rest < in_limit ? rest : in_limit;
-                encoder_progress(gf);
-
-                /* encode */
-
-                imp3 = lame_encode_buffer_int(gf, buffer_l, buffer_r, chunk,
-                                              mp3buffer, sizeof(mp3buffer));
-                buffer_l += chunk;
-                buffer_r += chunk;
-                rest -= chunk;
-
-                /* was our output buffer big enough? */
-                if (imp3 < 0) {
-                    if (imp3 == -1)
-                        error_printf("mp3 buffer is not big enough... \n");
-                    else
-                        error_printf("mp3 internal error:  error code=%i\n", imp3);
-                    return 1;
-                }
-                owrite = (int) fwrite(mp3buffer, 1, imp3, outf);
-                if (owrite != imp3) {
+            encoder_progress(gf);
+
+            /* encode */
+
+            imp3 = lame_encode_buffer_int(gf, Buffer[0], Buffer[1], iread, 0, 0);
+
+            if (imp3 < 0) {
+                if (imp3 == -7)
                     error_printf("Error writing mp3 output \n");
+                else
+                    error_printf("mp3 internal error:  error code=%i\n", imp3);
+                return 1;
+            }
+            samples_read += iread;
+            if (samples_read >= next_checkpoint && iread > 0) {
+                if (write_checkpoint(gf, outf, samples_read) != 0) {
+                    error_printf("Error writing checkpoint '%s'\n", global_writer.checkpoint_path);
                     return 1;
                 }
-            } while (rest > 0);
+                next_checkpoint = samples_read
+                    + (unsigned long) global_writer.checkpoint_interval * lame_get_in_samplerate(gf);
+            }
         }
         if (global_writer.flush_write == 1) {
             fflush(outf);
@@ -474,26 +656,20 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
     } while (iread > 0);
 
     if (nogap)
-        imp3 = lame_encode_flush_nogap(gf, mp3buffer, sizeof(mp3buffer)); /* may return one more mp3 frame */
+        imp3 = lame_encode_flush_nogap(gf, 0, 0); /* may return one more mp3 frame */
     else
-        imp3 = lame_encode_flush(gf, mp3buffer, sizeof(mp3buffer)); /* may return one more mp3 frame */
+        imp3 = lame_encode_flush(gf, 0, 0); /* may return one more mp3 frame */
+    lame_set_output_function(gf, 0, 0);
 
     if (imp3 < 0) {
-        if (imp3 == -1)
-            error_printf("mp3 buffer is not big enough... \n");
+        if (imp3 == -7)
+            error_printf("Error writing mp3 output \n");
         else
             error_printf("mp3 internal error:  error code=%i\n", imp3);
         return 1;
-
     }
 
     encoder_progress_end(gf);
-
-    owrite = (int) fwrite(mp3buffer, 1, imp3, outf);
-    if (owrite != imp3) {
-        error_printf("Error writing mp3 output \n");
-        return 1;
-    }
     if (global_writer.flush_write == 1) {
         fflush(outf);
     }
@@ -511,6 +687,9 @@ lame_encoder_loop(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
     if (global_ui_config.silent <= 0) {
         print_trailing_info(gf);
     }
+    if (global_writer.checkpoint_path[0] != '\0') {
+        remove(global_writer.checkpoint_path); /* the job is done */
+    }
     return 0;
 }
 
@@ -576,6 +755,26 @@ lame_main(lame_t gf, int argc, char **argv)
     }
     if (global_ui_config.update_interval < 0.)
         global_ui_config.update_interval = 2.;
+    if (global_writer.checkpoint_interval <= 0)
+        global_writer.checkpoint_interval = 300;
+    if (global_writer.checkpoint_path[0] != '\0') {
+        if (max_nogap > 0 || lame_get_decode_only(gf) || strcmp(outPath, "-") == 0) {
+            error_printf("Error: --checkpoint needs one input file and an output file\n");
+            return -1;
+        }
+        if (global_writer.resume) {
+            /* nothing to resume before the first checkpoint */
+            FILE   *f = lame_fopen(global_writer.checkpoint_path, "rb");
+            if (f != NULL)
+                fclose(f);
+            else
+                global_writer.resume = 0;
+        }
+    }
+    else if (global_writer.resume) {
+        error_printf("Error: --resume needs --checkpoint <file>\n");
+        return -1;
+    }
 
     if (outPath[0] != '\0' && max_nogap > 0) {
         strncpy(nogapdir, outPath, PATH_MAX + 1);
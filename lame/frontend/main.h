@@ -54,6 +54,9 @@ typedef struct ReaderConfig
 typedef struct WriterConfig
 {
     int   flush_write;
+    char  checkpoint_path[PATH_MAX + 1]; /* empty: no checkpoints */
+    int   checkpoint_interval;      /* seconds of input between two checkpoints */
+    int   resume;                   /* continue from the checkpoint, if there is one */
 } WriterConfig;
 
 typedef struct UiConfig
@@ -786,6 +786,10 @@ long_help(const lame_global_flags * gfp, FILE * const fp, const char *ProgramNam
         );
     fprintf(fp,
             "    --flush         flush output stream as soon as possible\n"
+            "    --checkpoint <file>  save the encoder state to file every few minutes of\n"
+            "                    input, to continue a killed job with --resume\n"
+            "    --checkpoint-interval <n>  seconds of input between checkpoints (300)\n"
+            "    --resume        continue from the --checkpoint file, if it exists\n"
             "    --freeformat    produce a free format bitstream\n"
             "    --decode        input=mp3 file, output=wav\n"
             "    -t              disable writing wav header when using --decode\n");
@@ -855,6 +859,18 @@ long_help(const lame_global_flags * gfp, FILE * const fp, const char *ProgramNam
             "                                     default, strict, maximum\n"
             "\n"
             );
+    fprintf(fp,
+            "  Multi threading:\n"
+            "    --threads <n>   use up to n threads for encoding\n"
+            "    --segment-frames <n>  cut the input into segments of n frames (at least\n"
+            "                    256) and encode them in parallel. faster, but each\n"
+            "                    segment starts with an empty bit reservoir\n"
+            "    --pipeline      analyze the next frame while quantizing the current one,\n"
+            "                    needs --threads 2 or more. same output as without\n"
+            "    --parallel-quant  quantize granules and channels in parallel (VBR\n"
+            "                    new only), needs --threads 2 or more\n"
+            "\n"
+            );
     fprintf(fp,
             "  Filter options:\n"
             "  --lowpass <freq>        frequency(kHz), lowpass filter cutoff above freq\n"
@@ -1672,6 +1688,24 @@ parse_args_(lame_global_flags * gfp, int argc, char **argv,
                 T_ELIF("flush")
                     global_writer.flush_write = 1;
 
+                T_ELIF("checkpoint")
+                    int const arg_n = strnlen(nextArg, PATH_MAX);
+                    if (arg_n >= PATH_MAX) {
+                        error_printf("%s: %s argument length (%d) exceeds limit (%d)\n", ProgramName, token, arg_n, PATH_MAX);
+                        return -1;
+                    }
+                    strncpy(global_writer.checkpoint_path, nextArg, PATH_MAX);
+                    global_writer.checkpoint_path[PATH_MAX] = '\0';
+                    argUsed = 1;
+
+                T_ELIF("checkpoint-interval")
+                    argUsed = getIntValue(token, nextArg, &int_value);
+                    if (argUsed)
+                        global_writer.checkpoint_interval = int_value;
+
+                T_ELIF("resume")
+                    global_writer.resume = 1;
+
                 T_ELIF("decode-mp3delay")
                     argUsed = getIntValue(token, nextArg, &int_value);
                     if (argUsed) {
@@ -1732,6 +1766,30 @@ parse_args_(lame_global_flags * gfp, int argc, char **argv,
                 if (!strcmp(nextArg, "sse"))
                     (void) lame_set_asm_optimizations(gfp, SSE, 0);
 
+                T_ELIF("threads")
+                    argUsed = getIntValue(token, nextArg, &int_value);
+                    if (argUsed) {
+                        if (lame_set_num_threads(gfp, int_value) < 0) {
+                            error_printf("Error: invalid number of threads: %d\n", int_value);
+                            return -1;
+                        }
+                    }
+
+                T_ELIF("segment-frames")
+                    argUsed = getIntValue(token, nextArg, &int_value);
+                    if (argUsed) {
+                        if (lame_set_segment_frames(gfp, int_value) < 0) {
+                            error_printf("Error: invalid segment length: %d\n", int_value);
+                            return -1;
+                        }
+                    }
+
+                T_ELIF("pipeline")
+                    lame_set_pipeline(gfp, 1);
+
+                T_ELIF("parallel-quant")
+                    lame_set_parallel_quantization(gfp, 1);
+
                 T_ELIF("freeformat")
                     lame_set_free_format(gfp, 1);
 
@@ -2580,6 +2638,15 @@ parse_args_(lame_global_flags * gfp, int argc, char **argv,
             return -1;
         }
     }
+    /* the encoder state can't be saved in these modes, say so before
+     * any file is opened */
+    if (global_writer.checkpoint_path[0] != '\0') {
+        if ((lame_get_segment_frames(gfp) > 0 && lame_get_num_threads(gfp) > 1)
+            || lame_get_decode_on_the_fly(gfp)) {
+            error_printf("Error: no checkpoints with segmented encoding or decoding on the fly\n");
+            return -1;
+        }
+    }
     if (num_nogap != NULL)
         *num_nogap = count_nogap;
     return 0;
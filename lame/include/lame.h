@@ -36,6 +36,7 @@ extern "C" {
 #endif
 
 typedef void (*lame_report_function)(const char *format, va_list ap);
+typedef int (*lame_output_function)(void *user_data, const unsigned char *data, int size);
 
 #if defined(WIN32) || defined(_WIN32)
 #undef CDECL
@@ -172,6 +173,27 @@ lame_global_flags * CDECL lame_init(void);
 int CDECL lame_init_old(lame_global_flags *);
 #endif
 
+/*
+ * OPTIONAL:
+ * as lame_init(), but all memory of the encoder instance comes from the
+ * functions in allocator instead of malloc() and free().  allocator may
+ * be NULL, the struct is copied.
+ *
+ * With arena_size > 0, the memory is carved from one block of arena_size
+ * bytes instead: arena, or one block taken from allocator if arena is
+ * NULL.  Carved memory is not given back before lame_close(), what does
+ * not fit comes from allocator.  After lame_close() an arena passed in
+ * belongs to the caller again and may be used for the next encoder.
+ */
+typedef struct {
+    void *(*malloc_func)(void *user_data, size_t size);
+    void  (*free_func)(void *user_data, void *ptr);
+    void   *user_data;
+} lame_allocator;
+
+lame_global_flags * CDECL lame_init_allocator(const lame_allocator *allocator,
+                                              void *arena, size_t arena_size);
+
 /*
  * OPTIONAL:
  * set as needed to override defaults
@@ -329,6 +351,65 @@ int CDECL lame_get_nogap_total(const lame_global_flags*);
 int CDECL lame_set_nogap_currentindex(lame_global_flags* , int);
 int CDECL lame_get_nogap_currentindex(const lame_global_flags*);
 
+/* number of threads the encoder may use.  default=1 */
+int CDECL lame_set_num_threads(lame_global_flags *, int);
+int CDECL lame_get_num_threads(const lame_global_flags *);
+
+/*
+ * Segmented encoding: with more than one thread, the input is cut into
+ * segments of this many frames which are encoded in parallel and joined
+ * into one gapless stream.  Every segment starts with an empty bit
+ * reservoir, so the result is not bit identical to a normal encode.
+ * With resampling, ReplayGain is analyzed before the resampling.
+ * Not available with decoding on the fly, free format, gapless (nogap)
+ * encoding and some unusual resampling ratios, LAME then encodes normally
+ * and prints a warning.  For
+ * gapless encoding, lame_set_nogap_total() may also be called after
+ * lame_init_params(), as long as no samples have been encoded.
+ * Output is delayed by a few segments, lame_encode_flush() returns all of
+ * the rest at once: mp3buf has to hold up to num_threads + 1 segments of
+ * at most 1441 bytes per frame.  If it is smaller, lame_encode_flush()
+ * returns -1 and keeps the output for another call with a larger mp3buf.
+ * default = 0 (disabled), values below 256 are raised to 256, and with
+ * resampling up to a length that spans a whole number of input samples
+ */
+int CDECL lame_set_segment_frames(lame_global_flags *, int);
+int CDECL lame_get_segment_frames(const lame_global_flags *);
+
+/*
+ * Pipelined encoding: with more than one thread, the psychoacoustic model
+ * and MDCT of the next frame run in parallel to the quantization of the
+ * current frame.  The output is bit identical to a normal encode, but
+ * delayed by one frame.  Segmented encoding takes precedence, not used
+ * by the frame analyzer.
+ * default = 0 (disabled)
+ */
+int CDECL lame_set_pipeline(lame_global_flags *, int);
+int CDECL lame_get_pipeline(const lame_global_flags *);
+
+/*
+ * With more than one thread, search the scalefactors of all granules and
+ * channels of a frame in parallel.  Only used by the default VBR mode
+ * (vbr_mtrh), the output is the same as without.
+ * default = 0 (disabled)
+ */
+int CDECL lame_set_parallel_quantization(lame_global_flags *, int);
+int CDECL lame_get_parallel_quantization(const lame_global_flags *);
+
+/*
+ * Compact memory: the bit buffer and the input buffer are sized for the
+ * frames of this stream instead of the largest possible ones, for servers
+ * with many encoders at low bitrates.  The output is the same.  Then
+ * lame_get_input_buffer() hands out room for one frame only.
+ * Independent of this setting, the ReplayGain analysis is only allocated
+ * when it is enabled and mono needs one input buffer only, the frame
+ * analyzer and the decoder of lame_set_decode_on_the_fly() only take
+ * memory when they are used.
+ * default = 0 (disabled)
+ */
+int CDECL lame_set_compact_memory(lame_global_flags *, int);
+int CDECL lame_get_compact_memory(const lame_global_flags *);
+
 
 /*
  * OPTIONAL:
@@ -347,6 +428,25 @@ int CDECL lame_set_errorf(lame_global_flags *, lame_report_function);
 int CDECL lame_set_debugf(lame_global_flags *, lame_report_function);
 int CDECL lame_set_msgf  (lame_global_flags *, lame_report_function);
 
+/*
+ * OPTIONAL:
+ * Hand the encoded bytes to a function instead of copying them into the
+ * mp3buf passed to lame_encode_buffer*() and lame_encode_flush*():
+ *   int my_output(void *user_data, const unsigned char *data, int size)
+ *   {
+ *       return fwrite(data, 1, size, (FILE *) user_data) == size ? 0 : -1;
+ *   }
+ * It is called as soon as a frame is formatted, data points into the
+ * encoder's bit buffer and is only valid during the call.  The call always
+ * comes from the thread which called the encode function, also when the
+ * encoder uses more threads.  The encode
+ * functions then return 0 bytes, and mp3buf may be NULL with a size of 0.
+ * If the function returns a negative value, the encode function returns -7.
+ * May be set before or after lame_init_params(), NULL restores mp3buf.
+ */
+int CDECL lame_set_output_function(lame_global_flags *, lame_output_function,
+                                   void *user_data);
+
 
 
 /* set one of brate compression ratio.  default is compression ratio of 11.  */
@@ -622,6 +722,12 @@ int CDECL lame_get_noclipGainChange(const lame_global_flags *);
    not clip or the value cannot be determined */
 float CDECL lame_get_noclipScale(const lame_global_flags *);
 
+/* bytes of memory the encoder holds from its allocator or arena (see
+   lame_init_allocator()).  Tables shared with other encoders of the same
+   settings count for the encoder which computed them only.  The decoder
+   of lame_set_decode_on_the_fly() and the worker threads are not counted. */
+size_t CDECL lame_get_memory_usage(const lame_global_flags *);
+
 /* returns the limit of PCM samples, which one can pass in an encode call
    under the constrain of a provided buffer of size buffer_size */
 int CDECL lame_get_maximum_number_of_samples(lame_t gfp, size_t buffer_size);
@@ -690,6 +796,7 @@ void CDECL lame_print_internals( const lame_global_flags *gfp);
  *                 -2:  malloc() problem
  *                 -3:  lame_init_params() not called
  *                 -4:  psycho acoustic problems
+ *                 -7:  the output function failed
  *
  * The required mp3buf_size can be computed from num_samples,
  * samplerate and encoding rate, but here is a worst case estimate:
@@ -789,6 +896,29 @@ int CDECL lame_encode_buffer_interleaved_ieee_double(
         unsigned char * mp3buf,
         const int       mp3buf_size);
 
+/*
+ * Encoding without handing over the PCM data:  lame_get_input_buffer()
+ * returns two planar float buffers owned by the encoder and the number of
+ * samples per channel that may be written into them, or a negative error
+ * code.  After writing nsamples <= that number, lame_encode_input_buffer()
+ * encodes them just like lame_encode_buffer_float() would, so the samples
+ * must be scaled to +/- 32768 for full scale.  For mono input pcm_r is the
+ * same buffer as pcm_l.
+ *
+ * When no resampling, scaling or downmix is configured, the buffers are
+ * the encoder's own sample window and the samples are not copied at all.
+ * They stay valid only until the next call of any lame_encode_* function.
+ */
+int CDECL lame_get_input_buffer(
+        lame_t          gfp,
+        float **        pcm_l,             /* out: left channel buffer      */
+        float **        pcm_r);            /* out: right channel buffer     */
+int CDECL lame_encode_input_buffer(
+        lame_t          gfp,
+        int             nsamples,          /* samples written per channel   */
+        unsigned char * mp3buf,
+        int             mp3buf_size);
+
 /* as lame_encode_buffer, but for long's
  * !! NOTE: !! data must still be scaled to be in the same range as
  * short int, +/- 32768
@@ -909,6 +1039,61 @@ int CDECL lame_encode_flush_nogap(
 int CDECL lame_init_bitstream(
         lame_global_flags *  gfp);    /* global context handle                 */
 
+/*
+ * OPTIONAL:
+ * Prepares an encoder for the next stream with the same settings, without
+ * going through lame_close(), lame_init() and lame_init_params() again.
+ * Call it after lame_encode_flush() (or at any point to abandon the
+ * current stream).  Buffered samples, the bit reservoir, the psymodel
+ * history and the ReplayGain analysis are cleared, the tables computed by
+ * lame_init_params() are kept.  Like lame_init_params(), it writes the
+ * id3v2 tag and the Xing frame into the front of the new bitstream, so
+ * set the tags of the next stream before calling it.  Pointers returned
+ * by lame_get_input_buffer() are no longer valid afterwards.
+ *
+ * return code: 0 on success, -3 if lame_init_params() was not called
+ */
+int CDECL lame_reset(
+        lame_global_flags *  gfp);    /* global context handle                 */
+
+/*
+ * OPTIONAL:
+ * Snapshot of a stream in progress, to continue it in another encoder,
+ * for instance on another machine when this one fails.  It holds the
+ * samples not encoded yet, the MDCT and psymodel history, the bit
+ * reservoir, the frames not completely written yet, the ReplayGain
+ * analysis, the peak sample and the data of the Xing/LAME tag.
+ *
+ * Save the state between two encode calls, after the mp3 data they
+ * returned is written.  Restore it into an encoder set up with the same
+ * settings and lame_init_params(), instead of lame_encode_buffer*() for
+ * the first samples.  The restored encoder continues the stream exactly
+ * as the saved one would have, its output appended to what the saved one
+ * had output gives one continuous bitstream.  A snapshot works with the
+ * same build of the library only.  Segmented encoding and decoding on the
+ * fly are not supported.  Pointers returned by lame_get_input_buffer()
+ * are no longer valid after lame_restore_state().
+ *
+ * lame_get_state_size() returns the size of the state right now, or 0
+ * lame_save_state() return code: number of bytes used, -1 state_size is
+ *     too small, -3 not set up by lame_init_params() or not supported
+ * lame_restore_state() return code: 0 on success, -1 the state is broken
+ *     or from other settings, -2 out of memory, -3 as above.  The encoder
+ *     is unchanged if restoring fails.
+ */
+size_t CDECL lame_get_state_size(
+        const lame_global_flags *  gfp);   /* global context handle       */
+
+int CDECL lame_save_state(
+        const lame_global_flags *  gfp,    /* global context handle       */
+        unsigned char *            state,  /* pointer to state buffer     */
+        size_t                     state_size); /* number of valid octets */
+
+int CDECL lame_restore_state(
+        lame_global_flags *        gfp,    /* global context handle       */
+        const unsigned char *      state,  /* pointer to saved state      */
+        size_t                     state_size); /* number of valid octets */
+
 
 
 /*
@@ -515,7 +515,7 @@ InitVbrTag(lame_global_flags * gfp)
     gfc->VBR_seek_table.pos = 0;
 
     if (gfc->VBR_seek_table.bag == NULL) {
-        gfc->VBR_seek_table.bag = lame_calloc(int, 400);
+        gfc->VBR_seek_table.bag = gfc_calloc(gfc, int, 400);
         if (gfc->VBR_seek_table.bag != NULL) {
             gfc->VBR_seek_table.size = 400;
         }
@@ -530,13 +530,12 @@ InitVbrTag(lame_global_flags * gfp)
     /* write dummy VBR tag of all 0's into bitstream */
     {
         uint8_t buffer[MAXFRAMESIZE];
-        size_t  i, n;
 
         memset(buffer, 0, sizeof(buffer));
         setLameTagFrameHeader(gfc, buffer);
-        n = gfc->VBR_seek_table.TotalFrameSize;
-        for (i = 0; i < n; ++i) {
-            add_dummy_byte(gfc, buffer[i], 1);
+        if (add_dummy_bytes(gfc, buffer, gfc->VBR_seek_table.TotalFrameSize) < 0) {
+            gfc->cfg.write_lame_tag = 0;
+            return -1;
         }
     }
     /* Success */
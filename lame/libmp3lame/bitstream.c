@@ -29,6 +29,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "lame.h"
 #include "machine.h"
@@ -162,7 +163,7 @@ putbits2(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             assert(esv->header[esv->w_ptr].write_timing >= bs->totbit);
             if (esv->header[esv->w_ptr].write_timing == bs->totbit) {
                 putheader_bits(gfc);
@@ -197,7 +198,7 @@ putbits_noheaders(lame_internal_flags * gfc, int val, int j)
         if (bs->buf_bit_idx == 0) {
             bs->buf_bit_idx = 8;
             bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
+            assert(bs->buf_byte_idx < bs->buf_size);
             bs->buf[bs->buf_byte_idx] = 0;
         }
 
@@ -215,6 +216,118 @@ putbits_noheaders(lame_internal_flags * gfc, int val, int j)
 }
 
 
+/*
+  Bit writer for the main data of a granule.  The bits are collected in a
+  64 bit accumulator and stored 32 bits at a time, without looking for the
+  frame headers due in between.  Those are spliced into the finished bytes
+  by bitwriter_close(), once per granule.
+*/
+typedef struct {
+    uint64_t acc;           /* pending bits, the last one in bit 0 */
+    int     nbits;          /* number of pending bits, less than 32 between calls */
+    unsigned char *out;     /* where the pending bits go */
+    unsigned char *start;   /* out when opened */
+    int     start_bit;      /* bs.totbit at the first bit of start */
+} BitWriter_t;
+
+
+inline static void
+bitwriter_open(lame_internal_flags const *gfc, BitWriter_t * w)
+{
+    Bit_stream_struc const *const bs = &gfc->bs;
+
+    if (bs->buf_bit_idx == 0) {
+        w->acc = 0;
+        w->nbits = 0;
+        w->out = &bs->buf[bs->buf_byte_idx + 1];
+    }
+    else {
+        /* continue the partly filled byte */
+        w->nbits = 8 - bs->buf_bit_idx;
+        w->acc = bs->buf[bs->buf_byte_idx] >> bs->buf_bit_idx;
+        w->out = &bs->buf[bs->buf_byte_idx];
+    }
+    w->start = w->out;
+    w->start_bit = bs->totbit - w->nbits;
+    assert(w->start_bit % 8 == 0);
+}
+
+
+/*write j bits into the accumulator */
+inline static void
+bitwriter_put(BitWriter_t * w, unsigned int val, int j)
+{
+    assert(j <= MAX_LENGTH);
+    assert(j == MAX_LENGTH || (val >> j) == 0);
+
+    w->acc = (w->acc << j) | val;
+    w->nbits += j;
+    if (w->nbits >= 32) {
+        uint32_t const word = (uint32_t) (w->acc >> (w->nbits - 32));
+        w->out[0] = (unsigned char) (word >> 24);
+        w->out[1] = (unsigned char) (word >> 16);
+        w->out[2] = (unsigned char) (word >> 8);
+        w->out[3] = (unsigned char) word;
+        w->out += 4;
+        w->nbits -= 32;
+    }
+}
+
+
+/* the position of the next bit, in bs.totbit units, not counting the
+ * headers spliced in by bitwriter_close */
+inline static int
+bitwriter_tell(BitWriter_t const *w)
+{
+    return w->start_bit + 8 * (int) (w->out - w->start) + w->nbits;
+}
+
+
+/* stores the pending bits in the bit stream and inserts the frame headers
+ * which are due before the last bit written, as putbits2 would have done */
+inline static void
+bitwriter_close(lame_internal_flags * gfc, BitWriter_t * w)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    Bit_stream_struc *const bs = &gfc->bs;
+    int const start_idx = (int) (w->start - bs->buf);
+
+    while (w->nbits >= 8) {
+        w->nbits -= 8;
+        *w->out++ = (unsigned char) (w->acc >> w->nbits);
+    }
+    bs->totbit = bitwriter_tell(w);
+    if (w->nbits > 0) {
+        *w->out = (unsigned char) (w->acc << (8 - w->nbits));
+        bs->buf_byte_idx = (int) (w->out - bs->buf);
+        bs->buf_bit_idx = 8 - w->nbits;
+    }
+    else {
+        bs->buf_byte_idx = (int) (w->out - bs->buf) - 1;
+        bs->buf_bit_idx = 0;
+    }
+    assert(bs->buf_byte_idx < bs->buf_size);
+
+    while (esv->header[esv->w_ptr].write_timing < bs->totbit) {
+        int const write_timing = esv->header[esv->w_ptr].write_timing;
+        int const pos = start_idx + (write_timing - w->start_bit) / 8;
+
+        assert(write_timing >= w->start_bit);
+        assert(write_timing % 8 == 0);
+        assert(bs->buf_byte_idx + cfg->sideinfo_len < bs->buf_size);
+#ifdef DEBUG
+        hogege += cfg->sideinfo_len * 8;
+#endif
+        memmove(&bs->buf[pos + cfg->sideinfo_len], &bs->buf[pos], bs->buf_byte_idx + 1 - pos);
+        memcpy(&bs->buf[pos], esv->header[esv->w_ptr].buf, cfg->sideinfo_len);
+        bs->buf_byte_idx += cfg->sideinfo_len;
+        bs->totbit += cfg->sideinfo_len * 8;
+        esv->w_ptr = (esv->w_ptr + 1) & (MAX_HEADER_BUF - 1);
+    }
+}
+
+
 /*
   Some combinations of bitrate, Fs, and stereo make it impossible to stuff
   out a frame using just main_data, due to the limited number of bits to
@@ -488,14 +601,11 @@ encodeSideInfo2(lame_internal_flags * gfc, int bitsPerFrame)
 
 
 inline static int
-huffman_coder_count1(lame_internal_flags * gfc, gr_info const *gi)
+huffman_coder_count1(BitWriter_t * w, gr_info const *gi)
 {
     /* Write count1 area */
     struct huffcodetab const *const h = &ht[gi->count1table_select + 32];
     int     i, bits = 0;
-#ifdef DEBUG
-    int     gegebo = gfc->bs.totbit;
-#endif
 
     int const *ix = &gi->l3_enc[gi->big_values];
     FLOAT const *xr = &gi->xr[gi->big_values];
@@ -542,13 +652,9 @@ huffman_coder_count1(lame_internal_flags * gfc, gr_info const *gi)
 
         ix += 4;
         xr += 4;
-        putbits2(gfc, huffbits + h->table[p], h->hlen[p]);
+        bitwriter_put(w, huffbits + h->table[p], h->hlen[p]);
         bits += h->hlen[p];
     }
-#ifdef DEBUG
-    DEBUGF(gfc, "count1: real: %ld counted:%d (bigv %d count1len %d)\n",
-           gfc->bs.totbit - gegebo, gi->count1bits, gi->big_values, gi->count1);
-#endif
     return bits;
 }
 
@@ -558,7 +664,7 @@ huffman_coder_count1(lame_internal_flags * gfc, gr_info const *gi)
   Implements the pseudocode of page 98 of the IS
   */
 inline static int
-Huffmancode(lame_internal_flags * const gfc, const unsigned int tableindex,
+Huffmancode(BitWriter_t * const w, const unsigned int tableindex,
             int start, int end, gr_info const *gi)
 {
     struct huffcodetab const *const h = &ht[tableindex];
@@ -623,8 +729,8 @@ Huffmancode(lame_internal_flags * const gfc, const unsigned int tableindex,
         assert(cbits <= MAX_LENGTH);
         assert(xbits <= MAX_LENGTH);
 
-        putbits2(gfc, h->table[x1], cbits);
-        putbits2(gfc, (int)ext, xbits);
+        bitwriter_put(w, h->table[x1], cbits);
+        bitwriter_put(w, ext, xbits);
         bits += cbits + xbits;
     }
     return bits;
@@ -636,7 +742,7 @@ Huffmancode(lame_internal_flags * const gfc, const unsigned int tableindex,
   information on pages 26 and 27.
   */
 static int
-ShortHuffmancodebits(lame_internal_flags * gfc, gr_info const *gi)
+ShortHuffmancodebits(lame_internal_flags * gfc, BitWriter_t * w, gr_info const *gi)
 {
     int     bits;
     int     region1Start;
@@ -646,13 +752,13 @@ ShortHuffmancodebits(lame_internal_flags * gfc, gr_info const *gi)
         region1Start = gi->big_values;
 
     /* short blocks do not have a region2 */
-    bits = Huffmancode(gfc, gi->table_select[0], 0, region1Start, gi);
-    bits += Huffmancode(gfc, gi->table_select[1], region1Start, gi->big_values, gi);
+    bits = Huffmancode(w, gi->table_select[0], 0, region1Start, gi);
+    bits += Huffmancode(w, gi->table_select[1], region1Start, gi->big_values, gi);
     return bits;
 }
 
 static int
-LongHuffmancodebits(lame_internal_flags * gfc, gr_info const *gi)
+LongHuffmancodebits(lame_internal_flags * gfc, BitWriter_t * w, gr_info const *gi)
 {
     unsigned int i;
     int     bigvalues, bits;
@@ -676,9 +782,9 @@ LongHuffmancodebits(lame_internal_flags * gfc, gr_info const *gi)
     if (region2Start > bigvalues)
         region2Start = bigvalues;
 
-    bits = Huffmancode(gfc, gi->table_select[0], 0, region1Start, gi);
-    bits += Huffmancode(gfc, gi->table_select[1], region1Start, region2Start, gi);
-    bits += Huffmancode(gfc, gi->table_select[2], region2Start, bigvalues, gi);
+    bits = Huffmancode(w, gi->table_select[0], 0, region1Start, gi);
+    bits += Huffmancode(w, gi->table_select[1], region1Start, region2Start, gi);
+    bits += Huffmancode(w, gi->table_select[2], region2Start, bigvalues, gi);
     return bits;
 }
 
@@ -687,6 +793,7 @@ writeMainData(lame_internal_flags * const gfc)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     III_side_info_t const *const l3_side = &gfc->l3_side;
+    BitWriter_t w;
     int     gr, ch, sfb, data_bits, tot_bits = 0;
 
     if (cfg->version == 1) {
@@ -700,27 +807,29 @@ writeMainData(lame_internal_flags * const gfc)
 #ifdef DEBUG
                 hogege = gfc->bs.totbit;
 #endif
+                bitwriter_open(gfc, &w);
                 for (sfb = 0; sfb < gi->sfbdivide; sfb++) {
                     if (gi->scalefac[sfb] == -1)
                         continue; /* scfsi is used */
-                    putbits2(gfc, gi->scalefac[sfb], slen1);
+                    bitwriter_put(&w, gi->scalefac[sfb], slen1);
                     data_bits += slen1;
                 }
                 for (; sfb < gi->sfbmax; sfb++) {
                     if (gi->scalefac[sfb] == -1)
                         continue; /* scfsi is used */
-                    putbits2(gfc, gi->scalefac[sfb], slen2);
+                    bitwriter_put(&w, gi->scalefac[sfb], slen2);
                     data_bits += slen2;
                 }
                 assert(data_bits == gi->part2_length);
 
                 if (gi->block_type == SHORT_TYPE) {
-                    data_bits += ShortHuffmancodebits(gfc, gi);
+                    data_bits += ShortHuffmancodebits(gfc, &w, gi);
                 }
                 else {
-                    data_bits += LongHuffmancodebits(gfc, gi);
+                    data_bits += LongHuffmancodebits(gfc, &w, gi);
                 }
-                data_bits += huffman_coder_count1(gfc, gi);
+                data_bits += huffman_coder_count1(&w, gi);
+                bitwriter_close(gfc, &w);
 #ifdef DEBUG
                 DEBUGF(gfc, "<%ld> ", gfc->bs.totbit - hogege);
 #endif
@@ -741,6 +850,7 @@ writeMainData(lame_internal_flags * const gfc)
 #ifdef DEBUG
             hogege = gfc->bs.totbit;
 #endif
+            bitwriter_open(gfc, &w);
             sfb = 0;
             sfb_partition = 0;
 
@@ -749,26 +859,27 @@ writeMainData(lame_internal_flags * const gfc)
                     int const sfbs = gi->sfb_partition_table[sfb_partition] / 3;
                     int const slen = gi->slen[sfb_partition];
                     for (i = 0; i < sfbs; i++, sfb++) {
-                        putbits2(gfc, Max(gi->scalefac[sfb * 3 + 0], 0), slen);
-                        putbits2(gfc, Max(gi->scalefac[sfb * 3 + 1], 0), slen);
-                        putbits2(gfc, Max(gi->scalefac[sfb * 3 + 2], 0), slen);
+                        bitwriter_put(&w, Max(gi->scalefac[sfb * 3 + 0], 0), slen);
+                        bitwriter_put(&w, Max(gi->scalefac[sfb * 3 + 1], 0), slen);
+                        bitwriter_put(&w, Max(gi->scalefac[sfb * 3 + 2], 0), slen);
                         scale_bits += 3 * slen;
                     }
                 }
-                data_bits += ShortHuffmancodebits(gfc, gi);
+                data_bits += ShortHuffmancodebits(gfc, &w, gi);
             }
             else {
                 for (; sfb_partition < 4; sfb_partition++) {
                     int const sfbs = gi->sfb_partition_table[sfb_partition];
                     int const slen = gi->slen[sfb_partition];
                     for (i = 0; i < sfbs; i++, sfb++) {
-                        putbits2(gfc, Max(gi->scalefac[sfb], 0), slen);
+                        bitwriter_put(&w, Max(gi->scalefac[sfb], 0), slen);
                         scale_bits += slen;
                     }
                 }
-                data_bits += LongHuffmancodebits(gfc, gi);
+                data_bits += LongHuffmancodebits(gfc, &w, gi);
             }
-            data_bits += huffman_coder_count1(gfc, gi);
+            data_bits += huffman_coder_count1(&w, gi);
+            bitwriter_close(gfc, &w);
 #ifdef DEBUG
             DEBUGF(gfc, "<%ld> ", gfc->bs.totbit - hogege);
 #endif
@@ -889,18 +1000,77 @@ flush_bitstream(lame_internal_flags * gfc)
 
 
 
-void
+/* size of the bit buffer with compact_memory: the largest frame and the
+ * bit reservoir, which format_bitstream and flush_bitstream may write
+ * before the buffer is emptied, and the side info of all frames in flight
+ */
+static int
+frame_buffer_size(SessionConfig_t const *cfg)
+{
+    int const kbps = cfg->free_format ? 640 : bitrate_table[cfg->version][14];
+
+    return calcFrameLength(cfg, kbps, 1) / 8 + 2 * 256 * cfg->mode_gr
+        + MAX_HEADER_BUF * cfg->sideinfo_len;
+}
+
+/* makes room for n more bytes of tags, which may be larger than the
+ * bit buffer */
+int
+bitstream_reserve(lame_internal_flags * gfc, unsigned int n)
+{
+    Bit_stream_struc *const bs = &gfc->bs;
+    size_t const need = (size_t) (bs->buf_byte_idx + 1) + n + frame_buffer_size(&gfc->cfg);
+    unsigned char *buf;
+
+    if (need <= (size_t) bs->buf_size)
+        return 0;
+    if (need > INT_MAX)
+        return -1;
+    buf = gfc_calloc(gfc, unsigned char, need);
+    if (buf == 0)
+        return -1;
+    memcpy(buf, bs->buf, bs->buf_byte_idx + 1);
+    gfc_free(gfc, bs->buf);
+    bs->buf = buf;
+    bs->buf_size = (int) need;
+    return 0;
+}
+
+
+int
 add_dummy_byte(lame_internal_flags * gfc, unsigned char val, unsigned int n)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
+    unsigned int k;
     int     i;
 
-    while (n-- > 0u) {
+    if (bitstream_reserve(gfc, n) < 0)
+        return -1;
+    for (k = 0; k < n; ++k)
         putbits_noheaders(gfc, val, 8);
 
-        for (i = 0; i < MAX_HEADER_BUF; ++i)
-            esv->header[i].write_timing += 8;
-    }
+    for (i = 0; i < MAX_HEADER_BUF; ++i)
+        esv->header[i].write_timing += 8 * n;
+    return 0;
+}
+
+
+/* same as add_dummy_byte, for the n bytes of a tag */
+int
+add_dummy_bytes(lame_internal_flags * gfc, unsigned char const *buf, unsigned int n)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    unsigned int k;
+    int     i;
+
+    if (bitstream_reserve(gfc, n) < 0)
+        return -1;
+    for (k = 0; k < n; ++k)
+        putbits_noheaders(gfc, buf[k], 8);
+
+    for (i = 0; i < MAX_HEADER_BUF; ++i)
+        esv->header[i].write_timing += 8 * n;
+    return 0;
 }
 
 
@@ -1093,19 +1263,55 @@ copy_buffer(lame_internal_flags * gfc, unsigned char *buffer, int size, int mp3d
 }
 
 
-void
+/* as copy_buffer, but if the application set an output function with
+   lame_set_output_function(), the data is handed to it straight out of
+   the bit buffer and nothing is written into buffer.
+*/
+int
+output_buffer(lame_internal_flags * gfc, unsigned char *buffer, int size, int mp3data)
+{
+    Bit_stream_struc *const bs = &gfc->bs;
+    int const minimum = bs->buf_byte_idx + 1;
+    int     ret = 0;
+
+    if (gfc->output_func == 0)
+        return copy_buffer(gfc, buffer, size, mp3data);
+    if (minimum <= 0)
+        return 0;
+    if (mp3data) {
+        UpdateMusicCRC(&gfc->nMusicCRC, bs->buf, minimum);
+        gfc->VBR_seek_table.nBytesWritten += minimum;
+        ret = do_gain_analysis(gfc, bs->buf, minimum);
+    }
+    if (gfc->output_func(gfc->output_data, bs->buf, minimum) < 0)
+        ret = -7;
+    bs->buf_byte_idx = -1;
+    bs->buf_bit_idx = 0;
+    return ret < 0 ? ret : 0;
+}
+
+
+int
 init_bit_stream_w(lame_internal_flags * gfc)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
+    int const size = gfc->cfg.compact_memory ? frame_buffer_size(&gfc->cfg) : BUFFER_SIZE;
 
     esv->h_ptr = esv->w_ptr = 0;
     esv->header[esv->h_ptr].write_timing = 0;
 
-    gfc->bs.buf = lame_calloc(unsigned char, BUFFER_SIZE);
-    gfc->bs.buf_size = BUFFER_SIZE;
+    if (gfc->bs.buf == 0 || gfc->bs.buf_size != size) {
+        gfc_free(gfc, gfc->bs.buf);
+        gfc->bs.buf = gfc_calloc(gfc, unsigned char, size);
+        gfc->bs.buf_size = 0;
+        if (gfc->bs.buf == 0)
+            return -1;
+        gfc->bs.buf_size = size;
+    }
     gfc->bs.buf_byte_idx = -1;
     gfc->bs.buf_bit_idx = 0;
     gfc->bs.totbit = 0;
+    return 0;
 }
 
 /* end of bitstream.c */
@@ -42,6 +42,8 @@
 #include "VbrTag.h"
 #include "quantize.h"
 #include "quantize_pvt.h"
+#include "threadpool.h"
+#include "state.h"
 
 
 
@@ -50,17 +52,18 @@
  * Gabriel Bouvigne 3 feb 2001
  *
  * modifies some values in
- *   gfp->internal_flags->ATH
- *   (gfc->ATH)
+ *   gfc->sv_psy
+ * the result is used for the frame being analyzed, see encode_frame_quantize
  */
 static void
-adjust_ATH(lame_internal_flags const *const gfc)
+adjust_ATH(lame_internal_flags * const gfc)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
+    PsyStateVar_t *const psv = &gfc->sv_psy;
     FLOAT   gr2_max, max_pow;
 
     if (gfc->ATH->use_adjust == 0) {
-        gfc->ATH->adjust_factor = 1.0; /* no adjustment */
+        psv->ath_adjust_factor = 1.0; /* no adjustment */
         return;
     }
 
@@ -99,40 +102,40 @@ adjust_ATH(lame_internal_flags const *const gfc)
     /* towards adjust_limit gradually. */
     /* max_pow is a loudness squared or a power. */
     if (max_pow > 0.03125) { /* ((1 - 0.000625)/ 31.98) from curve below */
-        if (gfc->ATH->adjust_factor >= 1.0) {
-            gfc->ATH->adjust_factor = 1.0;
+        if (psv->ath_adjust_factor >= 1.0) {
+            psv->ath_adjust_factor = 1.0;
         }
         else {
             /* preceding frame has lower ATH adjust; */
             /* ascend only to the preceding adjust_limit */
             /* in case there is leading low volume */
-            if (gfc->ATH->adjust_factor < gfc->ATH->adjust_limit) {
-                gfc->ATH->adjust_factor = gfc->ATH->adjust_limit;
+            if (psv->ath_adjust_factor < psv->ath_adjust_limit) {
+                psv->ath_adjust_factor = psv->ath_adjust_limit;
             }
         }
-        gfc->ATH->adjust_limit = 1.0;
+        psv->ath_adjust_limit = 1.0;
     }
     else {              /* adjustment curve */
         /* about 32 dB maximum adjust (0.000625) */
         FLOAT const adj_lim_new = 31.98 * max_pow + 0.000625;
-        if (gfc->ATH->adjust_factor >= adj_lim_new) { /* descend gradually */
-            gfc->ATH->adjust_factor *= adj_lim_new * 0.075 + 0.925;
-            if (gfc->ATH->adjust_factor < adj_lim_new) { /* stop descent */
-                gfc->ATH->adjust_factor = adj_lim_new;
+        if (psv->ath_adjust_factor >= adj_lim_new) { /* descend gradually */
+            psv->ath_adjust_factor *= adj_lim_new * 0.075 + 0.925;
+            if (psv->ath_adjust_factor < adj_lim_new) { /* stop descent */
+                psv->ath_adjust_factor = adj_lim_new;
             }
         }
         else {          /* ascend */
-            if (gfc->ATH->adjust_limit >= adj_lim_new) {
-                gfc->ATH->adjust_factor = adj_lim_new;
+            if (psv->ath_adjust_limit >= adj_lim_new) {
+                psv->ath_adjust_factor = adj_lim_new;
             }
             else {      /* preceding frame has lower ATH adjust; */
                 /* ascend only to the preceding adjust_limit */
-                if (gfc->ATH->adjust_factor < gfc->ATH->adjust_limit) {
-                    gfc->ATH->adjust_factor = gfc->ATH->adjust_limit;
+                if (psv->ath_adjust_factor < psv->ath_adjust_limit) {
+                    psv->ath_adjust_factor = psv->ath_adjust_limit;
                 }
             }
         }
-        gfc->ATH->adjust_limit = adj_lim_new;
+        psv->ath_adjust_limit = adj_lim_new;
     }
 }
 
@@ -186,8 +189,25 @@ updateStats(lame_internal_flags * const gfc)
 
 
 
+/* results of the analysis stages (psymodel, MDCT and MS/LR decision)
+ * of one frame, handed over to the quantization and bitstream stages
+ */
+typedef struct {
+    III_psy_ratio masking_LR[2][2]; /*LR masking & energy */
+    III_psy_ratio masking_MS[2][2]; /*MS masking & energy */
+    FLOAT   pe[2][2];
+    FLOAT   pe_MS[2][2];
+    FLOAT   ms_ener_ratio[2];
+    FLOAT   ath_adjust_factor;
+    int     block_type[2][2];
+    int     mode_ext;
+    FLOAT   xr[2][2][576];   /* MDCT coefficients */
+} FrameAnalysis_t;
+
+
 static void
-lame_encode_frame_init(lame_internal_flags * gfc, const sample_t *const inbuf[2])
+lame_encode_frame_init(lame_internal_flags * gfc, const sample_t *const inbuf[2],
+                       FrameAnalysis_t * fa)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
 
@@ -218,10 +238,10 @@ lame_encode_frame_init(lame_internal_flags * gfc, const sample_t *const inbuf[2]
         /* polyphase filtering / mdct */
         for (gr = 0; gr < cfg->mode_gr; gr++) {
             for (ch = 0; ch < cfg->channels_out; ch++) {
-                gfc->l3_side.tt[gr][ch].block_type = SHORT_TYPE;
+                fa->block_type[gr][ch] = SHORT_TYPE;
             }
         }
-        mdct_sub48(gfc, primebuff0, primebuff1);
+        mdct_sub48(gfc, primebuff0, primebuff1, fa->block_type, fa->xr);
 
         /* check FFT will not use a negative starting offset */
 #if 576 < FFTOFFSET
@@ -302,55 +322,27 @@ FFT's                    <---------1024---------->
 typedef FLOAT chgrdata[2][2];
 
 
-int
-lame_encode_mp3_frame(       /* Output */
-                         lame_internal_flags * gfc, /* Context */
-                         sample_t const *inbuf_l, /* Input */
-                         sample_t const *inbuf_r, /* Input */
-                         unsigned char *mp3buf, /* Output */
-                         int mp3buf_size)
-{                       /* Output */
+/* Stages 1 to 3, they depend on the PCM data and on the analysis of the
+ * previous frames only. The single exception is sv_psy.masking_lower,
+ * the caller has to set it up, see calc_masking_lower.
+ */
+static int
+encode_frame_analysis(lame_internal_flags * gfc, const sample_t *const inbuf[2],
+                      FrameAnalysis_t * fa)
+{
     SessionConfig_t const *const cfg = &gfc->cfg;
-    int     mp3count;
-    III_psy_ratio masking_LR[2][2]; /*LR masking & energy */
-    III_psy_ratio masking_MS[2][2]; /*MS masking & energy */
-    const III_psy_ratio (*masking)[2]; /*pointer to selected maskings */
-    const sample_t *inbuf[2];
-
     FLOAT   tot_ener[2][4];
-    FLOAT   ms_ener_ratio[2] = { .5, .5 };
-    FLOAT   pe[2][2] = { {0., 0.}, {0., 0.} }, pe_MS[2][2] = { {
-    0., 0.}, {
-    0., 0.}};
-    FLOAT (*pe_use)[2];
-
     int     ch, gr;
 
-    inbuf[0] = inbuf_l;
-    inbuf[1] = inbuf_r;
-
     if (gfc->lame_encode_frame_init == 0) {
         /*first run? */
-        lame_encode_frame_init(gfc, inbuf);
-
-    }
-
+        lame_encode_frame_init(gfc, inbuf, fa);
 
-    /********************** padding *****************************/
-    /* padding method as described in 
-     * "MPEG-Layer3 / Bitstream Syntax and Decoding"
-     * by Martin Sieler, Ralph Sperschneider
-     *
-     * note: there is no padding for the very first frame
-     *
-     * Robert Hegemann 2000-06-22
-     */
-    gfc->ov_enc.padding = FALSE;
-    if ((gfc->sv_enc.slot_lag -= gfc->sv_enc.frac_SpF) < 0) {
-        gfc->sv_enc.slot_lag += cfg->samplerate_out;
-        gfc->ov_enc.padding = TRUE;
     }
 
+    fa->ms_ener_ratio[0] = fa->ms_ener_ratio[1] = .5;
+    memset(fa->pe, 0, sizeof(fa->pe));
+    memset(fa->pe_MS, 0, sizeof(fa->pe_MS));
 
 
     /****************************************
@@ -364,7 +356,6 @@ lame_encode_mp3_frame(       /* Output */
          */
         int     ret;
         const sample_t *bufp[2] = {0, 0}; /* address of beginning of left & right granule */
-        int     blocktype[2];
 
         for (gr = 0; gr < cfg->mode_gr; gr++) {
 
@@ -372,22 +363,16 @@ lame_encode_mp3_frame(       /* Output */
                 bufp[ch] = &inbuf[ch][576 + gr * 576 - FFTOFFSET];
             }
             ret = L3psycho_anal_vbr(gfc, bufp, gr,
-                                    masking_LR, masking_MS,
-                                    pe[gr], pe_MS[gr], tot_ener[gr], blocktype);
+                                    fa->masking_LR, fa->masking_MS,
+                                    fa->pe[gr], fa->pe_MS[gr], tot_ener[gr],
+                                    fa->block_type[gr]);
             if (ret != 0)
                 return -4;
 
             if (cfg->mode == JOINT_STEREO) {
-                ms_ener_ratio[gr] = tot_ener[gr][2] + tot_ener[gr][3];
-                if (ms_ener_ratio[gr] > 0)
-                    ms_ener_ratio[gr] = tot_ener[gr][3] / ms_ener_ratio[gr];
-            }
-
-            /* block type flags */
-            for (ch = 0; ch < cfg->channels_out; ch++) {
-                gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
-                cod_info->block_type = blocktype[ch];
-                cod_info->mixed_block_flag = 0;
+                fa->ms_ener_ratio[gr] = tot_ener[gr][2] + tot_ener[gr][3];
+                if (fa->ms_ener_ratio[gr] > 0)
+                    fa->ms_ener_ratio[gr] = tot_ener[gr][3] / fa->ms_ener_ratio[gr];
             }
         }
     }
@@ -395,6 +380,7 @@ lame_encode_mp3_frame(       /* Output */
 
     /* auto-adjust of ATH, useful for low volume */
     adjust_ATH(gfc);
+    fa->ath_adjust_factor = gfc->sv_psy.ath_adjust_factor;
 
 
     /****************************************
@@ -402,7 +388,7 @@ lame_encode_mp3_frame(       /* Output */
     ****************************************/
 
     /* polyphase filtering / mdct */
-    mdct_sub48(gfc, inbuf[0], inbuf[1]);
+    mdct_sub48(gfc, inbuf[0], inbuf[1], fa->block_type, fa->xr);
 
 
     /****************************************
@@ -410,10 +396,10 @@ lame_encode_mp3_frame(       /* Output */
     ****************************************/
 
     /* Here will be selected MS or LR coding of the 2 stereo channels */
-    gfc->ov_enc.mode_ext = MPG_MD_LR_LR;
+    fa->mode_ext = MPG_MD_LR_LR;
 
     if (cfg->force_ms) {
-        gfc->ov_enc.mode_ext = MPG_MD_MS_LR;
+        fa->mode_ext = MPG_MD_MS_LR;
     }
     else if (cfg->mode == JOINT_STEREO) {
         /* ms_ratio = is scaled, for historical reasons, to look like
@@ -432,32 +418,78 @@ lame_encode_mp3_frame(       /* Output */
         FLOAT   sum_pe_LR = 0;
         for (gr = 0; gr < cfg->mode_gr; gr++) {
             for (ch = 0; ch < cfg->channels_out; ch++) {
-                sum_pe_MS += pe_MS[gr][ch];
-                sum_pe_LR += pe[gr][ch];
+                sum_pe_MS += fa->pe_MS[gr][ch];
+                sum_pe_LR += fa->pe[gr][ch];
             }
         }
 
         /* based on PE: M/S coding would not use much more bits than L/R */
         if (sum_pe_MS <= 1.00 * sum_pe_LR) {
 
-            gr_info const *const gi0 = &gfc->l3_side.tt[0][0];
-            gr_info const *const gi1 = &gfc->l3_side.tt[cfg->mode_gr - 1][0];
+            int const *const bt0 = fa->block_type[0];
+            int const *const bt1 = fa->block_type[cfg->mode_gr - 1];
 
-            if (gi0[0].block_type == gi0[1].block_type && gi1[0].block_type == gi1[1].block_type) {
+            if (bt0[0] == bt0[1] && bt1[0] == bt1[1]) {
 
-                gfc->ov_enc.mode_ext = MPG_MD_MS_LR;
+                fa->mode_ext = MPG_MD_MS_LR;
             }
         }
     }
+    return 0;
+}
+
+
+/* Stages 4 and 5, inbuf is only used by the frame analyzer.  Without
+ * output the frame is left in the bit buffer for output_buffer()
+ */
+static int
+encode_frame_quantize(lame_internal_flags * gfc, const sample_t *const inbuf[2],
+                      FrameAnalysis_t * fa, int output, unsigned char *mp3buf, int mp3buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    int     mp3count;
+    const III_psy_ratio (*masking)[2]; /*pointer to selected maskings */
+    FLOAT (*pe_use)[2];
+
+    int     ch, gr;
+
+
+    /********************** padding *****************************/
+    /* padding method as described in 
+     * "MPEG-Layer3 / Bitstream Syntax and Decoding"
+     * by Martin Sieler, Ralph Sperschneider
+     *
+     * note: there is no padding for the very first frame
+     *
+     * Robert Hegemann 2000-06-22
+     */
+    gfc->ov_enc.padding = FALSE;
+    if ((gfc->sv_enc.slot_lag -= gfc->sv_enc.frac_SpF) < 0) {
+        gfc->sv_enc.slot_lag += cfg->samplerate_out;
+        gfc->ov_enc.padding = TRUE;
+    }
+
+
+    /* take over the analysis results */
+    for (gr = 0; gr < cfg->mode_gr; gr++) {
+        for (ch = 0; ch < cfg->channels_out; ch++) {
+            gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
+            cod_info->block_type = fa->block_type[gr][ch];
+            cod_info->mixed_block_flag = 0;
+            memcpy(cod_info->xr, fa->xr[gr][ch], sizeof(cod_info->xr));
+        }
+    }
+    gfc->sv_qnt.ath_adjust_factor = fa->ath_adjust_factor;
+    gfc->ov_enc.mode_ext = fa->mode_ext;
 
     /* bit and noise allocation */
     if (gfc->ov_enc.mode_ext == MPG_MD_MS_LR) {
-        masking = (const III_psy_ratio (*)[2])masking_MS; /* use MS masking */
-        pe_use = pe_MS;
+        masking = (const III_psy_ratio (*)[2])fa->masking_MS; /* use MS masking */
+        pe_use = fa->pe_MS;
     }
     else {
-        masking = (const III_psy_ratio (*)[2])masking_LR; /* use LR masking */
-        pe_use = pe;
+        masking = (const III_psy_ratio (*)[2])fa->masking_LR; /* use LR masking */
+        pe_use = fa->pe;
     }
 
 
@@ -466,7 +498,7 @@ lame_encode_mp3_frame(       /* Output */
         for (gr = 0; gr < cfg->mode_gr; gr++) {
             for (ch = 0; ch < cfg->channels_out; ch++) {
                 gfc->pinfo->ms_ratio[gr] = 0;
-                gfc->pinfo->ms_ener_ratio[gr] = ms_ener_ratio[gr];
+                gfc->pinfo->ms_ener_ratio[gr] = fa->ms_ener_ratio[gr];
                 gfc->pinfo->blocktype[gr][ch] = gfc->l3_side.tt[gr][ch].block_type;
                 gfc->pinfo->pe[gr][ch] = pe_use[gr][ch];
                 memcpy(gfc->pinfo->xr[gr][ch], &gfc->l3_side.tt[gr][ch].xr[0], sizeof(FLOAT) * 576);
@@ -520,17 +552,17 @@ lame_encode_mp3_frame(       /* Output */
     {
     default:
     case vbr_off:
-        CBR_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
+        CBR_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, fa->ms_ener_ratio, masking);
         break;
     case vbr_abr:
-        ABR_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
+        ABR_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, fa->ms_ener_ratio, masking);
         break;
     case vbr_rh:
-        VBR_old_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
+        VBR_old_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, fa->ms_ener_ratio, masking);
         break;
     case vbr_mt:
     case vbr_mtrh:
-        VBR_new_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
+        VBR_new_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, fa->ms_ener_ratio, masking);
         break;
     }
 
@@ -544,7 +576,7 @@ lame_encode_mp3_frame(       /* Output */
     (void) format_bitstream(gfc);
 
     /* copy mp3 bit buffer into array */
-    mp3count = copy_buffer(gfc, mp3buf, mp3buf_size, 1);
+    mp3count = output ? output_buffer(gfc, mp3buf, mp3buf_size, 1) : 0;
 
 
     if (cfg->write_lame_tag) {
@@ -572,3 +604,239 @@ lame_encode_mp3_frame(       /* Output */
 
     return mp3count;
 }
+
+
+int
+lame_encode_mp3_frame(       /* Output */
+                         lame_internal_flags * gfc, /* Context */
+                         sample_t const *inbuf_l, /* Input */
+                         sample_t const *inbuf_r, /* Input */
+                         unsigned char *mp3buf, /* Output */
+                         int mp3buf_size)
+{                       /* Output */
+    FrameAnalysis_t fa;
+    const sample_t *inbuf[2];
+    int     ret;
+
+    inbuf[0] = inbuf_l;
+    inbuf[1] = inbuf_r;
+
+    if (gfc->sv_pipe != 0) {
+        return pipeline_encode_frame(gfc, inbuf_l, inbuf_r, mp3buf, mp3buf_size);
+    }
+
+    gfc->sv_psy.masking_lower = gfc->sv_qnt.masking_lower;
+    ret = encode_frame_analysis(gfc, inbuf, &fa);
+    if (ret != 0)
+        return ret;
+    return encode_frame_quantize(gfc, inbuf, &fa, 1, mp3buf, mp3buf_size);
+}
+
+
+
+/************************************************************************
+*
+* pipelined encoding
+*
+* The analysis of frame N+1 runs on one thread while frame N is quantized
+* and written to the bitstream on another one. The output is identical
+* to the serial encoder, but delayed by one frame. It is handed out by the
+* calling thread once both are done, so an output function never runs on
+* a thread of the pool.
+*
+* The psymodel of frame N+1 needs sv_qnt.masking_lower as the iteration
+* loops leave it behind for frame N. That value only depends on block type
+* and PE of the last granule, so it is known before frame N is quantized.
+*
+************************************************************************/
+
+struct PipelineState_t {
+    FrameAnalysis_t frame[2];
+    int     current;         /* frame waiting for quantization */
+    int     pending;         /* 1 if there is such a frame */
+};
+
+typedef struct {
+    lame_internal_flags *gfc;
+    const sample_t *inbuf[2];
+    FrameAnalysis_t *fa;
+    int     analyze;         /* 1: stages 1 to 3, 0: stages 4 and 5 */
+    int     ret;
+} PipelineJob_t;
+
+
+static void
+pipeline_job(void *arg)
+{
+    PipelineJob_t *const job = (PipelineJob_t *) arg;
+
+    if (job->analyze) {
+        job->ret = encode_frame_analysis(job->gfc, job->inbuf, job->fa);
+    }
+    else {
+        job->ret = encode_frame_quantize(job->gfc, 0, job->fa, 0, 0, 0);
+    }
+}
+
+
+int
+pipeline_init(lame_internal_flags * gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+
+    pipeline_free(gfc);
+    if (!cfg->pipeline || gfc->thread_pool == 0 || gfc->sv_seg != 0) {
+        return 1;
+    }
+    /* the frame analyzer wants all stages of a frame at once */
+    if (cfg->analysis) {
+        return 1;
+    }
+    gfc->sv_pipe = gfc_calloc(gfc, PipelineState_t, 1);
+    if (gfc->sv_pipe == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+void
+pipeline_free(lame_internal_flags * gfc)
+{
+    if (gfc->sv_pipe != 0) {
+        gfc_free(gfc, gfc->sv_pipe);
+        gfc->sv_pipe = 0;
+    }
+}
+
+
+void
+pipeline_reset(lame_internal_flags * gfc)
+{
+    if (gfc->sv_pipe != 0) {
+        gfc->sv_pipe->current = 0;
+        gfc->sv_pipe->pending = 0;
+    }
+}
+
+
+int
+pipeline_pending_frames(lame_internal_flags const *gfc)
+{
+    if (gfc->sv_pipe != 0) {
+        return gfc->sv_pipe->pending;
+    }
+    return 0;
+}
+
+
+void
+pipeline_state(lame_internal_flags * gfc, StateIO_t * io)
+{
+    PipelineState_t *const ps = gfc->sv_pipe;
+    int const pending = state_count(io, ps->pending, 1);
+
+    if (state_restoring(io)) {
+        ps->current = 0;
+        ps->pending = pending;
+    }
+    if (pending) {
+        SessionConfig_t const *const cfg = &gfc->cfg;
+        FrameAnalysis_t fa = ps->frame[ps->current];
+        int     gr, ch, ok;
+
+        state_copy(io, &fa, sizeof(fa));
+        ok = fa.mode_ext == MPG_MD_LR_LR || fa.mode_ext == MPG_MD_MS_LR;
+        for (gr = 0; gr < cfg->mode_gr; gr++) {
+            for (ch = 0; ch < cfg->channels_out; ch++) {
+                ok &= NORM_TYPE <= fa.block_type[gr][ch] && fa.block_type[gr][ch] <= STOP_TYPE;
+            }
+        }
+        state_check(io, ok);
+        if (state_restoring(io)) {
+            ps->frame[ps->current] = fa;
+        }
+    }
+}
+
+
+uint32_t
+pipeline_layout(uint32_t h)
+{
+    static const size_t layout[] = {
+        STATE_FIELD(FrameAnalysis_t, masking_LR), STATE_FIELD(FrameAnalysis_t, masking_MS),
+        STATE_FIELD(FrameAnalysis_t, pe), STATE_FIELD(FrameAnalysis_t, pe_MS),
+        STATE_FIELD(FrameAnalysis_t, ms_ener_ratio),
+        STATE_FIELD(FrameAnalysis_t, ath_adjust_factor),
+        STATE_FIELD(FrameAnalysis_t, block_type), STATE_FIELD(FrameAnalysis_t, mode_ext),
+        STATE_FIELD(FrameAnalysis_t, xr), sizeof(FrameAnalysis_t)
+    };
+
+    return state_layout(h, layout, sizeof(layout) / sizeof(layout[0]));
+}
+
+
+int
+pipeline_encode_frame(lame_internal_flags * gfc, sample_t const *inbuf_l,
+                      sample_t const *inbuf_r, unsigned char *mp3buf, int mp3buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    PipelineState_t *const pv = gfc->sv_pipe;
+    PipelineJob_t job[2];
+    FrameAnalysis_t *fa;
+    int     gr, ch;
+
+    memset(job, 0, sizeof(job));
+    job[0].gfc = gfc;
+    job[0].inbuf[0] = inbuf_l;
+    job[0].inbuf[1] = inbuf_r;
+    job[0].analyze = 1;
+
+    if (!pv->pending) {
+        /* nothing to quantize yet */
+        gfc->sv_psy.masking_lower = gfc->sv_qnt.masking_lower;
+        job[0].fa = &pv->frame[pv->current];
+        pipeline_job(&job[0]);
+        if (job[0].ret != 0)
+            return job[0].ret;
+        pv->pending = 1;
+        return 0;
+    }
+
+    fa = &pv->frame[pv->current];
+    gr = cfg->mode_gr - 1;
+    ch = cfg->channels_out - 1;
+    gfc->sv_psy.masking_lower = calc_masking_lower(gfc, fa->block_type[gr][ch],
+                                                   fa->mode_ext == MPG_MD_MS_LR ?
+                                                   fa->pe_MS[gr][ch] : fa->pe[gr][ch]);
+
+    job[0].fa = &pv->frame[1 - pv->current];
+    job[1].gfc = gfc;
+    job[1].fa = fa;
+    thread_pool_run(gfc->thread_pool, pipeline_job, job, sizeof(job[0]), 2);
+
+    assert(gfc->sv_qnt.masking_lower == gfc->sv_psy.masking_lower);
+    pv->current = 1 - pv->current;
+    if (job[0].ret != 0) {
+        pv->pending = 0;
+        return job[0].ret;
+    }
+    if (job[1].ret < 0) {
+        return job[1].ret;
+    }
+    /* here, so an output function is called by the thread of the caller */
+    return output_buffer(gfc, mp3buf, mp3buf_size, 1);
+}
+
+
+int
+pipeline_flush(lame_internal_flags * gfc, unsigned char *mp3buf, int mp3buf_size)
+{
+    PipelineState_t *const pv = gfc->sv_pipe;
+
+    if (pv == 0 || !pv->pending) {
+        return 0;
+    }
+    pv->pending = 0;
+    return encode_frame_quantize(gfc, 0, &pv->frame[pv->current], 1, mp3buf, mp3buf_size);
+}
@@ -153,4 +153,30 @@ int     lame_encode_mp3_frame(lame_internal_flags * gfc,
                               sample_t const *inbuf_l,
                               sample_t const *inbuf_r, unsigned char *mp3buf, int mp3buf_size);
 
+/* pipelined encoding, the analysis of the next frame runs in parallel to
+ * the quantization of the current one. lame_encode_mp3_frame uses it when
+ * pipeline_init returned 0, its output is then delayed by one frame.
+ */
+struct PipelineState_t;
+typedef struct PipelineState_t PipelineState_t;
+
+int     pipeline_init(lame_internal_flags * gfc);
+void    pipeline_free(lame_internal_flags * gfc);
+void    pipeline_reset(lame_internal_flags * gfc);
+int     pipeline_encode_frame(lame_internal_flags * gfc, sample_t const *inbuf_l,
+                              sample_t const *inbuf_r, unsigned char *mp3buf, int mp3buf_size);
+
+/* number of analyzed frames not yet quantized, 0 or 1 */
+int     pipeline_pending_frames(lame_internal_flags const *gfc);
+
+/* quantizes the pending frame, if there is one */
+int     pipeline_flush(lame_internal_flags * gfc, unsigned char *mp3buf, int mp3buf_size);
+
+/* saves or restores the pending frame, see state.c */
+struct StateIO_t;
+void    pipeline_state(lame_internal_flags * gfc, struct StateIO_t *io);
+
+/* adds the layout of the pending frame to the snapshot fingerprint h */
+uint32_t pipeline_layout(uint32_t h);
+
 #endif /* LAME_ENCODER_H */
@@ -304,7 +304,18 @@ extern void fht_SSE(FLOAT * fz, int n);
 #endif
 
 void
-init_fft(lame_internal_flags * const gfc)
+init_fft_tables(void)
+{
+#ifdef HAVE_IMMINTRIN_H
+    fht_avx2_init();
+#endif
+#ifdef HAVE_ARM_NEON_H
+    fht_neon_init();
+#endif
+}
+
+void
+init_fft_windows(FLOAT window[BLKSIZE], FLOAT window_s[BLKSIZE_s / 2])
 {
     int     i;
 
@@ -312,12 +323,16 @@ init_fft(lame_internal_flags * const gfc)
     /* in the interest of merging nspsytune stuff - switch to blackman window */
     for (i = 0; i < BLKSIZE; i++)
         /* blackman window */
-        gfc->cd_psy->window[i] = 0.42 - 0.5 * cos(2 * PI * (i + .5) / BLKSIZE) +
+        window[i] = 0.42 - 0.5 * cos(2 * PI * (i + .5) / BLKSIZE) +
             0.08 * cos(4 * PI * (i + .5) / BLKSIZE);
 
     for (i = 0; i < BLKSIZE_s / 2; i++)
-        gfc->cd_psy->window_s[i] = 0.5 * (1.0 - cos(2.0 * PI * (i + 0.5) / BLKSIZE_s));
+        window_s[i] = 0.5 * (1.0 - cos(2.0 * PI * (i + 0.5) / BLKSIZE_s));
+}
 
+void
+init_fft(lame_internal_flags * const gfc)
+{
     gfc->fft_fht = fht;
 #ifdef HAVE_NASM
     if (gfc->CPU_features.AMD_3DNow) {
@@ -331,9 +346,19 @@ init_fft(lame_internal_flags * const gfc)
     }
 #else
 #ifdef HAVE_XMMINTRIN_H
-#ifdef MIN_ARCH_SSE
-    gfc->fft_fht = fht_SSE2;
+#if defined(MIN_ARCH_SSE) || defined(__x86_64__) || defined(_M_X64)
+    if (gfc->CPU_features.SSE2) {
+        gfc->fft_fht = fht_SSE2;
+    }
 #endif
 #endif
 #endif
+#ifdef HAVE_IMMINTRIN_H
+    if (gfc->CPU_features.AVX2) {
+        gfc->fft_fht = fht_AVX2;
+    }
+#endif
+#ifdef HAVE_ARM_NEON_H
+    gfc->fft_fht = fht_NEON;
+#endif
 }
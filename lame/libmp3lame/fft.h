@@ -28,6 +28,8 @@ void    fft_long(lame_internal_flags const *const gfc, FLOAT x_real[BLKSIZE],
 void    fft_short(lame_internal_flags const *const gfc, FLOAT x_real[3][BLKSIZE_s],
                   int chn, const sample_t *const data[2]);
 
+void    init_fft_tables(void);
+void    init_fft_windows(FLOAT window[BLKSIZE], FLOAT window_s[BLKSIZE_s / 2]);
 void    init_fft(lame_internal_flags * const gfc);
 
 #endif
@@ -408,12 +408,12 @@ fromLatin1Char(const unsigned short* s, unsigned short c)
 
 
 static  size_t
-local_strdup(char **dst, const char *src)
+local_strdup(lame_internal_flags * gfc, char **dst, const char *src)
 {
     if (dst == 0) {
         return 0;
     }
-    free(*dst);
+    gfc_free(gfc, *dst);
     *dst = 0;
     if (src != 0) {
         size_t  n;
@@ -421,7 +421,7 @@ local_strdup(char **dst, const char *src)
         }
         if (n > 0) {    /* string length without zero termination */
             assert(sizeof(*src) == sizeof(**dst));
-            *dst = lame_calloc(char, n + 1);
+            *dst = gfc_calloc(gfc, char, n + 1);
             if (*dst != 0) {
                 memcpy(*dst, src, n * sizeof(**dst));
                 (*dst)[n] = 0;
@@ -433,12 +433,12 @@ local_strdup(char **dst, const char *src)
 }
 
 static  size_t
-local_ucs2_strdup(unsigned short **dst, unsigned short const *src)
+local_ucs2_strdup(lame_internal_flags * gfc, unsigned short **dst, unsigned short const *src)
 {
     if (dst == 0) {
         return 0;
     }
-    free(*dst);         /* free old string pointer */
+    gfc_free(gfc, *dst); /* free old string pointer */
     *dst = 0;
     if (src != 0) {
         size_t  n;
@@ -447,7 +447,7 @@ local_ucs2_strdup(unsigned short **dst, unsigned short const *src)
         if (n > 0) {    /* string length without zero termination */
             assert(sizeof(*src) >= 2);
             assert(sizeof(*src) == sizeof(**dst));
-            *dst = lame_calloc(unsigned short, n + 1);
+            *dst = gfc_calloc(gfc, unsigned short, n + 1);
             if (*dst != 0) {
                 memcpy(*dst, src, n * sizeof(**dst));
                 (*dst)[n] = 0;
@@ -641,7 +641,7 @@ id3tag_set_albumart(lame_t gfp, const char *image, size_t size)
         }
     }
     if (gfc->tag_spec.albumart != 0) {
-        free(gfc->tag_spec.albumart);
+        gfc_free(gfc, gfc->tag_spec.albumart);
         gfc->tag_spec.albumart = 0;
         gfc->tag_spec.albumart_size = 0;
         gfc->tag_spec.albumart_mimetype = MIMETYPE_NONE;
@@ -649,7 +649,7 @@ id3tag_set_albumart(lame_t gfp, const char *image, size_t size)
     if (size < 1 || mimetype == MIMETYPE_NONE) {
         return 0;
     }
-    gfc->tag_spec.albumart = lame_calloc(unsigned char, size);
+    gfc->tag_spec.albumart = gfc_calloc(gfc, unsigned char, size);
     if (gfc->tag_spec.albumart != 0) {
         memcpy(gfc->tag_spec.albumart, image, size);
         gfc->tag_spec.albumart_size = (unsigned int)size;
@@ -881,7 +881,7 @@ id3v2_add_ucs2(lame_t gfp, uint32_t frame_id, char const *lng, unsigned short co
             }
         }
         if (node == 0) {
-            node = lame_calloc(FrameDataNode, 1);
+            node = gfc_calloc(gfc, FrameDataNode, 1);
             if (node == 0) {
                 return -254; /* memory problem */
             }
@@ -889,9 +889,9 @@ id3v2_add_ucs2(lame_t gfp, uint32_t frame_id, char const *lng, unsigned short co
         }
         node->fid = frame_id;
         setLang(node->lng, lang);
-        node->dsc.dim = local_ucs2_strdup(&node->dsc.ptr.u, desc);
+        node->dsc.dim = local_ucs2_strdup(gfc, &node->dsc.ptr.u, desc);
         node->dsc.enc = 1;
-        node->txt.dim = local_ucs2_strdup(&node->txt.ptr.u, text);
+        node->txt.dim = local_ucs2_strdup(gfc, &node->txt.ptr.u, text);
         node->txt.enc = 1;
         gfc->tag_spec.flags |= (CHANGED_FLAG | ADD_V2_FLAG);
         return 0;
@@ -918,7 +918,7 @@ id3v2_add_latin1(lame_t gfp, uint32_t frame_id, char const *lng, char const *des
             }
         }
         if (node == 0) {
-            node = lame_calloc(FrameDataNode, 1);
+            node = gfc_calloc(gfc, FrameDataNode, 1);
             if (node == 0) {
                 return -254; /* memory problem */
             }
@@ -926,9 +926,9 @@ id3v2_add_latin1(lame_t gfp, uint32_t frame_id, char const *lng, char const *des
         }
         node->fid = frame_id;
         setLang(node->lng, lang);
-        node->dsc.dim = local_strdup(&node->dsc.ptr.l, desc);
+        node->dsc.dim = local_strdup(gfc, &node->dsc.ptr.l, desc);
         node->dsc.enc = 0;
-        node->txt.dim = local_strdup(&node->txt.ptr.l, text);
+        node->txt.dim = local_strdup(gfc, &node->txt.ptr.l, text);
         node->txt.enc = 0;
         gfc->tag_spec.flags |= (CHANGED_FLAG | ADD_V2_FLAG);
         return 0;
@@ -961,15 +961,16 @@ id3v2_add_latin1_lng(lame_t gfp, uint32_t frame_id, char const *desc, char const
 static int
 id3tag_set_userinfo_latin1(lame_t gfp, uint32_t id, char const *fieldvalue)
 {
+    lame_internal_flags *gfc = gfp->internal_flags;
     char const separator = '=';
     int     rc = -7;
     int     a = local_char_pos(fieldvalue, separator);
     if (a >= 0) {
         char*   dup = 0;
-        local_strdup(&dup, fieldvalue);
+        local_strdup(gfc, &dup, fieldvalue);
         dup[a] = 0;
         rc = id3v2_add_latin1_lng(gfp, id, dup, dup+a+1);
-        free(dup);
+        gfc_free(gfc, dup);
     }
     return rc;
 }
@@ -1118,7 +1119,7 @@ id3tag_set_title(lame_t gfp, const char *title)
 {
     lame_internal_flags *gfc = gfp != 0 ? gfp->internal_flags : 0;
     if (gfc && title && *title) {
-        local_strdup(&gfc->tag_spec.title, title);
+        local_strdup(gfc, &gfc->tag_spec.title, title);
         gfc->tag_spec.flags |= CHANGED_FLAG;
         copyV1ToV2(gfp, ID_TITLE, title);
     }
@@ -1129,7 +1130,7 @@ id3tag_set_artist(lame_t gfp, const char *artist)
 {
     lame_internal_flags *gfc = gfp != 0 ? gfp->internal_flags : 0;
     if (gfc && artist && *artist) {
-        local_strdup(&gfc->tag_spec.artist, artist);
+        local_strdup(gfc, &gfc->tag_spec.artist, artist);
         gfc->tag_spec.flags |= CHANGED_FLAG;
         copyV1ToV2(gfp, ID_ARTIST, artist);
     }
@@ -1140,7 +1141,7 @@ id3tag_set_album(lame_t gfp, const char *album)
 {
     lame_internal_flags *gfc = gfp != 0 ? gfp->internal_flags : 0;
     if (gfc && album && *album) {
-        local_strdup(&gfc->tag_spec.album, album);
+        local_strdup(gfc, &gfc->tag_spec.album, album);
         gfc->tag_spec.flags |= CHANGED_FLAG;
         copyV1ToV2(gfp, ID_ALBUM, album);
     }
@@ -1172,7 +1173,7 @@ id3tag_set_comment(lame_t gfp, const char *comment)
 {
     lame_internal_flags *gfc = gfp != 0 ? gfp->internal_flags : 0;
     if (gfc && comment && *comment) {
-        local_strdup(&gfc->tag_spec.comment, comment);
+        local_strdup(gfc, &gfc->tag_spec.comment, comment);
         gfc->tag_spec.flags |= CHANGED_FLAG;
         {
             uint32_t const flags = gfc->tag_spec.flags;
@@ -1824,12 +1825,10 @@ id3tag_write_v2(lame_t gfp)
             free(tag);
             return -1;
         }
-        else {
-            size_t  i;
-            /* write tag directly into bitstream at current position */
-            for (i = 0; i < tag_size; ++i) {
-                add_dummy_byte(gfc, tag[i], 1);
-            }
+        /* write tag directly into bitstream at current position */
+        if (add_dummy_bytes(gfc, tag, tag_size) < 0) {
+            free(tag);
+            return -1;
         }
         free(tag);
         return (int) tag_size; /* ok, tag should not exceed 2GB */
@@ -1905,7 +1904,7 @@ int
 id3tag_write_v1(lame_t gfp)
 {
     lame_internal_flags* gfc = 0;
-    size_t  i, n, m;
+    size_t  n, m;
     unsigned char tag[128];
 
     if (is_lame_internal_flags_null(gfp)) {
@@ -1919,8 +1918,8 @@ id3tag_write_v1(lame_t gfp)
         return 0;
     }
     /* write tag directly into bitstream at current position */
-    for (i = 0; i < n; ++i) {
-        add_dummy_byte(gfc, tag[i], 1);
+    if (add_dummy_bytes(gfc, tag, n) < 0) {
+        return -1;
     }
     return (int) n;     /* ok, tag has fixed size of 128 bytes, well below 2GB */
 }
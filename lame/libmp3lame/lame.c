@@ -43,9 +43,14 @@
 #include "set_get.h"
 #include "quantize.h"
 #include "psymodel.h"
+#include "newmdct.h"
 #include "version.h"
 #include "VbrTag.h"
 #include "tables.h"
+#include "threadpool.h"
+#include "segment.h"
+#include "session.h"
+#include "fft.h"
 
 
 #if defined(__FreeBSD__) && !defined(__alpha__)
@@ -488,6 +493,88 @@ linear_int(double a, double b, double m)
 
 
 
+static void
+init_decode_on_the_fly(lame_global_flags const *gfp)
+{
+#ifdef DECODE_ON_THE_FLY
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    if (gfc->cfg.decode_on_the_fly && !gfp->decode_only) {
+        if (gfc->hip) {
+            hip_decode_exit(gfc->hip);
+        }
+        gfc->hip = hip_decode_init();
+        /* report functions */
+        hip_set_errorf(gfc->hip, gfp->report.errorf);
+        hip_set_debugf(gfc->hip, gfp->report.debugf);
+        hip_set_msgf(gfc->hip, gfp->report.msgf);
+    }
+#else
+    (void) gfp;
+#endif
+}
+
+
+static int
+calcNeeded(SessionConfig_t const * cfg)
+{
+    int     mf_needed;
+    int     pcm_samples_per_frame = 576 * cfg->mode_gr;
+
+    /* some sanity checks */
+#if ENCDELAY < MDCTDELAY
+# error ENCDELAY is less than MDCTDELAY, see encoder.h
+#endif
+#if FFTOFFSET > BLKSIZE
+# error FFTOFFSET is greater than BLKSIZE, see encoder.h
+#endif
+
+    mf_needed = BLKSIZE + pcm_samples_per_frame - FFTOFFSET; /* amount needed for FFT */
+    /*mf_needed = Max(mf_needed, 286 + 576 * (1 + gfc->mode_gr)); */
+    mf_needed = Max(mf_needed, 512 + pcm_samples_per_frame - 32);
+
+    assert(MFSIZE >= mf_needed);
+    
+    return mf_needed;
+}
+
+
+/* mf_bufsize samples of input for each output channel.  With compact_memory
+ * there is room for one frame more than calcNeeded(), otherwise for the
+ * sliding window of MFBUFSIZE.
+ */
+static int
+mfbuf_init(lame_internal_flags * gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+
+    if (esv->mfbuf[1] != esv->mfbuf[0]) {
+        gfc_free(gfc, esv->mfbuf[1]);
+    }
+    gfc_free(gfc, esv->mfbuf[0]);
+    esv->mfbuf[0] = esv->mfbuf[1] = 0;
+
+    if (cfg->compact_memory) {
+        esv->mf_window = 576 * cfg->mode_gr;
+        esv->mf_bufsize = calcNeeded(cfg) + esv->mf_window;
+    }
+    else {
+        esv->mf_window = MFBUFSIZE - MFSIZE;
+        esv->mf_bufsize = MFBUFSIZE;
+    }
+    esv->mfbuf[0] = gfc_calloc(gfc, sample_t, esv->mf_bufsize);
+    esv->mfbuf[1] = esv->mfbuf[0];
+    if (cfg->channels_out == 2) {
+        esv->mfbuf[1] = gfc_calloc(gfc, sample_t, esv->mf_bufsize);
+    }
+    if (esv->mfbuf[0] == 0 || esv->mfbuf[1] == 0) {
+        ERRORF(gfc, "Error: can't allocate mfbuf\n");
+        return -2;
+    }
+    return 0;
+}
+
+
 /********************************************************************
  *   initialize internal params based on data in gf
  *   (globalflags struct filled in by calling program)
@@ -544,6 +631,7 @@ lame_init_params(lame_global_flags * gfp)
     int     j;
     lame_internal_flags *gfc;
     SessionConfig_t *cfg;
+    lame_global_flags user_gfp;
 
     if (!is_lame_global_flags_valid(gfp)) 
         return -1;
@@ -555,6 +643,9 @@ lame_init_params(lame_global_flags * gfp)
     if (is_lame_internal_flags_valid(gfc))
         return -1; /* already initialized */
 
+    /* keep the settings as given, segmented encoding needs them */
+    user_gfp = *gfp;
+
     /* start updating lame internal flags */
     gfc->class_id = LAME_ID;
     gfc->lame_init_params_successful = 0; /* will be set to one, when we get through until the end */
@@ -584,6 +675,8 @@ lame_init_params(lame_global_flags * gfp)
     gfc->report_msg = gfp->report.msgf;
     gfc->report_dbg = gfp->report.debugf;
     gfc->report_err = gfp->report.errorf;
+    gfc->output_func = gfp->output.func;
+    gfc->output_data = gfp->output.user_data;
 
     if (gfp->asm_optimizations.amd3dnow)
         gfc->CPU_features.AMD_3DNow = has_3DNow();
@@ -598,10 +691,14 @@ lame_init_params(lame_global_flags * gfp)
     if (gfp->asm_optimizations.sse) {
         gfc->CPU_features.SSE = has_SSE();
         gfc->CPU_features.SSE2 = has_SSE2();
+        gfc->CPU_features.AVX2 = has_AVX2();
+        gfc->CPU_features.AVX512 = has_AVX512();
     }
     else {
         gfc->CPU_features.SSE = 0;
         gfc->CPU_features.SSE2 = 0;
+        gfc->CPU_features.AVX2 = 0;
+        gfc->CPU_features.AVX512 = 0;
     }
 
 
@@ -936,8 +1033,6 @@ lame_init_params(lame_global_flags * gfp)
         gfc->ov_enc.bitrate_index = 1;
     }
 
-    init_bit_stream_w(gfc);
-
     j = cfg->samplerate_index + (3 * cfg->version) + 6 * (cfg->samplerate_out < 16000);
     for (i = 0; i < SBMAX_l + 1; i++)
         gfc->scalefac_band.l[i] = sfBandIndex[j].l[i];
@@ -968,6 +1063,12 @@ lame_init_params(lame_global_flags * gfp)
     if (cfg->error_protection)
         cfg->sideinfo_len += 2;
 
+    /* bit buffer and input buffer, see lame_set_compact_memory() */
+    cfg->compact_memory = gfp->compact_memory;
+    if (init_bit_stream_w(gfc) < 0 || mfbuf_init(gfc) < 0) {
+        return -2;
+    }
+
     {
         int     k;
 
@@ -1275,8 +1376,18 @@ lame_init_params(lame_global_flags * gfp)
 
     (void) lame_init_bitstream(gfp);
 
+    /* ATH, psymodel and resampling tables, maybe from another encoder */
+    if (session_tables_attach(gfp) < 0) {
+        return -2;
+    }
+    if (isResamplingNecessary(cfg) && fill_buffer_resample_init(gfc) < 0) {
+        return -2;
+    }
     iteration_init(gfc);
-    (void) psymodel_init(gfp);
+    if (psymodel_init(gfp) == 0) {
+        session_tables_publish(gfc);
+    }
+    init_mdct(gfc);
 
     cfg->buffer_constraint = get_max_frame_buffer_size_by_constraint(cfg, gfp->strict_ISO);
 
@@ -1288,6 +1399,12 @@ lame_init_params(lame_global_flags * gfp)
         cfg->findPeakSample = 1;
 
     if (cfg->findReplayGain) {
+        if (gfc->sv_rpg.rgdata == 0) {
+            gfc->sv_rpg.rgdata = gfc_calloc(gfc, replaygain_t, 1);
+            if (gfc->sv_rpg.rgdata == 0) {
+                return -2;
+            }
+        }
         if (InitGainAnalysis(gfc->sv_rpg.rgdata, cfg->samplerate_out) == INIT_GAIN_ANALYSIS_ERROR) {
             /* Actually this never happens, our samplerates are the ones RG accepts!
              * But just in case, turn RG off
@@ -1297,18 +1414,22 @@ lame_init_params(lame_global_flags * gfp)
         }
     }
 
-#ifdef DECODE_ON_THE_FLY
-    if (cfg->decode_on_the_fly && !gfp->decode_only) {
-        if (gfc->hip) {
-            hip_decode_exit(gfc->hip);
-        }
-        gfc->hip = hip_decode_init();
-        /* report functions */
-        hip_set_errorf(gfc->hip, gfp->report.errorf);
-        hip_set_debugf(gfc->hip, gfp->report.debugf);
-        hip_set_msgf(gfc->hip, gfp->report.msgf);
+    init_decode_on_the_fly(gfp);
+
+    cfg->num_threads = gfp->num_threads;
+    cfg->segment_frames = gfp->segment_frames;
+    cfg->pipeline = gfp->pipeline;
+    cfg->parallel_quantization = gfp->parallel_quantization;
+    if (cfg->num_threads > 1) {
+        gfc->thread_pool = thread_pool_create(gfc, cfg->num_threads);
     }
-#endif
+    if (segment_init(gfc, &user_gfp) < 0) {
+        return -2;
+    }
+    if (pipeline_init(gfc) < 0) {
+        return -2;
+    }
+
     /* updating lame internal flags finished successful */
     gfc->lame_init_params_successful = 1;
     return 0;
@@ -1344,7 +1465,8 @@ lame_print_config(const lame_global_flags * gfp)
     MSGF(gfc, "warning: alpha versions should be used for testing only\n");
 #endif
     if (gfc->CPU_features.MMX
-        || gfc->CPU_features.AMD_3DNow || gfc->CPU_features.SSE || gfc->CPU_features.SSE2) {
+        || gfc->CPU_features.AMD_3DNow || gfc->CPU_features.SSE || gfc->CPU_features.SSE2
+        || gfc->CPU_features.AVX2 || gfc->CPU_features.AVX512) {
         char    text[256] = { 0 };
         int     fft_asm_used = 0;
 #ifdef HAVE_NASM
@@ -1355,7 +1477,7 @@ lame_print_config(const lame_global_flags * gfp)
             fft_asm_used = 2;
         }
 #else
-# if defined( HAVE_XMMINTRIN_H ) && defined( MIN_ARCH_SSE )
+# if defined( HAVE_XMMINTRIN_H ) && ( defined( MIN_ARCH_SSE ) || defined( __x86_64__ ) || defined( _M_X64 ) )
         {
             fft_asm_used = 3;
         }
@@ -1381,6 +1503,20 @@ lame_print_config(const lame_global_flags * gfp)
         if (gfc->CPU_features.SSE2) {
             concatSep(text, ", ", (fft_asm_used == 3) ? "SSE2 (ASM used)" : "SSE2");
         }
+        if (gfc->CPU_features.AVX2) {
+#if defined(HAVE_IMMINTRIN_H)
+            concatSep(text, ", ", "AVX2 (ASM used)");
+#else
+            concatSep(text, ", ", "AVX2");
+#endif
+        }
+        if (gfc->CPU_features.AVX512) {
+#if defined(HAVE_IMMINTRIN_H)
+            concatSep(text, ", ", "AVX-512 (ASM used)");
+#else
+            concatSep(text, ", ", "AVX-512");
+#endif
+        }
         MSGF(gfc, "CPU features: %s\n", text);
     }
 
@@ -1631,21 +1767,21 @@ update_inbuffer_size(lame_internal_flags * gfc, const int nsamples)
     EncStateVar_t *const esv = &gfc->sv_enc;
     if (esv->in_buffer_0 == 0 || esv->in_buffer_nsamples < nsamples) {
         if (esv->in_buffer_0) {
-            free(esv->in_buffer_0);
+            gfc_free(gfc, esv->in_buffer_0);
         }
         if (esv->in_buffer_1) {
-            free(esv->in_buffer_1);
+            gfc_free(gfc, esv->in_buffer_1);
         }
-        esv->in_buffer_0 = lame_calloc(sample_t, nsamples);
-        esv->in_buffer_1 = lame_calloc(sample_t, nsamples);
+        esv->in_buffer_0 = gfc_calloc(gfc, sample_t, nsamples);
+        esv->in_buffer_1 = gfc_calloc(gfc, sample_t, nsamples);
         esv->in_buffer_nsamples = nsamples;
     }
     if (esv->in_buffer_0 == NULL || esv->in_buffer_1 == NULL) {
         if (esv->in_buffer_0) {
-            free(esv->in_buffer_0);
+            gfc_free(gfc, esv->in_buffer_0);
         }
         if (esv->in_buffer_1) {
-            free(esv->in_buffer_1);
+            gfc_free(gfc, esv->in_buffer_1);
         }
         esv->in_buffer_0 = 0;
         esv->in_buffer_1 = 0;
@@ -1657,96 +1793,175 @@ update_inbuffer_size(lame_internal_flags * gfc, const int nsamples)
 }
 
 
-static int
-calcNeeded(SessionConfig_t const * cfg)
+enum PCMSampleType 
+{   pcm_short_type
+,   pcm_int_type
+,   pcm_long_type
+,   pcm_float_type
+,   pcm_double_type
+};
+
+/* caller PCM of one of the types above, with the user defined re-scaling */
+typedef struct {
+    void const *l;
+    void const *r;
+    enum PCMSampleType type;
+    int     jump;
+    FLOAT   m[2][2];
+} PcmInput_t;
+
+static void
+lame_init_pcm_input(lame_internal_flags const *gfc, PcmInput_t * in,
+                    void const *l, void const *r, enum PCMSampleType pcm_type, int jump, FLOAT s)
 {
-    int     mf_needed;
-    int     pcm_samples_per_frame = 576 * cfg->mode_gr;
+    SessionConfig_t const *const cfg = &gfc->cfg;
 
-    /* some sanity checks */
-#if ENCDELAY < MDCTDELAY
-# error ENCDELAY is less than MDCTDELAY, see encoder.h
-#endif
-#if FFTOFFSET > BLKSIZE
-# error FFTOFFSET is greater than BLKSIZE, see encoder.h
-#endif
+    in->l = l;
+    in->r = r;
+    in->type = pcm_type;
+    in->jump = jump;
 
-    mf_needed = BLKSIZE + pcm_samples_per_frame - FFTOFFSET; /* amount needed for FFT */
-    /*mf_needed = Max(mf_needed, 286 + 576 * (1 + gfc->mode_gr)); */
-    mf_needed = Max(mf_needed, 512 + pcm_samples_per_frame - 32);
+    /* Apply user defined re-scaling */
+    in->m[0][0] = s * cfg->pcm_transform[0][0];
+    in->m[0][1] = s * cfg->pcm_transform[0][1];
+    in->m[1][0] = s * cfg->pcm_transform[1][0];
+    in->m[1][1] = s * cfg->pcm_transform[1][1];
+}
 
-    assert(MFSIZE >= mf_needed);
-    
-    return mf_needed;
+/* convert nsamples samples, starting with sample pos, to sample_t.
+ * For mono ib1 may be ib0, the first channel is stored last */
+static void
+lame_copy_inbuffer(PcmInput_t const *in, int pos, sample_t * ib0, sample_t * ib1, int nsamples)
+{
+    FLOAT const m00 = in->m[0][0], m01 = in->m[0][1];
+    FLOAT const m10 = in->m[1][0], m11 = in->m[1][1];
+    int const jump = in->jump;
+
+#define COPY_AND_TRANSFORM(T) \
+{ \
+    T const *bl = (T const *) in->l + pos * jump; \
+    T const *br = (T const *) in->r + pos * jump; \
+    int     i; \
+    for (i = 0; i < nsamples; i++) { \
+        sample_t const xl = *bl; \
+        sample_t const xr = *br; \
+        sample_t const u = xl * m00 + xr * m01; \
+        sample_t const v = xl * m10 + xr * m11; \
+        ib1[i] = v; \
+        ib0[i] = u; \
+        bl += jump; \
+        br += jump; \
+    } \
+}
+    switch ( in->type ) {
+    case pcm_short_type: 
+        COPY_AND_TRANSFORM(short int);
+        break;
+    case pcm_int_type:
+        COPY_AND_TRANSFORM(int);
+        break;
+    case pcm_long_type:
+        COPY_AND_TRANSFORM(long int);
+        break;
+    case pcm_float_type:
+        COPY_AND_TRANSFORM(float);
+        break;
+    case pcm_double_type:
+        COPY_AND_TRANSFORM(double);
+        break;
+    }
+#undef COPY_AND_TRANSFORM
 }
 
 
-/*
- * THE MAIN LAME ENCODING INTERFACE
- * mt 3/00
- *
- * input pcm data, output (maybe) mp3 frames.
- * This routine handles all buffering, resampling and filtering for you.
- * The required mp3buffer_size can be computed from num_samples,
- * samplerate and encoding rate, but here is a worst case estimate:
- *
- * mp3buffer_size in bytes = 1.25*num_samples + 7200
- *
- * return code = number of bytes output in mp3buffer.  can be 0
- *
- * NOTE: this routine uses LAME's internal PCM data representation,
- * 'sample_t'.  It should not be used by any application.
- * applications should use lame_encode_buffer(),
- *                         lame_encode_buffer_float()
- *                         lame_encode_buffer_int()
- * etc... depending on what type of data they are working with.
-*/
+/* make room for nsamples new samples behind the ones in mfbuf, moving
+ * them to the front only when the end of mfbuf is reached
+ */
+static void
+mfbuf_reserve(lame_internal_flags * gfc, int nsamples)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int     ch;
+
+    if (esv->mf_start + esv->mf_size + nsamples <= esv->mf_bufsize)
+        return;
+    for (ch = 0; ch < gfc->cfg.channels_out; ch++)
+        memmove(esv->mfbuf[ch], esv->mfbuf[ch] + esv->mf_start,
+                esv->mf_size * sizeof(esv->mfbuf[0][0]));
+    esv->mf_start = 0;
+}
+
+
+/* stage the new samples in mfbuf and encode every complete frame.  They
+ * come either as sample_t in in_buffer_0/1, resampled if necessary, or
+ * as caller PCM in pcm, which is converted straight into mfbuf.  Without
+ * both, the caller already wrote them into mfbuf behind the pending ones,
+ * see lame_get_input_buffer().
+ */
 static int
-lame_encode_buffer_sample_t(lame_internal_flags * gfc,
-                            int nsamples, unsigned char *mp3buf, const int mp3buf_size)
+encode_buffer(lame_internal_flags * gfc, sample_t const *in_buffer_0,
+              sample_t const *in_buffer_1, PcmInput_t const *pcm, int nsamples,
+              unsigned char *mp3buf, const int mp3buf_size)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     EncStateVar_t *const esv = &gfc->sv_enc;
     int     pcm_samples_per_frame = 576 * cfg->mode_gr;
-    int     mp3size = 0, ret, i, ch, mf_needed;
+    int     mp3size = 0, ret, mf_needed;
     int     mp3out;
-    sample_t *mfbuf[2];
-    sample_t *in_buffer[2];
-
-    if (gfc->class_id != LAME_ID)
-        return -3;
-
-    if (nsamples == 0)
-        return 0;
+    int     pcm_pos = 0;
+    sample_t const *in_buffer[2];
+    int const in_place = (in_buffer_0 == 0 && pcm == 0);
 
     /* copy out any tags that may have been written into bitstream */
     {   /* if user specifed buffer size = 0, dont check size */
         int const buf_size = mp3buf_size == 0 ? INT_MAX : mp3buf_size;
-        mp3out = copy_buffer(gfc, mp3buf, buf_size, 0);
+        mp3out = output_buffer(gfc, mp3buf, buf_size, 0);
     }
     if (mp3out < 0)
         return mp3out;  /* not enough buffer space */
     mp3buf += mp3out;
     mp3size += mp3out;
 
-    in_buffer[0] = esv->in_buffer_0;
-    in_buffer[1] = esv->in_buffer_1;
+    in_buffer[0] = in_buffer_0;
+    in_buffer[1] = in_buffer_1;
 
     mf_needed = calcNeeded(cfg);
 
-    mfbuf[0] = esv->mfbuf[0];
-    mfbuf[1] = esv->mfbuf[1];
-
     while (nsamples > 0) {
-        sample_t const *in_buffer_ptr[2];
+        sample_t *mfbuf[2];
         int     n_in = 0;    /* number of input samples processed with fill_buffer */
         int     n_out = 0;   /* number of samples output with fill_buffer */
         /* n_in <> n_out if we are resampling */
 
-        in_buffer_ptr[0] = in_buffer[0];
-        in_buffer_ptr[1] = in_buffer[1];
-        /* copy in new samples into mfbuf, with resampling */
-        fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], nsamples, &n_in, &n_out);
+        if (!in_place)
+            mfbuf_reserve(gfc, pcm_samples_per_frame);
+        mfbuf[0] = esv->mfbuf[0] + esv->mf_start;
+        mfbuf[1] = esv->mfbuf[1] + esv->mf_start;
+
+        if (in_place) {
+            /* nothing to copy, just take the next frame into account */
+            n_in = n_out = Min(pcm_samples_per_frame, nsamples);
+        }
+        else if (pcm != 0) {
+            /* no resampling, the samples are written only once */
+            n_in = n_out = Min(pcm_samples_per_frame, nsamples);
+            lame_copy_inbuffer(pcm, pcm_pos, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size],
+                               n_in);
+            pcm_pos += n_in;
+        }
+        else {
+            sample_t const *in_buffer_ptr[2];
+
+            in_buffer_ptr[0] = in_buffer[0];
+            in_buffer_ptr[1] = in_buffer[1];
+            /* copy in new samples into mfbuf, with resampling */
+            fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], nsamples, &n_in, &n_out);
+
+            /* update in_buffer counters */
+            in_buffer[0] += n_in;
+            if (cfg->channels_out == 2)
+                in_buffer[1] += n_in;
+        }
 
         /* compute ReplayGain of resampled input if requested */
         if (cfg->findReplayGain && !cfg->decode_on_the_fly)
@@ -1755,17 +1970,12 @@ lame_encode_buffer_sample_t(lame_internal_flags * gfc,
                  cfg->channels_out) == GAIN_ANALYSIS_ERROR)
                 return -6;
 
-
-
-        /* update in_buffer counters */
         nsamples -= n_in;
-        in_buffer[0] += n_in;
-        if (cfg->channels_out == 2)
-            in_buffer[1] += n_in;
 
         /* update mfbuf[] counters */
         esv->mf_size += n_out;
         assert(esv->mf_size <= MFSIZE);
+        assert(esv->mf_start + esv->mf_size <= esv->mf_bufsize);
         
         /* lame_encode_flush may have set gfc->mf_sample_to_encode to 0
          * so we have to reinitialize it here when that happened.
@@ -1797,12 +2007,10 @@ lame_encode_buffer_sample_t(lame_internal_flags * gfc,
             mp3buf += ret;
             mp3size += ret;
 
-            /* shift out old samples */
+            /* step over the old samples */
             esv->mf_size -= pcm_samples_per_frame;
             esv->mf_samples_to_encode -= pcm_samples_per_frame;
-            for (ch = 0; ch < cfg->channels_out; ch++)
-                for (i = 0; i < esv->mf_size; i++)
-                    mfbuf[ch][i] = mfbuf[ch][i + pcm_samples_per_frame];
+            esv->mf_start += pcm_samples_per_frame;
         }
     }
     assert(nsamples == 0);
@@ -1810,64 +2018,42 @@ lame_encode_buffer_sample_t(lame_internal_flags * gfc,
     return mp3size;
 }
 
-enum PCMSampleType 
-{   pcm_short_type
-,   pcm_int_type
-,   pcm_long_type
-,   pcm_float_type
-,   pcm_double_type
-};
 
-static void
-lame_copy_inbuffer(lame_internal_flags* gfc, 
-                   void const* l, void const* r, int nsamples,
-                   enum PCMSampleType pcm_type, int jump, FLOAT s)
+/*
+ * THE MAIN LAME ENCODING INTERFACE
+ * mt 3/00
+ *
+ * input pcm data, output (maybe) mp3 frames.
+ * This routine handles all buffering, resampling and filtering for you.
+ * The required mp3buffer_size can be computed from num_samples,
+ * samplerate and encoding rate, but here is a worst case estimate:
+ *
+ * mp3buffer_size in bytes = 1.25*num_samples + 7200
+ *
+ * return code = number of bytes output in mp3buffer.  can be 0
+ *
+ * NOTE: this routine uses LAME's internal PCM data representation,
+ * 'sample_t'.  It should not be used by any application.
+ * applications should use lame_encode_buffer(),
+ *                         lame_encode_buffer_float()
+ *                         lame_encode_buffer_int()
+ * etc... depending on what type of data they are working with.
+*/
+int
+lame_encode_buffer_sample_t(lame_internal_flags * gfc, sample_t const *in_buffer_0,
+                            sample_t const *in_buffer_1, int nsamples,
+                            unsigned char *mp3buf, const int mp3buf_size)
 {
-    SessionConfig_t const *const cfg = &gfc->cfg;
-    EncStateVar_t *const esv = &gfc->sv_enc;
-    sample_t* ib0 = esv->in_buffer_0;
-    sample_t* ib1 = esv->in_buffer_1;
-    FLOAT   m[2][2];
+    if (gfc->class_id != LAME_ID)
+        return -3;
 
-    /* Apply user defined re-scaling */
-    m[0][0] = s * cfg->pcm_transform[0][0];
-    m[0][1] = s * cfg->pcm_transform[0][1];
-    m[1][0] = s * cfg->pcm_transform[1][0];
-    m[1][1] = s * cfg->pcm_transform[1][1];
+    if (nsamples == 0)
+        return 0;
 
-    /* make a copy of input buffer, changing type to sample_t */
-#define COPY_AND_TRANSFORM(T) \
-{ \
-    T const *bl = l, *br = r; \
-    int     i; \
-    for (i = 0; i < nsamples; i++) { \
-        sample_t const xl = *bl; \
-        sample_t const xr = *br; \
-        sample_t const u = xl * m[0][0] + xr * m[0][1]; \
-        sample_t const v = xl * m[1][0] + xr * m[1][1]; \
-        ib0[i] = u; \
-        ib1[i] = v; \
-        bl += jump; \
-        br += jump; \
-    } \
-}
-    switch ( pcm_type ) {
-    case pcm_short_type: 
-        COPY_AND_TRANSFORM(short int);
-        break;
-    case pcm_int_type:
-        COPY_AND_TRANSFORM(int);
-        break;
-    case pcm_long_type:
-        COPY_AND_TRANSFORM(long int);
-        break;
-    case pcm_float_type:
-        COPY_AND_TRANSFORM(float);
-        break;
-    case pcm_double_type:
-        COPY_AND_TRANSFORM(double);
-        break;
-    }
+    if (gfc->sv_seg != 0)
+        return segment_encode_buffer(gfc, in_buffer_0, in_buffer_1, nsamples, mp3buf, mp3buf_size);
+
+    return encode_buffer(gfc, in_buffer_0, in_buffer_1, 0, nsamples, mp3buf, mp3buf_size);
 }
 
 
@@ -1880,28 +2066,41 @@ lame_encode_buffer_template(lame_global_flags * gfp,
         lame_internal_flags *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
             SessionConfig_t const *const cfg = &gfc->cfg;
+            PcmInput_t pcm;
 
             if (nsamples == 0)
                 return 0;
 
-            if (update_inbuffer_size(gfc, nsamples) != 0) {
+            if (segment_check_nogap(gfc, gfp) < 0)
                 return -2;
+
+            if (buffer_l == 0) {
+                return 0;
             }
-            /* make a copy of input buffer, changing type to sample_t */
             if (cfg->channels_in > 1) {
-                if (buffer_l == 0 || buffer_r == 0) {
+                if (buffer_r == 0) {
                     return 0;
                 }
-                lame_copy_inbuffer(gfc, buffer_l, buffer_r, nsamples, pcm_type, aa, norm);
             }
             else {
-                if (buffer_l == 0) {
-                    return 0;
-                }
-                lame_copy_inbuffer(gfc, buffer_l, buffer_l, nsamples, pcm_type, aa, norm);
+                buffer_r = buffer_l;
+            }
+            lame_init_pcm_input(gfc, &pcm, buffer_l, buffer_r, pcm_type, aa, norm);
+
+            if (gfc->sv_seg == 0 && !isResamplingNecessary(cfg)) {
+                /* convert straight into mfbuf */
+                return encode_buffer(gfc, 0, 0, &pcm, nsamples, mp3buf, mp3buf_size);
+            }
+
+            if (update_inbuffer_size(gfc, nsamples) != 0) {
+                return -2;
             }
+            /* make a copy of input buffer, changing type to sample_t */
+            lame_copy_inbuffer(&pcm, 0, gfc->sv_enc.in_buffer_0, gfc->sv_enc.in_buffer_1, nsamples);
 
-            return lame_encode_buffer_sample_t(gfc, nsamples, mp3buf, mp3buf_size);
+            return lame_encode_buffer_sample_t(gfc, gfc->sv_enc.in_buffer_0,
+                                               gfc->sv_enc.in_buffer_1, nsamples,
+                                               mp3buf, mp3buf_size);
         }
     }
     return -3;
@@ -2022,6 +2221,97 @@ lame_encode_buffer_interleaved_int(lame_t gfp,
 
 
 
+/* the samples go straight into mfbuf when they need no processing at all */
+static int
+is_input_window_in_mfbuf(lame_internal_flags const *gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+
+    if (sizeof(sample_t) != sizeof(float))
+        return 0;
+    if (gfc->sv_seg != 0 || isResamplingNecessary(cfg))
+        return 0;
+    if (cfg->channels_in != cfg->channels_out)
+        return 0;
+    return cfg->pcm_transform[0][0] == 1 && cfg->pcm_transform[0][1] == 0
+        && cfg->pcm_transform[1][0] == 0 && cfg->pcm_transform[1][1] == 1;
+}
+
+
+int
+lame_get_input_buffer(lame_t gfp, float **pcm_l, float **pcm_r)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            EncStateVar_t *const esv = &gfc->sv_enc;
+
+            if (pcm_l == 0 || pcm_r == 0)
+                return -3;
+            if (segment_check_nogap(gfc, gfp) < 0)
+                return -2;
+
+            if (is_input_window_in_mfbuf(gfc)) {
+                mfbuf_reserve(gfc, esv->mf_window);
+                *pcm_l = (float *) &esv->mfbuf[0][esv->mf_start + esv->mf_size];
+                *pcm_r = (float *) &esv->mfbuf[1][esv->mf_start + esv->mf_size];
+                if (gfc->cfg.channels_out == 1)
+                    *pcm_r = *pcm_l;
+                return esv->mf_bufsize - esv->mf_start - esv->mf_size;
+            }
+
+            if (esv->in_window[0] == 0) {
+                esv->in_window[0] = gfc_calloc(gfc, float, esv->mf_window);
+                esv->in_window[1] = gfc_calloc(gfc, float, esv->mf_window);
+                if (esv->in_window[0] == 0 || esv->in_window[1] == 0) {
+                    gfc_free(gfc, esv->in_window[0]);
+                    gfc_free(gfc, esv->in_window[1]);
+                    esv->in_window[0] = 0;
+                    esv->in_window[1] = 0;
+                    ERRORF(gfc, "Error: can't allocate in_window buffer\n");
+                    return -2;
+                }
+                esv->in_window_nsamples = esv->mf_window;
+            }
+            *pcm_l = esv->in_window[0];
+            *pcm_r = esv->in_window[gfc->cfg.channels_in == 2 ? 1 : 0];
+            return esv->in_window_nsamples;
+        }
+    }
+    return -3;
+}
+
+
+int
+lame_encode_input_buffer(lame_t gfp, int nsamples, unsigned char *mp3buf, int mp3buf_size)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            EncStateVar_t const *const esv = &gfc->sv_enc;
+
+            if (nsamples <= 0)
+                return nsamples == 0 ? 0 : -3;
+
+            if (is_input_window_in_mfbuf(gfc)) {
+                if (nsamples > esv->mf_bufsize - esv->mf_start - esv->mf_size)
+                    return -3;
+                return encode_buffer(gfc, 0, 0, 0, nsamples, mp3buf, mp3buf_size);
+            }
+
+            if (nsamples > esv->in_window_nsamples)
+                return -3;
+            return lame_encode_buffer_template(gfp, esv->in_window[0], esv->in_window[1],
+                                               nsamples, mp3buf, mp3buf_size,
+                                               pcm_float_type, 1, 1.0);
+        }
+    }
+    return -3;
+}
+
+
+
+
 /*****************************************************************
  Flush mp3 buffer, pad with ancillary data so last frame is complete.
  Reset reservoir size to 0
@@ -2038,11 +2328,24 @@ lame_encode_flush_nogap(lame_global_flags * gfp, unsigned char *mp3buffer, int m
     if (is_lame_global_flags_valid(gfp)) {
         lame_internal_flags *const gfc = gfp->internal_flags;
         if (is_lame_internal_flags_valid(gfc)) {
-            flush_bitstream(gfc);
+            if (segment_check_nogap(gfc, gfp) < 0)
+                return -2;
+            if (gfc->sv_seg != 0) {
+                ERRORF(gfc, "Error: gapless encoding not possible in segmented mode\n");
+                return -1;
+            }
             /* if user specifed buffer size = 0, dont check size */
             if (mp3buffer_size == 0)
                 mp3buffer_size = INT_MAX;
-            rc = copy_buffer(gfc, mp3buffer, mp3buffer_size, 1);
+            /* the last analyzed frame still belongs to this track */
+            rc = pipeline_flush(gfc, mp3buffer, mp3buffer_size);
+            if (rc < 0)
+                return rc;
+            flush_bitstream(gfc);
+            {
+                int const imp3 = output_buffer(gfc, mp3buffer + rc, mp3buffer_size - rc, 1);
+                rc = imp3 < 0 ? imp3 : rc + imp3;
+            }
             save_gain_values(gfc);
         }
     }
@@ -2082,6 +2385,89 @@ lame_init_bitstream(lame_global_flags * gfp)
     return -3;
 }
 
+/* puts an encoder back to the state lame_init_params left it in, so it
+ * can encode the next stream with the same settings.  Everything that
+ * only depends on the settings (ATH, psymodel, huffman and resampling
+ * tables) is kept, only the stream dependent state is cleared.
+ */
+int
+lame_reset(lame_global_flags * gfp)
+{
+    lame_internal_flags *gfc;
+    SessionConfig_t const *cfg;
+    EncStateVar_t *esv;
+    int     k;
+
+    if (!is_lame_global_flags_valid(gfp)) {
+        return -3;
+    }
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc)) {
+        return -3;
+    }
+    cfg = &gfc->cfg;
+    esv = &gfc->sv_enc;
+
+    /* input buffer, MDCT and polyphase filter history */
+    for (k = 0; k < cfg->channels_out; k++)
+        memset(esv->mfbuf[k], 0, esv->mf_bufsize * sizeof(esv->mfbuf[0][0]));
+    memset(esv->sb_sample, 0, sizeof(esv->sb_sample));
+    esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
+    esv->mf_size = ENCDELAY - MDCTDELAY;
+    esv->mf_start = 0;
+    fill_buffer_resample_reset(gfc);
+    gfc->lame_encode_frame_init = 0;
+
+    /* CBR padding and pe filter */
+    esv->slot_lag = esv->frac_SpF;
+    for (k = 0; k < 19; k++)
+        esv->pefirbuf[k] = 700 * cfg->mode_gr * cfg->channels_out;
+
+    /* bitstream, header buffer and bit reservoir */
+    esv->h_ptr = esv->w_ptr = 0;
+    esv->header[esv->h_ptr].write_timing = 0;
+    esv->ancillary_flag = 0;
+    esv->ResvSize = 0;
+    esv->ResvMax = 0;
+    gfc->bs.buf_byte_idx = -1;
+    gfc->bs.buf_bit_idx = 0;
+    gfc->bs.totbit = 0;
+    memset(&gfc->l3_side, 0, sizeof(gfc->l3_side));
+
+    /* quantization and psymodel history */
+    gfc->sv_qnt.OldValue[0] = 180;
+    gfc->sv_qnt.OldValue[1] = 180;
+    gfc->sv_qnt.CurrentStep[0] = 4;
+    gfc->sv_qnt.CurrentStep[1] = 4;
+    gfc->sv_qnt.masking_lower = 1;
+    memset(gfc->sv_qnt.pseudohalf, 0, sizeof(gfc->sv_qnt.pseudohalf));
+    psymodel_reset(gfc);
+
+    /* results of the previous stream */
+    if (cfg->vbr != vbr_off)
+        gfc->ov_enc.bitrate_index = 1;
+    gfc->ov_enc.padding = 0;
+    gfc->ov_enc.mode_ext = 0;
+    gfc->ov_enc.encoder_padding = 0;
+    gfc->nMusicCRC = 0;
+
+    /* ReplayGain */
+    gfc->ov_rpg.RadioGain = 0;
+    gfc->ov_rpg.noclipGainChange = 0;
+    gfc->ov_rpg.noclipScale = -1.0;
+    if (cfg->findReplayGain) {
+        (void) InitGainAnalysis(gfc->sv_rpg.rgdata, cfg->samplerate_out);
+    }
+    init_decode_on_the_fly(gfp);
+
+    segment_reset(gfc);
+    pipeline_reset(gfc);
+
+    /* new id3v2 and Xing VBR tags */
+    return lame_init_bitstream(gfp);
+}
+
+
 static int
 calc_mp3buffer_size_remaining( int mp3buffer_size, int mp3count)
 {
@@ -2139,6 +2525,29 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
     }
     cfg = &gfc->cfg;
     esv = &gfc->sv_enc;
+
+    if (segment_check_nogap(gfc, gfp) < 0) {
+        return -2;
+    }
+    if (gfc->sv_seg != 0) {
+        /* encode what is left and return all of it.  If it doesn't fit
+         * into mp3buffer, it is kept for another call with more room */
+        imp3 = segment_finish(gfc);
+        if (imp3 < 0) {
+            return imp3;
+        }
+        if (imp3 > 0) {
+            save_gain_values(gfc);
+            if (gfp->write_id3tag_automatic) {
+                (void) id3tag_write_v1(gfp);
+                imp3 = segment_queue_tags(gfc);
+                if (imp3 < 0) {
+                    return imp3;
+                }
+            }
+        }
+        return segment_drain(gfc, mp3buffer, mp3buffer_size, 1);
+    }
     
     /* Was flush already called? */
     if (esv->mf_samples_to_encode < 1) {
@@ -2165,7 +2574,7 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
     
     frames_left = (samples_to_encode + end_padding) / pcm_samples_per_frame;
     while (frames_left > 0 && imp3 >= 0) {
-        int const frame_num = gfc->ov_enc.frame_number;
+        int const frame_num = gfc->ov_enc.frame_number + pipeline_pending_frames(gfc);
         int     bunch = mf_needed - esv->mf_size;
 
         bunch *= resample_ratio;
@@ -2186,7 +2595,8 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
         {   /* even a single pcm sample can produce several frames!
              * for example: 1 Hz input file resampled to 8 kHz mpeg2.5
              */
-            int const new_frames = gfc->ov_enc.frame_number - frame_num;
+            int const new_frames =
+                gfc->ov_enc.frame_number + pipeline_pending_frames(gfc) - frame_num;
             if (new_frames > 0)
                 frames_left -=  new_frames;
         }
@@ -2203,9 +2613,18 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
 
     mp3buffer_size_remaining = calc_mp3buffer_size_remaining(mp3buffer_size, mp3count);
 
+    /* quantize the last frame, in pipelined mode it is still pending */
+    imp3 = pipeline_flush(gfc, mp3buffer, mp3buffer_size_remaining);
+    if (imp3 < 0) {
+        return imp3;
+    }
+    mp3buffer += imp3;
+    mp3count += imp3;
+    mp3buffer_size_remaining = calc_mp3buffer_size_remaining(mp3buffer_size, mp3count);
+
     /* mp3 related stuff.  bit buffer might still contain some mp3 data */
     flush_bitstream(gfc);
-    imp3 = copy_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 1);
+    imp3 = output_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 1);
     save_gain_values(gfc);
     if (imp3 < 0) {
         /* some type of fatal error */
@@ -2222,7 +2641,7 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
         /* write a id3 tag to the bitstream */
         (void) id3tag_write_v1(gfp);
 
-        imp3 = copy_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 0);
+        imp3 = output_buffer(gfc, mp3buffer, mp3buffer_size_remaining, 0);
 
         if (imp3 < 0) {
             return imp3;
@@ -2261,21 +2680,28 @@ lame_close(lame_global_flags * gfp)
     int     ret = 0;
     if (gfp && gfp->class_id == LAME_ID) {
         lame_internal_flags *const gfc = gfp->internal_flags;
+        EncMemory_t mem;
         gfp->class_id = 0;
         if (NULL == gfc || gfc->class_id != LAME_ID) {
             ret = -3;
         }
         if (NULL != gfc) {
+            mem = gfc->mem;
             gfc->lame_init_params_successful = 0;
             gfc->class_id = 0;
             /* this routine will free all malloc'd data in gfc, and then free gfc: */
             freegfc(gfc);
             gfp->internal_flags = NULL;
         }
+        else {
+            (void) lame_mem_init(&mem, NULL, NULL, 0);
+        }
         if (gfp->lame_allocated_gfp) {
             gfp->lame_allocated_gfp = 0;
-            free(gfp);
+            lame_mem_free(&mem, gfp);
         }
+        /* gives the arena back, if it was not passed in */
+        lame_mem_release(&mem);
     }
     return ret;
 }
@@ -2381,27 +2807,42 @@ lame_init_internal_flags(lame_internal_flags* gfc)
     gfc->ov_rpg.noclipGainChange = 0;
     gfc->ov_rpg.noclipScale = -1.0;
 
-    gfc->ATH = lame_calloc(ATH_t, 1);
+    gfc->ATH = gfc_calloc(gfc, ATH_t, 1);
     if (NULL == gfc->ATH)
         return -2;      /* maybe error codes should be enumerated in lame.h ?? */
 
-    gfc->sv_rpg.rgdata = lame_calloc(replaygain_t, 1);
-    if (NULL == gfc->sv_rpg.rgdata) {
-        return -2;
-    }
+    /* the ReplayGain analysis and mfbuf are allocated in lame_init_params,
+       when it is known what they are needed for */
     return 0;
 }
 
-/* initialize mp3 encoder */
-#if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
-static
-#else
-#endif
-int
-lame_init_old(lame_global_flags * gfp)
+/* tables shared by all encoder instances of the process, they depend
+ * on nothing but constants and are never changed afterwards
+ */
+static void
+init_global_tables(void)
+{
+    init_log_table();
+    init_quantize_tables();
+    init_huffman_tables();
+    init_fft_tables();
+    init_mdct_tables();
+    init_psymodel_tables();
+}
+
+static ThreadOnce_t global_tables_once = THREAD_ONCE_INIT;
+
+
+/* initialize mp3 encoder, the internal flags come from mem */
+static int
+lame_init_gfp(lame_global_flags * gfp, EncMemory_t * mem)
 {
+    lame_internal_flags *gfc;
+
     disable_FPE();      /* disable floating point exceptions */
 
+    thread_once(&global_tables_once, init_global_tables);
+
     memset(gfp, 0, sizeof(lame_global_flags));
 
     gfp->class_id = LAME_ID;
@@ -2460,6 +2901,11 @@ lame_init_old(lame_global_flags * gfp)
     gfp->findReplayGain = 0;
     gfp->decode_on_the_fly = 0;
 
+    gfp->num_threads = 1;
+    gfp->segment_frames = 0;
+    gfp->pipeline = 0;
+    gfp->parallel_quantization = 0;
+
     gfp->asm_optimizations.mmx = 1;
     gfp->asm_optimizations.amd3dnow = 1;
     gfp->asm_optimizations.sse = 1;
@@ -2472,10 +2918,14 @@ lame_init_old(lame_global_flags * gfp)
     gfp->report.errorf = &lame_report_def;
     gfp->report.msgf = &lame_report_def;
 
-    gfp->internal_flags = lame_calloc(lame_internal_flags, 1);
+    gfc = lame_mem_calloc(mem, sizeof(lame_internal_flags));
+    if (gfc == NULL)
+        return -1;
+    gfc->mem = *mem;
+    gfp->internal_flags = gfc;
 
-    if (lame_init_internal_flags(gfp->internal_flags) < 0) {
-        freegfc(gfp->internal_flags);
+    if (lame_init_internal_flags(gfc) < 0) {
+        freegfc(gfc);
         gfp->internal_flags = 0;
         return -1;
     }
@@ -2483,21 +2933,39 @@ lame_init_old(lame_global_flags * gfp)
 }
 
 
+#if DEPRECATED_OR_OBSOLETE_CODE_REMOVED
+#else
+int
+lame_init_old(lame_global_flags * gfp)
+{
+    EncMemory_t mem;
+
+    (void) lame_mem_init(&mem, NULL, NULL, 0);
+    return lame_init_gfp(gfp, &mem);
+}
+#endif
+
+
 lame_global_flags *
-lame_init(void)
+lame_init_allocator(const lame_allocator * allocator, void *arena, size_t arena_size)
 {
     lame_global_flags *gfp;
+    EncMemory_t mem;
     int     ret;
 
-    init_log_table();
+    if (lame_mem_init(&mem, allocator, arena, arena_size) != 0)
+        return NULL;
 
-    gfp = lame_calloc(lame_global_flags, 1);
-    if (gfp == NULL)
+    gfp = lame_mem_calloc(&mem, sizeof(lame_global_flags));
+    if (gfp == NULL) {
+        lame_mem_release(&mem);
         return NULL;
+    }
 
-    ret = lame_init_old(gfp);
+    ret = lame_init_gfp(gfp, &mem);
     if (ret != 0) {
-        free(gfp);
+        lame_mem_free(&mem, gfp);
+        lame_mem_release(&mem);
         return NULL;
     }
 
@@ -2506,6 +2974,13 @@ lame_init(void)
 }
 
 
+lame_global_flags *
+lame_init(void)
+{
+    return lame_init_allocator(NULL, NULL, 0);
+}
+
+
 /***********************************************************************
  *
  *  some simple statistics
@@ -58,6 +58,14 @@ struct lame_global_struct {
     int     nogap_total;
     int     nogap_current;
 
+    int     num_threads;     /* number of encoder threads. default=1        */
+    int     segment_frames;  /* frames per independently encoded segment,
+                                0 (default) disables segmented encoding     */
+    int     pipeline;        /* pipelined encoding. default=0               */
+    int     parallel_quantization; /* quantize granules and channels in
+                                      parallel (VBR new only). default=0 */
+    int     compact_memory;  /* buffers sized for this stream. default=0    */
+
     int     substep_shaping;
     int     noise_shaping;
     int     subblock_gain;   /*  0 = no, 1 = yes */
@@ -155,6 +163,11 @@ struct lame_global_struct {
         void    (*errorf) (const char *format, va_list ap);
     } report;
 
+    struct {
+        lame_output_function func;
+        void   *user_data;
+    } output;
+
   /************************************************************************/
     /* internal variables, do not set...                                    */
     /* provided because they may be of use to calling application           */
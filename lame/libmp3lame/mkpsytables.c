@@ -0,0 +1,154 @@
+/*
+ *      mkpsytables.c
+ *
+ *  Writes the samplerate dependent constants of the psychoacoustic model
+ *  for all MPEG samplerates to stdout, as C source for psymodel.c.  It is
+ *  run at build time, so that psymodel_init() only has to copy them
+ *  instead of evaluating the spreading function for every new encoder.
+ *
+ *  usage: mkpsytables > psytables_data.h
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "tables.h"
+#include "psytables.h"
+
+
+#define NRATES 9
+
+/* in the order of sfBandIndex[] */
+static const int samplerates[NRATES] = {
+    22050, 24000, 16000, 44100, 48000, 32000, 11025, 12000, 8000
+};
+
+/* enough digits to read back the very same FLOAT */
+#define FLOAT_DIGITS (sizeof(FLOAT) > sizeof(float) ? 17 : 9)
+
+
+static void
+print_floats(FLOAT const *v, int n, char const *indent)
+{
+    int     i;
+    printf("{");
+    for (i = 0; i < n; i++) {
+        if (i > 0)
+            printf(i % 6 ? ", " : ",\n%s ", indent);
+        printf("%.*g", FLOAT_DIGITS, (double) v[i]);
+    }
+    printf("}");
+}
+
+static void
+print_ints(int const *v, int n, char const *indent)
+{
+    int     i;
+    printf("{");
+    for (i = 0; i < n; i++) {
+        if (i > 0)
+            printf(i % 16 ? ", " : ",\n%s ", indent);
+        printf("%d", v[i]);
+    }
+    printf("}");
+}
+
+static void
+print_s3ind(int const (*s3ind)[2], char const *indent)
+{
+    int     i;
+    printf("{");
+    for (i = 0; i < CBANDS; i++) {
+        if (i > 0)
+            printf(i % 8 ? ", " : ",\n%s ", indent);
+        printf("{%d, %d}", s3ind[i][0], s3ind[i][1]);
+    }
+    printf("}");
+}
+
+static void
+print_partition(PsyPartition_t const *p, char const *s3_name)
+{
+    static char const indent[] = "      ";
+    int const nsb = Max(SBMAX_l, SBMAX_s);
+
+    printf("     {");
+    print_floats(p->mld_cb, CBANDS, indent);
+    printf(",\n      ");
+    print_floats(p->bval, CBANDS, indent);
+    printf(",\n      ");
+    print_floats(p->bval_width, CBANDS, indent);
+    printf(",\n      ");
+    print_floats(p->mld, nsb, indent);
+    printf(",\n      ");
+    print_floats(p->bo_weight, nsb, indent);
+    printf(",\n      ");
+    print_ints(p->numlines, CBANDS, indent);
+    printf(",\n      ");
+    print_ints(p->bm, nsb, indent);
+    printf(",\n      ");
+    print_ints(p->bo, nsb, indent);
+    printf(",\n      ");
+    print_s3ind(p->s3ind, indent);
+    printf(",\n      %d, %d, %d, %s}", p->npart, p->n_sb, p->s3_size, s3_name);
+}
+
+
+int
+main(void)
+{
+    static PsyTables_t t[NRATES];
+    static FLOAT s3[NRATES][2][CBANDS * CBANDS];
+    char    name[2][32];
+    int     i;
+
+    printf("/* psytables_data.h, generated by mkpsytables, do not edit */\n\n");
+
+    for (i = 0; i < NRATES; i++) {
+        psy_tables_compute(&t[i], s3[i][0], s3[i][1], samplerates[i],
+                           sfBandIndex[i].l, sfBandIndex[i].s);
+        printf("static const FLOAT psy_s3_l_%d[%d] = ", samplerates[i], t[i].l.s3_size);
+        print_floats(t[i].l.s3, t[i].l.s3_size, "   ");
+        printf(";\n\nstatic const FLOAT psy_s3_s_%d[%d] = ", samplerates[i], t[i].s.s3_size);
+        print_floats(t[i].s.s3, t[i].s.s3_size, "   ");
+        printf(";\n\n");
+    }
+
+    printf("static const PsyTables_t psy_tables[%d] = {\n", NRATES);
+    for (i = 0; i < NRATES; i++) {
+        sprintf(name[0], "psy_s3_l_%d", samplerates[i]);
+        sprintf(name[1], "psy_s3_s_%d", samplerates[i]);
+        printf("    {%d,\n", samplerates[i]);
+        print_partition(&t[i].l, name[0]);
+        printf(",\n");
+        print_partition(&t[i].s, name[1]);
+        printf(",\n");
+        print_partition(&t[i].l_to_s, "0");
+        printf("}%s\n", i < NRATES - 1 ? "," : "");
+    }
+    printf("};\n");
+
+    return ferror(stdout) ? 1 : 0;
+}
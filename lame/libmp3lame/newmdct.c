@@ -36,6 +36,8 @@
 #include "util.h"
 #include "newmdct.h"
 
+#include "vector/lame_intrin.h"
+
 
 
 #ifndef USE_GOGO_SUBBAND
@@ -426,9 +428,9 @@ static const int order[] = {
 };
 
 
-/* returns sum_j=0^31 a[j]*cos(PI*j*(k+1/2)/32), 0<=k<32 */
-inline static void
-window_subband(const sample_t * x1, FLOAT a[SBLIMIT])
+/* the windowing of 15 pairs of subbands, a[0] to a[29] */
+static void
+window_subband_core_c(const sample_t * x1, FLOAT a[SBLIMIT])
 {
     int     i;
     FLOAT const *wp = enwindow + 10;
@@ -501,6 +503,17 @@ window_subband(const sample_t * x1, FLOAT a[SBLIMIT])
         x1--;
         x2++;
     }
+}
+
+
+/* returns sum_j=0^31 a[j]*cos(PI*j*(k+1/2)/32), 0<=k<32 */
+inline static void
+window_subband(lame_internal_flags const *gfc, const sample_t * x1, FLOAT a[SBLIMIT])
+{
+    FLOAT const *wp = enwindow + 10 + 15 * 18;
+
+    gfc->window_subband_core(x1, a);
+    x1 -= 15;
     {
         FLOAT   s, t, u, v;
         t = x1[-16] * wp[-10];
@@ -941,8 +954,96 @@ mdct_long(FLOAT * out, FLOAT const *in)
 }
 
 
+/* MDCT and aliasing reduction of the 32 subbands of one granule,
+ * sb0 and sb1 hold the previous and the current 18 subband samples
+ */
+static void
+mdct_bands_c(FLOAT const *sb0, FLOAT * sb1, FLOAT const amp_filter[SBLIMIT], int type,
+             FLOAT * mdct_enc)
+{
+    int     band, k;
+
+    for (band = 0; band < 32; band++, mdct_enc += 18) {
+        FLOAT const *const band0 = sb0 + order[band];
+        FLOAT  *const band1 = sb1 + order[band];
+        if (amp_filter[band] < 1e-12) {
+            memset(mdct_enc, 0, 18 * sizeof(FLOAT));
+        }
+        else {
+            if (amp_filter[band] < 1.0) {
+                for (k = 0; k < 18; k++)
+                    band1[k * 32] *= amp_filter[band];
+            }
+            if (type == SHORT_TYPE) {
+                for (k = -NS / 4; k < 0; k++) {
+                    FLOAT const w = win[SHORT_TYPE][k + 3];
+                    mdct_enc[k * 3 + 9] = band0[(9 + k) * 32] * w - band0[(8 - k) * 32];
+                    mdct_enc[k * 3 + 18] = band0[(14 - k) * 32] * w + band0[(15 + k) * 32];
+                    mdct_enc[k * 3 + 10] = band0[(15 + k) * 32] * w - band0[(14 - k) * 32];
+                    mdct_enc[k * 3 + 19] = band1[(2 - k) * 32] * w + band1[(3 + k) * 32];
+                    mdct_enc[k * 3 + 11] = band1[(3 + k) * 32] * w - band1[(2 - k) * 32];
+                    mdct_enc[k * 3 + 20] = band1[(8 - k) * 32] * w + band1[(9 + k) * 32];
+                }
+                mdct_short(mdct_enc);
+            }
+            else {
+                FLOAT   work[18];
+                for (k = -NL / 4; k < 0; k++) {
+                    FLOAT   a, b;
+                    a = win[type][k + 27] * band1[(k + 9) * 32]
+                        + win[type][k + 36] * band1[(8 - k) * 32];
+                    b = win[type][k + 9] * band0[(k + 9) * 32]
+                        - win[type][k + 18] * band0[(8 - k) * 32];
+                    work[k + 9] = a - b * tantab_l[k + 9];
+                    work[k + 18] = a * tantab_l[k + 9] + b;
+                }
+
+                mdct_long(mdct_enc, work);
+            }
+        }
+        /*
+         * Perform aliasing reduction butterfly
+         */
+        if (type != SHORT_TYPE && band != 0) {
+            for (k = 7; k >= 0; --k) {
+                FLOAT   bu, bd;
+                bu = mdct_enc[k] * ca[k] + mdct_enc[-1 - k] * cs[k];
+                bd = mdct_enc[k] * cs[k] - mdct_enc[-1 - k] * ca[k];
+
+                mdct_enc[-1 - k] = bu;
+                mdct_enc[k] = bd;
+            }
+        }
+    }
+}
+
+
+void
+init_mdct_tables(void)
+{
+#ifdef HAVE_IMMINTRIN_H
+    mdct_avx2_init(enwindow, win, order);
+#endif
+}
+
+
+void
+init_mdct(lame_internal_flags * gfc)
+{
+    gfc->window_subband_core = window_subband_core_c;
+    gfc->mdct_bands = mdct_bands_c;
+#ifdef HAVE_IMMINTRIN_H
+    if (gfc->CPU_features.AVX2) {
+        gfc->window_subband_core = window_subband_core_avx2;
+        gfc->mdct_bands = mdct_bands_avx2;
+    }
+#endif
+}
+
+
 void
-mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1)
+mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1,
+           int const block_type[2][2], FLOAT xr[2][2][576])
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
     EncStateVar_t *const esv = &gfc->sv_enc;
@@ -954,13 +1055,13 @@ mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1)
     for (ch = 0; ch < cfg->channels_out; ch++) {
         for (gr = 0; gr < cfg->mode_gr; gr++) {
             int     band;
-            gr_info *const gi = &(gfc->l3_side.tt[gr][ch]);
-            FLOAT  *mdct_enc = gi->xr;
+            int const type = block_type[gr][ch];
+            FLOAT  *const mdct_enc = xr[gr][ch];
             FLOAT  *samp = esv->sb_sample[ch][1 - gr][0];
 
             for (k = 0; k < 18 / 2; k++) {
-                window_subband(wk, samp);
-                window_subband(wk + 32, samp + 32);
+                window_subband(gfc, wk, samp);
+                window_subband(gfc, wk + 32, samp + 32);
                 samp += 64;
                 wk += 64;
                 /*
@@ -975,61 +1076,8 @@ mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1)
              * Perform imdct of 18 previous subband samples
              * + 18 current subband samples
              */
-            for (band = 0; band < 32; band++, mdct_enc += 18) {
-                int     type = gi->block_type;
-                FLOAT const *const band0 = esv->sb_sample[ch][gr][0] + order[band];
-                FLOAT  *const band1 = esv->sb_sample[ch][1 - gr][0] + order[band];
-                if (gi->mixed_block_flag && band < 2)
-                    type = 0;
-                if (esv->amp_filter[band] < 1e-12) {
-                    memset(mdct_enc, 0, 18 * sizeof(FLOAT));
-                }
-                else {
-                    if (esv->amp_filter[band] < 1.0) {
-                        for (k = 0; k < 18; k++)
-                            band1[k * 32] *= esv->amp_filter[band];
-                    }
-                    if (type == SHORT_TYPE) {
-                        for (k = -NS / 4; k < 0; k++) {
-                            FLOAT const w = win[SHORT_TYPE][k + 3];
-                            mdct_enc[k * 3 + 9] = band0[(9 + k) * 32] * w - band0[(8 - k) * 32];
-                            mdct_enc[k * 3 + 18] = band0[(14 - k) * 32] * w + band0[(15 + k) * 32];
-                            mdct_enc[k * 3 + 10] = band0[(15 + k) * 32] * w - band0[(14 - k) * 32];
-                            mdct_enc[k * 3 + 19] = band1[(2 - k) * 32] * w + band1[(3 + k) * 32];
-                            mdct_enc[k * 3 + 11] = band1[(3 + k) * 32] * w - band1[(2 - k) * 32];
-                            mdct_enc[k * 3 + 20] = band1[(8 - k) * 32] * w + band1[(9 + k) * 32];
-                        }
-                        mdct_short(mdct_enc);
-                    }
-                    else {
-                        FLOAT   work[18];
-                        for (k = -NL / 4; k < 0; k++) {
-                            FLOAT   a, b;
-                            a = win[type][k + 27] * band1[(k + 9) * 32]
-                                + win[type][k + 36] * band1[(8 - k) * 32];
-                            b = win[type][k + 9] * band0[(k + 9) * 32]
-                                - win[type][k + 18] * band0[(8 - k) * 32];
-                            work[k + 9] = a - b * tantab_l[k + 9];
-                            work[k + 18] = a * tantab_l[k + 9] + b;
-                        }
-
-                        mdct_long(mdct_enc, work);
-                    }
-                }
-                /*
-                 * Perform aliasing reduction butterfly
-                 */
-                if (type != SHORT_TYPE && band != 0) {
-                    for (k = 7; k >= 0; --k) {
-                        FLOAT   bu, bd;
-                        bu = mdct_enc[k] * ca[k] + mdct_enc[-1 - k] * cs[k];
-                        bd = mdct_enc[k] * cs[k] - mdct_enc[-1 - k] * ca[k];
-
-                        mdct_enc[-1 - k] = bu;
-                        mdct_enc[k] = bd;
-                    }
-                }
-            }
+            gfc->mdct_bands(esv->sb_sample[ch][gr][0], esv->sb_sample[ch][1 - gr][0],
+                            esv->amp_filter, type, mdct_enc);
         }
         wk = w1 + 286;
         if (cfg->mode_gr == 1) {
@@ -22,6 +22,11 @@
 #ifndef LAME_NEWMDCT_H
 #define LAME_NEWMDCT_H
 
-void    mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1);
+void    init_mdct_tables(void);
+void    init_mdct(lame_internal_flags * gfc);
+
+/* MDCT of one frame, block_type and xr are indexed [gr][ch] */
+void    mdct_sub48(lame_internal_flags * gfc, const sample_t * w0, const sample_t * w1,
+                   int const block_type[2][2], FLOAT xr[2][2][576]);
 
 #endif /* LAME_NEWMDCT_H */
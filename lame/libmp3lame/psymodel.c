@@ -154,15 +154,12 @@ blocktype_d[2]        block type to use for previous granule
 #include "lame_global_flags.h"
 #include "fft.h"
 #include "lame-analysis.h"
+#include "psytables.h"
 
+#include "vector/lame_intrin.h"
 
-#define NSFIRLEN 21
 
-#ifdef M_LN10
-#define  LN_TO_LOG10  (M_LN10/10)
-#else
-#define  LN_TO_LOG10  0.2302585093
-#endif
+#define NSFIRLEN 21
 
 
 /*
@@ -300,17 +297,17 @@ init_mask_add_max_values(void)
 
 
 
+static const FLOAT table2[] = {
+    1.33352 * 1.33352, 1.35879 * 1.35879, 1.38454 * 1.38454, 1.39497 * 1.39497,
+    1.40548 * 1.40548, 1.3537 * 1.3537, 1.30382 * 1.30382, 1.22321 * 1.22321,
+    1.14758 * 1.14758,
+    1
+};
+
 /* addition of simultaneous masking   Naoki Shibata 2000/7 */
 inline static FLOAT
 vbrpsy_mask_add(FLOAT m1, FLOAT m2, int b, int delta)
 {
-    static const FLOAT table2[] = {
-        1.33352 * 1.33352, 1.35879 * 1.35879, 1.38454 * 1.38454, 1.39497 * 1.39497,
-        1.40548 * 1.40548, 1.3537 * 1.3537, 1.30382 * 1.30382, 1.22321 * 1.22321,
-        1.14758 * 1.14758,
-        1
-    };
-
     FLOAT   ratio;
 
     if (m1 < 0) {
@@ -1038,14 +1035,68 @@ vbrpsy_calc_mask_index_s(lame_internal_flags const *gfc, FLOAT const *max,
 }
 
 
+/* convolve the partitioned energy with the spreading function, s3[b][k]
+ * ecb[b]: masking spread into partition b, before the average mask weighting
+ * dd[b]:  sum of the mask indices of the partitions spreading into b
+ */
+static void
+s3_convolve_c(PsyConst_CB2SB_t const *gd, FLOAT const *eb, unsigned char const *mask_idx,
+              FLOAT * ecb_out, int *dd_out)
+{
+    int     b, k = 0;
+
+    for (b = 0; b < gd->npart; b++) {
+        int     kk = gd->s3ind[b][0];
+        int const last = gd->s3ind[b][1];
+        int const delta = mask_add_delta(mask_idx[b]);
+        int     dd;
+        FLOAT   x, ecb;
+
+        dd = mask_idx[kk];
+        ecb = gd->s3[k] * eb[kk] * tab[mask_idx[kk]];
+        ++k, ++kk;
+        while (kk <= last) {
+            dd += mask_idx[kk];
+            x = gd->s3[k] * eb[kk] * tab[mask_idx[kk]];
+            ecb = vbrpsy_mask_add(ecb, x, kk - b, delta);
+            ++k, ++kk;
+        }
+        ecb_out[b] = ecb;
+        dd_out[b] = dd;
+    }
+}
+
+
+void
+init_psymodel_tables(void)
+{
+#if defined(HAVE_IMMINTRIN_H) && defined(USE_FAST_LOG)
+    s3_convolve_avx2_init(tab, table2, tab_mask_add_delta, ma_max_i1, ma_max_i2);
+#endif
+}
+
+
+void
+init_s3_convolve(lame_internal_flags * gfc)
+{
+    gfc->s3_convolve = s3_convolve_c;
+#if defined(HAVE_IMMINTRIN_H) && defined(USE_FAST_LOG)
+    if (gfc->CPU_features.AVX2) {
+        gfc->s3_convolve = s3_convolve_avx2;
+    }
+#endif
+}
+
+
 static void
 vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HBLKSIZE_s],
                          FLOAT * eb, FLOAT * thr, int chn, int sblock)
 {
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gds = &gfc->cd_psy->s;
-    FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   max[CBANDS], avg[CBANDS], ecb_s3[CBANDS];
     int     i, j, b;
+    int     dd_s3[CBANDS];
     unsigned char mask_idx_s[CBANDS];
 
     memset(max, 0, sizeof(max));
@@ -1070,26 +1121,15 @@ vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HB
     assert(b == gds->npart);
     assert(j == 129);
     vbrpsy_calc_mask_index_s(gfc, max, avg, mask_idx_s);
-    for (j = b = 0; b < gds->npart; b++) {
-        int     kk = gds->s3ind[b][0];
-        int const last = gds->s3ind[b][1];
-        int const delta = mask_add_delta(mask_idx_s[b]);
-        int     dd, dd_n;
+    gfc->s3_convolve(gds, eb, mask_idx_s, ecb_s3, dd_s3);
+    for (b = 0; b < gds->npart; b++) {
+        int const dd_n = gds->s3ind[b][1] - gds->s3ind[b][0] + 1;
+        int     dd;
         FLOAT   x, ecb, avg_mask;
-        FLOAT const masking_lower = gds->masking_lower[b] * gfc->sv_qnt.masking_lower;
+        FLOAT const masking_lower = gds->masking_lower[b] * gfc->sv_psy.masking_lower;
 
-        dd = mask_idx_s[kk];
-        dd_n = 1;
-        ecb = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-        ++j, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_s[kk];
-            dd_n += 1;
-            x = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-            ecb = vbrpsy_mask_add(ecb, x, kk - b, delta);
-            ++j, ++kk;
-        }
-        dd = (1 + 2 * dd) / (2 * dd_n);
+        ecb = ecb_s3[b];
+        dd = (1 + 2 * dd_s3[b]) / (2 * dd_n);
         avg_mask = tab[dd] * 0.5f;
         ecb *= avg_mask;
 #if 0                   /* we can do PRE ECHO control now here, or do it later */
@@ -1147,9 +1187,10 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
 {
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gdl = &gfc->cd_psy->l;
-    FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   max[CBANDS], avg[CBANDS], ecb_s3[CBANDS];
     unsigned char mask_idx_l[CBANDS + 2];
-    int     k, b;
+    int     dd_s3[CBANDS];
+    int     b;
 
  /*********************************************************************
     *    Calculate the energy and the tonality of each partition.
@@ -1161,36 +1202,15 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
     *      convolve the partitioned energy and unpredictability
     *      with the spreading function, s3_l[b][k]
  ********************************************************************/
-    k = 0;
+    gfc->s3_convolve(gdl, eb_l, mask_idx_l, ecb_s3, dd_s3);
     for (b = 0; b < gdl->npart; b++) {
-        FLOAT   x, ecb, avg_mask, t;
-        FLOAT const masking_lower = gdl->masking_lower[b] * gfc->sv_qnt.masking_lower;
-        /* convolve the partitioned energy with the spreading function */
-        int     kk = gdl->s3ind[b][0];
-        int const last = gdl->s3ind[b][1];
-        int const delta = mask_add_delta(mask_idx_l[b]);
-        int     dd = 0, dd_n = 0;
-
-        dd = mask_idx_l[kk];
-        dd_n += 1;
-        ecb = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-        ++k, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_l[kk];
-            dd_n += 1;
-            x = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-            t = vbrpsy_mask_add(ecb, x, kk - b, delta);
-#if 0
-            ecb += eb_l[kk];
-            if (ecb > t) {
-                ecb = t;
-            }
-#else
-            ecb = t;
-#endif
-            ++k, ++kk;
-        }
-        dd = (1 + 2 * dd) / (2 * dd_n);
+        FLOAT   x, ecb, avg_mask;
+        FLOAT const masking_lower = gdl->masking_lower[b] * gfc->sv_psy.masking_lower;
+        int const dd_n = gdl->s3ind[b][1] - gdl->s3ind[b][0] + 1;
+        int     dd;
+
+        ecb = ecb_s3[b];
+        dd = (1 + 2 * dd_s3[b]) / (2 * dd_n);
         avg_mask = tab[dd] * 0.5f;
         ecb *= avg_mask;
 
@@ -1433,7 +1453,7 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
     FLOAT   thmm;
     FLOAT const pcfact = 0.6f;
     FLOAT const ath_factor =
-        (cfg->msfix > 0.f) ? (cfg->ATH_offset_factor * gfc->ATH->adjust_factor) : 1.f;
+        (cfg->msfix > 0.f) ? (cfg->ATH_offset_factor * psv->ath_adjust_factor) : 1.f;
 
     const   FLOAT(*const_eb)[CBANDS] = (const FLOAT(*)[CBANDS]) eb;
     const   FLOAT(*const_fftenergy_s)[HBLKSIZE_s] = (const FLOAT(*)[HBLKSIZE_s]) fftenergy_s;
@@ -1593,10 +1613,10 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
             mr = &masking_ratio[gr_out][chn];
         }
         if (type == SHORT_TYPE) {
-            ppe[chn] = pecalc_s(mr, gfc->sv_qnt.masking_lower);
+            ppe[chn] = pecalc_s(mr, gfc->sv_psy.masking_lower);
         }
         else {
-            ppe[chn] = pecalc_l(mr, gfc->sv_qnt.masking_lower);
+            ppe[chn] = pecalc_l(mr, gfc->sv_psy.masking_lower);
         }
 
         if (plt) {
@@ -1609,300 +1629,87 @@ L3psycho_anal_vbr(lame_internal_flags * gfc,
 
 
 
-/* 
- *   The spreading function.  Values returned in units of energy
- */
-static  FLOAT
-s3_func(FLOAT bark)
-{
-    FLOAT   tempx, x, tempy, temp;
-    tempx = bark;
-    if (tempx >= 0)
-        tempx *= 3;
-    else
-        tempx *= 1.5;
-
-    if (tempx >= 0.5 && tempx <= 2.5) {
-        temp = tempx - 0.5;
-        x = 8.0 * (temp * temp - 2.0 * temp);
-    }
-    else
-        x = 0.0;
-    tempx += 0.474;
-    tempy = 15.811389 + 7.5 * tempx - 17.5 * sqrt(1.0 + tempx * tempx);
-
-    if (tempy <= -60.0)
-        return 0.0;
-
-    tempx = exp((x + tempy) * LN_TO_LOG10);
-
-    /* Normalization.  The spreading function should be normalized so that:
-       +inf
-       /
-       |  s3 [ bark ]  d(bark)   =  1
-       /
-       -inf
-     */
-    tempx /= .6609193;
-    return tempx;
-}
+#ifdef HAVE_PSYTABLES_DATA
+#include "psytables_data.h"
 
-#if 0
-static  FLOAT
-norm_s3_func(void)
+static PsyTables_t const *
+find_psy_tables(int samplerate)
 {
-    double  lim_a = 0, lim_b = 0;
-    double  x = 0, l, h;
-    for (x = 0; s3_func(x) > 1e-20; x -= 1);
-    l = x;
-    h = 0;
-    while (fabs(h - l) > 1e-12) {
-        x = (h + l) / 2;
-        if (s3_func(x) > 0) {
-            h = x;
-        }
-        else {
-            l = x;
-        }
-    }
-    lim_a = l;
-    for (x = 0; s3_func(x) > 1e-20; x += 1);
-    l = 0;
-    h = x;
-    while (fabs(h - l) > 1e-12) {
-        x = (h + l) / 2;
-        if (s3_func(x) > 0) {
-            l = x;
-        }
-        else {
-            h = x;
-        }
-    }
-    lim_b = h;
-    {
-        double  sum = 0;
-        int const m = 1000;
-        int     i;
-        for (i = 0; i <= m; ++i) {
-            double  x = lim_a + i * (lim_b - lim_a) / m;
-            double  y = s3_func(x);
-            sum += y;
-        }
-        {
-            double  norm = (m + 1) / (sum * (lim_b - lim_a));
-            /*printf( "norm = %lf\n",norm); */
-            return norm;
-        }
+    int     i;
+    for (i = 0; i < (int) (sizeof(psy_tables) / sizeof(psy_tables[0])); i++) {
+        if (psy_tables[i].samplerate == samplerate)
+            return &psy_tables[i];
     }
+    return 0;
 }
 #endif
 
-static  FLOAT
-stereo_demask(double f)
+/* take over the samplerate dependent values of one partition layout,
+ * the spreading function only if p has one
+ */
+static int
+init_partition(lame_internal_flags * gfc, PsyConst_CB2SB_t * gd, PsyPartition_t const *p)
 {
-    /* setup stereo demasking thresholds */
-    /* formula reverse enginerred from plot in paper */
-    double  arg = freq2bark(f);
-    arg = (Min(arg, 15.5) / 15.5);
-
-    return pow(10.0, 1.25 * (1 - cos(PI * arg)) - 2.5);
-}
+    int     i;
 
-static void
-init_numline(PsyConst_CB2SB_t * gd, FLOAT sfreq, int fft_size,
-             int mdct_size, int sbmax, int const *scalepos)
-{
-    FLOAT   b_frq[CBANDS + 1];
-    FLOAT const mdct_freq_frac = sfreq / (2.0f * mdct_size);
-    FLOAT const deltafreq = fft_size / (2.0f * mdct_size);
-    int     partition[HBLKSIZE] = { 0 };
-    int     i, j, ni;
-    int     sfb;
-    sfreq /= fft_size;
-    j = 0;
-    ni = 0;
-    /* compute numlines, the number of spectral lines in each partition band */
-    /* each partition band should be about DELBARK wide. */
+    memcpy(gd->numlines, p->numlines, sizeof(gd->numlines));
     for (i = 0; i < CBANDS; i++) {
-        FLOAT   bark1;
-        int     j2, nl;
-        bark1 = freq2bark(sfreq * j);
-
-        b_frq[i] = sfreq * j;
-
-        for (j2 = j; freq2bark(sfreq * j2) - bark1 < DELBARK && j2 <= fft_size / 2; j2++);
-
-        nl = j2 - j;
-        gd->numlines[i] = nl;
+        int const nl = p->numlines[i];
         gd->rnumlines[i] = (nl > 0) ? (1.0f / nl) : 0;
-
-        ni = i + 1;
-
-        while (j < j2) {
-            assert(j < HBLKSIZE);
-            partition[j++] = i;
-        }
-        if (j > fft_size / 2) {
-            j = fft_size / 2;
-            ++i;
-            break;
-        }
     }
-    assert(i < CBANDS);
-    b_frq[i] = sfreq * j;
-
-    gd->n_sb = sbmax;
-    gd->npart = ni;
-
-    {
-        j = 0;
-        for (i = 0; i < gd->npart; i++) {
-            int const nl = gd->numlines[i];
-            FLOAT const freq = sfreq * (j + nl / 2);
-            gd->mld_cb[i] = stereo_demask(freq);
-            j += nl;
-        }
-        for (; i < CBANDS; ++i) {
-            gd->mld_cb[i] = 1;
-        }
-    }
-    for (sfb = 0; sfb < sbmax; sfb++) {
-        int     i1, i2, bo;
-        int     start = scalepos[sfb];
-        int     end = scalepos[sfb + 1];
-
-        i1 = floor(.5 + deltafreq * (start - .5));
-        if (i1 < 0)
-            i1 = 0;
-        i2 = floor(.5 + deltafreq * (end - .5));
-
-        if (i2 > fft_size / 2)
-            i2 = fft_size / 2;
-
-        bo = partition[i2];
-        gd->bm[sfb] = (partition[i1] + partition[i2]) / 2;
-        gd->bo[sfb] = bo;
-
-        /* calculate how much of this band belongs to current scalefactor band */
-        {
-            FLOAT const f_tmp = mdct_freq_frac * end;
-            FLOAT   bo_w = (f_tmp - b_frq[bo]) / (b_frq[bo + 1] - b_frq[bo]);
-            if (bo_w < 0) {
-                bo_w = 0;
-            }
-            else {
-                if (bo_w > 1) {
-                    bo_w = 1;
-                }
-            }
-            gd->bo_weight[sfb] = bo_w;
-        }
-        gd->mld[sfb] = stereo_demask(mdct_freq_frac * start);
-    }
-}
-
-static void
-compute_bark_values(PsyConst_CB2SB_t const *gd, FLOAT sfreq, int fft_size,
-                    FLOAT * bval, FLOAT * bval_width)
-{
-    /* compute bark values of each critical band */
-    int     k, j = 0, ni = gd->npart;
-    sfreq /= fft_size;
-    for (k = 0; k < ni; k++) {
-        int const w = gd->numlines[k];
-        FLOAT   bark1, bark2;
-
-        bark1 = freq2bark(sfreq * (j));
-        bark2 = freq2bark(sfreq * (j + w - 1));
-        bval[k] = .5 * (bark1 + bark2);
-
-        bark1 = freq2bark(sfreq * (j - .5));
-        bark2 = freq2bark(sfreq * (j + w - .5));
-        bval_width[k] = bark2 - bark1;
-        j += w;
+    memcpy(gd->mld_cb, p->mld_cb, sizeof(gd->mld_cb));
+    memcpy(gd->mld, p->mld, sizeof(gd->mld));
+    memcpy(gd->bo_weight, p->bo_weight, sizeof(gd->bo_weight));
+    memcpy(gd->bm, p->bm, sizeof(gd->bm));
+    memcpy(gd->bo, p->bo, sizeof(gd->bo));
+    gd->npart = p->npart;
+    gd->n_sb = p->n_sb;
+    if (p->s3_size > 0) {
+        memcpy(gd->s3ind, p->s3ind, sizeof(gd->s3ind));
+        gd->s3 = gfc_calloc(gfc, FLOAT, p->s3_size);
+        if (!gd->s3)
+            return -1;
+        memcpy(gd->s3, p->s3, p->s3_size * sizeof(FLOAT));
     }
+    return 0;
 }
 
+/* copy the packed s3 values into groups of S3_LANES partitions, row t of
+ * a group holds s3[b][s3ind[b][0] + t] for each of its partitions b and
+ * is zero past s3ind[b][1], which leaves the masking unchanged
+ */
 static int
-init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
-               FLOAT const *bval, FLOAT const *bval_width, FLOAT const *norm)
+init_s3_band(lame_internal_flags * gfc, PsyConst_CB2SB_t * gd)
 {
-    FLOAT   s3[CBANDS][CBANDS];
-    /* The s3 array is not linear in the bark scale.
-     * bval[x] should be used to get the bark value.
-     */
-    int     i, j, k;
-    int     numberOfNoneZero = 0;
-
-    memset(&s3[0][0], 0, sizeof(s3));
-
-    /* s[i][j], the value of the spreading function,
-     * centered at band j (masker), for band i (maskee)
-     *
-     * i.e.: sum over j to spread into signal barkval=i
-     * NOTE: i and j are used opposite as in the ISO docs
-     */
-    for (i = 0; i < npart; i++) {
-        for (j = 0; j < npart; j++) {
-            FLOAT   v = s3_func(bval[i] - bval[j]) * bval_width[j];
-            s3[i][j] = v * norm[i];
-        }
-    }
-    for (i = 0; i < npart; i++) {
-        for (j = 0; j < npart; j++) {
-            if (s3[i][j] > 0.0f)
-                break;
-        }
-        s3ind[i][0] = j;
-
-        for (j = npart - 1; j > 0; j--) {
-            if (s3[i][j] > 0.0f)
-                break;
-        }
-        s3ind[i][1] = j;
-        numberOfNoneZero += (s3ind[i][1] - s3ind[i][0] + 1);
-    }
-    *p = lame_calloc(FLOAT, numberOfNoneZero);
-    if (!*p)
+    int const ngroups = (gd->npart + S3_LANES - 1) / S3_LANES;
+    int     b, t, k = 0, width = 0;
+
+    for (b = 0; b < gd->npart; b++)
+        width = Max(width, gd->s3ind[b][1] - gd->s3ind[b][0] + 1);
+    gd->s3_width = width;
+    gd->s3_band = gfc_calloc(gfc, FLOAT, ngroups * width * S3_LANES);
+    if (!gd->s3_band)
         return -1;
 
-    k = 0;
-    for (i = 0; i < npart; i++)
-        for (j = s3ind[i][0]; j <= s3ind[i][1]; j++)
-            (*p)[k++] = s3[i][j];
-
+    for (b = 0; b < gd->npart; b++) {
+        FLOAT  *const p = gd->s3_band + (b / S3_LANES) * width * S3_LANES + b % S3_LANES;
+        for (t = 0; t <= gd->s3ind[b][1] - gd->s3ind[b][0]; t++)
+            p[t * S3_LANES] = gd->s3[k++];
+    }
     return 0;
 }
 
-int
-psymodel_init(lame_global_flags const *gfp)
+/* sets the psymodel history back to the start of a stream, the
+ * constants computed by psymodel_init() are left alone
+ */
+void
+psymodel_reset(lame_internal_flags * gfc)
 {
-    lame_internal_flags *const gfc = gfp->internal_flags;
-    SessionConfig_t *const cfg = &gfc->cfg;
     PsyStateVar_t *const psv = &gfc->sv_psy;
-    PsyConst_t *gd;
-    int     i, j, b, sb, k;
-    FLOAT   bvl_a = 13, bvl_b = 24;
-    FLOAT   snr_l_a = 0, snr_l_b = 0;
-    FLOAT   snr_s_a = -8.25, snr_s_b = -4.5;
-
-    FLOAT   bval[CBANDS];
-    FLOAT   bval_width[CBANDS];
-    FLOAT   norm[CBANDS];
-    FLOAT const sfreq = cfg->samplerate_out;
-
-    FLOAT   xav = 10, xbv = 12;
-    FLOAT const minval_low = (0.f - cfg->minval);
+    int     i, j, sb;
 
-    if (gfc->cd_psy != 0) {
-        return 0;
-    }
-    memset(norm, 0, sizeof(norm));
-
-    gd = lame_calloc(PsyConst_t, 1);
-    gfc->cd_psy = gd;
-
-    gd->force_short_block_calc = gfp->experimentalZ;
+    memset(psv, 0, sizeof(*psv));
+    memset(&gfc->ov_psy, 0, sizeof(gfc->ov_psy));
 
     psv->blocktype_old[0] = psv->blocktype_old[1] = NORM_TYPE; /* the vbr header is long blocks */
 
@@ -1931,28 +1738,43 @@ psymodel_init(lame_global_flags const *gfp)
     /* init. for loudness approx. -jd 2001 mar 27 */
     psv->loudness_sq_save[0] = psv->loudness_sq_save[1] = 0.0;
 
+    psv->ath_adjust_factor = 0.01; /* minimum, for leading low loudness */
+    psv->ath_adjust_limit = 1.0; /* on lead, allow adjust up to maximum */
+    gfc->sv_qnt.ath_adjust_factor = psv->ath_adjust_factor;
+}
+
+
+static int
+init_psy_const(lame_global_flags const *gfp, PsyTables_t const *pt)
+{
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    SessionConfig_t *const cfg = &gfc->cfg;
+    PsyConst_t *gd;
+    int     i, j, b, k;
+
+    FLOAT const *bval;
+    FLOAT const sfreq = cfg->samplerate_out;
+
+    FLOAT   xav = 10, xbv = 12;
+    FLOAT const minval_low = (0.f - cfg->minval);
+
+    gd = gfc_calloc(gfc, PsyConst_t, 1);
+    if (gd == 0)
+        return -1;
+    gfc->cd_psy = gd;
+
+    gd->force_short_block_calc = gfp->experimentalZ;
+
 
 
     /*************************************************************************
      * now compute the psychoacoustic model specific constants
      ************************************************************************/
-    /* compute numlines, bo, bm, bval, bval_width, mld */
-    init_numline(&gd->l, sfreq, BLKSIZE, 576, SBMAX_l, gfc->scalefac_band.l);
-    assert(gd->l.npart < CBANDS);
-    compute_bark_values(&gd->l, sfreq, BLKSIZE, bval, bval_width);
-
-    /* compute the spreading function */
-    for (i = 0; i < gd->l.npart; i++) {
-        double  snr = snr_l_a;
-        if (bval[i] >= bvl_a) {
-            snr = snr_l_b * (bval[i] - bvl_a) / (bvl_b - bvl_a)
-                + snr_l_a * (bvl_b - bval[i]) / (bvl_b - bvl_a);
-        }
-        norm[i] = pow(10.0, snr / 10.0);
-    }
-    i = init_s3_values(&gd->l.s3, gd->l.s3ind, gd->l.npart, bval, bval_width, norm);
+    /* numlines, bo, bm, mld and the spreading function */
+    i = init_partition(gfc, &gd->l, &pt->l);
     if (i)
         return i;
+    bval = pt->l.bval;
 
     /* compute long block specific values, ATH and MINVAL */
     j = 0;
@@ -1997,20 +1819,14 @@ psymodel_init(lame_global_flags const *gfp)
     /************************************************************************
      * do the same things for short blocks
      ************************************************************************/
-    init_numline(&gd->s, sfreq, BLKSIZE_s, 192, SBMAX_s, gfc->scalefac_band.s);
-    assert(gd->s.npart < CBANDS);
-    compute_bark_values(&gd->s, sfreq, BLKSIZE_s, bval, bval_width);
+    i = init_partition(gfc, &gd->s, &pt->s);
+    if (i)
+        return i;
+    bval = pt->s.bval;
 
-    /* SNR formula. short block is normalized by SNR. is it still right ? */
     j = 0;
     for (i = 0; i < gd->s.npart; i++) {
         double  x;
-        double  snr = snr_s_a;
-        if (bval[i] >= bvl_a) {
-            snr = snr_s_b * (bval[i] - bvl_a) / (bvl_b - bvl_a)
-                + snr_s_a * (bvl_b - bval[i]) / (bvl_b - bvl_a);
-        }
-        norm[i] = pow(10.0, snr / 10.0);
 
         /* ATH */
         x = FLOAT_MAX;
@@ -2049,26 +1865,13 @@ psymodel_init(lame_global_flags const *gfp)
         gd->s.minval[i] = pow(10.0, x / 10) * gd->s.numlines[i];
     }
 
-    i = init_s3_values(&gd->s.s3, gd->s.s3ind, gd->s.npart, bval, bval_width, norm);
-    if (i)
-        return i;
-
-
     init_mask_add_max_values();
-    init_fft(gfc);
+    init_fft_windows(gd->window, gd->window_s);
 
     /* setup temporal masking */
     gd->decay = exp(-1.0 * LOG10 / (temporalmask_sustain_sec * sfreq / 192.0));
 
     {
-        FLOAT   msfix;
-        msfix = NS_MSFIX;
-        if (cfg->use_safe_joint_stereo)
-            msfix = 1.0;
-        if (fabs(cfg->msfix) > 0.0)
-            msfix = cfg->msfix;
-        cfg->msfix = msfix;
-
         /* spread only from npart_l bands.  Normally, we use the spreading
          * function to convolve from npart_l down to npart_l bands 
          */
@@ -2076,14 +1879,18 @@ psymodel_init(lame_global_flags const *gfp)
             if (gd->l.s3ind[b][1] > gd->l.npart - 1)
                 gd->l.s3ind[b][1] = gd->l.npart - 1;
     }
+    i = init_s3_band(gfc, &gd->l);
+    if (i)
+        return i;
+    i = init_s3_band(gfc, &gd->s);
+    if (i)
+        return i;
 
     /*  prepare for ATH auto adjustment:
      *  we want to decrease the ATH by 12 dB per second
      */
 #define  frame_duration (576. * cfg->mode_gr / sfreq)
     gfc->ATH->decay = pow(10., -12. / 10. * frame_duration);
-    gfc->ATH->adjust_factor = 0.01; /* minimum, for leading low loudness */
-    gfc->ATH->adjust_limit = 1.0; /* on lead, allow adjust up to maximum */
 #undef  frame_duration
 
     assert(gd->l.bo[SBMAX_l - 1] <= gd->l.npart);
@@ -2162,6 +1969,51 @@ psymodel_init(lame_global_flags const *gfp)
         }
     }
     memcpy(&gd->l_to_s, &gd->l, sizeof(gd->l_to_s));
-    init_numline(&gd->l_to_s, sfreq, BLKSIZE, 192, SBMAX_s, gfc->scalefac_band.s);
-    return 0;
+    return init_partition(gfc, &gd->l_to_s, &pt->l_to_s);
+}
+
+
+int
+psymodel_init(lame_global_flags const *gfp)
+{
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    SessionConfig_t *const cfg = &gfc->cfg;
+    PsyTables_t *computed;
+    FLOAT  *s3;
+    FLOAT   msfix;
+    int     ret = -1;
+
+    psymodel_reset(gfc);
+    init_fft(gfc);
+    init_s3_convolve(gfc);
+
+    msfix = NS_MSFIX;
+    if (cfg->use_safe_joint_stereo)
+        msfix = 1.0;
+    if (fabs(cfg->msfix) > 0.0)
+        msfix = cfg->msfix;
+    cfg->msfix = msfix;
+
+    /* the constants may come from another encoder, see session.c */
+    if (gfc->cd_psy != 0) {
+        return 0;
+    }
+#ifdef HAVE_PSYTABLES_DATA
+    {
+        PsyTables_t const *const pt = find_psy_tables(cfg->samplerate_out);
+        if (pt != 0)
+            return init_psy_const(gfp, pt);
+    }
+#endif
+    /* not generated at build time, compute them now */
+    computed = lame_calloc(PsyTables_t, 1);
+    s3 = lame_calloc(FLOAT, 2 * CBANDS * CBANDS);
+    if (computed != 0 && s3 != 0) {
+        psy_tables_compute(computed, s3, s3 + CBANDS * CBANDS, cfg->samplerate_out,
+                           gfc->scalefac_band.l, gfc->scalefac_band.s);
+        ret = init_psy_const(gfp, computed);
+    }
+    free(computed);
+    free(s3);
+    return ret;
 }
@@ -37,6 +37,10 @@ int     L3psycho_anal_vbr(lame_internal_flags * gfc,
 
 
 int     psymodel_init(lame_global_flags const* gfp);
+void    psymodel_reset(lame_internal_flags * gfc);
+
+void    init_psymodel_tables(void);
+void    init_s3_convolve(lame_internal_flags * gfc);
 
 
 #define rpelev 2
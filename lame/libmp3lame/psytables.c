@@ -0,0 +1,377 @@
+/*
+ *      psytables.c
+ *
+ *      Copyright (c) 1999-2000 Mark Taylor
+ *      Copyright (c) 2000-2012 Robert Hegemann
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+/*
+ *  The psychoacoustic model constants which only depend on the samplerate:
+ *  the partitioning of the FFT lines, its mapping onto the scalefactor
+ *  bands and the spreading function.  This file is part of the library
+ *  and of mkpsytables, which writes the results for all MPEG samplerates
+ *  into a header at build time, so keep it free of other library code.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "psymodel.h"
+#include "psytables.h"
+
+
+#ifdef M_LN10
+#define  LN_TO_LOG10  (M_LN10/10)
+#else
+#define  LN_TO_LOG10  0.2302585093
+#endif
+
+
+/* see for example "Zwicker: Psychoakustik, 1982; ISBN 3-540-11401-7 */
+FLOAT
+freq2bark(FLOAT freq)
+{
+    /* input: freq in hz  output: barks */
+    if (freq < 0)
+        freq = 0;
+    freq = freq * 0.001;
+    return 13.0 * atan(.76 * freq) + 3.5 * atan(freq * freq / (7.5 * 7.5));
+}
+
+/* 
+ *   The spreading function.  Values returned in units of energy
+ */
+static  FLOAT
+s3_func(FLOAT bark)
+{
+    FLOAT   tempx, x, tempy, temp;
+    tempx = bark;
+    if (tempx >= 0)
+        tempx *= 3;
+    else
+        tempx *= 1.5;
+
+    if (tempx >= 0.5 && tempx <= 2.5) {
+        temp = tempx - 0.5;
+        x = 8.0 * (temp * temp - 2.0 * temp);
+    }
+    else
+        x = 0.0;
+    tempx += 0.474;
+    tempy = 15.811389 + 7.5 * tempx - 17.5 * sqrt(1.0 + tempx * tempx);
+
+    if (tempy <= -60.0)
+        return 0.0;
+
+    tempx = exp((x + tempy) * LN_TO_LOG10);
+
+    /* Normalization.  The spreading function should be normalized so that:
+       +inf
+       /
+       |  s3 [ bark ]  d(bark)   =  1
+       /
+       -inf
+     */
+    tempx /= .6609193;
+    return tempx;
+}
+
+#if 0
+static  FLOAT
+norm_s3_func(void)
+{
+    double  lim_a = 0, lim_b = 0;
+    double  x = 0, l, h;
+    for (x = 0; s3_func(x) > 1e-20; x -= 1);
+    l = x;
+    h = 0;
+    while (fabs(h - l) > 1e-12) {
+        x = (h + l) / 2;
+        if (s3_func(x) > 0) {
+            h = x;
+        }
+        else {
+            l = x;
+        }
+    }
+    lim_a = l;
+    for (x = 0; s3_func(x) > 1e-20; x += 1);
+    l = 0;
+    h = x;
+    while (fabs(h - l) > 1e-12) {
+        x = (h + l) / 2;
+        if (s3_func(x) > 0) {
+            l = x;
+        }
+        else {
+            h = x;
+        }
+    }
+    lim_b = h;
+    {
+        double  sum = 0;
+        int const m = 1000;
+        int     i;
+        for (i = 0; i <= m; ++i) {
+            double  x = lim_a + i * (lim_b - lim_a) / m;
+            double  y = s3_func(x);
+            sum += y;
+        }
+        {
+            double  norm = (m + 1) / (sum * (lim_b - lim_a));
+            /*printf( "norm = %lf\n",norm); */
+            return norm;
+        }
+    }
+}
+#endif
+
+static  FLOAT
+stereo_demask(double f)
+{
+    /* setup stereo demasking thresholds */
+    /* formula reverse enginerred from plot in paper */
+    double  arg = freq2bark(f);
+    arg = (Min(arg, 15.5) / 15.5);
+
+    return pow(10.0, 1.25 * (1 - cos(PI * arg)) - 2.5);
+}
+
+static void
+init_numline(PsyPartition_t * gd, FLOAT sfreq, int fft_size,
+             int mdct_size, int sbmax, int const *scalepos)
+{
+    FLOAT   b_frq[CBANDS + 1];
+    FLOAT const mdct_freq_frac = sfreq / (2.0f * mdct_size);
+    FLOAT const deltafreq = fft_size / (2.0f * mdct_size);
+    int     partition[HBLKSIZE] = { 0 };
+    int     i, j, ni;
+    int     sfb;
+    sfreq /= fft_size;
+    j = 0;
+    ni = 0;
+    /* compute numlines, the number of spectral lines in each partition band */
+    /* each partition band should be about DELBARK wide. */
+    for (i = 0; i < CBANDS; i++) {
+        FLOAT   bark1;
+        int     j2, nl;
+        bark1 = freq2bark(sfreq * j);
+
+        b_frq[i] = sfreq * j;
+
+        for (j2 = j; freq2bark(sfreq * j2) - bark1 < DELBARK && j2 <= fft_size / 2; j2++);
+
+        nl = j2 - j;
+        gd->numlines[i] = nl;
+
+        ni = i + 1;
+
+        while (j < j2) {
+            assert(j < HBLKSIZE);
+            partition[j++] = i;
+        }
+        if (j > fft_size / 2) {
+            j = fft_size / 2;
+            ++i;
+            break;
+        }
+    }
+    assert(i < CBANDS);
+    b_frq[i] = sfreq * j;
+
+    gd->n_sb = sbmax;
+    gd->npart = ni;
+
+    {
+        j = 0;
+        for (i = 0; i < gd->npart; i++) {
+            int const nl = gd->numlines[i];
+            FLOAT const freq = sfreq * (j + nl / 2);
+            gd->mld_cb[i] = stereo_demask(freq);
+            j += nl;
+        }
+        for (; i < CBANDS; ++i) {
+            gd->mld_cb[i] = 1;
+        }
+    }
+    for (sfb = 0; sfb < sbmax; sfb++) {
+        int     i1, i2, bo;
+        int     start = scalepos[sfb];
+        int     end = scalepos[sfb + 1];
+
+        i1 = floor(.5 + deltafreq * (start - .5));
+        if (i1 < 0)
+            i1 = 0;
+        i2 = floor(.5 + deltafreq * (end - .5));
+
+        if (i2 > fft_size / 2)
+            i2 = fft_size / 2;
+
+        bo = partition[i2];
+        gd->bm[sfb] = (partition[i1] + partition[i2]) / 2;
+        gd->bo[sfb] = bo;
+
+        /* calculate how much of this band belongs to current scalefactor band */
+        {
+            FLOAT const f_tmp = mdct_freq_frac * end;
+            FLOAT   bo_w = (f_tmp - b_frq[bo]) / (b_frq[bo + 1] - b_frq[bo]);
+            if (bo_w < 0) {
+                bo_w = 0;
+            }
+            else {
+                if (bo_w > 1) {
+                    bo_w = 1;
+                }
+            }
+            gd->bo_weight[sfb] = bo_w;
+        }
+        gd->mld[sfb] = stereo_demask(mdct_freq_frac * start);
+    }
+}
+
+static void
+compute_bark_values(PsyPartition_t * gd, FLOAT sfreq, int fft_size)
+{
+    /* compute bark values of each critical band */
+    int     k, j = 0, ni = gd->npart;
+    sfreq /= fft_size;
+    for (k = 0; k < ni; k++) {
+        int const w = gd->numlines[k];
+        FLOAT   bark1, bark2;
+
+        bark1 = freq2bark(sfreq * (j));
+        bark2 = freq2bark(sfreq * (j + w - 1));
+        gd->bval[k] = .5 * (bark1 + bark2);
+
+        bark1 = freq2bark(sfreq * (j - .5));
+        bark2 = freq2bark(sfreq * (j + w - .5));
+        gd->bval_width[k] = bark2 - bark1;
+        j += w;
+    }
+}
+
+/* computes the spreading function and packs its nonzero range of each
+ * partition into p, which needs room for npart * npart values
+ */
+static void
+init_s3_values(PsyPartition_t * gd, FLOAT * p, FLOAT const *norm)
+{
+    FLOAT   s3[CBANDS][CBANDS];
+    /* The s3 array is not linear in the bark scale.
+     * bval[x] should be used to get the bark value.
+     */
+    FLOAT const *const bval = gd->bval;
+    FLOAT const *const bval_width = gd->bval_width;
+    int     (*const s3ind)[2] = gd->s3ind;
+    int const npart = gd->npart;
+    int     i, j, k;
+
+    memset(&s3[0][0], 0, sizeof(s3));
+
+    /* s[i][j], the value of the spreading function,
+     * centered at band j (masker), for band i (maskee)
+     *
+     * i.e.: sum over j to spread into signal barkval=i
+     * NOTE: i and j are used opposite as in the ISO docs
+     */
+    for (i = 0; i < npart; i++) {
+        for (j = 0; j < npart; j++) {
+            FLOAT   v = s3_func(bval[i] - bval[j]) * bval_width[j];
+            s3[i][j] = v * norm[i];
+        }
+    }
+    for (i = 0; i < npart; i++) {
+        for (j = 0; j < npart; j++) {
+            if (s3[i][j] > 0.0f)
+                break;
+        }
+        s3ind[i][0] = j;
+
+        for (j = npart - 1; j > 0; j--) {
+            if (s3[i][j] > 0.0f)
+                break;
+        }
+        s3ind[i][1] = j;
+    }
+
+    k = 0;
+    for (i = 0; i < npart; i++)
+        for (j = s3ind[i][0]; j <= s3ind[i][1]; j++)
+            p[k++] = s3[i][j];
+    gd->s3 = p;
+    gd->s3_size = k;
+}
+
+
+void
+psy_tables_compute(PsyTables_t * t, FLOAT * s3_l, FLOAT * s3_s, int samplerate,
+                   int const *scalefac_band_l, int const *scalefac_band_s)
+{
+    FLOAT   bvl_a = 13, bvl_b = 24;
+    FLOAT   snr_l_a = 0, snr_l_b = 0;
+    FLOAT   snr_s_a = -8.25, snr_s_b = -4.5;
+    FLOAT   norm[CBANDS];
+    FLOAT const sfreq = samplerate;
+    int     i;
+
+    memset(t, 0, sizeof(*t));
+    memset(norm, 0, sizeof(norm));
+    t->samplerate = samplerate;
+
+    /* compute numlines, bo, bm, bval, bval_width, mld */
+    init_numline(&t->l, sfreq, BLKSIZE, 576, SBMAX_l, scalefac_band_l);
+    assert(t->l.npart < CBANDS);
+    compute_bark_values(&t->l, sfreq, BLKSIZE);
+
+    /* compute the spreading function */
+    for (i = 0; i < t->l.npart; i++) {
+        double  snr = snr_l_a;
+        if (t->l.bval[i] >= bvl_a) {
+            snr = snr_l_b * (t->l.bval[i] - bvl_a) / (bvl_b - bvl_a)
+                + snr_l_a * (bvl_b - t->l.bval[i]) / (bvl_b - bvl_a);
+        }
+        norm[i] = pow(10.0, snr / 10.0);
+    }
+    init_s3_values(&t->l, s3_l, norm);
+
+    /* do the same things for short blocks */
+    init_numline(&t->s, sfreq, BLKSIZE_s, 192, SBMAX_s, scalefac_band_s);
+    assert(t->s.npart < CBANDS);
+    compute_bark_values(&t->s, sfreq, BLKSIZE_s);
+
+    /* SNR formula. short block is normalized by SNR. is it still right ? */
+    for (i = 0; i < t->s.npart; i++) {
+        double  snr = snr_s_a;
+        if (t->s.bval[i] >= bvl_a) {
+            snr = snr_s_b * (t->s.bval[i] - bvl_a) / (bvl_b - bvl_a)
+                + snr_s_a * (bvl_b - t->s.bval[i]) / (bvl_b - bvl_a);
+        }
+        norm[i] = pow(10.0, snr / 10.0);
+    }
+    init_s3_values(&t->s, s3_s, norm);
+
+    /* long block partitions mapped onto the short block scalefactor bands */
+    init_numline(&t->l_to_s, sfreq, BLKSIZE, 192, SBMAX_s, scalefac_band_s);
+}
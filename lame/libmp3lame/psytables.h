@@ -0,0 +1,59 @@
+/*
+ *      psytables.h
+ *
+ *      Copyright (c) 1999-2000 Mark Taylor
+ *      Copyright (c) 2000-2012 Robert Hegemann
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_PSYTABLES_H
+#define LAME_PSYTABLES_H
+
+/* the partition layout of one block size, it only depends on the
+ * samplerate and is either computed by psy_tables_compute() or taken
+ * from the tables mkpsytables generated at build time
+ */
+typedef struct {
+    FLOAT   mld_cb[CBANDS];
+    FLOAT   bval[CBANDS];
+    FLOAT   bval_width[CBANDS];
+    FLOAT   mld[Max(SBMAX_l, SBMAX_s)];
+    FLOAT   bo_weight[Max(SBMAX_l, SBMAX_s)];
+    int     numlines[CBANDS];
+    int     bm[Max(SBMAX_l, SBMAX_s)];
+    int     bo[Max(SBMAX_l, SBMAX_s)];
+    int     s3ind[CBANDS][2];
+    int     npart;
+    int     n_sb;
+    int     s3_size;    /* number of packed s3 values, 0 for l_to_s */
+    FLOAT const *s3;
+} PsyPartition_t;
+
+typedef struct {
+    int     samplerate;
+    PsyPartition_t l;
+    PsyPartition_t s;
+    PsyPartition_t l_to_s;
+} PsyTables_t;
+
+FLOAT   freq2bark(FLOAT freq);
+
+/* s3_l and s3_s need room for CBANDS * CBANDS values each */
+void    psy_tables_compute(PsyTables_t * t, FLOAT * s3_l, FLOAT * s3_s, int samplerate,
+                           int const *scalefac_band_l, int const *scalefac_band_s);
+
+#endif /* LAME_PSYTABLES_H */
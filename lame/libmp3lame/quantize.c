@@ -103,6 +103,12 @@ init_xrpow_core_init(lame_internal_flags * const gfc)
     gfc->init_xrpow_core = init_xrpow_core_sse;
 #endif
 #endif
+#if defined(HAVE_IMMINTRIN_H)
+    if (gfc->CPU_features.AVX512)
+        gfc->init_xrpow_core = init_xrpow_core_avx512;
+    else if (gfc->CPU_features.AVX2)
+        gfc->init_xrpow_core = init_xrpow_core_avx2;
+#endif
 }
 
 
@@ -170,7 +176,7 @@ psfb21_analogsilence(lame_internal_flags const *gfc, gr_info * const cod_info)
             int const end = gfc->scalefac_band.psfb21[gsfb + 1];
             int     j;
             FLOAT   ath21;
-            ath21 = athAdjust(ATH->adjust_factor, ATH->psfb21[gsfb], ATH->floor, 0);
+            ath21 = athAdjust(gfc->sv_qnt.ath_adjust_factor, ATH->psfb21[gsfb], ATH->floor, 0);
 
             if (gfc->sv_qnt.longfact[21] > 1e-12f)
                 ath21 *= gfc->sv_qnt.longfact[21];
@@ -200,7 +206,7 @@ psfb21_analogsilence(lame_internal_flags const *gfc, gr_info * const cod_info)
                     start + (gfc->scalefac_band.psfb12[gsfb + 1] - gfc->scalefac_band.psfb12[gsfb]);
                 int     j;
                 FLOAT   ath12;
-                ath12 = athAdjust(ATH->adjust_factor, ATH->psfb12[gsfb], ATH->floor, 0);
+                ath12 = athAdjust(gfc->sv_qnt.ath_adjust_factor, ATH->psfb12[gsfb], ATH->floor, 0);
 
                 if (gfc->sv_qnt.shortfact[12] > 1e-12f)
                     ath12 *= gfc->sv_qnt.shortfact[12];
@@ -462,7 +468,7 @@ trancate_smallspectrums(lame_internal_flags const *gfc,
     if ((!(gfc->sv_qnt.substep_shaping & 4) && gi->block_type == SHORT_TYPE)
         || gfc->sv_qnt.substep_shaping & 0x80)
         return;
-    (void) calc_noise(gi, l3_xmin, distort, &dummy, 0);
+    (void) calc_noise(gfc, gi, l3_xmin, distort, &dummy, 0);
     for (j = 0; j < 576; j++) {
         FLOAT   xr = 0.0;
         if (gi->l3_enc[j] != 0)
@@ -1037,7 +1043,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
 
     /* compute the distortion in this quantization */
     /* coefficients and thresholds both l/r (or both mid/side) */
-    (void) calc_noise(cod_info, l3_xmin, distort, &best_noise_info, &prev_noise);
+    (void) calc_noise(gfc, cod_info, l3_xmin, distort, &best_noise_info, &prev_noise);
     best_noise_info.bits = cod_info->part2_3_length;
 
     cod_info_w = *cod_info;
@@ -1120,7 +1126,7 @@ outer_loop(lame_internal_flags * gfc, gr_info * const cod_info, const FLOAT * co
             }
 
             /* compute the distortion in this quantization */
-            (void) calc_noise(&cod_info_w, l3_xmin, distort, &noise_info, &prev_noise);
+            (void) calc_noise(gfc, &cod_info_w, l3_xmin, distort, &noise_info, &prev_noise);
             noise_info.bits = cod_info_w.part2_3_length;
 
             /* check if this quantization is better
@@ -1363,6 +1369,44 @@ get_framebits(lame_internal_flags * gfc, int frameBits[15])
 
 
 
+/*********************************************************************
+ *
+ *      calc_masking_lower()
+ *
+ *  masking lowering for one granule and channel, as set up by the
+ *  iteration loops. The value of the last granule and channel stays
+ *  in sv_qnt.masking_lower and is used by the psymodel of the next
+ *  frame, the pipelined encoder in encoder.c depends on that.
+ *
+ *********************************************************************/
+
+FLOAT
+calc_masking_lower(lame_internal_flags const *gfc, int block_type, FLOAT pe)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    FLOAT   masking_lower_db, adjust = 0.0;
+
+    if (cfg->vbr == vbr_mt || cfg->vbr == vbr_mtrh) {
+        return pow(10.0, gfc->sv_qnt.mask_adjust * 0.1);
+    }
+    /* CBR and ABR don't adjust by PE */
+    if (block_type != SHORT_TYPE) { /* NORM, START or STOP type */
+        if (cfg->vbr == vbr_rh) {
+            adjust = 1.28 / (1 + exp(3.5 - pe / 300.)) - 0.05;
+        }
+        masking_lower_db = gfc->sv_qnt.mask_adjust - adjust;
+    }
+    else {
+        if (cfg->vbr == vbr_rh) {
+            adjust = 2.56 / (1 + exp(3.5 - pe / 300.)) - 0.14;
+        }
+        masking_lower_db = gfc->sv_qnt.mask_adjust_short - adjust;
+    }
+    return pow(10.0, masking_lower_db * 0.1);
+}
+
+
+
 /*********************************************************************
  *
  *      VBR_prepare()
@@ -1396,7 +1440,6 @@ VBR_old_prepare(lame_internal_flags * gfc,
     SessionConfig_t const *const cfg = &gfc->cfg;
     EncResult_t *const eov = &gfc->ov_enc;
 
-    FLOAT   masking_lower_db, adjust = 0.0;
     int     gr, ch;
     int     analog_silence = 1;
     int     avg, mxb, bits = 0;
@@ -1415,15 +1458,7 @@ VBR_old_prepare(lame_internal_flags * gfc,
         for (ch = 0; ch < cfg->channels_out; ++ch) {
             gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
 
-            if (cod_info->block_type != SHORT_TYPE) { /* NORM, START or STOP type */
-                adjust = 1.28 / (1 + exp(3.5 - pe[gr][ch] / 300.)) - 0.05;
-                masking_lower_db = gfc->sv_qnt.mask_adjust - adjust;
-            }
-            else {
-                adjust = 2.56 / (1 + exp(3.5 - pe[gr][ch] / 300.)) - 0.14;
-                masking_lower_db = gfc->sv_qnt.mask_adjust_short - adjust;
-            }
-            gfc->sv_qnt.masking_lower = pow(10.0, masking_lower_db * 0.1);
+            gfc->sv_qnt.masking_lower = calc_masking_lower(gfc, cod_info->block_type, pe[gr][ch]);
 
             init_outer_loop(gfc, cod_info);
             bands[gr][ch] = calc_xmin(gfc, &ratio[gr][ch], cod_info, l3_xmin[gr][ch]);
@@ -1616,7 +1651,7 @@ VBR_new_prepare(lame_internal_flags * gfc,
         for (ch = 0; ch < cfg->channels_out; ++ch) {
             gr_info *const cod_info = &gfc->l3_side.tt[gr][ch];
 
-            gfc->sv_qnt.masking_lower = pow(10.0, gfc->sv_qnt.mask_adjust * 0.1);
+            gfc->sv_qnt.masking_lower = calc_masking_lower(gfc, cod_info->block_type, pe[gr][ch]);
 
             init_outer_loop(gfc, cod_info);
             if (0 != calc_xmin(gfc, &ratio[gr][ch], cod_info, l3_xmin[gr][ch]))
@@ -1943,20 +1978,9 @@ ABR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
             ms_convert(&gfc->l3_side, gr);
         }
         for (ch = 0; ch < cfg->channels_out; ch++) {
-            FLOAT   adjust, masking_lower_db;
             cod_info = &l3_side->tt[gr][ch];
 
-            if (cod_info->block_type != SHORT_TYPE) { /* NORM, START or STOP type */
-                /* adjust = 1.28/(1+exp(3.5-pe[gr][ch]/300.))-0.05; */
-                adjust = 0;
-                masking_lower_db = gfc->sv_qnt.mask_adjust - adjust;
-            }
-            else {
-                /* adjust = 2.56/(1+exp(3.5-pe[gr][ch]/300.))-0.14; */
-                adjust = 0;
-                masking_lower_db = gfc->sv_qnt.mask_adjust_short - adjust;
-            }
-            gfc->sv_qnt.masking_lower = pow(10.0, masking_lower_db * 0.1);
+            gfc->sv_qnt.masking_lower = calc_masking_lower(gfc, cod_info->block_type, pe[gr][ch]);
 
 
             /*  cod_info, scalefac and xrpow get initialized in init_outer_loop
@@ -2034,20 +2058,9 @@ CBR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
         }
 
         for (ch = 0; ch < cfg->channels_out; ch++) {
-            FLOAT   adjust, masking_lower_db;
             cod_info = &l3_side->tt[gr][ch];
 
-            if (cod_info->block_type != SHORT_TYPE) { /* NORM, START or STOP type */
-                /* adjust = 1.28/(1+exp(3.5-pe[gr][ch]/300.))-0.05; */
-                adjust = 0;
-                masking_lower_db = gfc->sv_qnt.mask_adjust - adjust;
-            }
-            else {
-                /* adjust = 2.56/(1+exp(3.5-pe[gr][ch]/300.))-0.14; */
-                adjust = 0;
-                masking_lower_db = gfc->sv_qnt.mask_adjust_short - adjust;
-            }
-            gfc->sv_qnt.masking_lower = pow(10.0, masking_lower_db * 0.1);
+            gfc->sv_qnt.masking_lower = calc_masking_lower(gfc, cod_info->block_type, pe[gr][ch]);
 
             /*  init_outer_loop sets up cod_info, scalefac and xrpow
              */
@@ -34,5 +34,7 @@ void    VBR_new_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
 void    ABR_iteration_loop(lame_internal_flags * gfc, const FLOAT pe[2][2],
                            const FLOAT ms_ratio[2], const III_psy_ratio ratio[2][2]);
 
+FLOAT   calc_masking_lower(lame_internal_flags const *gfc, int block_type, FLOAT pe);
+
 
 #endif /* LAME_QUANTIZE_H */
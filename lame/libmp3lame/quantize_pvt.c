@@ -35,6 +35,8 @@
 #include "quantize_pvt.h"
 #include "reservoir.h"
 #include "lame-analysis.h"
+#include "session.h"
+#include "vector/lame_intrin.h"
 #include <float.h>
 
 
@@ -88,91 +90,12 @@ const int pretab[SBMAX_l] = {
     1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0
 };
 
-/*
-  Here are MPEG1 Table B.8 and MPEG2 Table B.1
-  -- Layer III scalefactor bands. 
-  Index into this using a method such as:
-    idx  = fr_ps->header->sampling_frequency
-           + (fr_ps->header->version * 3)
-*/
-
-
-const scalefac_struct sfBandIndex[9] = {
-    {                   /* Table B.2.b: 22.05 kHz */
-     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
-      522, 576},
-     {0, 4, 8, 12, 18, 24, 32, 42, 56, 74, 100, 132, 174, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* Table B.2.c: 24 kHz */ /* docs: 332. mpg123(broken): 330 */
-     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 114, 136, 162, 194, 232, 278, 332, 394, 464,
-      540, 576},
-     {0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 136, 180, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* Table B.2.a: 16 kHz */
-     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
-      522, 576},
-     {0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 134, 174, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* Table B.8.b: 44.1 kHz */
-     {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 52, 62, 74, 90, 110, 134, 162, 196, 238, 288, 342, 418,
-      576},
-     {0, 4, 8, 12, 16, 22, 30, 40, 52, 66, 84, 106, 136, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* Table B.8.c: 48 kHz */
-     {0, 4, 8, 12, 16, 20, 24, 30, 36, 42, 50, 60, 72, 88, 106, 128, 156, 190, 230, 276, 330, 384,
-      576},
-     {0, 4, 8, 12, 16, 22, 28, 38, 50, 64, 80, 100, 126, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* Table B.8.a: 32 kHz */
-     {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 54, 66, 82, 102, 126, 156, 194, 240, 296, 364, 448, 550,
-      576},
-     {0, 4, 8, 12, 16, 22, 30, 42, 58, 78, 104, 138, 180, 192}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* MPEG-2.5 11.025 kHz */
-     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
-      522, 576},
-     {0 / 3, 12 / 3, 24 / 3, 36 / 3, 54 / 3, 78 / 3, 108 / 3, 144 / 3, 186 / 3, 240 / 3, 312 / 3,
-      402 / 3, 522 / 3, 576 / 3}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* MPEG-2.5 12 kHz */
-     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
-      522, 576},
-     {0 / 3, 12 / 3, 24 / 3, 36 / 3, 54 / 3, 78 / 3, 108 / 3, 144 / 3, 186 / 3, 240 / 3, 312 / 3,
-      402 / 3, 522 / 3, 576 / 3}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     },
-    {                   /* MPEG-2.5 8 kHz */
-     {0, 12, 24, 36, 48, 60, 72, 88, 108, 132, 160, 192, 232, 280, 336, 400, 476, 566, 568, 570,
-      572, 574, 576},
-     {0 / 3, 24 / 3, 48 / 3, 72 / 3, 108 / 3, 156 / 3, 216 / 3, 288 / 3, 372 / 3, 480 / 3, 486 / 3,
-      492 / 3, 498 / 3, 576 / 3}
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
-     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
-     }
-};
-
-
 /* FIXME: move global variables in some struct */
 
 FLOAT   pow20[Q_MAX + Q_MAX2 + 1];
 FLOAT   ipow20[Q_MAX];
 FLOAT   pow43[PRECALC_SIZE];
-/* initialized in first call to iteration_init */
+/* initialized once per process by init_quantize_tables */
 #ifdef TAKEHIRO_IEEE754_HACK
 FLOAT   adj43asm[PRECALC_SIZE];
 #else
@@ -334,6 +257,31 @@ static float const payload_short[2][4] =
 /************************************************************************/
 /*  initialization for iteration_loop */
 /************************************************************************/
+void
+init_quantize_tables(void)
+{
+    int     i;
+
+    pow43[0] = 0.0;
+    for (i = 1; i < PRECALC_SIZE; i++)
+        pow43[i] = pow((FLOAT) i, 4.0 / 3.0);
+
+#ifdef TAKEHIRO_IEEE754_HACK
+    adj43asm[0] = 0.0;
+    for (i = 1; i < PRECALC_SIZE; i++)
+        adj43asm[i] = i - 0.5 - pow(0.5 * (pow43[i - 1] + pow43[i]), 0.75);
+#else
+    for (i = 0; i < PRECALC_SIZE - 1; i++)
+        adj43[i] = (i + 1) - pow(0.5 * (pow43[i] + pow43[i + 1]), 0.75);
+    adj43[i] = 0.5;
+#endif
+    for (i = 0; i < Q_MAX; i++)
+        ipow20[i] = pow(2.0, (double) (i - 210) * -0.1875);
+    for (i = 0; i <= Q_MAX + Q_MAX2; i++)
+        pow20[i] = pow(2.0, (double) (i - 210 - Q_MAX2) * 0.25);
+}
+
+
 void
 iteration_init(lame_internal_flags * gfc)
 {
@@ -346,28 +294,12 @@ iteration_init(lame_internal_flags * gfc)
         gfc->iteration_init_init = 1;
 
         l3_side->main_data_begin = 0;
-        compute_ath(gfc);
-
-        pow43[0] = 0.0;
-        for (i = 1; i < PRECALC_SIZE; i++)
-            pow43[i] = pow((FLOAT) i, 4.0 / 3.0);
-
-#ifdef TAKEHIRO_IEEE754_HACK
-        adj43asm[0] = 0.0;
-        for (i = 1; i < PRECALC_SIZE; i++)
-            adj43asm[i] = i - 0.5 - pow(0.5 * (pow43[i - 1] + pow43[i]), 0.75);
-#else
-        for (i = 0; i < PRECALC_SIZE - 1; i++)
-            adj43[i] = (i + 1) - pow(0.5 * (pow43[i] + pow43[i + 1]), 0.75);
-        adj43[i] = 0.5;
-#endif
-        for (i = 0; i < Q_MAX; i++)
-            ipow20[i] = pow(2.0, (double) (i - 210) * -0.1875);
-        for (i = 0; i <= Q_MAX + Q_MAX2; i++)
-            pow20[i] = pow(2.0, (double) (i - 210 - Q_MAX2) * 0.25);
+        if (!session_tables_shared(gfc))
+            compute_ath(gfc);
 
         huffman_init(gfc);
         init_xrpow_core_init(gfc);
+        calc_noise_core_init(gfc);
 
         sel = 1;/* RH: all modes like vbr-new (cfg->vbr == vbr_mt || cfg->vbr == vbr_mtrh) ? 1 : 0;*/
 
@@ -602,7 +534,8 @@ calc_xmin(lame_internal_flags const *gfc,
         FLOAT   rh1, rh2, rh3;
         int     width, l;
 
-        xmin = athAdjust(ATH->adjust_factor, ATH->l[gsfb], ATH->floor, cfg->ATHfixpoint);
+        xmin = athAdjust(gfc->sv_qnt.ath_adjust_factor, ATH->l[gsfb], ATH->floor,
+                         cfg->ATHfixpoint);
         xmin *= gfc->sv_qnt.longfact[gsfb];
 
         width = cod_info->width[gsfb];
@@ -689,7 +622,8 @@ calc_xmin(lame_internal_flags const *gfc,
         int     width, b, l;
         FLOAT   tmpATH;
 
-        tmpATH = athAdjust(ATH->adjust_factor, ATH->s[sfb], ATH->floor, cfg->ATHfixpoint);
+        tmpATH = athAdjust(gfc->sv_qnt.ath_adjust_factor, ATH->s[sfb], ATH->floor,
+                           cfg->ATHfixpoint);
         tmpATH *= gfc->sv_qnt.shortfact[sfb];
         
         width = cod_info->width[gsfb];
@@ -797,6 +731,20 @@ calc_noise_core_c(const gr_info * const cod_info, int *startline, int l, FLOAT s
 }
 
 
+void
+calc_noise_core_init(lame_internal_flags * const gfc)
+{
+    gfc->calc_noise_core = calc_noise_core_c;
+
+#if defined(HAVE_IMMINTRIN_H)
+    if (gfc->CPU_features.AVX512)
+        gfc->calc_noise_core = calc_noise_core_avx512;
+    else if (gfc->CPU_features.AVX2)
+        gfc->calc_noise_core = calc_noise_core_avx2;
+#endif
+}
+
+
 /*************************************************************************/
 /*            calc_noise                                                 */
 /*************************************************************************/
@@ -814,7 +762,7 @@ calc_noise_core_c(const gr_info * const cod_info, int *startline, int l, FLOAT s
 /* +10 dB  =>  +6.45 */
 
 int
-calc_noise(gr_info const *const cod_info,
+calc_noise(lame_internal_flags const *gfc, gr_info const *const cod_info,
            FLOAT const *l3_xmin,
            FLOAT * distort, calc_noise_result * const res, calc_noise_data * prev_noise)
 {
@@ -860,7 +808,7 @@ calc_noise(gr_info const *const cod_info,
                     l = 0;
             }
 
-            noise = calc_noise_core_c(cod_info, &j, l, step);
+            noise = gfc->calc_noise_core(cod_info, &j, l, step);
 
 
             if (prev_noise) {
@@ -947,7 +895,7 @@ set_pinfo(lame_internal_flags const *gfc,
     calc_noise_result noise;
 
     (void) calc_xmin(gfc, ratio, cod_info, l3_xmin);
-    (void) calc_noise(cod_info, l3_xmin, xfsf, &noise, 0);
+    (void) calc_noise(gfc, cod_info, l3_xmin, xfsf, &noise, 0);
 
     j = 0;
     sfb2 = cod_info->sfb_lmax;
@@ -35,8 +35,6 @@ extern const int pretab[SBMAX_l];
 extern const int slen1_tab[16];
 extern const int slen2_tab[16];
 
-extern const scalefac_struct sfBandIndex[9];
-
 extern FLOAT pow43[PRECALC_SIZE];
 #ifdef TAKEHIRO_IEEE754_HACK
 extern FLOAT adj43asm[PRECALC_SIZE];
@@ -87,13 +85,14 @@ int     on_pe(lame_internal_flags * gfc, const FLOAT pe[2][2],
 void    reduce_side(int targ_bits[2], FLOAT ms_ener_ratio, int mean_bits, int max_bits);
 
 
+void    init_quantize_tables(void);
 void    iteration_init(lame_internal_flags * gfc);
 
 
 int     calc_xmin(lame_internal_flags const *gfc,
                   III_psy_ratio const *const ratio, gr_info * const cod_info, FLOAT * l3_xmin);
 
-int     calc_noise(const gr_info * const cod_info,
+int     calc_noise(lame_internal_flags const *gfc, const gr_info * const cod_info,
                    const FLOAT * l3_xmin,
                    FLOAT * distort, calc_noise_result * const res, calc_noise_data * prev_noise);
 
@@ -117,9 +116,11 @@ void    best_scalefac_store(const lame_internal_flags * gfc, const int gr, const
 
 int     scale_bitcount(const lame_internal_flags * gfc, gr_info * cod_info);
 
+void    init_huffman_tables(void);
 void    huffman_init(lame_internal_flags * const gfc);
 
 void    init_xrpow_core_init(lame_internal_flags * const gfc);
+void    calc_noise_core_init(lame_internal_flags * const gfc);
 
 FLOAT   athAdjust(FLOAT a, FLOAT x, FLOAT athFloor, float ATHfixpoint);
 
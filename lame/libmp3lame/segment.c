@@ -0,0 +1,761 @@
+/*
+ *      segmented (frame parallel) encoding
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+/*
+ *  How it works:
+ *
+ *  The input is cut into segments of 'segment_frames' frames, which are
+ *  encoded by independent encoder instances on the thread pool. Every
+ *  segment but the first one starts SEGMENT_WARMUP_FRAMES frames early.
+ *  Those warmup frames bring the psychoacoustic model, the MDCT overlap
+ *  and the other inter frame state close to what a continuous encode
+ *  would have; they are encoded, flushed and thrown away. Flushing empties
+ *  the bit reservoir, so the first kept frame has main_data_begin = 0 and
+ *  does not reference bytes of the previous segment. The last frame of a
+ *  segment is flushed as well, so the segments can simply be concatenated.
+ *
+ *  The instance a segment is encoded with sees its input delayed by a
+ *  whole number of frames, so its frames are aligned exactly with the
+ *  frames a single encoder would produce, and the encoder delay and
+ *  padding of the stitched stream are the ones of a continuous encode.
+ *
+ *  With resampling, the staged input is at the input rate and the worker
+ *  instances resample it themselves.  A segment then has to start where
+ *  the input and the output sample grid meet, so that the resampler of
+ *  the worker starts with the phase the continuous one has there: segment
+ *  and warmup lengths are multiples of the frames that span a whole
+ *  number of input samples.  The resampler history is part of the
+ *  warmup, like the psychoacoustic model.
+ *
+ *  The master instance does everything that has to see the stream as a
+ *  whole: id3 tags, the Xing/LAME tag with its seek table, music CRC,
+ *  ReplayGain analysis and the statistics reported to the frontend.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "bitstream.h"
+#include "VbrTag.h"
+#include "gain_analysis.h"
+#include "lame_global_flags.h"
+#include "threadpool.h"
+#include "segment.h"
+
+
+/* largest possible frame: 320 kbps at 32 kHz, or 160 kbps at 8 kHz */
+#define MAX_FRAME_BYTES 1441
+
+
+typedef struct {
+    lame_global_flags *gfp;  /* encoder instance for this segment */
+    sample_t const *pcm[2];
+    int     warmup;          /* samples fed before output is kept */
+    int     nsamples;        /* samples fed after the warmup */
+    int     is_last;         /* flush the encoder like at the end of a stream */
+
+    unsigned char *out;
+    int     out_len;
+    int     out_size;
+
+    int     frames;          /* number of frames kept */
+    int     encoder_padding;
+    int     bitrate_channelmode_hist[16][4 + 1];
+    int     bitrate_blocktype_hist[16][4 + 1 + 1];
+    int     ret;
+} SegmentJob_t;
+
+
+/* encoder instance of a worker, reset with lame_reset() for every segment */
+typedef struct {
+    lame_global_flags *gfp;
+    unsigned char *out;
+    int     out_size;
+} SegmentEncoder_t;
+
+
+struct SegmentState_t {
+    lame_global_flags user_gfp; /* settings as passed to lame_init_params */
+    int     frames_per_segment;
+    int     warmup_frames;
+    int     framesize;
+    int     lookahead;       /* input samples beyond the last frame of a segment */
+    int     samplerate_in;   /* both the same without resampling */
+    int     samplerate_out;
+
+    /* input staging, pcm[ch][0] is the first sample the next segment needs */
+    sample_t *pcm[2];
+    int     pcm_len;
+    int     pcm_size;
+    int     next_frame;      /* first frame of the next segment */
+    int     finished;
+
+    /* one encoder per job of a thread_pool_run() batch, created on first use */
+    SegmentEncoder_t *enc;
+    int     nenc;
+
+    /* encoded data, not yet handed to the caller */
+    unsigned char *out;
+    int     out_pos;
+    int     out_len;
+    int     out_size;
+};
+
+
+
+static int
+gcd(int i, int j)
+{
+    return j ? gcd(j, i % j) : i;
+}
+
+
+/* rounds n up to a multiple of m */
+static int
+round_up(int n, int m)
+{
+    return (n + m - 1) / m * m;
+}
+
+
+int
+segment_init(lame_internal_flags * gfc, lame_global_flags const *user_gfp)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    int const framesize = 576 * cfg->mode_gr;
+    int const lookahead = Max(BLKSIZE - FFTOFFSET, 512 - 32) - (ENCDELAY - MDCTDELAY);
+    int     period = 1;      /* frames between two points where the sample grids meet */
+    SegmentState_t *seg;
+
+    if (cfg->segment_frames <= 0 || gfc->thread_pool == 0) {
+        return 1;
+    }
+    /* these need the whole stream in one encoder instance */
+    if (cfg->decode_on_the_fly || cfg->analysis || cfg->free_format
+        || user_gfp->nogap_total > 0) {
+        MSGF(gfc, "Warning: no segmented encoding with decoding on the fly, "
+             "analysis, free format or gapless encoding\n");
+        return 1;
+    }
+    if (isResamplingNecessary(cfg)) {
+        period = cfg->samplerate_out / gcd(cfg->samplerate_out, framesize * cfg->samplerate_in);
+        if (period > 2 * SEGMENT_WARMUP_FRAMES) {
+            MSGF(gfc, "Warning: no segmented encoding when resampling from %d Hz to %d Hz\n",
+                 cfg->samplerate_in, cfg->samplerate_out);
+            return 1;
+        }
+        /* the ReplayGain analysis sees the input before it is resampled */
+        if (cfg->findReplayGain
+            && InitGainAnalysis(gfc->sv_rpg.rgdata, cfg->samplerate_in) != INIT_GAIN_ANALYSIS_OK) {
+            MSGF(gfc, "Warning: no segmented encoding with ReplayGain analysis at %d Hz\n",
+                 cfg->samplerate_in);
+            return 1;
+        }
+    }
+    seg = gfc_calloc(gfc, SegmentState_t, 1);
+    if (seg == 0) {
+        return -2;
+    }
+    seg->user_gfp = *user_gfp;
+    seg->framesize = framesize;
+    seg->samplerate_in = cfg->samplerate_in;
+    seg->samplerate_out = cfg->samplerate_out;
+    seg->frames_per_segment = round_up(Max(cfg->segment_frames, SEGMENT_MIN_FRAMES), period);
+    seg->warmup_frames = round_up(SEGMENT_WARMUP_FRAMES, period);
+    assert(lookahead >= 0);
+    seg->lookahead = lookahead;
+    if (isResamplingNecessary(cfg)) {
+        /* the resampler needs this much more input for its last samples */
+        seg->lookahead = (int) ceil((double) lookahead * cfg->samplerate_in / cfg->samplerate_out)
+            + resample_filter_length(cfg);
+    }
+    gfc->sv_seg = seg;
+    return 0;
+}
+
+
+void
+segment_free(lame_internal_flags * gfc)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    int     k;
+    if (seg == 0) {
+        return;
+    }
+    if (seg->enc) {
+        for (k = 0; k < seg->nenc; ++k) {
+            if (seg->enc[k].out) {
+                gfc_free(gfc, seg->enc[k].out);
+            }
+            if (seg->enc[k].gfp) {
+                (void) lame_close(seg->enc[k].gfp);
+            }
+        }
+        gfc_free(gfc, seg->enc);
+    }
+    if (seg->pcm[0]) {
+        gfc_free(gfc, seg->pcm[0]);
+    }
+    if (seg->pcm[1]) {
+        gfc_free(gfc, seg->pcm[1]);
+    }
+    if (seg->out) {
+        gfc_free(gfc, seg->out);
+    }
+    gfc_free(gfc, seg);
+    gfc->sv_seg = 0;
+}
+
+
+void
+segment_reset(lame_internal_flags * gfc)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    if (seg == 0) {
+        return;
+    }
+    seg->pcm_len = 0;
+    seg->next_frame = 0;
+    seg->finished = 0;
+    seg->out_pos = 0;
+    seg->out_len = 0;
+    if (gfc->cfg.findReplayGain && isResamplingNecessary(&gfc->cfg)) {
+        (void) InitGainAnalysis(gfc->sv_rpg.rgdata, seg->samplerate_in);
+    }
+}
+
+
+int
+segment_check_nogap(lame_internal_flags * gfc, lame_global_flags const *gfp)
+{
+    SegmentState_t const *const seg = gfc->sv_seg;
+
+    if (seg == 0 || gfp->nogap_total <= 0) {
+        return 0;
+    }
+    if (seg->pcm_len > 0 || seg->next_frame > 0 || seg->out_len > 0 || seg->finished) {
+        /* too late, lame_encode_flush_nogap() will fail */
+        return 0;
+    }
+    MSGF(gfc, "Warning: no segmented encoding with gapless encoding\n");
+    segment_free(gfc);
+    if (gfc->cfg.findReplayGain) {
+        (void) InitGainAnalysis(gfc->sv_rpg.rgdata, gfc->cfg.samplerate_out);
+    }
+    /* segmented encoding had turned pipelining off */
+    if (pipeline_init(gfc) < 0) {
+        return -2;
+    }
+    return 0;
+}
+
+
+/* make room for n more bytes in the output queue */
+static int
+reserve_output(lame_internal_flags * gfc, int n)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+
+    if (seg->out_pos > 0) {
+        seg->out_len -= seg->out_pos;
+        memmove(seg->out, seg->out + seg->out_pos, seg->out_len);
+        seg->out_pos = 0;
+    }
+    if (seg->out_len + n > seg->out_size) {
+        int const new_size = 2 * (seg->out_len + n);
+        unsigned char *new_out = gfc_calloc(gfc, unsigned char, new_size);
+        if (new_out == 0) {
+            return -2;
+        }
+        if (seg->out) {
+            memcpy(new_out, seg->out, seg->out_len);
+            gfc_free(gfc, seg->out);
+        }
+        seg->out = new_out;
+        seg->out_size = new_size;
+    }
+    return 0;
+}
+
+
+static int
+append_input(lame_internal_flags * gfc, int nch, sample_t const *in_buffer_0,
+             sample_t const *in_buffer_1, int nsamples)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    sample_t const *const in[2] = { in_buffer_0, in_buffer_1 };
+    int     ch;
+
+    if (seg->pcm_len + nsamples > seg->pcm_size) {
+        int const new_size = 2 * (seg->pcm_len + nsamples);
+        for (ch = 0; ch < 2; ++ch) {
+            sample_t *new_pcm = gfc_calloc(gfc, sample_t, new_size);
+            if (new_pcm == 0) {
+                return -2;
+            }
+            if (seg->pcm[ch]) {
+                memcpy(new_pcm, seg->pcm[ch], seg->pcm_len * sizeof(sample_t));
+                gfc_free(gfc, seg->pcm[ch]);
+            }
+            seg->pcm[ch] = new_pcm;
+        }
+        seg->pcm_size = new_size;
+    }
+    for (ch = 0; ch < nch; ++ch) {
+        memcpy(seg->pcm[ch] + seg->pcm_len, in[ch], nsamples * sizeof(sample_t));
+    }
+    seg->pcm_len += nsamples;
+    return 0;
+}
+
+
+/* input samples the given number of frames take, exact when frames is a
+ * multiple of the period segment_init() rounded the lengths to */
+static int
+frame_samples(SegmentState_t const *seg, int frames)
+{
+    return (int) ((double) frames * seg->framesize * seg->samplerate_in / seg->samplerate_out
+                  + 0.5);
+}
+
+
+/* input samples before the warmup of the k-th segment, counted from pcm[ch][0] */
+static int
+segment_start(SegmentState_t const *seg, int k)
+{
+    int const n = seg->frames_per_segment;
+    if (k == 0) {
+        return 0;
+    }
+    if (seg->next_frame == 0) {
+        return frame_samples(seg, k * n - seg->warmup_frames);
+    }
+    return frame_samples(seg, k * n);
+}
+
+
+static int
+segment_warmup(SegmentState_t const *seg, int k)
+{
+    if (seg->next_frame == 0 && k == 0) {
+        return 0;
+    }
+    return frame_samples(seg, seg->warmup_frames) + seg->lookahead;
+}
+
+
+/* number of segments which can be encoded with the input we have, not
+ * counting the last one of the stream */
+static int
+segments_ready(SegmentState_t const *seg)
+{
+    int     k = 0;
+    for (;;) {
+        int     need = segment_start(seg, k) + segment_warmup(seg, k)
+            + frame_samples(seg, seg->frames_per_segment);
+        if (segment_warmup(seg, k) == 0) {
+            need += seg->lookahead;
+        }
+        if (need > seg->pcm_len) {
+            return k;
+        }
+        ++k;
+    }
+}
+
+
+/* creates the encoder instance of a worker. done in the calling thread,
+ * lame_init_params is not meant to run concurrently */
+static lame_global_flags *
+segment_encoder_new(lame_internal_flags const *gfc)
+{
+    SegmentState_t const *const seg = gfc->sv_seg;
+    lame_global_flags *gfp = lame_init_allocator(&gfc->mem.alloc, 0, 0);
+    lame_internal_flags *job_gfc;
+
+    if (gfp == 0) {
+        return 0;
+    }
+    job_gfc = gfp->internal_flags;
+    *gfp = seg->user_gfp;
+    gfp->internal_flags = job_gfc;
+    gfp->lame_allocated_gfp = 1;
+
+    /* all of this is done once for the whole stream */
+    gfp->write_lame_tag = 0;
+    gfp->write_id3tag_automatic = 0;
+    gfp->findReplayGain = 0;
+    gfp->num_threads = 1;
+    gfp->segment_frames = 0;
+    /* the segment output is collected in job->out */
+    gfp->output.func = 0;
+    gfp->output.user_data = 0;
+    if (lame_init_params(gfp) < 0) {
+        (void) lame_close(gfp);
+        return 0;
+    }
+    return gfp;
+}
+
+
+/* gives a job the encoder of a worker, ready for a new stream, and an
+ * output buffer large enough for the segment */
+static int
+segment_job_init(lame_internal_flags * gfc, SegmentJob_t * job, SegmentEncoder_t * enc)
+{
+    SegmentState_t const *const seg = gfc->sv_seg;
+    int const frames = (int) ((double) (job->warmup + job->nsamples) * seg->samplerate_out
+                              / seg->samplerate_in) / seg->framesize + 4;
+    int const out_size = frames * MAX_FRAME_BYTES + 7200;
+
+    if (enc->gfp == 0) {
+        enc->gfp = segment_encoder_new(gfc);
+        if (enc->gfp == 0) {
+            return -1;
+        }
+    }
+    else if (lame_reset(enc->gfp) < 0) {
+        return -1;
+    }
+    if (enc->out_size < out_size) {
+        if (enc->out) {
+            gfc_free(gfc, enc->out);
+        }
+        enc->out_size = 0;
+        enc->out = gfc_calloc(gfc, unsigned char, out_size);
+        if (enc->out == 0) {
+            return -2;
+        }
+        enc->out_size = out_size;
+    }
+    job->gfp = enc->gfp;
+    job->out = enc->out;
+    job->out_size = enc->out_size;
+    return 0;
+}
+
+
+static void
+segment_encode_job(void *arg)
+{
+    SegmentJob_t *const job = (SegmentJob_t *) arg;
+    lame_internal_flags *const gfc = job->gfp->internal_flags;
+    EncResult_t const *const eov = &gfc->ov_enc;
+    int     warmup_frames = 0;
+    int     ret, i, j;
+
+    if (job->warmup > 0) {
+        ret = lame_encode_buffer_sample_t(gfc, job->pcm[0], job->pcm[1], job->warmup,
+                                          job->out, job->out_size);
+        if (ret < 0) {
+            job->ret = ret;
+            return;
+        }
+        /* empty the bit reservoir and forget about the warmup frames */
+        flush_bitstream(gfc);
+        (void) copy_buffer(gfc, job->out, job->out_size, 0);
+        warmup_frames = eov->frame_number;
+        memcpy(job->bitrate_channelmode_hist, eov->bitrate_channelmode_hist,
+               sizeof(job->bitrate_channelmode_hist));
+        memcpy(job->bitrate_blocktype_hist, eov->bitrate_blocktype_hist,
+               sizeof(job->bitrate_blocktype_hist));
+    }
+    ret = lame_encode_buffer_sample_t(gfc, job->pcm[0] + job->warmup,
+                                      job->pcm[1] + job->warmup, job->nsamples,
+                                      job->out, job->out_size);
+    if (ret < 0) {
+        job->ret = ret;
+        return;
+    }
+    job->out_len = ret;
+    if (job->is_last) {
+        ret = lame_encode_flush(job->gfp, job->out + job->out_len, job->out_size - job->out_len);
+        job->encoder_padding = eov->encoder_padding;
+    }
+    else {
+        flush_bitstream(gfc);
+        ret = copy_buffer(gfc, job->out + job->out_len, job->out_size - job->out_len, 0);
+    }
+    if (ret < 0) {
+        job->ret = ret;
+        return;
+    }
+    job->out_len += ret;
+    job->frames = eov->frame_number - warmup_frames;
+
+    for (i = 0; i < 16; ++i) {
+        for (j = 0; j < 4 + 1; ++j) {
+            job->bitrate_channelmode_hist[i][j] =
+                eov->bitrate_channelmode_hist[i][j] - job->bitrate_channelmode_hist[i][j];
+        }
+        for (j = 0; j < 4 + 1 + 1; ++j) {
+            job->bitrate_blocktype_hist[i][j] =
+                eov->bitrate_blocktype_hist[i][j] - job->bitrate_blocktype_hist[i][j];
+        }
+    }
+    job->ret = 0;
+}
+
+
+/* appends the output of a segment to the stream, doing the bookkeeping
+ * which would otherwise happen frame by frame in the encoder */
+static int
+segment_job_collect(lame_internal_flags * gfc, SegmentJob_t const *job)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    SegmentState_t *const seg = gfc->sv_seg;
+    EncResult_t *const eov = &gfc->ov_enc;
+    unsigned char const *p = job->out;
+    unsigned char const *const end = job->out + job->out_len;
+    int     frames = 0;
+    int     i, j;
+
+    if (job->ret < 0) {
+        return job->ret;
+    }
+    while (p + 4 <= end) {
+        if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0) {
+            ERRORF(gfc, "Error: lost frame sync while joining segments\n");
+            return -1;
+        }
+        eov->bitrate_index = (p[2] >> 4) & 0x0f;
+        eov->padding = (p[2] >> 1) & 0x01;
+        if (cfg->write_lame_tag) {
+            AddVbrFrame(gfc);
+        }
+        p += getframebits(gfc) / 8;
+        ++frames;
+    }
+    if (p != end || frames != job->frames) {
+        ERRORF(gfc, "Error: segment does not consist of whole frames\n");
+        return -1;
+    }
+
+    if (reserve_output(gfc, job->out_len) < 0) {
+        return -2;
+    }
+    memcpy(seg->out + seg->out_len, job->out, job->out_len);
+    seg->out_len += job->out_len;
+    UpdateMusicCRC(&gfc->nMusicCRC, job->out, job->out_len);
+    gfc->VBR_seek_table.nBytesWritten += job->out_len;
+
+    eov->frame_number += frames;
+    for (i = 0; i < 16; ++i) {
+        for (j = 0; j < 4 + 1; ++j) {
+            eov->bitrate_channelmode_hist[i][j] += job->bitrate_channelmode_hist[i][j];
+        }
+        for (j = 0; j < 4 + 1 + 1; ++j) {
+            eov->bitrate_blocktype_hist[i][j] += job->bitrate_blocktype_hist[i][j];
+        }
+    }
+    if (job->is_last) {
+        eov->encoder_padding = job->encoder_padding;
+    }
+    return 0;
+}
+
+
+/* encodes 'nready' complete segments, plus the final one if 'last' is set,
+ * in batches of one segment per worker */
+static int
+segment_run(lame_internal_flags * gfc, int nready, int last)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    int const njobs = nready + (last ? 1 : 0);
+    SegmentJob_t *jobs;
+    int     first, n, k, ret = 0, consumed;
+
+    if (njobs == 0) {
+        return 0;
+    }
+    if (seg->enc == 0) {
+        int const nenc = thread_pool_size(gfc->thread_pool);
+        seg->enc = gfc_calloc(gfc, SegmentEncoder_t, nenc);
+        if (seg->enc == 0) {
+            return -2;
+        }
+        seg->nenc = nenc;
+    }
+    jobs = lame_calloc(SegmentJob_t, seg->nenc);
+    if (jobs == 0) {
+        return -2;
+    }
+    for (first = 0; first < njobs && ret == 0; first += n) {
+        n = Min(njobs - first, seg->nenc);
+        memset(jobs, 0, n * sizeof(jobs[0]));
+        for (k = 0; k < n && ret == 0; ++k) {
+            SegmentJob_t *const job = &jobs[k];
+            int const start = segment_start(seg, first + k);
+            job->pcm[0] = seg->pcm[0] + start;
+            job->pcm[1] = seg->pcm[1] + start;
+            job->warmup = segment_warmup(seg, first + k);
+            job->is_last = (first + k == nready);
+            if (job->is_last) {
+                job->nsamples = seg->pcm_len - start - job->warmup;
+            }
+            else {
+                job->nsamples = frame_samples(seg, seg->frames_per_segment);
+                if (job->warmup == 0) {
+                    job->nsamples += seg->lookahead;
+                }
+            }
+            assert(job->nsamples >= 0);
+            ret = segment_job_init(gfc, job, &seg->enc[k]);
+        }
+        if (ret == 0) {
+            thread_pool_run(gfc->thread_pool, segment_encode_job, jobs, sizeof(SegmentJob_t), n);
+            for (k = 0; k < n && ret == 0; ++k) {
+                ret = segment_job_collect(gfc, &jobs[k]);
+            }
+        }
+    }
+    free(jobs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* drop the input nobody needs anymore */
+    consumed = last ? seg->pcm_len : segment_start(seg, nready);
+    seg->next_frame += nready * seg->frames_per_segment;
+    seg->pcm_len -= consumed;
+    if (seg->pcm_len > 0) {
+        memmove(seg->pcm[0], seg->pcm[0] + consumed, seg->pcm_len * sizeof(sample_t));
+        memmove(seg->pcm[1], seg->pcm[1] + consumed, seg->pcm_len * sizeof(sample_t));
+    }
+    return 0;
+}
+
+
+int
+segment_queue_tags(lame_internal_flags * gfc)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    int     ret;
+
+    if (reserve_output(gfc, gfc->bs.buf_byte_idx + 1) < 0) {
+        return -2;
+    }
+    ret = copy_buffer(gfc, seg->out + seg->out_len, seg->out_size - seg->out_len, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    seg->out_len += ret;
+    return 0;
+}
+
+
+int
+segment_drain(lame_internal_flags * gfc, unsigned char *mp3buf, int mp3buf_size, int whole)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    int     n = seg->out_len - seg->out_pos;
+
+    if (gfc->output_func != 0) {
+        /* see lame_set_output_function() */
+        unsigned char const *const data = seg->out + seg->out_pos;
+        seg->out_pos = seg->out_len;
+        if (n > 0 && gfc->output_func(gfc->output_data, data, n) < 0) {
+            return -7;
+        }
+        return 0;
+    }
+    if (mp3buf_size > 0 && n > mp3buf_size) {
+        if (whole) {
+            return -1;
+        }
+        n = mp3buf_size;
+    }
+    else if (mp3buf_size < 0) {
+        n = 0;
+    }
+    memcpy(mp3buf, seg->out + seg->out_pos, n);
+    seg->out_pos += n;
+    return n;
+}
+
+
+int
+segment_encode_buffer(lame_internal_flags * gfc, sample_t const *in_buffer_0,
+                      sample_t const *in_buffer_1, int nsamples,
+                      unsigned char *mp3buf, int mp3buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    SegmentState_t *const seg = gfc->sv_seg;
+    int     ret, nready;
+
+    if (seg->finished) {
+        return -1;
+    }
+    /* id3v2 and the dummy Xing frame go in front of everything */
+    ret = segment_queue_tags(gfc);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (cfg->findReplayGain) {
+        if (AnalyzeSamples(gfc->sv_rpg.rgdata, in_buffer_0, in_buffer_1, nsamples,
+                           cfg->channels_out) == GAIN_ANALYSIS_ERROR) {
+            return -6;
+        }
+    }
+    ret = append_input(gfc, cfg->channels_out, in_buffer_0, in_buffer_1, nsamples);
+    if (ret < 0) {
+        return ret;
+    }
+
+    nready = segments_ready(seg);
+    if (nready >= thread_pool_size(gfc->thread_pool)) {
+        ret = segment_run(gfc, nready, 0);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return segment_drain(gfc, mp3buf, mp3buf_size, 0);
+}
+
+
+int
+segment_finish(lame_internal_flags * gfc)
+{
+    SegmentState_t *const seg = gfc->sv_seg;
+    int     ret;
+
+    if (seg->finished) {
+        return 0;
+    }
+    seg->finished = 1;
+    ret = segment_queue_tags(gfc);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = segment_run(gfc, segments_ready(seg), 1);
+    if (ret < 0) {
+        return ret;
+    }
+    return 1;
+}
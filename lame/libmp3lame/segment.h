@@ -0,0 +1,70 @@
+/*
+ *      segmented (frame parallel) encoding include file
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_SEGMENT_H
+#define LAME_SEGMENT_H
+
+/* frames encoded and thrown away in front of every segment but the first,
+ * to get psymodel, MDCT overlap and the CBR pe filter into steady state */
+#define SEGMENT_WARMUP_FRAMES  32
+
+/* a segment is at least this long, so the warmup costs less than 13% */
+#define SEGMENT_MIN_FRAMES    256
+
+struct SegmentState_t;
+typedef struct SegmentState_t SegmentState_t;
+
+/* sets up segmented encoding if the session allows it, returns 0 when
+ * segmented encoding is in use, 1 when it falls back to the normal
+ * encoder and <0 on errors */
+int     segment_init(lame_internal_flags * gfc, lame_global_flags const *user_gfp);
+void    segment_free(lame_internal_flags * gfc);
+
+/* drops queued input and output, for lame_reset(), and restarts the
+ * ReplayGain analysis at the input samplerate */
+void    segment_reset(lame_internal_flags * gfc);
+
+/* falls back to the normal encoder if gapless encoding was asked for after
+ * lame_init_params(), as long as nothing has been encoded yet */
+int     segment_check_nogap(lame_internal_flags * gfc, lame_global_flags const *gfp);
+
+int     segment_encode_buffer(lame_internal_flags * gfc, sample_t const *in_buffer_0,
+                              sample_t const *in_buffer_1, int nsamples,
+                              unsigned char *mp3buf, int mp3buf_size);
+
+/* encodes all remaining input. returns 1 the first time, 0 afterwards */
+int     segment_finish(lame_internal_flags * gfc);
+
+/* moves id3 and VBR tags, written into gfc->bs, to the output queue */
+int     segment_queue_tags(lame_internal_flags * gfc);
+
+/* copies queued output to the user buffer, mp3buf_size = 0 means unlimited.
+ * With whole set it copies all of it, or returns -1 and keeps it queued
+ * if it doesn't fit */
+int     segment_drain(lame_internal_flags * gfc, unsigned char *mp3buf, int mp3buf_size,
+                      int whole);
+
+/* implemented in lame.c, encodes PCM data already in sample_t format */
+int     lame_encode_buffer_sample_t(lame_internal_flags * gfc, sample_t const *in_buffer_0,
+                                    sample_t const *in_buffer_1, int nsamples,
+                                    unsigned char *mp3buf, const int mp3buf_size);
+
+#endif /* LAME_SEGMENT_H */
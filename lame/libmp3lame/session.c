@@ -0,0 +1,199 @@
+/*
+ *      shared session tables
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+/*
+ *  The ATH, the psymodel constants (cd_psy) and the resampling filters
+ *  only depend on the settings of an encoder and are not changed once
+ *  lame_init_params is done.  Encoders alive at the same time with the
+ *  same settings share one copy of them, which is reference counted and
+ *  freed by the encoder that drops the last reference.
+ *
+ *  The tables are allocated by the first encoder, so only encoders with
+ *  the same allocator share them, and never encoders with an arena, see
+ *  lame_init_allocator().
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "threadpool.h"
+#include "session.h"
+
+static ThreadLock_t tables_lock = THREAD_LOCK_INIT;
+
+
+/* everything the tables are computed from */
+typedef struct {
+    SessionConfig_t cfg;
+    lame_allocator alloc;
+    int     experimentalZ;
+    int     VBR_q;
+    float   VBR_q_frac;
+    float   attackthre;
+    float   attackthre_s;
+    int     athaa_type;
+    float   athaa_sensitivity;
+} SessionKey_t;
+
+struct SessionTables_t {
+    SessionTables_t *next;
+    int     refcount;        /* protected by tables_lock */
+    int     ready;           /* complete and in tables_list */
+    SessionKey_t key;
+    ATH_t  *ATH;
+    PsyConst_t *cd_psy;
+    sample_t *blackfilt;
+};
+
+static SessionTables_t *tables_list = 0;
+
+
+static void
+session_key(lame_global_flags const *gfp, SessionKey_t * key)
+{
+    lame_internal_flags const *const gfc = gfp->internal_flags;
+
+    /* compared with memcmp, so clear the padding too */
+    memset(key, 0, sizeof(*key));
+    memcpy(&key->cfg, &gfc->cfg, sizeof(key->cfg));
+    memcpy(&key->alloc, &gfc->mem.alloc, sizeof(key->alloc));
+    key->experimentalZ = gfp->experimentalZ;
+    key->VBR_q = gfp->VBR_q;
+    key->VBR_q_frac = gfp->VBR_q_frac;
+    key->attackthre = gfp->attackthre;
+    key->attackthre_s = gfp->attackthre_s;
+    key->athaa_type = gfp->athaa_type;
+    key->athaa_sensitivity = gfp->athaa_sensitivity;
+}
+
+
+int
+session_tables_attach(lame_global_flags const *gfp)
+{
+    lame_internal_flags *const gfc = gfp->internal_flags;
+    SessionTables_t *t, *found;
+
+    /* the arena goes away with the encoder */
+    if (gfc->tables != 0 || gfc->mem.arena != 0) {
+        return 0;
+    }
+    t = gfc_calloc(gfc, SessionTables_t, 1);
+    if (t == 0) {
+        return -2;
+    }
+    session_key(gfp, &t->key);
+    t->refcount = 1;
+
+    thread_lock(&tables_lock);
+    for (found = tables_list; found != 0; found = found->next) {
+        if (memcmp(&found->key, &t->key, sizeof(t->key)) == 0) {
+            found->refcount++;
+            break;
+        }
+    }
+    thread_unlock(&tables_lock);
+
+    if (found == 0) {
+        /* we compute them, see session_tables_publish */
+        gfc->tables = t;
+        return 0;
+    }
+    gfc_free(gfc, t);
+    gfc_free(gfc, gfc->ATH);
+    gfc->ATH = found->ATH;
+    gfc->cd_psy = found->cd_psy;
+    gfc->sv_enc.blackfilt = found->blackfilt;
+    gfc->tables = found;
+    return 1;
+}
+
+
+void
+session_tables_publish(lame_internal_flags * gfc)
+{
+    SessionTables_t *const t = gfc->tables;
+
+    if (t == 0 || t->ready) {
+        return;
+    }
+    t->ATH = gfc->ATH;
+    t->cd_psy = gfc->cd_psy;
+    t->blackfilt = gfc->sv_enc.blackfilt;
+    t->ready = 1;
+
+    thread_lock(&tables_lock);
+    t->next = tables_list;
+    tables_list = t;
+    thread_unlock(&tables_lock);
+}
+
+
+int
+session_tables_shared(lame_internal_flags const *gfc)
+{
+    return gfc->tables != 0 && gfc->tables->ready;
+}
+
+
+void
+session_tables_release(lame_internal_flags * gfc)
+{
+    SessionTables_t *const t = gfc->tables;
+    int     last = 1;
+
+    if (t == 0) {
+        return;
+    }
+    gfc->tables = 0;
+    if (t->ready) {
+        thread_lock(&tables_lock);
+        if (--t->refcount == 0) {
+            SessionTables_t **p = &tables_list;
+            while (*p != t) {
+                p = &(*p)->next;
+            }
+            *p = t->next;
+        }
+        else {
+            last = 0;
+        }
+        thread_unlock(&tables_lock);
+
+        if (!last) {
+            gfc->ATH = 0;
+            gfc->cd_psy = 0;
+            gfc->sv_enc.blackfilt = 0;
+            return;
+        }
+        gfc->ATH = t->ATH;
+        gfc->cd_psy = t->cd_psy;
+        gfc->sv_enc.blackfilt = t->blackfilt;
+    }
+    gfc_free(gfc, t);
+}
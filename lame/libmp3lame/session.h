@@ -0,0 +1,45 @@
+/*
+ *      shared session tables include file
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_SESSION_H
+#define LAME_SESSION_H
+
+struct SessionTables_t;
+typedef struct SessionTables_t SessionTables_t;
+
+/* called by lame_init_params before the tables are computed.  If another
+ * encoder with the same settings is alive, gfc->ATH, gfc->cd_psy and
+ * the resampling filters are taken from it and 1 is returned, otherwise
+ * they have to be computed and handed over by session_tables_publish.
+ * Returns <0 on errors */
+int     session_tables_attach(lame_global_flags const *gfp);
+
+/* lets encoders initialized later use the tables of gfc */
+void    session_tables_publish(lame_internal_flags * gfc);
+
+/* 1 if gfc uses the tables of another encoder, which must not be changed */
+int     session_tables_shared(lame_internal_flags const *gfc);
+
+/* drops gfc's reference. gfc->ATH, gfc->cd_psy and the resampling filters
+ * are left to gfc to free only if no other encoder uses them anymore */
+void    session_tables_release(lame_internal_flags * gfc);
+
+#endif /* LAME_SESSION_H */
@@ -670,6 +670,122 @@ lame_get_nogap_currentindex(const lame_global_flags * gfp)
 }
 
 
+/* multi threaded encoding */
+
+int
+lame_set_num_threads(lame_global_flags * gfp, int num_threads)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 1 */
+        if (num_threads < 1 || 256 < num_threads)
+            return -1;
+        gfp->num_threads = num_threads;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_num_threads(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        return gfp->num_threads;
+    }
+    return 1;
+}
+
+int
+lame_set_segment_frames(lame_global_flags * gfp, int segment_frames)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+        if (segment_frames < 0)
+            return -1;
+        gfp->segment_frames = segment_frames;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_segment_frames(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        return gfp->segment_frames;
+    }
+    return 0;
+}
+
+int
+lame_set_pipeline(lame_global_flags * gfp, int pipeline)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+        if (pipeline < 0 || 1 < pipeline)
+            return -1;
+        gfp->pipeline = pipeline;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_pipeline(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->pipeline && 1 >= gfp->pipeline);
+        return gfp->pipeline;
+    }
+    return 0;
+}
+
+int
+lame_set_parallel_quantization(lame_global_flags * gfp, int parallel_quantization)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+        if (parallel_quantization < 0 || 1 < parallel_quantization)
+            return -1;
+        gfp->parallel_quantization = parallel_quantization;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_parallel_quantization(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->parallel_quantization && 1 >= gfp->parallel_quantization);
+        return gfp->parallel_quantization;
+    }
+    return 0;
+}
+
+int
+lame_set_compact_memory(lame_global_flags * gfp, int compact_memory)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (disabled) */
+        if (compact_memory < 0 || 1 < compact_memory)
+            return -1;
+        gfp->compact_memory = compact_memory;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_compact_memory(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(0 <= gfp->compact_memory && 1 >= gfp->compact_memory);
+        return gfp->compact_memory;
+    }
+    return 0;
+}
+
+
 /* message handlers */
 int
 lame_set_errorf(lame_global_flags * gfp, void (*func) (const char *, va_list))
@@ -702,6 +818,25 @@ lame_set_msgf(lame_global_flags * gfp, void (*func) (const char *, va_list))
 }
 
 
+/* output handler */
+int
+lame_set_output_function(lame_global_flags * gfp, lame_output_function func, void *user_data)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags *const gfc = gfp->internal_flags;
+        gfp->output.func = func;
+        gfp->output.user_data = user_data;
+        /* lame_init_params() already took the old one */
+        if (is_lame_internal_flags_valid(gfc)) {
+            gfc->output_func = func;
+            gfc->output_data = user_data;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+
 /*
  * Set one of
  *  - brate
@@ -2119,6 +2254,19 @@ lame_get_noclipScale(const lame_global_flags * gfp)
     return 0;
 }
 
+size_t
+lame_get_memory_usage(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (gfc != 0) {
+            /* lame_global_flags and lame_internal_flags are counted too */
+            return gfc->mem.arena_used + gfc->mem.heap_used;
+        }
+    }
+    return 0;
+}
+
 
 /*
  * LAME's estimate of the total number of frames to be encoded.
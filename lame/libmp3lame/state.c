@@ -0,0 +1,735 @@
+/*
+ *      encoder state snapshot
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+/*
+ *  A snapshot holds everything of an encoder which changes from frame to
+ *  frame: the input samples not encoded yet, the resampler, MDCT and
+ *  psymodel history, the bit reservoir with the frames whose main data
+ *  is not complete yet, the bytes not handed out, the ReplayGain analysis
+ *  and the data for the Xing/LAME tag.  What lame_init_params computed
+ *  from the settings is not part of it, the encoder a snapshot is restored
+ *  into has to be set up with the same settings.  A fingerprint of the
+ *  session config and of the offset and size of every saved field makes
+ *  sure of that; the data itself is stored as it is in memory, so a
+ *  snapshot can only be restored by a build with the same layout.
+ *
+ *  Only the parts in use are saved: the input buffer from mf_start on,
+ *  which is restored to the front of mfbuf, the headers between w_ptr and
+ *  h_ptr, the ReplayGain filter buffers up to the current sample and the
+ *  nonzero entries of its histograms.  Pointers are never saved.
+ *
+ *  Layout: a StateHeader_t, then the data in the order of
+ *  state_transfer(), in native byte order.  Counts of variable length
+ *  parts are ints.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "bitstream.h"
+#include "gain_analysis.h"
+#include "lame_global_flags.h"
+#include "state.h"
+
+
+/* raise it whenever the data or its order change */
+#define STATE_VERSION 2
+
+typedef enum {
+    STATE_SIZE,              /* count the bytes only */
+    STATE_SAVE,
+    STATE_CHECK,             /* read the snapshot, but change nothing */
+    STATE_RESTORE
+} state_mode_e;
+
+struct StateIO_t {
+    state_mode_e mode;
+    unsigned char *dst;      /* STATE_SAVE */
+    unsigned char const *src; /* STATE_CHECK and STATE_RESTORE */
+    size_t  size;
+    size_t  pos;
+    int     error;           /* -1: snapshot too short or broken, -2: out of memory */
+};
+
+typedef struct {
+    char    magic[4];
+    uint32_t version;
+    uint32_t fingerprint;
+    uint32_t size;           /* of the whole snapshot */
+} StateHeader_t;
+
+
+void
+state_data(StateIO_t * io, void *data, size_t n)
+{
+    if (io->error != 0 || n == 0)
+        return;
+    if (n > io->size - io->pos) {
+        io->error = -1;
+        return;
+    }
+    if (io->mode == STATE_SAVE)
+        memcpy(io->dst + io->pos, data, n);
+    else if (io->mode == STATE_RESTORE)
+        memcpy(data, io->src + io->pos, n);
+    io->pos += n;
+}
+
+
+int
+state_count(StateIO_t * io, int n, int max)
+{
+    if (io->mode == STATE_SIZE || io->mode == STATE_SAVE) {
+        assert(0 <= n && n <= max);
+        state_data(io, &n, sizeof(n));
+        return n;
+    }
+    if (io->error != 0)
+        return 0;
+    if (sizeof(n) > io->size - io->pos) {
+        io->error = -1;
+        return 0;
+    }
+    memcpy(&n, io->src + io->pos, sizeof(n));
+    io->pos += sizeof(n);
+    if (n < 0 || n > max) {
+        io->error = -1;
+        return 0;
+    }
+    return n;
+}
+
+
+int
+state_restoring(StateIO_t const *io)
+{
+    return io->mode == STATE_RESTORE;
+}
+
+static int
+state_saving(StateIO_t const *io)
+{
+    return io->mode == STATE_SIZE || io->mode == STATE_SAVE;
+}
+
+void
+state_copy(StateIO_t * io, void *copy, size_t n)
+{
+    size_t const pos = io->pos;
+
+    state_data(io, copy, n);
+    if (io->mode == STATE_CHECK && io->error == 0 && n != 0)
+        memcpy(copy, io->src + pos, n);
+}
+
+void
+state_check(StateIO_t * io, int ok)
+{
+    if (!state_saving(io) && io->error == 0 && !ok)
+        io->error = -1;
+}
+
+#define IN_RANGE(x, lo, hi) ((lo) <= (x) && (x) <= (hi))
+
+static int
+ints_in_range(int const *v, int n, int lo, int hi)
+{
+    while (n-- > 0) {
+        if (!IN_RANGE(*v, lo, hi))
+            return 0;
+        v++;
+    }
+    return 1;
+}
+
+
+static  uint32_t
+fnv1a(uint32_t h, void const *data, size_t n)
+{
+    unsigned char const *p = (unsigned char const *) data;
+
+    while (n-- > 0) {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t
+state_layout(uint32_t h, size_t const *layout, size_t n)
+{
+    return fnv1a(h, layout, n * sizeof(layout[0]));
+}
+
+/* the fields state_transfer() saves, and those of the structures it saves
+ * as a whole */
+static const size_t state_fields[] = {
+    sizeof(sample_t), sizeof(FLOAT), sizeof(int),
+
+    STATE_FIELD(lame_internal_flags, lame_encode_frame_init),
+    STATE_FIELD(lame_internal_flags, nMusicCRC),
+
+    STATE_FIELD(EncStateVar_t, sb_sample), STATE_FIELD(EncStateVar_t, itime),
+    STATE_FIELD(EncStateVar_t, pefirbuf), STATE_FIELD(EncStateVar_t, slot_lag),
+    STATE_FIELD(EncStateVar_t, header[0].write_timing),
+    STATE_FIELD(EncStateVar_t, header[0].ptr), STATE_FIELD(EncStateVar_t, header[0].buf),
+    STATE_FIELD(EncStateVar_t, ancillary_flag), STATE_FIELD(EncStateVar_t, ResvSize),
+    STATE_FIELD(EncStateVar_t, ResvMax), STATE_FIELD(EncStateVar_t, mf_samples_to_encode),
+
+    STATE_FIELD(PsyStateVar_t, nb_l1), STATE_FIELD(PsyStateVar_t, nb_l2),
+    STATE_FIELD(PsyStateVar_t, nb_s1), STATE_FIELD(PsyStateVar_t, nb_s2),
+    STATE_FIELD(PsyStateVar_t, thm), STATE_FIELD(PsyStateVar_t, en),
+    STATE_FIELD(PsyStateVar_t, loudness_sq_save), STATE_FIELD(PsyStateVar_t, tot_ener),
+    STATE_FIELD(PsyStateVar_t, last_en_subshort), STATE_FIELD(PsyStateVar_t, last_attacks),
+    STATE_FIELD(PsyStateVar_t, ath_adjust_factor), STATE_FIELD(PsyStateVar_t, ath_adjust_limit),
+    STATE_FIELD(PsyStateVar_t, masking_lower), STATE_FIELD(PsyStateVar_t, blocktype_old),
+    sizeof(PsyStateVar_t),
+    STATE_FIELD(III_psy_ratio, thm), STATE_FIELD(III_psy_ratio, en),
+    STATE_FIELD(III_psy_xmin, l), STATE_FIELD(III_psy_xmin, s),
+
+    STATE_FIELD(PsyResult_t, loudness_sq), sizeof(PsyResult_t),
+
+    STATE_FIELD(QntStateVar_t, longfact), STATE_FIELD(QntStateVar_t, shortfact),
+    STATE_FIELD(QntStateVar_t, masking_lower), STATE_FIELD(QntStateVar_t, mask_adjust),
+    STATE_FIELD(QntStateVar_t, mask_adjust_short),
+    STATE_FIELD(QntStateVar_t, ath_adjust_factor), STATE_FIELD(QntStateVar_t, OldValue),
+    STATE_FIELD(QntStateVar_t, CurrentStep), STATE_FIELD(QntStateVar_t, pseudohalf),
+    STATE_FIELD(QntStateVar_t, sfb21_extra), STATE_FIELD(QntStateVar_t, substep_shaping),
+    STATE_FIELD(QntStateVar_t, bv_scf), sizeof(QntStateVar_t),
+
+    STATE_FIELD(gr_info, scalefac), STATE_FIELD(gr_info, xrpow_max),
+    STATE_FIELD(gr_info, part2_3_length), STATE_FIELD(gr_info, big_values),
+    STATE_FIELD(gr_info, count1), STATE_FIELD(gr_info, global_gain),
+    STATE_FIELD(gr_info, scalefac_compress), STATE_FIELD(gr_info, block_type),
+    STATE_FIELD(gr_info, mixed_block_flag), STATE_FIELD(gr_info, table_select),
+    STATE_FIELD(gr_info, subblock_gain), STATE_FIELD(gr_info, region0_count),
+    STATE_FIELD(gr_info, region1_count), STATE_FIELD(gr_info, preflag),
+    STATE_FIELD(gr_info, scalefac_scale), STATE_FIELD(gr_info, count1table_select),
+    STATE_FIELD(gr_info, part2_length), STATE_FIELD(gr_info, sfb_lmax),
+    STATE_FIELD(gr_info, sfb_smin), STATE_FIELD(gr_info, psy_lmax),
+    STATE_FIELD(gr_info, sfbmax), STATE_FIELD(gr_info, psymax),
+    STATE_FIELD(gr_info, sfbdivide), STATE_FIELD(gr_info, width),
+    STATE_FIELD(gr_info, window), STATE_FIELD(gr_info, count1bits),
+    STATE_FIELD(gr_info, sfb_partition_table), STATE_FIELD(gr_info, slen),
+    STATE_FIELD(gr_info, max_nonzero_coeff), STATE_FIELD(gr_info, energy_above_cutoff),
+    sizeof(gr_info),
+
+    STATE_FIELD(III_side_info_t, main_data_begin), STATE_FIELD(III_side_info_t, private_bits),
+    STATE_FIELD(III_side_info_t, resvDrain_pre), STATE_FIELD(III_side_info_t, resvDrain_post),
+    STATE_FIELD(III_side_info_t, scfsi),
+
+    STATE_FIELD(Bit_stream_struc, buf_bit_idx), STATE_FIELD(Bit_stream_struc, totbit),
+
+    STATE_FIELD(EncResult_t, bitrate_channelmode_hist),
+    STATE_FIELD(EncResult_t, bitrate_blocktype_hist), STATE_FIELD(EncResult_t, bitrate_index),
+    STATE_FIELD(EncResult_t, frame_number), STATE_FIELD(EncResult_t, padding),
+    STATE_FIELD(EncResult_t, mode_ext), STATE_FIELD(EncResult_t, encoder_delay),
+    STATE_FIELD(EncResult_t, encoder_padding), sizeof(EncResult_t),
+
+    STATE_FIELD(replaygain_t, linprebuf), STATE_FIELD(replaygain_t, lstepbuf),
+    STATE_FIELD(replaygain_t, loutbuf), STATE_FIELD(replaygain_t, rinprebuf),
+    STATE_FIELD(replaygain_t, rstepbuf), STATE_FIELD(replaygain_t, routbuf),
+    STATE_FIELD(replaygain_t, lsum), STATE_FIELD(replaygain_t, rsum),
+    STATE_FIELD(replaygain_t, first), STATE_FIELD(replaygain_t, A),
+    STATE_FIELD(replaygain_t, B),
+
+    STATE_FIELD(RpgResult_t, noclipScale), STATE_FIELD(RpgResult_t, PeakSample),
+    STATE_FIELD(RpgResult_t, RadioGain), STATE_FIELD(RpgResult_t, noclipGainChange),
+    sizeof(RpgResult_t),
+
+    STATE_FIELD(VBR_seek_info_t, sum), STATE_FIELD(VBR_seek_info_t, seen),
+    STATE_FIELD(VBR_seek_info_t, want), sizeof(int), /* bag[] */
+    STATE_FIELD(VBR_seek_info_t, nVbrNumFrames), STATE_FIELD(VBR_seek_info_t, nBytesWritten),
+    STATE_FIELD(VBR_seek_info_t, TotalFrameSize)
+};
+
+static  uint32_t
+state_fingerprint(lame_internal_flags const *gfc)
+{
+    uint32_t h = 2166136261u;
+
+    h = state_layout(h, state_fields, sizeof(state_fields) / sizeof(state_fields[0]));
+    h = pipeline_layout(h);
+    return fnv1a(h, &gfc->cfg, sizeof(gfc->cfg));
+}
+
+
+/* the nonzero entries of a histogram as index/value pairs */
+static void
+state_histogram(StateIO_t * io, uint32_t * hist, int len)
+{
+    int     i, k, n = 0;
+
+    if (state_saving(io)) {
+        for (i = 0; i < len; i++)
+            n += hist[i] != 0;
+    }
+    n = state_count(io, n, len);
+    if (state_restoring(io)) {
+        memset(hist, 0, len * sizeof(hist[0]));
+    }
+    for (i = 0, k = 0; k < n; k++, i++) {
+        uint32_t value = 0;
+        if (state_saving(io)) {
+            while (hist[i] == 0)
+                i++;
+            value = hist[i];
+        }
+        i = state_count(io, i, len - 1);
+        STATE_VAR(io, value);
+        if (state_restoring(io)) {
+            hist[i] = value;
+        }
+    }
+}
+
+/* the filter histories, the samples of the current RMS window and the
+ * loudness histogram, the other fields depend on the samplerate only */
+static void
+state_replaygain(replaygain_t * rgd, StateIO_t * io)
+{
+    int     n;
+
+    state_data(io, rgd->linprebuf, MAX_ORDER * sizeof(Float_t));
+    state_data(io, rgd->rinprebuf, MAX_ORDER * sizeof(Float_t));
+    n = state_count(io, (int) rgd->totsamp, MAX_SAMPLES_PER_WINDOW);
+    if (state_restoring(io)) {
+        rgd->totsamp = n;
+    }
+    n += MAX_ORDER;
+    state_data(io, rgd->lstepbuf, n * sizeof(Float_t));
+    state_data(io, rgd->loutbuf, n * sizeof(Float_t));
+    state_data(io, rgd->rstepbuf, n * sizeof(Float_t));
+    state_data(io, rgd->routbuf, n * sizeof(Float_t));
+    STATE_VAR(io, rgd->lsum);
+    STATE_VAR(io, rgd->rsum);
+    STATE_VAR(io, rgd->first);
+    state_histogram(io, rgd->A, sizeof(rgd->A) / sizeof(rgd->A[0]));
+    state_histogram(io, rgd->B, sizeof(rgd->B) / sizeof(rgd->B[0]));
+}
+
+
+/* the side info of a granule has to fit its fields in the bitstream and
+ * the tables it indexes */
+static int
+granule_valid(gr_info const *gi)
+{
+    int     i;
+
+    for (i = 0; i < 3; i++) {
+        int const t = gi->table_select[i];
+        if (!IN_RANGE(t, 0, 31) || t == 4 || t == 14)
+            return 0;
+    }
+    return IN_RANGE(gi->part2_3_length, 0, MAX_BITS_PER_GRANULE)
+        && IN_RANGE(gi->part2_length, 0, MAX_BITS_PER_GRANULE)
+        && IN_RANGE(gi->big_values, 0, 576)
+        && IN_RANGE(gi->count1, gi->big_values, 576)
+        && IN_RANGE(gi->global_gain, 0, 255)
+        && IN_RANGE(gi->scalefac_compress, 0, 511)
+        && IN_RANGE(gi->block_type, NORM_TYPE, STOP_TYPE)
+        && IN_RANGE(gi->mixed_block_flag, 0, 1)
+        && ints_in_range(gi->subblock_gain, 4, 0, 7)
+        && IN_RANGE(gi->region0_count, 0, 15)
+        && IN_RANGE(gi->region1_count, 0, SBMAX_l)
+        && IN_RANGE(gi->preflag, 0, 1)
+        && IN_RANGE(gi->scalefac_scale, 0, 1)
+        && IN_RANGE(gi->count1table_select, 0, 1)
+        && IN_RANGE(gi->sfb_lmax, 0, SBMAX_l)
+        && IN_RANGE(gi->sfb_smin, 0, SBMAX_s)
+        && IN_RANGE(gi->psy_lmax, 0, SBMAX_l)
+        && IN_RANGE(gi->sfbmax, 0, SFBMAX)
+        && IN_RANGE(gi->psymax, 0, SFBMAX)
+        && IN_RANGE(gi->sfbdivide, 0, SFBMAX)
+        && ints_in_range(gi->width, SFBMAX, 0, 576)
+        && ints_in_range(gi->window, SFBMAX, 0, 3)
+        && IN_RANGE(gi->count1bits, 0, MAX_BITS_PER_GRANULE)
+        && ints_in_range(gi->slen, 4, 0, 15)
+        && IN_RANGE(gi->max_nonzero_coeff, 0, 575);
+}
+
+
+/* the region0 and region1 counts of bv_scf, see huffman_init */
+static int
+regions_valid(char const *bv_scf)
+{
+    int     i;
+
+    for (i = 0; i < 576; i += 2) {
+        if (bv_scf[i] < 0 || bv_scf[i + 1] < 0 || bv_scf[i] + bv_scf[i + 1] + 2 >= SBPSY_l)
+            return 0;
+    }
+    return 1;
+}
+
+
+/* the headers of the frames in the bit reservoir, from w_ptr on, and the
+ * write timing of the next frame at h_ptr.  Returns the write timing of
+ * the first one, which may not be before the bits written so far */
+static int
+state_headers(lame_internal_flags * gfc, StateIO_t * io)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int     n, i, first = 0, last = 0;
+
+    n = state_count(io, ((esv->h_ptr - esv->w_ptr) & (MAX_HEADER_BUF - 1)) + 1,
+                    MAX_HEADER_BUF);
+    state_check(io, n != 0);
+    if (state_restoring(io)) {
+        esv->w_ptr = 0;
+        esv->h_ptr = n - 1;
+    }
+    for (i = 0; i < n; i++) {
+        int const k = (esv->w_ptr + i) & (MAX_HEADER_BUF - 1);
+        int     write_timing = esv->header[k].write_timing;
+        int     ptr = esv->header[k].ptr;
+
+        state_copy(io, &write_timing, sizeof(write_timing));
+        state_copy(io, &ptr, sizeof(ptr));
+        state_check(io, write_timing % 8 == 0 && (i == 0 || write_timing > last)
+                    && IN_RANGE(ptr, 0, 8 * gfc->cfg.sideinfo_len));
+        if (i == 0) {
+            first = write_timing;
+        }
+        last = write_timing;
+        if (state_restoring(io)) {
+            esv->header[k].write_timing = write_timing;
+            esv->header[k].ptr = ptr;
+        }
+        state_data(io, esv->header[k].buf, gfc->cfg.sideinfo_len);
+    }
+    return first;
+}
+
+
+static void
+state_transfer(lame_internal_flags * gfc, StateIO_t * io)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    Bit_stream_struc *const bs = &gfc->bs;
+    III_side_info_t *const l3_side = &gfc->l3_side;
+    VBR_seek_info_t *const vbr = &gfc->VBR_seek_table;
+    /* main_data_begin has 9 bits in MPEG-1, 8 bits in MPEG-2 */
+    int const resv_limit = 8 * 256 * cfg->mode_gr - 8;
+    int     gr, ch, n, mf_size, first_header;
+
+    /* what the encoder indexes with or loops over is checked before it is
+     * restored, those are read into copies first */
+    n = gfc->lame_encode_frame_init;
+    state_copy(io, &n, sizeof(n));
+    state_check(io, IN_RANGE(n, 0, 1));
+    if (state_restoring(io)) {
+        gfc->lame_encode_frame_init = n;
+    }
+
+    /* input samples not encoded yet */
+    mf_size = state_count(io, esv->mf_size, esv->mf_bufsize);
+    if (state_restoring(io)) {
+        esv->mf_start = 0;
+        esv->mf_size = mf_size;
+    }
+    for (ch = 0; ch < cfg->channels_out; ch++) {
+        state_data(io, esv->mfbuf[ch] + esv->mf_start, mf_size * sizeof(sample_t));
+    }
+    /* the samples in mfbuf plus the encoder delay and padding, 0 after a
+     * flush.  lame_encode_flush() pads with as many frames as that */
+    n = esv->mf_samples_to_encode;
+    state_copy(io, &n, sizeof(n));
+    state_check(io, IN_RANGE(n, 0, mf_size + ENCDELAY + POSTDELAY));
+    if (state_restoring(io)) {
+        esv->mf_samples_to_encode = n;
+    }
+    if (isResamplingNecessary(cfg)) {
+        int const filter_l = resample_filter_length(cfg);
+        int const blacksize = filter_l + 1;
+        double  itime[2];
+
+        /* fill_buffer_resample reads inbuf_old[blacksize + j] for
+         * j >= -itime - filter_l / 2 */
+        memcpy(itime, esv->itime, sizeof(itime));
+        state_copy(io, itime, sizeof(itime));
+        for (ch = 0; ch < 2; ch++) {
+            state_check(io, IN_RANGE(itime[ch], -blacksize, blacksize - filter_l / 2));
+        }
+        if (state_restoring(io)) {
+            memcpy(esv->itime, itime, sizeof(itime));
+        }
+        for (ch = 0; ch < 2; ch++) {
+            state_data(io, esv->inbuf_old[ch], blacksize * sizeof(sample_t));
+        }
+    }
+
+    /* polyphase filter, psymodel and quantization history */
+    for (ch = 0; ch < cfg->channels_out; ch++) {
+        STATE_VAR(io, esv->sb_sample[ch]);
+    }
+    {
+        PsyStateVar_t psv = gfc->sv_psy;
+
+        state_copy(io, &psv, sizeof(psv));
+        state_check(io, ints_in_range(psv.blocktype_old, 2, NORM_TYPE, STOP_TYPE));
+        if (state_restoring(io)) {
+            gfc->sv_psy = psv;
+        }
+    }
+    STATE_VAR(io, gfc->ov_psy);
+    {
+        QntStateVar_t qsv = gfc->sv_qnt;
+
+        state_copy(io, &qsv, sizeof(qsv));
+        state_check(io, ints_in_range(qsv.OldValue, 2, 0, 255)
+                    && ints_in_range(qsv.CurrentStep, 2, 1, 4)
+                    && regions_valid(qsv.bv_scf));
+        if (state_restoring(io)) {
+            gfc->sv_qnt = qsv;
+        }
+    }
+    for (gr = 0; gr < 2; gr++) {
+        for (ch = 0; ch < 2; ch++) {
+            gr_info gi = l3_side->tt[gr][ch];
+
+            /* xr and l3_enc are computed again for every granule, and the
+             * LSF partition table is looked up again before it is used */
+            state_copy(io, gi.scalefac,
+                       offsetof(gr_info, sfb_partition_table) - offsetof(gr_info, scalefac));
+            state_copy(io, gi.slen, sizeof(gi) - offsetof(gr_info, slen));
+            state_check(io, granule_valid(&gi));
+            if (state_restoring(io)) {
+                l3_side->tt[gr][ch] = gi;
+            }
+        }
+    }
+    {
+        III_side_info_t side = *l3_side;
+
+        state_copy(io, &side.main_data_begin, sizeof(side.main_data_begin));
+        state_copy(io, &side.private_bits, sizeof(side.private_bits));
+        state_copy(io, &side.resvDrain_pre, sizeof(side.resvDrain_pre));
+        state_copy(io, &side.resvDrain_post, sizeof(side.resvDrain_post));
+        state_copy(io, side.scfsi, sizeof(side.scfsi));
+        state_check(io, IN_RANGE(side.main_data_begin, 0, resv_limit / 8)
+                    && IN_RANGE(side.private_bits, 0, 31)
+                    && IN_RANGE(side.resvDrain_pre, 0, resv_limit)
+                    && side.resvDrain_post >= 0
+                    && ints_in_range(&side.scfsi[0][0], 2 * 4, 0, 1));
+        if (state_restoring(io)) {
+            l3_side->main_data_begin = side.main_data_begin;
+            l3_side->private_bits = side.private_bits;
+            l3_side->resvDrain_pre = side.resvDrain_pre;
+            l3_side->resvDrain_post = side.resvDrain_post;
+            memcpy(l3_side->scfsi, side.scfsi, sizeof(side.scfsi));
+        }
+    }
+    if (state_count(io, gfc->sv_pipe != 0, gfc->sv_pipe != 0)) {
+        pipeline_state(gfc, io);
+    }
+    else if (state_restoring(io)) {
+        pipeline_reset(gfc);
+    }
+
+    /* bit reservoir, padding and the headers of frames in the reservoir */
+    STATE_VAR(io, esv->pefirbuf);
+    STATE_VAR(io, esv->slot_lag);
+    {
+        int     resv[3];
+
+        resv[0] = esv->ResvSize;
+        resv[1] = esv->ResvMax;
+        resv[2] = esv->ancillary_flag;
+        state_copy(io, &resv[0], sizeof(resv[0]));
+        state_copy(io, &resv[1], sizeof(resv[1]));
+        state_copy(io, &resv[2], sizeof(resv[2]));
+        state_check(io, ints_in_range(resv, 2, 0, resv_limit) && IN_RANGE(resv[2], 0, 1));
+        if (state_restoring(io)) {
+            esv->ResvSize = resv[0];
+            esv->ResvMax = resv[1];
+            esv->ancillary_flag = resv[2];
+        }
+    }
+    first_header = state_headers(gfc, io);
+
+    /* bytes not handed out yet */
+    n = state_count(io, bs->buf_byte_idx + 1, INT_MAX / 2);
+    if (io->mode == STATE_CHECK && io->error == 0 && bitstream_reserve(gfc, n) < 0) {
+        io->error = -2;
+    }
+    if (state_restoring(io)) {
+        bs->buf_byte_idx = n - 1;
+    }
+    state_data(io, bs->buf, n);
+    {
+        int     bit_idx = bs->buf_bit_idx, totbit = bs->totbit;
+
+        state_copy(io, &bit_idx, sizeof(bit_idx));
+        state_copy(io, &totbit, sizeof(totbit));
+        state_check(io, IN_RANGE(bit_idx, 0, 8) && IN_RANGE(totbit, 0, first_header));
+        if (state_restoring(io)) {
+            bs->buf_bit_idx = bit_idx;
+            bs->totbit = totbit;
+        }
+    }
+
+    /* statistics, ReplayGain, peak sample and the Xing/LAME tag */
+    {
+        EncResult_t eov = gfc->ov_enc;
+
+        state_copy(io, &eov, sizeof(eov));
+        state_check(io, IN_RANGE(eov.bitrate_index, 0, 15) && IN_RANGE(eov.padding, 0, 1)
+                    && IN_RANGE(eov.mode_ext, 0, 3) && eov.frame_number >= 0);
+        if (state_restoring(io)) {
+            gfc->ov_enc = eov;
+        }
+    }
+    if (cfg->findReplayGain) {
+        state_replaygain(gfc->sv_rpg.rgdata, io);
+    }
+    STATE_VAR(io, gfc->ov_rpg);
+    STATE_VAR(io, gfc->nMusicCRC);
+    STATE_VAR(io, vbr->sum);
+    STATE_VAR(io, vbr->seen);
+    STATE_VAR(io, vbr->want);
+    n = state_count(io, vbr->pos, vbr->size);
+    if (state_restoring(io)) {
+        vbr->pos = n;
+    }
+    state_data(io, vbr->bag, n * sizeof(vbr->bag[0]));
+    STATE_VAR(io, vbr->nVbrNumFrames);
+    STATE_VAR(io, vbr->nBytesWritten);
+    STATE_VAR(io, vbr->TotalFrameSize);
+}
+
+
+/* the encoders lame_save_state and lame_restore_state work with */
+static lame_internal_flags *
+state_encoder(lame_global_flags const *gfp)
+{
+    lame_internal_flags *gfc;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return 0;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc))
+        return 0;
+    if (gfc->sv_seg != 0 || gfc->cfg.decode_on_the_fly) {
+        ERRORF(gfc, "Error: no encoder state with segmented encoding or decoding on the fly\n");
+        return 0;
+    }
+    return gfc;
+}
+
+
+size_t
+lame_get_state_size(const lame_global_flags * gfp)
+{
+    lame_internal_flags *const gfc = state_encoder(gfp);
+    StateIO_t io;
+
+    if (gfc == 0)
+        return 0;
+    memset(&io, 0, sizeof(io));
+    io.mode = STATE_SIZE;
+    io.size = (size_t) -1;
+    state_transfer(gfc, &io);
+    return sizeof(StateHeader_t) + io.pos;
+}
+
+
+int
+lame_save_state(const lame_global_flags * gfp, unsigned char *state, size_t state_size)
+{
+    lame_internal_flags *const gfc = state_encoder(gfp);
+    StateHeader_t head;
+    StateIO_t io;
+
+    if (gfc == 0 || state == 0)
+        return -3;
+    if (state_size < sizeof(head))
+        return -1;
+    memset(&io, 0, sizeof(io));
+    io.mode = STATE_SAVE;
+    io.dst = state + sizeof(head);
+    io.size = Min(state_size, (size_t) INT_MAX) - sizeof(head);
+    state_transfer(gfc, &io);
+    if (io.error != 0)
+        return -1;
+
+    memcpy(head.magic, "LMST", 4);
+    head.version = STATE_VERSION;
+    head.fingerprint = state_fingerprint(gfc);
+    head.size = (uint32_t) (sizeof(head) + io.pos);
+    memcpy(state, &head, sizeof(head));
+    return (int) head.size;
+}
+
+
+int
+lame_restore_state(lame_global_flags * gfp, const unsigned char *state, size_t state_size)
+{
+    lame_internal_flags *const gfc = state_encoder(gfp);
+    StateHeader_t head;
+    StateIO_t io;
+
+    if (gfc == 0 || state == 0)
+        return -3;
+    if (state_size < sizeof(head))
+        return -1;
+    memcpy(&head, state, sizeof(head));
+    if (memcmp(head.magic, "LMST", 4) != 0 || head.version != STATE_VERSION
+        || head.size < sizeof(head) || head.size > state_size) {
+        ERRORF(gfc, "Error: not a complete encoder state of this version\n");
+        return -1;
+    }
+    if (head.fingerprint != state_fingerprint(gfc)) {
+        ERRORF(gfc, "Error: the encoder state is from other settings or another build\n");
+        return -1;
+    }
+
+    /* read it once without changing anything, so a broken snapshot
+     * leaves the encoder as it was; this checks the indexes, counts and
+     * bit positions too */
+    memset(&io, 0, sizeof(io));
+    io.mode = STATE_CHECK;
+    io.src = state + sizeof(head);
+    io.size = head.size - sizeof(head);
+    state_transfer(gfc, &io);
+    if (io.error == 0 && io.pos != io.size)
+        io.error = -1;
+    if (io.error != 0) {
+        ERRORF(gfc, "Error: broken encoder state\n");
+        return io.error;
+    }
+
+    io.mode = STATE_RESTORE;
+    io.pos = 0;
+    state_transfer(gfc, &io);
+    assert(io.error == 0 && io.pos == io.size);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ *      encoder state snapshot include file
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_STATE_H
+#define LAME_STATE_H
+
+/* lame_save_state() and lame_restore_state() walk over the stream state
+ * of an encoder with one list of state_data() calls.  Depending on the
+ * mode of io, the data is counted, saved, checked against the snapshot
+ * or restored from it.
+ */
+struct StateIO_t;
+typedef struct StateIO_t StateIO_t;
+
+/* transfers n bytes at data */
+void    state_data(StateIO_t * io, void *data, size_t n);
+
+/* transfers the number of valid elements n of an array of max elements.
+ * Returns n, or the number found in the snapshot when checking or
+ * restoring, which should be used for the elements that follow */
+int     state_count(StateIO_t * io, int n, int max);
+
+/* 1 if the state is being restored, so everything may be changed */
+int     state_restoring(StateIO_t const *io);
+
+/* transfers n bytes like state_data(), but into copy when checking too,
+ * so that the values can be checked before the encoder uses them.  copy
+ * has to hold the values of the encoder when saving */
+void    state_copy(StateIO_t * io, void *copy, size_t n);
+
+/* marks the snapshot as broken if ok is 0, when checking or restoring */
+void    state_check(StateIO_t * io, int ok);
+
+#define STATE_VAR(io, var) state_data((io), &(var), sizeof(var))
+
+/* offset and size of a field saved with state_data(), for the fingerprint
+ * of the snapshot layout.  Every field has to be listed, so that moving a
+ * field or changing its type makes old snapshots invalid */
+#define STATE_FIELD(type, member) offsetof(type, member), sizeof(((type *) 0)->member)
+
+/* adds n values of a STATE_FIELD() list to the fingerprint h */
+uint32_t state_layout(uint32_t h, size_t const *layout, size_t n);
+
+#endif /* LAME_STATE_H */
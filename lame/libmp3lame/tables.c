@@ -28,6 +28,8 @@
 #include "machine.h"
 
 #include "lame.h"
+#include "encoder.h"
+#include "l3side.h"
 #include "tables.h"
 
 
@@ -561,4 +563,83 @@ lame_get_samplerate(int mpeg_version, int table_index)
 /* This is the scfsi_band table from 2.4.2.7 of the IS */
 const int scfsi_band[5] = { 0, 6, 11, 16, 21 };
 
+
+/*
+  Here are MPEG1 Table B.8 and MPEG2 Table B.1
+  -- Layer III scalefactor bands. 
+  Index into this using a method such as:
+    idx  = fr_ps->header->sampling_frequency
+           + (fr_ps->header->version * 3)
+*/
+
+
+const scalefac_struct sfBandIndex[9] = {
+    {                   /* Table B.2.b: 22.05 kHz */
+     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
+      522, 576},
+     {0, 4, 8, 12, 18, 24, 32, 42, 56, 74, 100, 132, 174, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* Table B.2.c: 24 kHz */ /* docs: 332. mpg123(broken): 330 */
+     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 114, 136, 162, 194, 232, 278, 332, 394, 464,
+      540, 576},
+     {0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 136, 180, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* Table B.2.a: 16 kHz */
+     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
+      522, 576},
+     {0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 134, 174, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* Table B.8.b: 44.1 kHz */
+     {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 52, 62, 74, 90, 110, 134, 162, 196, 238, 288, 342, 418,
+      576},
+     {0, 4, 8, 12, 16, 22, 30, 40, 52, 66, 84, 106, 136, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* Table B.8.c: 48 kHz */
+     {0, 4, 8, 12, 16, 20, 24, 30, 36, 42, 50, 60, 72, 88, 106, 128, 156, 190, 230, 276, 330, 384,
+      576},
+     {0, 4, 8, 12, 16, 22, 28, 38, 50, 64, 80, 100, 126, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* Table B.8.a: 32 kHz */
+     {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 54, 66, 82, 102, 126, 156, 194, 240, 296, 364, 448, 550,
+      576},
+     {0, 4, 8, 12, 16, 22, 30, 42, 58, 78, 104, 138, 180, 192}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* MPEG-2.5 11.025 kHz */
+     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
+      522, 576},
+     {0 / 3, 12 / 3, 24 / 3, 36 / 3, 54 / 3, 78 / 3, 108 / 3, 144 / 3, 186 / 3, 240 / 3, 312 / 3,
+      402 / 3, 522 / 3, 576 / 3}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* MPEG-2.5 12 kHz */
+     {0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464,
+      522, 576},
+     {0 / 3, 12 / 3, 24 / 3, 36 / 3, 54 / 3, 78 / 3, 108 / 3, 144 / 3, 186 / 3, 240 / 3, 312 / 3,
+      402 / 3, 522 / 3, 576 / 3}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     },
+    {                   /* MPEG-2.5 8 kHz */
+     {0, 12, 24, 36, 48, 60, 72, 88, 108, 132, 160, 192, 232, 280, 336, 400, 476, 566, 568, 570,
+      572, 574, 576},
+     {0 / 3, 24 / 3, 48 / 3, 72 / 3, 108 / 3, 156 / 3, 216 / 3, 288 / 3, 372 / 3, 480 / 3, 486 / 3,
+      492 / 3, 498 / 3, 576 / 3}
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb21 pseudo sub bands */
+     , {0, 0, 0, 0, 0, 0, 0} /*  sfb12 pseudo sub bands */
+     }
+};
+
 /* end of tables.c */
@@ -89,6 +89,8 @@ extern const uint32_t table56[4 * 4];
 
 extern const int scfsi_band[5];
 
+extern const scalefac_struct sfBandIndex[9];
+
 extern const int bitrate_table    [3][16];
 extern const int samplerate_table [3][ 4];
 
@@ -33,6 +33,7 @@
 #include "util.h"
 #include "quantize_pvt.h"
 #include "tables.h"
+#include "vector/lame_intrin.h"
 
 
 static const struct {
@@ -279,8 +280,8 @@ quantize_lines_xrpow(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix)
  *********************************************************************/
 
 static void
-quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_info,
-               calc_noise_data const *prev_noise)
+quantize_xrpow(lame_internal_flags const *gfc, const FLOAT * xp, int *pi, FLOAT istep,
+               gr_info const *const cod_info, calc_noise_data const *prev_noise)
 {
     /* quantize on xr^(3/4) instead of xr */
     int     sfb;
@@ -324,11 +325,11 @@ quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_
             /* do not recompute this part,
                but compute accumulated lines */
             if (accumulate) {
-                quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
+                gfc->quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
                 accumulate = 0;
             }
             if (accumulate01) {
-                quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
+                gfc->quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
                 accumulate01 = 0;
             }
         }
@@ -363,7 +364,7 @@ quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_
                 prev_noise->step[sfb] > 0 && step >= prev_noise->step[sfb]) {
 
                 if (accumulate) {
-                    quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
+                    gfc->quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
                     accumulate = 0;
                     acc_iData = iData;
                     acc_xp = xp;
@@ -372,7 +373,7 @@ quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_
             }
             else {
                 if (accumulate01) {
-                    quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
+                    gfc->quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
                     accumulate01 = 0;
                     acc_iData = iData;
                     acc_xp = xp;
@@ -385,11 +386,11 @@ quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_
                  *  may happen due to "prev_data_use" optimization 
                  */
                 if (accumulate01) {
-                    quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
+                    gfc->quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
                     accumulate01 = 0;
                 }
                 if (accumulate) {
-                    quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
+                    gfc->quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
                     accumulate = 0;
                 }
 
@@ -403,11 +404,11 @@ quantize_xrpow(const FLOAT * xp, int *pi, FLOAT istep, gr_info const *const cod_
         }
     }
     if (accumulate) {   /*last data part */
-        quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
+        gfc->quantize_lines_xrpow(accumulate, istep, acc_xp, acc_iData);
         accumulate = 0;
     }
     if (accumulate01) { /*last data part */
-        quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
+        gfc->quantize_lines_xrpow_01(accumulate01, istep, acc_xp, acc_iData);
         accumulate01 = 0;
     }
 
@@ -776,7 +777,7 @@ count_bits(lame_internal_flags const *const gfc,
     if (gi->xrpow_max > w)
         return LARGE_BITS;
 
-    quantize_xrpow(xr, ix, IPOW20(gi->global_gain), gi, prev_noise);
+    quantize_xrpow(gfc, xr, ix, IPOW20(gi->global_gain), gi, prev_noise);
 
     if (gfc->sv_qnt.substep_shaping & 2) {
         int     sfb, j = 0;
@@ -1331,6 +1332,15 @@ scale_bitcount(const lame_internal_flags * gfc, gr_info * cod_info)
 extern int choose_table_MMX(const int *ix, const int *const end, int *const s);
 #endif
 
+void
+init_huffman_tables(void)
+{
+#if defined(HAVE_IMMINTRIN_H)
+    choose_table_avx2_init();
+#endif
+}
+
+
 void
 huffman_init(lame_internal_flags * const gfc)
 {
@@ -1343,6 +1353,29 @@ huffman_init(lame_internal_flags * const gfc)
         gfc->choose_table = choose_table_MMX;
     }
 #endif
+#if defined(HAVE_IMMINTRIN_H)
+    if (gfc->CPU_features.AVX2) {
+        gfc->choose_table = choose_table_avx2;
+    }
+#endif
+
+    gfc->quantize_lines_xrpow = quantize_lines_xrpow;
+    gfc->quantize_lines_xrpow_01 = quantize_lines_xrpow_01;
+
+#if defined(HAVE_IMMINTRIN_H)
+    if (gfc->CPU_features.AVX512) {
+        gfc->quantize_lines_xrpow_01 = quantize_lines_xrpow_01_avx512;
+#ifdef TAKEHIRO_IEEE754_HACK
+        gfc->quantize_lines_xrpow = quantize_lines_xrpow_avx512;
+#endif
+    }
+    else if (gfc->CPU_features.AVX2) {
+        gfc->quantize_lines_xrpow_01 = quantize_lines_xrpow_01_avx2;
+#ifdef TAKEHIRO_IEEE754_HACK
+        gfc->quantize_lines_xrpow = quantize_lines_xrpow_avx2;
+#endif
+    }
+#endif
 
     for (i = 2; i <= 576; i += 2) {
         int     scfb_anz = 0, bv_index;
@@ -0,0 +1,345 @@
+/*
+ *      simple worker thread pool
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* $Id$ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "threadpool.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+# define USE_PTHREADS 1
+# include <pthread.h>
+#endif
+
+
+#ifdef USE_PTHREADS
+
+struct ThreadPool_t {
+    int     nthreads;        /* helper threads + calling thread */
+    int     nstarted;        /* helper threads actually running */
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    /* current batch, protected by lock */
+    thread_job_fn fn;
+    char   *args;
+    int     arg_size;
+    int     njobs;
+    int     next_job;
+    int     jobs_done;
+    int     quit;
+};
+
+
+/* takes the next pending job of the current batch, -1 if there is none.
+ * must be called with pool->lock held
+ */
+static int
+take_job(ThreadPool_t * pool)
+{
+    if (pool->fn != 0 && pool->next_job < pool->njobs) {
+        return pool->next_job++;
+    }
+    return -1;
+}
+
+
+static void
+finish_job(ThreadPool_t * pool)
+{
+    if (++pool->jobs_done == pool->njobs) {
+        pthread_cond_broadcast(&pool->work_done);
+    }
+}
+
+
+static void *
+thread_pool_worker(void *arg)
+{
+    ThreadPool_t *const pool = (ThreadPool_t *) arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        int     job = take_job(pool);
+        if (job >= 0) {
+            thread_job_fn const fn = pool->fn;
+            void   *const job_arg = pool->args + (size_t) job * pool->arg_size;
+            pthread_mutex_unlock(&pool->lock);
+            fn(job_arg);
+            pthread_mutex_lock(&pool->lock);
+            finish_job(pool);
+        }
+        else if (pool->quit) {
+            break;
+        }
+        else {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+
+ThreadPool_t *
+thread_pool_create(lame_internal_flags * gfc, int nthreads)
+{
+    ThreadPool_t *pool;
+    int     i;
+
+    if (nthreads <= 1) {
+        return 0;
+    }
+    pool = gfc_calloc(gfc, ThreadPool_t, 1);
+    if (pool == 0) {
+        return 0;
+    }
+    pool->threads = gfc_calloc(gfc, pthread_t, nthreads - 1);
+    if (pool->threads == 0) {
+        gfc_free(gfc, pool);
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->work_ready, 0);
+    pthread_cond_init(&pool->work_done, 0);
+
+    for (i = 0; i < nthreads - 1; ++i) {
+        if (pthread_create(&pool->threads[i], 0, thread_pool_worker, pool) != 0) {
+            break;
+        }
+    }
+    pool->nstarted = i;
+    pool->nthreads = i + 1;
+    if (pool->nstarted == 0) {
+        thread_pool_free(gfc, pool);
+        return 0;
+    }
+    return pool;
+}
+
+
+void
+thread_pool_free(lame_internal_flags * gfc, ThreadPool_t * pool)
+{
+    int     i;
+
+    if (pool == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nstarted; ++i) {
+        pthread_join(pool->threads[i], 0);
+    }
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    gfc_free(gfc, pool->threads);
+    gfc_free(gfc, pool);
+}
+
+
+int
+thread_pool_size(ThreadPool_t const *pool)
+{
+    return pool != 0 ? pool->nthreads : 1;
+}
+
+
+void
+thread_pool_run(ThreadPool_t * pool, thread_job_fn fn, void *args, int arg_size, int njobs)
+{
+    int     job;
+
+    if (pool == 0 || njobs <= 1) {
+        for (job = 0; job < njobs; ++job) {
+            fn((char *) args + (size_t) job * arg_size);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->fn != 0) {
+        /* called from one of our own jobs, run this batch right here */
+        pthread_mutex_unlock(&pool->lock);
+        for (job = 0; job < njobs; ++job) {
+            fn((char *) args + (size_t) job * arg_size);
+        }
+        return;
+    }
+    pool->fn = fn;
+    pool->args = (char *) args;
+    pool->arg_size = arg_size;
+    pool->njobs = njobs;
+    pool->next_job = 0;
+    pool->jobs_done = 0;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    /* the calling thread lends a hand, too */
+    while ((job = take_job(pool)) >= 0) {
+        pthread_mutex_unlock(&pool->lock);
+        fn((char *) args + (size_t) job * arg_size);
+        pthread_mutex_lock(&pool->lock);
+        finish_job(pool);
+    }
+    while (pool->jobs_done < pool->njobs) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pool->fn = 0;
+    pool->njobs = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#else /* USE_PTHREADS */
+
+/* no thread support on this platform, every job runs in the caller's thread
+ */
+
+ThreadPool_t *
+thread_pool_create(lame_internal_flags * gfc, int nthreads)
+{
+    (void) gfc;
+    (void) nthreads;
+    return 0;
+}
+
+
+void
+thread_pool_free(lame_internal_flags * gfc, ThreadPool_t * pool)
+{
+    (void) gfc;
+    (void) pool;
+}
+
+
+int
+thread_pool_size(ThreadPool_t const *pool)
+{
+    (void) pool;
+    return 1;
+}
+
+
+void
+thread_pool_run(ThreadPool_t * pool, thread_job_fn fn, void *args, int arg_size, int njobs)
+{
+    int     job;
+    (void) pool;
+    for (job = 0; job < njobs; ++job) {
+        fn((char *) args + (size_t) job * arg_size);
+    }
+}
+
+#endif /* USE_PTHREADS */
+
+
+
+#if defined(USE_PTHREADS)
+
+void
+thread_once(ThreadOnce_t * once, void (*init) (void))
+{
+    pthread_once(once, init);
+}
+
+
+void
+thread_lock(ThreadLock_t * lock)
+{
+    pthread_mutex_lock(lock);
+}
+
+
+void
+thread_unlock(ThreadLock_t * lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+#elif defined(_MSC_VER)
+
+static BOOL CALLBACK
+run_once(PINIT_ONCE once, PVOID init, PVOID * context)
+{
+    (void) once;
+    (void) context;
+    (*(void (**)(void)) init) ();
+    return TRUE;
+}
+
+
+void
+thread_once(ThreadOnce_t * once, void (*init) (void))
+{
+    InitOnceExecuteOnce(once, run_once, &init, 0);
+}
+
+
+void
+thread_lock(ThreadLock_t * lock)
+{
+    AcquireSRWLockExclusive(lock);
+}
+
+
+void
+thread_unlock(ThreadLock_t * lock)
+{
+    ReleaseSRWLockExclusive(lock);
+}
+
+#else /* no threads */
+
+void
+thread_once(ThreadOnce_t * once, void (*init) (void))
+{
+    if (!*once) {
+        *once = 1;
+        init();
+    }
+}
+
+
+void
+thread_lock(ThreadLock_t * lock)
+{
+    (void) lock;
+}
+
+
+void
+thread_unlock(ThreadLock_t * lock)
+{
+    (void) lock;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ *      simple worker thread pool include file
+ *
+ *      Copyright (c) 2026 The LAME Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_THREADPOOL_H
+#define LAME_THREADPOOL_H
+
+/* A job receives a pointer to its own argument record.
+ */
+typedef void (*thread_job_fn) (void *arg);
+
+struct ThreadPool_t;
+typedef struct ThreadPool_t ThreadPool_t;
+
+/* Creates a pool able to run 'nthreads' jobs at the same time. The calling
+ * thread counts as one of them, so nthreads-1 helper threads are started.
+ * Returns NULL when no helper threads are needed or available, callers
+ * then fall back to running the jobs themselves (see thread_pool_run).
+ * The pool is allocated from the memory of gfc.
+ */
+ThreadPool_t *thread_pool_create(lame_internal_flags * gfc, int nthreads);
+void    thread_pool_free(lame_internal_flags * gfc, ThreadPool_t * pool);
+
+/* number of jobs that may run at the same time, 1 for a NULL pool */
+int     thread_pool_size(ThreadPool_t const *pool);
+
+/* Runs fn on njobs argument records, each arg_size bytes apart starting
+ * at args, and returns when all of them are done (fork/join).
+ * A NULL pool runs all jobs serially in the calling thread, so does
+ * a batch started from within a job of the same pool.
+ */
+void    thread_pool_run(ThreadPool_t * pool, thread_job_fn fn, void *args, int arg_size,
+                        int njobs);
+
+
+/* Process wide one-time initialization and locking, for the tables that
+ * all encoders share.  Both can be initialized statically.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+# include <pthread.h>
+typedef pthread_once_t ThreadOnce_t;
+typedef pthread_mutex_t ThreadLock_t;
+# define THREAD_ONCE_INIT PTHREAD_ONCE_INIT
+# define THREAD_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#elif defined(_MSC_VER)
+/* windows.h comes with machine.h */
+typedef INIT_ONCE ThreadOnce_t;
+typedef SRWLOCK ThreadLock_t;
+# define THREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
+# define THREAD_LOCK_INIT SRWLOCK_INIT
+#else
+/* no threads */
+typedef int ThreadOnce_t;
+typedef int ThreadLock_t;
+# define THREAD_ONCE_INIT 0
+# define THREAD_LOCK_INIT 0
+#endif
+
+/* calls init the first time it is called with once, other threads calling
+ * it meanwhile wait until init has returned */
+void    thread_once(ThreadOnce_t * once, void (*init) (void));
+
+void    thread_lock(ThreadLock_t * lock);
+void    thread_unlock(ThreadLock_t * lock);
+
+#endif /* LAME_THREADPOOL_H */
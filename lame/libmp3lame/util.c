@@ -32,6 +32,9 @@
 #include "encoder.h"
 #include "util.h"
 #include "tables.h"
+#include "threadpool.h"
+#include "segment.h"
+#include "session.h"
 
 #define PRECOMPUTE
 #if defined(__FreeBSD__) && !defined(__alpha__)
@@ -51,24 +54,24 @@ free_id3tag(lame_internal_flags * const gfc)
 {
     gfc->tag_spec.language[0] = 0;
     if (gfc->tag_spec.title != 0) {
-        free(gfc->tag_spec.title);
+        gfc_free(gfc, gfc->tag_spec.title);
         gfc->tag_spec.title = 0;
     }
     if (gfc->tag_spec.artist != 0) {
-        free(gfc->tag_spec.artist);
+        gfc_free(gfc, gfc->tag_spec.artist);
         gfc->tag_spec.artist = 0;
     }
     if (gfc->tag_spec.album != 0) {
-        free(gfc->tag_spec.album);
+        gfc_free(gfc, gfc->tag_spec.album);
         gfc->tag_spec.album = 0;
     }
     if (gfc->tag_spec.comment != 0) {
-        free(gfc->tag_spec.comment);
+        gfc_free(gfc, gfc->tag_spec.comment);
         gfc->tag_spec.comment = 0;
     }
 
     if (gfc->tag_spec.albumart != 0) {
-        free(gfc->tag_spec.albumart);
+        gfc_free(gfc, gfc->tag_spec.albumart);
         gfc->tag_spec.albumart = 0;
         gfc->tag_spec.albumart_size = 0;
         gfc->tag_spec.albumart_mimetype = MIMETYPE_NONE;
@@ -80,9 +83,9 @@ free_id3tag(lame_internal_flags * const gfc)
             void   *q = node->txt.ptr.b;
             void   *r = node;
             node = node->nxt;
-            free(p);
-            free(q);
-            free(r);
+            gfc_free(gfc, p);
+            gfc_free(gfc, q);
+            gfc_free(gfc, r);
         } while (node != 0);
         gfc->tag_spec.v2_head = 0;
         gfc->tag_spec.v2_tail = 0;
@@ -96,13 +99,16 @@ free_global_data(lame_internal_flags * gfc)
     if (gfc && gfc->cd_psy) {
         if (gfc->cd_psy->l.s3) {
             /* XXX allocated in psymodel_init() */
-            free(gfc->cd_psy->l.s3);
+            gfc_free(gfc, gfc->cd_psy->l.s3);
         }
         if (gfc->cd_psy->s.s3) {
             /* XXX allocated in psymodel_init() */
-            free(gfc->cd_psy->s.s3);
+            gfc_free(gfc, gfc->cd_psy->s.s3);
         }
-        free(gfc->cd_psy);
+        /* XXX allocated in psymodel_init() */
+        gfc_free(gfc, gfc->cd_psy->l.s3_band);
+        gfc_free(gfc, gfc->cd_psy->s.s3_band);
+        gfc_free(gfc, gfc->cd_psy);
         gfc->cd_psy = 0;
     }
 }
@@ -111,47 +117,61 @@ free_global_data(lame_internal_flags * gfc)
 void
 freegfc(lame_internal_flags * const gfc)
 {                       /* bit stream structure */
-    int     i;
-
     if (gfc == 0) return;
 
-    for (i = 0; i <= 2 * BPC; i++)
-        if (gfc->sv_enc.blackfilt[i] != NULL) {
-            free(gfc->sv_enc.blackfilt[i]);
-            gfc->sv_enc.blackfilt[i] = NULL;
-        }
+    /* leaves the tables to us, unless other encoders still use them */
+    session_tables_release(gfc);
+
+    if (gfc->sv_enc.blackfilt != NULL) {
+        gfc_free(gfc, gfc->sv_enc.blackfilt);
+        gfc->sv_enc.blackfilt = NULL;
+    }
     if (gfc->sv_enc.inbuf_old[0]) {
-        free(gfc->sv_enc.inbuf_old[0]);
+        gfc_free(gfc, gfc->sv_enc.inbuf_old[0]);
         gfc->sv_enc.inbuf_old[0] = NULL;
     }
     if (gfc->sv_enc.inbuf_old[1]) {
-        free(gfc->sv_enc.inbuf_old[1]);
+        gfc_free(gfc, gfc->sv_enc.inbuf_old[1]);
         gfc->sv_enc.inbuf_old[1] = NULL;
     }
 
     if (gfc->bs.buf != NULL) {
-        free(gfc->bs.buf);
+        gfc_free(gfc, gfc->bs.buf);
         gfc->bs.buf = NULL;
     }
 
     if (gfc->VBR_seek_table.bag) {
-        free(gfc->VBR_seek_table.bag);
+        gfc_free(gfc, gfc->VBR_seek_table.bag);
         gfc->VBR_seek_table.bag = NULL;
         gfc->VBR_seek_table.size = 0;
     }
     if (gfc->ATH) {
-        free(gfc->ATH);
+        gfc_free(gfc, gfc->ATH);
     }
     if (gfc->sv_rpg.rgdata) {
-        free(gfc->sv_rpg.rgdata);
+        gfc_free(gfc, gfc->sv_rpg.rgdata);
     }
     if (gfc->sv_enc.in_buffer_0) {
-        free(gfc->sv_enc.in_buffer_0);
+        gfc_free(gfc, gfc->sv_enc.in_buffer_0);
     }
     if (gfc->sv_enc.in_buffer_1) {
-        free(gfc->sv_enc.in_buffer_1);
+        gfc_free(gfc, gfc->sv_enc.in_buffer_1);
     }
+    if (gfc->sv_enc.in_window[0]) {
+        gfc_free(gfc, gfc->sv_enc.in_window[0]);
+    }
+    if (gfc->sv_enc.in_window[1]) {
+        gfc_free(gfc, gfc->sv_enc.in_window[1]);
+    }
+    if (gfc->sv_enc.mfbuf[1] != gfc->sv_enc.mfbuf[0]) {
+        gfc_free(gfc, gfc->sv_enc.mfbuf[1]);
+    }
+    gfc_free(gfc, gfc->sv_enc.mfbuf[0]);
     free_id3tag(gfc);
+    segment_free(gfc);
+    pipeline_free(gfc);
+    thread_pool_free(gfc, gfc->thread_pool);
+    gfc->thread_pool = 0;
 
 #ifdef DECODE_ON_THE_FLY
     if (gfc->hip) {
@@ -162,9 +182,110 @@ freegfc(lame_internal_flags * const gfc)
 
     free_global_data(gfc);
 
-    free(gfc);
+    {
+        EncMemory_t mem = gfc->mem;
+        lame_mem_free(&mem, gfc);
+    }
+}
+
+/* memory carved from the arena starts on this boundary */
+#define ARENA_ALIGN 32
+
+/* blocks from the allocator keep their size in front, for
+ * lame_get_memory_usage(), without losing the alignment of the allocator */
+#define HEAP_HEADER ARENA_ALIGN
+
+static void *
+default_malloc(void *user_data, size_t size)
+{
+    (void) user_data;
+    return malloc(size);
+}
+
+static void
+default_free(void *user_data, void *ptr)
+{
+    (void) user_data;
+    free(ptr);
+}
+
+int
+lame_mem_init(EncMemory_t * mem, lame_allocator const *allocator, void *arena, size_t arena_size)
+{
+    memset(mem, 0, sizeof(*mem));
+    if (allocator != 0 && allocator->malloc_func != 0 && allocator->free_func != 0) {
+        mem->alloc = *allocator;
+    }
+    else {
+        mem->alloc.malloc_func = &default_malloc;
+        mem->alloc.free_func = &default_free;
+    }
+    if (arena_size > 0) {
+        if (arena == 0) {
+            arena = mem->alloc.malloc_func(mem->alloc.user_data, arena_size);
+            if (arena == 0)
+                return -1;
+            mem->arena_owned = 1;
+        }
+        mem->arena = arena;
+        mem->arena_size = arena_size;
+    }
+    return 0;
 }
 
+void
+lame_mem_release(EncMemory_t * mem)
+{
+    if (mem->arena_owned) {
+        mem->alloc.free_func(mem->alloc.user_data, mem->arena);
+    }
+    mem->arena = 0;
+    mem->arena_size = mem->arena_used = 0;
+    mem->arena_owned = 0;
+}
+
+/* zero initialized, like calloc() */
+void   *
+lame_mem_calloc(EncMemory_t * mem, size_t size)
+{
+    void   *ptr;
+
+    if (mem->arena != 0) {
+        size_t const pos = (size_t) (mem->arena + mem->arena_used);
+        size_t const pad = (ARENA_ALIGN - pos % ARENA_ALIGN) % ARENA_ALIGN;
+        if (pad + size <= mem->arena_size - mem->arena_used) {
+            ptr = mem->arena + mem->arena_used + pad;
+            mem->arena_used += pad + size;
+            memset(ptr, 0, size);
+            return ptr;
+        }
+    }
+    ptr = mem->alloc.malloc_func(mem->alloc.user_data, HEAP_HEADER + size);
+    if (ptr == 0) {
+        return 0;
+    }
+    *(size_t *) ptr = size;
+    mem->heap_used += size;
+    ptr = (unsigned char *) ptr + HEAP_HEADER;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+/* memory carved from the arena is only given back with the whole arena */
+void
+lame_mem_free(EncMemory_t * mem, void *ptr)
+{
+    unsigned char *const p = ptr;
+
+    if (p == 0)
+        return;
+    if (mem->arena != 0 && p >= mem->arena && p < mem->arena + mem->arena_size)
+        return;
+    mem->heap_used -= *(size_t *) (p - HEAP_HEADER);
+    mem->alloc.free_func(mem->alloc.user_data, p - HEAP_HEADER);
+}
+
+
 void
 calloc_aligned(aligned_pointer_t * ptr, unsigned int size, unsigned int bytes)
 {
@@ -276,17 +397,6 @@ ATHformula(SessionConfig_t const *cfg, FLOAT freq)
     return ath;
 }
 
-/* see for example "Zwicker: Psychoakustik, 1982; ISBN 3-540-11401-7 */
-FLOAT
-freq2bark(FLOAT freq)
-{
-    /* input: freq in hz  output: barks */
-    if (freq < 0)
-        freq = 0;
-    freq = freq * 0.001;
-    return 13.0 * atan(.76 * freq) + 3.5 * atan(freq * freq / (7.5 * 7.5));
-}
-
 #if 0
 extern FLOAT freq2cbw(FLOAT freq);
 
@@ -534,6 +644,90 @@ gcd(int i, int j)
 
 
 
+int
+resample_filter_length(SessionConfig_t const *cfg)
+{
+    double const resample_ratio = (double)cfg->samplerate_in / (double)cfg->samplerate_out;
+    int const intratio = (fabs(resample_ratio - floor(.5 + resample_ratio)) < FLT_EPSILON);
+    int     filter_l = 31; /* must be odd */
+    filter_l += intratio; /* unless resample_ratio=int, it must be even */
+    return filter_l;
+}
+
+
+/* called by lame_init_params when resampling is necessary */
+int
+fill_buffer_resample_init(lame_internal_flags * gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    double const resample_ratio = (double)cfg->samplerate_in / (double)cfg->samplerate_out;
+    int const filter_l = resample_filter_length(cfg);
+    int const BLACKSIZE = filter_l + 1; /* size of data needed for FIR */
+    FLOAT   offset;
+    FLOAT   fcn;
+    int     i, j;
+    int     bpc;             /* number of convolution functions to pre-compute */
+
+    if (gfc->fill_buffer_resample_init) {
+        return 0;
+    }
+    bpc = cfg->samplerate_out / gcd(cfg->samplerate_out, cfg->samplerate_in);
+    if (bpc > BPC)
+        bpc = BPC;
+
+    fcn = 1.00 / resample_ratio;
+    if (fcn > 1.00)
+        fcn = 1.00;
+
+    esv->inbuf_old[0] = gfc_calloc(gfc, sample_t, BLACKSIZE);
+    esv->inbuf_old[1] = gfc_calloc(gfc, sample_t, BLACKSIZE);
+    if (esv->inbuf_old[0] == 0 || esv->inbuf_old[1] == 0) {
+        return -1;
+    }
+    esv->itime[0] = 0;
+    esv->itime[1] = 0;
+
+    /* precompute blackman filter coefficients, unless another encoder
+     * with the same settings already did */
+    if (esv->blackfilt == 0) {
+        esv->blackfilt = gfc_calloc(gfc, sample_t, (2 * bpc + 1) * BLACKSIZE);
+        if (esv->blackfilt == 0) {
+            return -1;
+        }
+        for (j = 0; j <= 2 * bpc; j++) {
+            sample_t *const filt = esv->blackfilt + j * BLACKSIZE;
+            FLOAT   sum = 0.;
+            offset = (j - bpc) / (2. * bpc);
+            for (i = 0; i <= filter_l; i++)
+                sum += filt[i] = blackman(i - offset, fcn, filter_l);
+            for (i = 0; i <= filter_l; i++)
+                filt[i] /= sum;
+        }
+    }
+    gfc->fill_buffer_resample_init = 1;
+    return 0;
+}
+
+
+/* forgets the input history of the resampler, the filter coefficients
+ * stay as they are */
+void
+fill_buffer_resample_reset(lame_internal_flags * gfc)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int const BLACKSIZE = resample_filter_length(&gfc->cfg) + 1;
+
+    if (gfc->fill_buffer_resample_init == 0) {
+        return;
+    }
+    memset(esv->inbuf_old[0], 0, BLACKSIZE * sizeof(sample_t));
+    memset(esv->inbuf_old[1], 0, BLACKSIZE * sizeof(sample_t));
+    esv->itime[0] = 0;
+    esv->itime[1] = 0;
+}
+
+
 static int
 fill_buffer_resample(lame_internal_flags * gfc,
                      sample_t * outbuf,
@@ -546,44 +740,22 @@ fill_buffer_resample(lame_internal_flags * gfc,
     FLOAT   offset;
     int     i, j = 0, k;
     int     filter_l;
-    FLOAT   fcn, intratio;
+    FLOAT   fcn;
     FLOAT  *inbuf_old;
     int     bpc;             /* number of convolution functions to pre-compute */
     bpc = cfg->samplerate_out / gcd(cfg->samplerate_out, cfg->samplerate_in);
     if (bpc > BPC)
         bpc = BPC;
 
-    intratio = (fabs(resample_ratio - floor(.5 + resample_ratio)) < FLT_EPSILON);
     fcn = 1.00 / resample_ratio;
     if (fcn > 1.00)
         fcn = 1.00;
-    filter_l = 31;     /* must be odd */
-    filter_l += intratio; /* unless resample_ratio=int, it must be even */
+    filter_l = resample_filter_length(cfg);
 
 
     BLACKSIZE = filter_l + 1; /* size of data needed for FIR */
 
-    if (gfc->fill_buffer_resample_init == 0) {
-        esv->inbuf_old[0] = lame_calloc(sample_t, BLACKSIZE);
-        esv->inbuf_old[1] = lame_calloc(sample_t, BLACKSIZE);
-        for (i = 0; i <= 2 * bpc; ++i)
-            esv->blackfilt[i] = lame_calloc(sample_t, BLACKSIZE);
-
-        esv->itime[0] = 0;
-        esv->itime[1] = 0;
-
-        /* precompute blackman filter coefficients */
-        for (j = 0; j <= 2 * bpc; j++) {
-            FLOAT   sum = 0.;
-            offset = (j - bpc) / (2. * bpc);
-            for (i = 0; i <= filter_l; i++)
-                sum += esv->blackfilt[j][i] = blackman(i - offset, fcn, filter_l);
-            for (i = 0; i <= filter_l; i++)
-                esv->blackfilt[j][i] /= sum;
-        }
-        gfc->fill_buffer_resample_init = 1;
-    }
-
+    assert(gfc->fill_buffer_resample_init);
     inbuf_old = esv->inbuf_old[ch];
 
     /* time of j'th element in inbuf = itime + j/ifreq; */
@@ -615,7 +787,7 @@ fill_buffer_resample(lame_internal_flags * gfc,
             assert(j2 + BLACKSIZE >= 0);
             y = (j2 < 0) ? inbuf_old[BLACKSIZE + j2] : inbuf[j2];
 #ifdef PRECOMPUTE
-            xvalue += y * esv->blackfilt[joff][i];
+            xvalue += y * esv->blackfilt[joff * BLACKSIZE + i];
 #else
             xvalue += y * blackman(i - offset, fcn, filter_l); /* very slow! */
 #endif
@@ -831,6 +1003,93 @@ has_SSE2(void)
 #endif
 }
 
+/* AVX2 and AVX-512 are newer than anything the nasm code knows about,
+ * ask the CPU (and the OS, which has to save the wide registers) directly
+ */
+#if defined( HAVE_IMMINTRIN_H ) && defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+#include <cpuid.h>
+#define HAVE_CPUID_XGETBV
+static void
+cpuid_count(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    if (leaf <= __get_cpuid_max(0, 0))
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+}
+
+static unsigned int
+xgetbv0(void)
+{
+    unsigned int eax, edx;
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+}
+#elif defined( HAVE_IMMINTRIN_H ) && defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#include <intrin.h>
+#define HAVE_CPUID_XGETBV
+static void
+cpuid_count(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+    int     r[4] = { 0, 0, 0, 0 };
+    __cpuid(r, 0);
+    if (leaf <= (unsigned int) r[0])
+        __cpuidex(r, (int) leaf, (int) subleaf);
+    else
+        r[0] = r[1] = r[2] = r[3] = 0;
+    regs[0] = r[0];
+    regs[1] = r[1];
+    regs[2] = r[2];
+    regs[3] = r[3];
+}
+
+static unsigned int
+xgetbv0(void)
+{
+    return (unsigned int) _xgetbv(0);
+}
+#endif
+
+#ifdef HAVE_CPUID_XGETBV
+/* which of the SSE/AVX (bits 1-2) and AVX-512 (bits 5-7) states the OS saves */
+static unsigned int
+os_saved_states(void)
+{
+    unsigned int regs[4];
+    cpuid_count(1, 0, regs);
+    if ((regs[2] & (1u << 27)) == 0) /* no OSXSAVE, no xgetbv */
+        return 0;
+    return xgetbv0();
+}
+#endif
+
+int
+has_AVX2(void)
+{
+#ifdef HAVE_CPUID_XGETBV
+    unsigned int regs[4];
+    if ((os_saved_states() & 0x06) != 0x06)
+        return 0;
+    cpuid_count(7, 0, regs);
+    return (regs[1] >> 5) & 1; /* EBX bit 5 */
+#else
+    return 0;           /* don't know, assume not */
+#endif
+}
+
+int
+has_AVX512(void)
+{
+#ifdef HAVE_CPUID_XGETBV
+    unsigned int regs[4];
+    if ((os_saved_states() & 0xe6) != 0xe6)
+        return 0;
+    cpuid_count(7, 0, regs);
+    return (regs[1] >> 16) & 1; /* EBX bit 16, AVX-512 Foundation */
+#else
+    return 0;           /* don't know, assume not */
+#endif
+}
+
 void
 disable_FPE(void)
 {
@@ -956,10 +1215,7 @@ disable_FPE(void)
  ***********************************************************************/
 
 
-#define LOG2_SIZE       (512)
-#define LOG2_SIZE_L2    (9)
-
-static ieee754_float32_t log_table[LOG2_SIZE + 1];
+ieee754_float32_t log_table[LOG2_SIZE + 1];
 
 
 
@@ -967,16 +1223,12 @@ void
 init_log_table(void)
 {
     int     j;
-    static int init = 0;
 
     /* Range for log2(x) over [1,2[ is [0,1[ */
     assert((1 << LOG2_SIZE_L2) == LOG2_SIZE);
 
-    if (!init) {
-        for (j = 0; j < LOG2_SIZE + 1; j++)
-            log_table[j] = log(1.0f + j / (ieee754_float32_t) LOG2_SIZE) / log(2.0f);
-    }
-    init = 1;
+    for (j = 0; j < LOG2_SIZE + 1; j++)
+        log_table[j] = log(1.0f + j / (ieee754_float32_t) LOG2_SIZE) / log(2.0f);
 }
 
 
@@ -97,6 +97,8 @@ extern  "C" {
 #define         FAST_LOG(x)         (fast_log2(x)*LOG2)
 #define         FAST_LOG10_X(x,y)   (fast_log2(x)*(LOG2/LOG10*(y)))
 #define         FAST_LOG_X(x,y)     (fast_log2(x)*(LOG2*(y)))
+#define         LOG2_SIZE       (512)
+#define         LOG2_SIZE_L2    (9)
 #else
 #define         FAST_LOG10(x)       log10(x)
 #define         FAST_LOG(x)         log(x)
@@ -130,6 +132,26 @@ extern  "C" {
     void    calloc_aligned(aligned_pointer_t * ptr, unsigned int size, unsigned int bytes);
     void    free_aligned(aligned_pointer_t * ptr);
 
+    /* where the memory of one encoder instance comes from,
+     * see lame_init_allocator() */
+    typedef struct {
+        lame_allocator alloc;
+        unsigned char *arena;
+        size_t  arena_size;
+        size_t  arena_used;
+        int     arena_owned;
+        size_t  heap_used;   /* taken from alloc and not given back yet */
+    } EncMemory_t;
+
+    int     lame_mem_init(EncMemory_t * mem, lame_allocator const *allocator, void *arena,
+                          size_t arena_size);
+    void    lame_mem_release(EncMemory_t * mem);
+    void   *lame_mem_calloc(EncMemory_t * mem, size_t size);
+    void    lame_mem_free(EncMemory_t * mem, void *ptr);
+
+#define gfc_calloc(GFC, TYPE, COUNT) ((TYPE*)lame_mem_calloc(&(GFC)->mem, (COUNT)*sizeof(TYPE)))
+#define gfc_free(GFC, PTR) lame_mem_free(&(GFC)->mem, (PTR))
+
 
     /* "bit_stream.h" Type Definitions */
 
@@ -161,15 +183,15 @@ extern  "C" {
 
     /**
      *  ATH related stuff, if something new ATH related has to be added,
-     *  please plugg it here into the ATH_t struct
+     *  please plugg it here into the ATH_t struct.  It is not changed
+     *  after lame_init_params, encoders with the same settings share it
+     *  (see session.c), so the per frame adjustment is in QntStateVar_t
      */
     typedef struct {
         int     use_adjust;  /* method for the auto adjustment  */
         FLOAT   aa_sensitivity_p; /* factor for tuning the (sample power)
                                      point below which adaptive threshold
                                      of hearing adjustment occurs */
-        FLOAT   adjust_factor; /* lowering based on peak volume, 1 = no lowering */
-        FLOAT   adjust_limit; /* limit for dynamic ATH adjust */
         FLOAT   decay;       /* determined to lower x dB each second */
         FLOAT   floor;       /* lowest ATH value */
         FLOAT   l[SBMAX_l];  /* ATH for sfbs in long blocks */
@@ -185,6 +207,9 @@ extern  "C" {
      *  PSY Model related stuff
      */
 
+/* partitions per group in the banded layout of the spreading function */
+#define S3_LANES 8
+
     typedef struct {
         FLOAT   masking_lower[CBANDS];
         FLOAT   minval[CBANDS];
@@ -199,7 +224,9 @@ extern  "C" {
         int     bo[Max(SBMAX_l,SBMAX_s)];
         int     npart;
         int     n_sb; /* SBMAX_l or SBMAX_s */
+        int     s3_width; /* longest s3ind range */
         FLOAT  *s3;
+        FLOAT  *s3_band; /* s3 of S3_LANES partitions interleaved, s3_width rows each */
     } PsyConst_CB2SB_t;
 
 
@@ -233,6 +260,13 @@ extern  "C" {
         FLOAT   last_en_subshort[4][9];
         int     last_attacks[4];
 
+        /* dynamic ATH adjustment, see adjust_ATH() in encoder.c */
+        FLOAT   ath_adjust_factor;
+        FLOAT   ath_adjust_limit;
+
+        /* sv_qnt.masking_lower as left behind by the previous frame */
+        FLOAT   masking_lower;
+
         int     blocktype_old[2];
     } PsyStateVar_t;
 
@@ -254,7 +288,7 @@ extern  "C" {
 #define BPC 320
         double  itime[2]; /* float precision seems to be not enough */
         sample_t *inbuf_old[2];
-        sample_t *blackfilt[2 * BPC + 1];
+        sample_t *blackfilt; /* 2*bpc+1 filters of BLACKSIZE taps each */
 
         FLOAT   pefirbuf[19];
         
@@ -290,13 +324,26 @@ extern  "C" {
         sample_t *in_buffer_0;
         sample_t *in_buffer_1;
 
+        /* handed out by lame_get_input_buffer() when the samples can't be
+         * written into mfbuf directly */
+        int     in_window_nsamples;
+        float  *in_window[2];
+
 #ifndef  MFSIZE
 # define MFSIZE  ( 3*1152 + ENCDELAY - MDCTDELAY )
 #endif
-        sample_t mfbuf[2][MFSIZE];
+/* the frame to encode starts at mfbuf[ch][mf_start], the samples left over
+ * are moved to the front only when the next frame would not fit behind them.
+ * MFBUFSIZE is the default size, see mfbuf_init() for compact_memory
+ */
+#define MFBUFSIZE ( MFSIZE + 8*1152 )
+        sample_t *mfbuf[2];  /* mf_bufsize samples, for mono mfbuf[1] == mfbuf[0] */
+        int     mf_bufsize;
+        int     mf_window;   /* room handed out by lame_get_input_buffer() */
 
         int     mf_samples_to_encode;
         int     mf_size;
+        int     mf_start;
 
     } EncStateVar_t;
 
@@ -323,6 +370,8 @@ extern  "C" {
         FLOAT   masking_lower;
         FLOAT   mask_adjust; /* the dbQ stuff */
         FLOAT   mask_adjust_short; /* the dbQ stuff */
+        FLOAT   ath_adjust_factor; /* lowering based on peak volume, 1 = no lowering,
+                                      for the frame being quantized */
         int     OldValue[2];
         int     CurrentStep[2];
         int     pseudohalf[SFBMAX];
@@ -413,6 +462,11 @@ extern  "C" {
         int     buffer_constraint;  /* enforce ISO spec as much as possible   */
         int     free_format;
         int     write_lame_tag; /* add Xing VBR tag?                           */
+        int     num_threads; /* number of threads the encoder may use   */
+        int     segment_frames; /* frames per segment, 0 = no segmented encoding */
+        int     pipeline;    /* analyze next frame while quantizing current */
+        int     parallel_quantization; /* VBR new: granules/channels in parallel */
+        int     compact_memory; /* buffers sized for this stream only      */
 
         int     error_protection; /* use 2 bytes per frame for a CRC checksum. default=0 */
         int     copyright;   /* mark as copyright. default=0           */
@@ -488,6 +542,8 @@ extern  "C" {
         int     iteration_init_init;
         int     fill_buffer_resample_init;
 
+        EncMemory_t mem;     /* everything below is allocated from here */
+
         SessionConfig_t cfg;
 
         /* variables used by lame.c */
@@ -518,7 +574,9 @@ extern  "C" {
             unsigned int AMD_3DNow:1; /* K6-2, K6-III, Athlon      */
             unsigned int SSE:1; /* Pentium III, Pentium 4    */
             unsigned int SSE2:1; /* Pentium 4, K8             */
-            unsigned int _unused:28;
+            unsigned int AVX2:1; /* Haswell, Zen              */
+            unsigned int AVX512:1; /* Skylake-X, Zen 4        */
+            unsigned int _unused:26;
         } CPU_features;
 
 
@@ -528,19 +586,45 @@ extern  "C" {
 
         PsyConst_t *cd_psy;
 
+        /* ATH, cd_psy and the resampling filters, when they are shared
+         * with other encoders, see session.c */
+        struct SessionTables_t *tables;
+
         /* used by the frame analyzer */
         plotting_data *pinfo;
         hip_t hip;
 
-        /* functions to replace with CPU feature optimized versions in takehiro.c */
+        /* worker threads, NULL when running single threaded */
+        struct ThreadPool_t *thread_pool;
+        /* segmented encoding, used by segment.c */
+        struct SegmentState_t *sv_seg;
+        /* pipelined encoding, used by encoder.c */
+        struct PipelineState_t *sv_pipe;
+
+        /* functions to replace with CPU feature optimized versions in takehiro.c,
+           quantize.c, quantize_pvt.c, newmdct.c
+           and psymodel.c */
         int     (*choose_table) (const int *ix, const int *const end, int *const s);
         void    (*fft_fht) (FLOAT *, int);
+        void    (*s3_convolve) (PsyConst_CB2SB_t const *gd, FLOAT const *eb,
+                                unsigned char const *mask_idx, FLOAT * ecb, int *dd);
         void    (*init_xrpow_core) (gr_info * const cod_info, FLOAT xrpow[576], int upper,
                                     FLOAT * sum);
+        void    (*quantize_lines_xrpow) (unsigned int l, FLOAT istep, const FLOAT * xr, int *ix);
+        void    (*quantize_lines_xrpow_01) (unsigned int l, FLOAT istep, const FLOAT * xr,
+                                            int *ix);
+        FLOAT   (*calc_noise_core) (const gr_info * const cod_info, int *startline, int l,
+                                    FLOAT step);
+        void    (*window_subband_core) (const sample_t * x1, FLOAT a[SBLIMIT]);
+        void    (*mdct_bands) (FLOAT const *sb0, FLOAT * sb1, FLOAT const amp_filter[SBLIMIT],
+                               int type, FLOAT * mdct_enc);
 
         lame_report_function report_msg;
         lame_report_function report_dbg;
         lame_report_function report_err;
+
+        lame_output_function output_func; /* see lame_set_output_function() */
+        void   *output_data;
     };
 
 #ifndef lame_internal_flags_defined
@@ -562,18 +646,23 @@ extern  "C" {
     extern int SmpFrqIndex(int, int *const);
     extern int nearestBitrateFullIndex(uint16_t bitrate);
     extern FLOAT ATHformula(SessionConfig_t const *cfg, FLOAT freq);
-    extern FLOAT freq2bark(FLOAT freq);
     void    disable_FPE(void);
 
 /* log/log10 approximations */
     extern void init_log_table(void);
     extern ieee754_float32_t fast_log2(ieee754_float32_t x);
+#ifdef USE_FAST_LOG
+    extern ieee754_float32_t log_table[LOG2_SIZE + 1];
+#endif
 
     int     isResamplingNecessary(SessionConfig_t const* cfg);
 
     void    fill_buffer(lame_internal_flags * gfc,
                         sample_t *const mfbuf[2],
                         sample_t const *const in_buffer[2], int nsamples, int *n_in, int *n_out);
+    int     fill_buffer_resample_init(lame_internal_flags * gfc);
+    int     resample_filter_length(SessionConfig_t const *cfg);
+    void    fill_buffer_resample_reset(lame_internal_flags * gfc);
 
 /* same as lame_decode1 (look in lame.h), but returns
    unclipped raw floating-point samples. It is declared
@@ -588,6 +677,8 @@ extern  "C" {
     extern int has_3DNow(void);
     extern int has_SSE(void);
     extern int has_SSE2(void);
+    extern int has_AVX2(void);
+    extern int has_AVX512(void);
 
 
 
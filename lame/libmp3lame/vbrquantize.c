@@ -33,6 +33,7 @@
 #include "util.h"
 #include "vbrquantize.h"
 #include "quantize_pvt.h"
+#include "threadpool.h"
 
 
 
@@ -1251,6 +1252,46 @@ reduce_bit_usage(lame_internal_flags * gfc, int gr, int ch
 
 
 
+/* work on one granule and channel, the searches of different granules
+ * and channels don't depend on each other and may run in parallel
+ */
+typedef struct {
+    algo_t *that;
+    const FLOAT *l3_xmin;
+    int    *sfwork;
+    int    *vbrsfmin;
+    int     max_nbits;
+} gr_ch_job_t;
+
+
+static void
+search_scalefacs_job(void *arg)
+{
+    gr_ch_job_t const *const job = (gr_ch_job_t const *) arg;
+    algo_t *const that = job->that;
+    int     vbrmax;
+
+    vbrmax = block_sf(that, job->l3_xmin, job->sfwork, job->vbrsfmin);
+    that->alloc(that, job->sfwork, job->vbrsfmin, vbrmax);
+    bitcount(that);
+
+    /* encode 'as is' */
+    memset(&that->cod_info->l3_enc[0], 0, sizeof(that->cod_info->l3_enc));
+    (void) quantizeAndCountBits(that);
+}
+
+
+static void
+out_of_bits_job(void *arg)
+{
+    gr_ch_job_t const *const job = (gr_ch_job_t const *) arg;
+    algo_t const *const that = job->that;
+
+    cutDistribution(job->sfwork, job->sfwork, that->cod_info->global_gain);
+    outOfBitsStrategy(that, job->sfwork, job->vbrsfmin, job->max_nbits);
+}
+
+
 int
 VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
                  const FLOAT l3_xmin[2][2][SFBMAX], const int max_bits[2][2])
@@ -1268,6 +1309,9 @@ VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
                                  ,{MAX_BITS_PER_CHANNEL+1, MAX_BITS_PER_CHANNEL+1}};
     int     use_nbits_gr[2] = { MAX_BITS_PER_GRANULE+1, MAX_BITS_PER_GRANULE+1 };
     int     use_nbits_fr = MAX_BITS_PER_GRANULE+MAX_BITS_PER_GRANULE;
+    gr_ch_job_t job[2 * 2];
+    ThreadPool_t *const pool = cfg->parallel_quantization ? gfc->thread_pool : 0;
+    int     njobs = 0;
     int     gr, ch;
     int     ok, sum_fr;
 
@@ -1292,19 +1336,17 @@ VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
             }
         }               /* for ch */
     }
-    /* searches scalefactors
+    /* searches scalefactors and encodes 'as is'
      */
     for (gr = 0; gr < ngr; ++gr) {
         for (ch = 0; ch < nch; ++ch) {
             if (max_bits[gr][ch] > 0) {
-                algo_t *that = &that_[gr][ch];
-                int    *sfwork = sfwork_[gr][ch];
-                int    *vbrsfmin = vbrsfmin_[gr][ch];
-                int     vbrmax;
-
-                vbrmax = block_sf(that, l3_xmin[gr][ch], sfwork, vbrsfmin);
-                that->alloc(that, sfwork, vbrsfmin, vbrmax);
-                bitcount(that);
+                job[njobs].that = &that_[gr][ch];
+                job[njobs].l3_xmin = l3_xmin[gr][ch];
+                job[njobs].sfwork = sfwork_[gr][ch];
+                job[njobs].vbrsfmin = vbrsfmin_[gr][ch];
+                job[njobs].max_nbits = 0;
+                ++njobs;
             }
             else {
                 /*  xr contains no energy 
@@ -1314,23 +1356,12 @@ VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
             }
         }               /* for ch */
     }
-    /* encode 'as is'
-     */
+    thread_pool_run(pool, search_scalefacs_job, job, sizeof(job[0]), njobs);
+
     use_nbits_fr = 0;
     for (gr = 0; gr < ngr; ++gr) {
         use_nbits_gr[gr] = 0;
         for (ch = 0; ch < nch; ++ch) {
-            algo_t const *that = &that_[gr][ch];
-            if (max_bits[gr][ch] > 0) {
-                memset(&that->cod_info->l3_enc[0], 0, sizeof(that->cod_info->l3_enc));
-                (void) quantizeAndCountBits(that);
-            }
-            else {
-                /*  xr contains no energy 
-                 *  l3_enc, our encoding data, will be quantized to zero
-                 *  continue with next channel
-                 */
-            }
             use_nbits_ch[gr][ch] = reduce_bit_usage(gfc, gr, ch);
             use_nbits_gr[gr] += use_nbits_ch[gr][ch];
         }               /* for ch */
@@ -1549,18 +1580,21 @@ VBR_encode_frame(lame_internal_flags * gfc, const FLOAT xr34orig[2][2][576],
 
     /* alter our encoded data, until it fits into the target bitrate
      */
-    use_nbits_fr = 0;
+    njobs = 0;
     for (gr = 0; gr < ngr; ++gr) {
-        use_nbits_gr[gr] = 0;
         for (ch = 0; ch < nch; ++ch) {
-            algo_t const *that = &that_[gr][ch];
-            use_nbits_ch[gr][ch] = 0;
             if (max_bits[gr][ch] > 0) {
-                int    *sfwork = sfwork_[gr][ch];
-                int const *vbrsfmin = vbrsfmin_[gr][ch];
-                cutDistribution(sfwork, sfwork, that->cod_info->global_gain);
-                outOfBitsStrategy(that, sfwork, vbrsfmin, max_nbits_ch[gr][ch]);
+                job[njobs].max_nbits = max_nbits_ch[gr][ch];
+                ++njobs;
             }
+        }
+    }
+    thread_pool_run(pool, out_of_bits_job, job, sizeof(job[0]), njobs);
+
+    use_nbits_fr = 0;
+    for (gr = 0; gr < ngr; ++gr) {
+        use_nbits_gr[gr] = 0;
+        for (ch = 0; ch < nch; ++ch) {
             use_nbits_ch[gr][ch] = reduce_bit_usage(gfc, gr, ch);
             assert(use_nbits_ch[gr][ch] <= max_nbits_ch[gr][ch]);
             use_nbits_gr[gr] += use_nbits_ch[gr][ch];
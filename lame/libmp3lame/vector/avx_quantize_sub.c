@@ -0,0 +1,1558 @@
+/*
+ * MP3 quantization, filterbank, FFT and psymodel, AVX2 and AVX-512 intrinsics functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "quantize_pvt.h"
+#include "tables.h"
+#include "lame_intrin.h"
+
+
+
+#ifdef HAVE_IMMINTRIN_H
+
+#include <immintrin.h>
+
+/* make sure functions with AVX instructions maintain their own properly aligned stack */
+#if defined (__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define REALIGN __attribute__((force_align_arg_pointer))
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define REALIGN
+#define TARGET(x)
+#endif
+
+#define AVX2_FUNCTION REALIGN TARGET("avx2")
+#define AVX512_FUNCTION REALIGN TARGET("avx512f")
+
+
+
+/*********************************************************************
+ * xrpow = |xr|^(3/4), its sum and maximum
+ *
+ * Like init_xrpow_core_c() the root is taken in double precision, so
+ * xrpow[] and xrpow_max are bit exact, only the sum is accumulated in
+ * a different order.
+ *********************************************************************/
+
+static void
+init_xrpow_core_tail(gr_info * const cod_info, FLOAT xrpow[576], int i, int upper,
+                     FLOAT * sum, FLOAT * xrpow_max)
+{
+    for (; i < upper; ++i) {
+        FLOAT const tmp = fabs(cod_info->xr[i]);
+        *sum += tmp;
+        xrpow[i] = sqrt(tmp * sqrt(tmp));
+        if (xrpow[i] > *xrpow_max)
+            *xrpow_max = xrpow[i];
+    }
+}
+
+
+AVX2_FUNCTION static __m128
+xrpow_avx2(__m128 x)
+{
+    __m256d const d = _mm256_cvtps_pd(x);
+    return _mm256_cvtpd_ps(_mm256_sqrt_pd(_mm256_mul_pd(d, _mm256_sqrt_pd(d))));
+}
+
+
+AVX2_FUNCTION void
+init_xrpow_core_avx2(gr_info * const cod_info, FLOAT xrpow[576], int max_nz, FLOAT * sum)
+{
+    int     i;
+    int const upper = max_nz + 1;
+    int const upper8 = upper & ~7;
+    __m256 const vec_fabs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256  vec_xrpow_max = _mm256_setzero_ps();
+    __m256  vec_sum = _mm256_setzero_ps();
+    float   tmp[8];
+    FLOAT   tmp_sum, tmp_max;
+
+    for (i = 0; i < upper8; i += 8) {
+        __m256  x = _mm256_and_ps(_mm256_loadu_ps(&cod_info->xr[i]), vec_fabs_mask);
+        vec_sum = _mm256_add_ps(vec_sum, x);
+        x = _mm256_insertf128_ps(_mm256_castps128_ps256(xrpow_avx2(_mm256_castps256_ps128(x))),
+                                 xrpow_avx2(_mm256_extractf128_ps(x, 1)), 1);
+        vec_xrpow_max = _mm256_max_ps(vec_xrpow_max, x);
+        _mm256_storeu_ps(&xrpow[i], x);
+    }
+    _mm256_storeu_ps(tmp, vec_sum);
+    tmp_sum = ((tmp[0] + tmp[1]) + (tmp[2] + tmp[3])) + ((tmp[4] + tmp[5]) + (tmp[6] + tmp[7]));
+    _mm256_storeu_ps(tmp, vec_xrpow_max);
+    tmp_max = 0;
+    for (i = 0; i < 8; ++i) {
+        if (tmp[i] > tmp_max)
+            tmp_max = tmp[i];
+    }
+    init_xrpow_core_tail(cod_info, xrpow, upper8, upper, &tmp_sum, &tmp_max);
+    cod_info->xrpow_max = tmp_max;
+    *sum = tmp_sum;
+}
+
+
+AVX512_FUNCTION static __m256
+xrpow_avx512(__m256 x)
+{
+    __m512d const d = _mm512_cvtps_pd(x);
+    return _mm512_cvtpd_ps(_mm512_sqrt_pd(_mm512_mul_pd(d, _mm512_sqrt_pd(d))));
+}
+
+
+AVX512_FUNCTION void
+init_xrpow_core_avx512(gr_info * const cod_info, FLOAT xrpow[576], int max_nz, FLOAT * sum)
+{
+    int     i;
+    int const upper = max_nz + 1;
+    int const upper16 = upper & ~15;
+    __m512i const vec_fabs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+    __m512  vec_xrpow_max = _mm512_setzero_ps();
+    __m512  vec_sum = _mm512_setzero_ps();
+    FLOAT   tmp_sum, tmp_max;
+
+    for (i = 0; i < upper16; i += 16) {
+        __m512  x = _mm512_castsi512_ps(_mm512_and_si512(
+                        _mm512_castps_si512(_mm512_loadu_ps(&cod_info->xr[i])), vec_fabs_mask));
+        __m256  lo, hi;
+        vec_sum = _mm512_add_ps(vec_sum, x);
+        lo = xrpow_avx512(_mm512_castps512_ps256(x));
+        hi = xrpow_avx512(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1)));
+        x = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)),
+                                                _mm256_castps_pd(hi), 1));
+        vec_xrpow_max = _mm512_max_ps(vec_xrpow_max, x);
+        _mm512_storeu_ps(&xrpow[i], x);
+    }
+    tmp_sum = _mm512_reduce_add_ps(vec_sum);
+    tmp_max = _mm512_reduce_max_ps(vec_xrpow_max);
+    init_xrpow_core_tail(cod_info, xrpow, upper16, upper, &tmp_sum, &tmp_max);
+    cod_info->xrpow_max = tmp_max;
+    *sum = tmp_sum;
+}
+
+
+
+/*********************************************************************
+ * quantize_lines_xrpow_01: lines known to quantize to 0 or 1
+ *
+ * bit exact with the C version in takehiro.c
+ *********************************************************************/
+
+AVX2_FUNCTION void
+quantize_lines_xrpow_01_avx2(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix)
+{
+    const FLOAT compareval0 = (1.0f - 0.4054f) / istep;
+    __m256 const vec_compareval0 = _mm256_set1_ps(compareval0);
+    __m256i const vec_one = _mm256_set1_epi32(1);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= l; i += 8) {
+        /* !(compareval0 > xr) also catches what the C code does with NaN */
+        __m256  m = _mm256_cmp_ps(vec_compareval0, _mm256_loadu_ps(&xr[i]), _CMP_NGT_UQ);
+        _mm256_storeu_si256((__m256i *) & ix[i], _mm256_and_si256(_mm256_castps_si256(m), vec_one));
+    }
+    for (; i < l; ++i)
+        ix[i] = (compareval0 > xr[i]) ? 0 : 1;
+}
+
+
+AVX512_FUNCTION void
+quantize_lines_xrpow_01_avx512(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix)
+{
+    const FLOAT compareval0 = (1.0f - 0.4054f) / istep;
+    __m512 const vec_compareval0 = _mm512_set1_ps(compareval0);
+    __m512i const vec_one = _mm512_set1_epi32(1);
+    unsigned int i;
+
+    for (i = 0; i + 16 <= l; i += 16) {
+        __mmask16 m = _mm512_cmp_ps_mask(vec_compareval0, _mm512_loadu_ps(&xr[i]), _CMP_NGT_UQ);
+        _mm512_storeu_si512(&ix[i], _mm512_maskz_mov_epi32(m, vec_one));
+    }
+    for (; i < l; ++i)
+        ix[i] = (compareval0 > xr[i]) ? 0 : 1;
+}
+
+
+
+#ifdef TAKEHIRO_IEEE754_HACK
+
+/*********************************************************************
+ * quantize_lines_xrpow: Takehiro's IEEE754 hack, 8 resp. 16 lines at
+ * a time.  The intermediate sums are kept in double precision, like
+ * the C version does, so the result is bit exact with it.
+ *********************************************************************/
+
+#define MAGIC_FLOAT (65536*(128))
+#define MAGIC_INT 0x4b000000
+
+typedef union {
+    float   f;
+    int     i;
+} fi_union;
+
+static void
+quantize_lines_xrpow_tail(unsigned int l, FLOAT istep, const FLOAT * xp, int *pi)
+{
+    unsigned int i;
+
+    for (i = 0; i < l; ++i) {
+        fi_union fi;
+        double  x0 = istep * xp[i];
+
+        x0 += MAGIC_FLOAT;
+        fi.f = x0;
+        fi.f = x0 + adj43asm[fi.i - MAGIC_INT];
+        pi[i] = fi.i - MAGIC_INT;
+    }
+}
+
+
+AVX2_FUNCTION void
+quantize_lines_xrpow_avx2(unsigned int l, FLOAT istep, const FLOAT * xp, int *pi)
+{
+    __m256 const vec_istep = _mm256_set1_ps(istep);
+    __m256d const vec_magic_float = _mm256_set1_pd(MAGIC_FLOAT);
+    __m256i const vec_magic_int = _mm256_set1_epi32(MAGIC_INT);
+    unsigned int i;
+
+    l &= ~1u;           /* the C version works on pairs of lines */
+    for (i = 0; i + 8 <= l; i += 8) {
+        __m256  x = _mm256_mul_ps(vec_istep, _mm256_loadu_ps(&xp[i]));
+        __m256d x_lo = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), vec_magic_float);
+        __m256d x_hi = _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vec_magic_float);
+        __m256  f = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(x_lo)),
+                                         _mm256_cvtpd_ps(x_hi), 1);
+        __m256i rx = _mm256_sub_epi32(_mm256_castps_si256(f), vec_magic_int);
+        __m256  adj = _mm256_i32gather_ps(adj43asm, rx, 4);
+
+        x_lo = _mm256_add_pd(x_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(adj)));
+        x_hi = _mm256_add_pd(x_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(adj, 1)));
+        f = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(x_lo)),
+                                 _mm256_cvtpd_ps(x_hi), 1);
+        _mm256_storeu_si256((__m256i *) & pi[i],
+                            _mm256_sub_epi32(_mm256_castps_si256(f), vec_magic_int));
+    }
+    if (i < l)
+        quantize_lines_xrpow_tail(l - i, istep, &xp[i], &pi[i]);
+}
+
+
+AVX512_FUNCTION void
+quantize_lines_xrpow_avx512(unsigned int l, FLOAT istep, const FLOAT * xp, int *pi)
+{
+    __m512 const vec_istep = _mm512_set1_ps(istep);
+    __m512d const vec_magic_float = _mm512_set1_pd(MAGIC_FLOAT);
+    __m512i const vec_magic_int = _mm512_set1_epi32(MAGIC_INT);
+    unsigned int i;
+
+    l &= ~1u;           /* the C version works on pairs of lines */
+    for (i = 0; i + 16 <= l; i += 16) {
+        __m512  x = _mm512_mul_ps(vec_istep, _mm512_loadu_ps(&xp[i]));
+        __m256  x_lo8 = _mm512_castps512_ps256(x);
+        __m256  x_hi8 = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1));
+        __m512d x_lo = _mm512_add_pd(_mm512_cvtps_pd(x_lo8), vec_magic_float);
+        __m512d x_hi = _mm512_add_pd(_mm512_cvtps_pd(x_hi8), vec_magic_float);
+        __m512  f;
+        __m512i rx;
+        __m512  adj;
+
+        f = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(
+                                                    _mm512_cvtpd_ps(x_lo))),
+                                                _mm256_castps_pd(_mm512_cvtpd_ps(x_hi)), 1));
+        rx = _mm512_sub_epi32(_mm512_castps_si512(f), vec_magic_int);
+        adj = _mm512_i32gather_ps(rx, adj43asm, 4);
+
+        x_lo = _mm512_add_pd(x_lo, _mm512_cvtps_pd(_mm512_castps512_ps256(adj)));
+        x_hi = _mm512_add_pd(x_hi, _mm512_cvtps_pd(_mm256_castpd_ps(
+                                       _mm512_extractf64x4_pd(_mm512_castps_pd(adj), 1))));
+        f = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(
+                                                    _mm512_cvtpd_ps(x_lo))),
+                                                _mm256_castps_pd(_mm512_cvtpd_ps(x_hi)), 1));
+        _mm512_storeu_si512(&pi[i], _mm512_sub_epi32(_mm512_castps_si512(f), vec_magic_int));
+    }
+    if (i < l)
+        quantize_lines_xrpow_tail(l - i, istep, &xp[i], &pi[i]);
+}
+
+#endif /* TAKEHIRO_IEEE754_HACK */
+
+
+
+/*********************************************************************
+ * calc_noise_core: quantization noise of 2*l lines starting at
+ * *startline, see calc_noise_core_c() in quantize_pvt.c
+ *
+ * The squared errors are computed 8 resp. 16 at a time, but added up
+ * one by one in line order, so the result is the same as the one of the
+ * C version.
+ *********************************************************************/
+
+static  FLOAT
+calc_noise_core_tail(const gr_info * const cod_info, int j0, int j, int n, FLOAT step,
+                     FLOAT noise)
+{
+    const int *const ix = cod_info->l3_enc;
+
+    /* the region is the one of the first line, as in calc_noise_core_c() */
+    if (j0 > cod_info->count1) {
+        for (; n > 0; --n, ++j)
+            noise += cod_info->xr[j] * cod_info->xr[j];
+    }
+    else if (j0 > cod_info->big_values) {
+        for (; n > 0; --n, ++j) {
+            FLOAT const temp = fabs(cod_info->xr[j]) - (ix[j] ? step : 0);
+            noise += temp * temp;
+        }
+    }
+    else {
+        for (; n > 0; --n, ++j) {
+            FLOAT const temp = fabs(cod_info->xr[j]) - pow43[ix[j]] * step;
+            noise += temp * temp;
+        }
+    }
+    return noise;
+}
+
+
+AVX2_FUNCTION FLOAT
+calc_noise_core_avx2(const gr_info * const cod_info, int *startline, int l, FLOAT step)
+{
+    int const j0 = *startline;
+    int const n = 2 * l;
+    int const n8 = n & ~7;
+    const FLOAT *const xr = &cod_info->xr[j0];
+    const int *const ix = &cod_info->l3_enc[j0];
+    __m256 const vec_fabs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 const vec_step = _mm256_set1_ps(step);
+    float   sq[8];
+    FLOAT   noise = 0;
+    int     i, k;
+
+    if (j0 > cod_info->count1) {
+        for (i = 0; i < n8; i += 8) {
+            __m256 const x = _mm256_loadu_ps(&xr[i]);
+            _mm256_storeu_ps(sq, _mm256_mul_ps(x, x));
+            for (k = 0; k < 8; k++)
+                noise += sq[k];
+        }
+    }
+    else if (j0 > cod_info->big_values) {
+        for (i = 0; i < n8; i += 8) {
+            __m256 const q = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i const *) &ix[i])),
+                                           vec_step);
+            __m256 const t = _mm256_sub_ps(_mm256_and_ps(_mm256_loadu_ps(&xr[i]), vec_fabs_mask), q);
+            _mm256_storeu_ps(sq, _mm256_mul_ps(t, t));
+            for (k = 0; k < 8; k++)
+                noise += sq[k];
+        }
+    }
+    else {
+        for (i = 0; i < n8; i += 8) {
+            __m256 const q = _mm256_mul_ps(_mm256_i32gather_ps(pow43,
+                                                               _mm256_loadu_si256((__m256i const *) &ix[i]),
+                                                               4), vec_step);
+            __m256 const t = _mm256_sub_ps(_mm256_and_ps(_mm256_loadu_ps(&xr[i]), vec_fabs_mask), q);
+            _mm256_storeu_ps(sq, _mm256_mul_ps(t, t));
+            for (k = 0; k < 8; k++)
+                noise += sq[k];
+        }
+    }
+    noise = calc_noise_core_tail(cod_info, j0, j0 + n8, n - n8, step, noise);
+
+    *startline = j0 + n;
+    return noise;
+}
+
+
+AVX512_FUNCTION FLOAT
+calc_noise_core_avx512(const gr_info * const cod_info, int *startline, int l, FLOAT step)
+{
+    int const j0 = *startline;
+    int const n = 2 * l;
+    int const n16 = n & ~15;
+    const FLOAT *const xr = &cod_info->xr[j0];
+    const int *const ix = &cod_info->l3_enc[j0];
+    __m512i const vec_fabs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+    __m512 const vec_step = _mm512_set1_ps(step);
+    float   sq[16];
+    FLOAT   noise = 0;
+    int     i, k;
+
+    if (j0 > cod_info->count1) {
+        for (i = 0; i < n16; i += 16) {
+            __m512 const x = _mm512_loadu_ps(&xr[i]);
+            _mm512_storeu_ps(sq, _mm512_mul_ps(x, x));
+            for (k = 0; k < 16; k++)
+                noise += sq[k];
+        }
+    }
+    else if (j0 > cod_info->big_values) {
+        for (i = 0; i < n16; i += 16) {
+            __m512 const q = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_loadu_si512(&ix[i])), vec_step);
+            __m512 const a = _mm512_castsi512_ps(_mm512_and_si512(
+                                 _mm512_castps_si512(_mm512_loadu_ps(&xr[i])), vec_fabs_mask));
+            __m512 const t = _mm512_sub_ps(a, q);
+            _mm512_storeu_ps(sq, _mm512_mul_ps(t, t));
+            for (k = 0; k < 16; k++)
+                noise += sq[k];
+        }
+    }
+    else {
+        for (i = 0; i < n16; i += 16) {
+            __m512 const q = _mm512_mul_ps(_mm512_i32gather_ps(_mm512_loadu_si512(&ix[i]),
+                                                               pow43, 4), vec_step);
+            __m512 const a = _mm512_castsi512_ps(_mm512_and_si512(
+                                 _mm512_castps_si512(_mm512_loadu_ps(&xr[i])), vec_fabs_mask));
+            __m512 const t = _mm512_sub_ps(a, q);
+            _mm512_storeu_ps(sq, _mm512_mul_ps(t, t));
+            for (k = 0; k < 16; k++)
+                noise += sq[k];
+        }
+    }
+    noise = calc_noise_core_tail(cod_info, j0, j0 + n16, n - n16, step, noise);
+
+    *startline = j0 + n;
+    return noise;
+}
+
+
+
+/*********************************************************************
+ * choose_table: Huffman bit counting, see choose_table_nonMMX() in
+ * takehiro.c
+ *
+ * Eight pairs of lines are looked up per step.  The candidate tables
+ * of count_bit_noESC_from2 and count_bit_ESC already come packed as two
+ * 16 bit counts per entry, for count_bit_noESC_from3 the three hlen[]
+ * tables get packed into 10 bit fields of one entry, so all candidates
+ * are counted with a single lookup.  The small tables are held in
+ * registers, the larger ones are gathered.  The sums wrap modulo 2^32
+ * like in the C version, so the results are bit exact.
+ *********************************************************************/
+
+static uint32_t hlen3_packed[3][16 * 16]; /* tables 7-9, 10-12, 13-15 */
+static uint32_t hlen1_packed;
+
+void
+choose_table_avx2_init(void)
+{
+    int     t, i;
+
+    for (t = 0; t < 3; ++t) {
+        int const t1 = 7 + 3 * t;
+        int const n = ht[t1].xlen * ht[t1].xlen;
+        for (i = 0; i < n; ++i) {
+            /* one lane sums at most 576 / 16 pairs, which has to fit into 10 bits */
+            assert(ht[t1].hlen[i] * (576 / 16) < 1024);
+            assert(ht[t1 + 1].hlen[i] * (576 / 16) < 1024);
+            assert(ht[t1 + 2].hlen[i] * (576 / 16) < 1024);
+            hlen3_packed[t][i] = (uint32_t) ht[t1].hlen[i]
+                | ((uint32_t) ht[t1 + 1].hlen[i] << 10)
+                | ((uint32_t) ht[t1 + 2].hlen[i] << 20);
+        }
+    }
+    hlen1_packed = 0;
+    for (i = 0; i < 4; ++i)
+        hlen1_packed |= (uint32_t) ht[1].hlen[i] << (8 * i);
+}
+
+
+/* x0 * xlen + x1 of the four pairs in v, in the low half of each 64 bit lane */
+AVX2_FUNCTION static __m256i
+pair_index_avx2(__m256i v, __m256i vec_xlen)
+{
+    return _mm256_add_epi32(_mm256_mullo_epi32(v, vec_xlen), _mm256_srli_epi64(v, 32));
+}
+
+
+/* merge the pair indices of two vectors, in no particular order */
+AVX2_FUNCTION static __m256i
+pair_index_merge_avx2(__m256i t0, __m256i t1)
+{
+    return _mm256_blend_epi32(t0, _mm256_slli_epi64(t1, 32), 0xAA);
+}
+
+
+/* load 16 lines, the last 16 - n of them read as 0 */
+AVX2_FUNCTION static void
+load16_avx2(const int *ix, int n, __m256i * v0, __m256i * v1)
+{
+    __m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const m0 = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), lane);
+    __m256i const m1 = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - 8), lane);
+    *v0 = _mm256_maskload_epi32(ix, m0);
+    *v1 = _mm256_maskload_epi32(ix + 8, m1);
+}
+
+
+AVX2_FUNCTION static uint32_t
+hsum_epi32_avx2(__m256i v)
+{
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t) _mm_cvtsi128_si32(x);
+}
+
+
+AVX2_FUNCTION static int
+ix_max_avx2(const int *ix, const int *end)
+{
+    int const n = (int) (end - ix);
+    const int *const end16 = ix + (n & ~15);
+    __m256i vec_max0 = _mm256_setzero_si256();
+    __m256i vec_max1 = _mm256_setzero_si256();
+    int     tmp[8];
+    int     max = 0;
+    int     i;
+
+    for (; ix < end16; ix += 16) {
+        vec_max0 = _mm256_max_epi32(vec_max0, _mm256_loadu_si256((__m256i const *) ix));
+        vec_max1 = _mm256_max_epi32(vec_max1, _mm256_loadu_si256((__m256i const *) (ix + 8)));
+    }
+    if (n & 15) {
+        __m256i v0, v1;
+        load16_avx2(ix, n & 15, &v0, &v1);
+        vec_max0 = _mm256_max_epi32(vec_max0, v0);
+        vec_max1 = _mm256_max_epi32(vec_max1, v1);
+    }
+    _mm256_storeu_si256((__m256i *) tmp, _mm256_max_epi32(vec_max0, vec_max1));
+    for (i = 0; i < 8; ++i) {
+        if (max < tmp[i])
+            max = tmp[i];
+    }
+    return max;
+}
+
+
+/* Every counting loop below runs over whole blocks of 16 lines, the
+ * block at the end is padded with zeros.  The padding adds the count
+ * of the pair (0,0) for (16 - n % 16) / 2 pairs, which gets subtracted
+ * again at the end.
+ */
+
+AVX2_FUNCTION static __m256i
+hlen1_avx2(__m256i x, __m256i vec_hlen1)
+{
+    __m256i const h = _mm256_srlv_epi32(vec_hlen1, _mm256_slli_epi32(x, 3));
+    return _mm256_and_si256(h, _mm256_set1_epi32(0xff));
+}
+
+
+AVX2_FUNCTION static int
+count_bit_noESC_avx2(const int *ix, const int *end, unsigned int *s)
+{
+    int const n = (int) (end - ix);
+    const int *const end16 = ix + (n & ~15);
+    __m256i const vec_hlen1 = _mm256_set1_epi32((int) hlen1_packed);
+    __m256i const vec_xlen = _mm256_set1_epi32(2);
+    __m256i vec_sum = _mm256_setzero_si256();
+    __m256i v0, v1;
+    unsigned int sum1;
+
+    for (; ix < end16; ix += 16) {
+        v0 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) ix), vec_xlen);
+        v1 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) (ix + 8)), vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, hlen1_avx2(pair_index_merge_avx2(v0, v1), vec_hlen1));
+    }
+    sum1 = 0;
+    if (n & 15) {
+        load16_avx2(ix, n & 15, &v0, &v1);
+        v0 = pair_index_avx2(v0, vec_xlen);
+        v1 = pair_index_avx2(v1, vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, hlen1_avx2(pair_index_merge_avx2(v0, v1), vec_hlen1));
+        sum1 -= ((16 - (n & 15)) >> 1) * ht[1].hlen[0];
+    }
+    sum1 += hsum_epi32_avx2(vec_sum);
+
+    *s += sum1;
+    return 1;
+}
+
+
+/* table23 has 9, table56 16 entries, both fit into two registers */
+AVX2_FUNCTION static __m256i
+lookup16_avx2(__m256i x, __m256i lo, __m256i hi)
+{
+    __m256i const sel = _mm256_slli_epi32(x, 28); /* bit 3 into the sign bit */
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(lo, x)),
+                                                _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(hi, x)),
+                                                _mm256_castsi256_ps(sel)));
+}
+
+
+AVX2_FUNCTION static int
+count_bit_noESC_from2_avx2(const int *ix, const int *end, int t1, unsigned int *s)
+{
+    int const n = (int) (end - ix);
+    const int *const end16 = ix + (n & ~15);
+    unsigned int const xlen = ht[t1].xlen;
+    uint32_t const *const table = (t1 == 2) ? &table23[0] : &table56[0];
+    uint32_t padded[16] = { 0 };
+    __m256i const vec_xlen = _mm256_set1_epi32(xlen);
+    __m256i vec_lo, vec_hi;
+    __m256i vec_sum = _mm256_setzero_si256();
+    __m256i v0, v1;
+    unsigned int sum, sum2;
+
+    memcpy(padded, table, xlen * xlen * sizeof(uint32_t));
+    vec_lo = _mm256_loadu_si256((__m256i const *) &padded[0]);
+    vec_hi = _mm256_loadu_si256((__m256i const *) &padded[8]);
+
+    for (; ix < end16; ix += 16) {
+        v0 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) ix), vec_xlen);
+        v1 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) (ix + 8)), vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, lookup16_avx2(pair_index_merge_avx2(v0, v1), vec_lo, vec_hi));
+    }
+    sum = 0;
+    if (n & 15) {
+        load16_avx2(ix, n & 15, &v0, &v1);
+        v0 = pair_index_avx2(v0, vec_xlen);
+        v1 = pair_index_avx2(v1, vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, lookup16_avx2(pair_index_merge_avx2(v0, v1), vec_lo, vec_hi));
+        sum -= ((16 - (n & 15)) >> 1) * table[0];
+    }
+    sum += hsum_epi32_avx2(vec_sum);
+
+    sum2 = sum & 0xffffu;
+    sum >>= 16u;
+
+    if (sum > sum2) {
+        sum = sum2;
+        t1++;
+    }
+
+    *s += sum;
+    return t1;
+}
+
+
+AVX2_FUNCTION static int
+count_bit_noESC_from3_avx2(const int *ix, const int *end, int t1, unsigned int *s)
+{
+    int const n = (int) (end - ix);
+    const int *const end16 = ix + (n & ~15);
+    unsigned int const xlen = ht[t1].xlen;
+    uint32_t const *const table = hlen3_packed[(t1 - 7) / 3];
+    __m256i const vec_xlen = _mm256_set1_epi32(xlen);
+    __m256i const vec_3ff = _mm256_set1_epi32(0x3ff);
+    __m256i vec_sum = _mm256_setzero_si256();
+    __m256i v0, v1;
+    unsigned int sum1, sum2, sum3, pad = 0;
+    int     t;
+
+    assert(n <= 576);
+    for (; ix < end16; ix += 16) {
+        v0 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) ix), vec_xlen);
+        v1 = pair_index_avx2(_mm256_loadu_si256((__m256i const *) (ix + 8)), vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, _mm256_i32gather_epi32((int const *) table,
+                                                                   pair_index_merge_avx2(v0, v1), 4));
+    }
+    if (n & 15) {
+        load16_avx2(ix, n & 15, &v0, &v1);
+        v0 = pair_index_avx2(v0, vec_xlen);
+        v1 = pair_index_avx2(v1, vec_xlen);
+        vec_sum = _mm256_add_epi32(vec_sum, _mm256_i32gather_epi32((int const *) table,
+                                                                   pair_index_merge_avx2(v0, v1), 4));
+        pad = (16 - (n & 15)) >> 1;
+    }
+    sum1 = hsum_epi32_avx2(_mm256_and_si256(vec_sum, vec_3ff)) - pad * (table[0] & 0x3ff);
+    sum2 = hsum_epi32_avx2(_mm256_and_si256(_mm256_srli_epi32(vec_sum, 10), vec_3ff))
+        - pad * ((table[0] >> 10) & 0x3ff);
+    sum3 = hsum_epi32_avx2(_mm256_srli_epi32(vec_sum, 20)) - pad * (table[0] >> 20);
+
+    t = t1;
+    if (sum1 > sum2) {
+        sum1 = sum2;
+        t++;
+    }
+    if (sum1 > sum3) {
+        sum1 = sum3;
+        t = t1 + 2;
+    }
+    *s += sum1;
+
+    return t;
+}
+
+
+AVX2_FUNCTION static __m256i
+esc_index_avx2(__m256i v0, __m256i v1, __m256i * vec_esc)
+{
+    __m256i const vec_xlen = _mm256_set1_epi32(16);
+    __m256i const vec_14 = _mm256_set1_epi32(14);
+    __m256i const vec_15 = _mm256_set1_epi32(15);
+
+    *vec_esc = _mm256_sub_epi32(*vec_esc, _mm256_cmpgt_epi32(v0, vec_14));
+    *vec_esc = _mm256_sub_epi32(*vec_esc, _mm256_cmpgt_epi32(v1, vec_14));
+    v0 = pair_index_avx2(_mm256_min_epi32(v0, vec_15), vec_xlen);
+    v1 = pair_index_avx2(_mm256_min_epi32(v1, vec_15), vec_xlen);
+    return pair_index_merge_avx2(v0, v1);
+}
+
+
+AVX2_FUNCTION static int
+count_bit_ESC_avx2(const int *ix, const int *const end, int t1, const int t2, unsigned int *const s)
+{
+    /* ESC-table is used */
+    unsigned int const linbits = ht[t1].xlen * 65536u + ht[t2].xlen;
+    int const n = (int) (end - ix);
+    const int *const end16 = ix + (n & ~15);
+    __m256i vec_esc = _mm256_setzero_si256();
+    __m256i vec_sum = _mm256_setzero_si256();
+    __m256i v0, v1;
+    unsigned int sum, sum2;
+
+    for (; ix < end16; ix += 16) {
+        v0 = _mm256_loadu_si256((__m256i const *) ix);
+        v1 = _mm256_loadu_si256((__m256i const *) (ix + 8));
+        vec_sum = _mm256_add_epi32(vec_sum, _mm256_i32gather_epi32((int const *) largetbl,
+                                                                   esc_index_avx2(v0, v1, &vec_esc), 4));
+    }
+    sum = 0;
+    if (n & 15) {
+        load16_avx2(ix, n & 15, &v0, &v1);
+        vec_sum = _mm256_add_epi32(vec_sum, _mm256_i32gather_epi32((int const *) largetbl,
+                                                                   esc_index_avx2(v0, v1, &vec_esc), 4));
+        sum -= ((16 - (n & 15)) >> 1) * largetbl[0];
+    }
+    sum += hsum_epi32_avx2(vec_sum) + linbits * hsum_epi32_avx2(vec_esc);
+
+    sum2 = sum & 0xffffu;
+    sum >>= 16u;
+
+    if (sum > sum2) {
+        sum = sum2;
+        t1 = t2;
+    }
+
+    *s += sum;
+    return t1;
+}
+
+
+static const int huf_tbl_noESC_avx2[] = {
+    1, 2, 5, 7, 7, 10, 10, 13, 13, 13, 13, 13, 13, 13, 13
+};
+
+AVX2_FUNCTION int
+choose_table_avx2(const int *ix, const int *const end, int *const _s)
+{
+    unsigned int *s = (unsigned int *) _s;
+    unsigned int max;
+    int     choice, choice2;
+    max = ix_max_avx2(ix, end);
+
+    if (max <= 15) {
+        if (max == 0)
+            return 0;
+        if (max == 1)
+            return count_bit_noESC_avx2(ix, end, s);
+        if (max <= 3)
+            return count_bit_noESC_from2_avx2(ix, end, huf_tbl_noESC_avx2[max - 1], s);
+        return count_bit_noESC_from3_avx2(ix, end, huf_tbl_noESC_avx2[max - 1], s);
+    }
+    /* try tables with linbits */
+    if (max > IXMAX_VAL) {
+        *s = LARGE_BITS;
+        return -1;
+    }
+    max -= 15u;
+    for (choice2 = 24; choice2 < 32; choice2++) {
+        if (ht[choice2].linmax >= max) {
+            break;
+        }
+    }
+
+    for (choice = choice2 - 8; choice < 24; choice++) {
+        if (ht[choice].linmax >= max) {
+            break;
+        }
+    }
+    return count_bit_ESC_avx2(ix, end, choice, choice2, s);
+}
+
+
+
+/*********************************************************************
+ * Hartley transform of fft_long() and fft_short(), see fht() in fft.c
+ *
+ * The same butterflies are computed in the same order, and the twiddle
+ * factors come from the same single precision recurrence, tabulated by
+ * fht_avx2_init(), so the result is bit exact unless the compiler is
+ * allowed to reassociate (-ffast-math).  The first pass works on
+ * eight 16 value blocks at once, transposed so that every lane holds
+ * one block.  The later passes run the twiddle loop over eight indices
+ * at once, the mirrored gi[] side is loaded and stored reversed.
+ * FMA is not used on purpose, it would round differently.
+ *********************************************************************/
+
+#define TRI_SIZE (5-1)  /* 1024 =  4**5 */
+static const FLOAT costab[TRI_SIZE * 2] = {
+    9.238795325112867e-01, 3.826834323650898e-01,
+    9.951847266721969e-01, 9.801714032956060e-02,
+    9.996988186962042e-01, 2.454122852291229e-02,
+    9.999811752826011e-01, 6.135884649154475e-03
+};
+
+/* c1, s1, c2, s2 of index i of each pass, one spare entry for the last lane */
+static FLOAT fht_twiddle[TRI_SIZE][4][BLKSIZE / 8 + 8];
+
+void
+fht_avx2_init(void)
+{
+    int     pass, i, kx;
+
+    for (pass = 0, kx = 2; pass < TRI_SIZE; pass++, kx <<= 2) {
+        FLOAT const *const tri = &costab[2 * pass];
+        FLOAT   c1 = tri[0], s1 = tri[1];
+        for (i = 1; i <= kx; i++) {
+            FLOAT   c2 = 1 - (2 * s1) * s1;
+            FLOAT   s2 = (2 * s1) * c1;
+            fht_twiddle[pass][0][i] = c1;
+            fht_twiddle[pass][1][i] = s1;
+            fht_twiddle[pass][2][i] = c2;
+            fht_twiddle[pass][3][i] = s2;
+            c2 = c1;
+            c1 = c2 * tri[0] - s1 * tri[1];
+            s1 = c2 * tri[1] + s1 * tri[0];
+        }
+    }
+}
+
+
+AVX2_FUNCTION static void
+transpose8_avx2(__m256 * r)
+{
+    __m256 const t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 const t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 const t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 const t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 const t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    __m256 const t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 const t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    __m256 const t7 = _mm256_unpackhi_ps(r[6], r[7]);
+    __m256 const u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 const u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 const u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 const u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 const u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 const u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 const u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 const u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+    r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+    r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+    r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+    r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+    r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+    r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+    r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+
+/* SQRT2 * x, multiplied in double precision like the C expression */
+AVX2_FUNCTION static __m256
+mul_sqrt2_avx2(__m256 x)
+{
+    __m256d const vec_sqrt2 = _mm256_set1_pd(SQRT2);
+    __m128 const lo = _mm256_cvtpd_ps(_mm256_mul_pd(vec_sqrt2,
+                                                    _mm256_cvtps_pd(_mm256_castps256_ps128(x))));
+    __m128 const hi = _mm256_cvtpd_ps(_mm256_mul_pd(vec_sqrt2,
+                                                    _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1))));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+
+/* first pass, k1 = 4, on blocks of 16 values */
+AVX2_FUNCTION static void
+fht_first_pass_avx2(FLOAT * fz, FLOAT const *fn)
+{
+    __m256 const c1 = _mm256_set1_ps(fht_twiddle[0][0][1]);
+    __m256 const s1 = _mm256_set1_ps(fht_twiddle[0][1][1]);
+    __m256 const c2 = _mm256_set1_ps(fht_twiddle[0][2][1]);
+    __m256 const s2 = _mm256_set1_ps(fht_twiddle[0][3][1]);
+
+    for (; fz < fn; fz += 8 * 16) {
+        __m256  lo[8], hi[8];   /* value 0-7 and 8-15 of block 0-7 */
+        __m256  a, b, f0, f1, f2, f3, g0, g1, g2, g3;
+        int     j;
+
+        for (j = 0; j < 8; j++) {
+            lo[j] = _mm256_loadu_ps(fz + 16 * j);
+            hi[j] = _mm256_loadu_ps(fz + 16 * j + 8);
+        }
+        transpose8_avx2(lo);
+        transpose8_avx2(hi);
+
+        /* i = 0, fi[] */
+        f1 = _mm256_sub_ps(lo[0], lo[4]);
+        f0 = _mm256_add_ps(lo[0], lo[4]);
+        f3 = _mm256_sub_ps(hi[0], hi[4]);
+        f2 = _mm256_add_ps(hi[0], hi[4]);
+        hi[0] = _mm256_sub_ps(f0, f2);
+        lo[0] = _mm256_add_ps(f0, f2);
+        hi[4] = _mm256_sub_ps(f1, f3);
+        lo[4] = _mm256_add_ps(f1, f3);
+
+        /* i = 0, gi[] */
+        f1 = _mm256_sub_ps(lo[2], lo[6]);
+        f0 = _mm256_add_ps(lo[2], lo[6]);
+        f3 = mul_sqrt2_avx2(hi[6]);
+        f2 = mul_sqrt2_avx2(hi[2]);
+        hi[2] = _mm256_sub_ps(f0, f2);
+        lo[2] = _mm256_add_ps(f0, f2);
+        hi[6] = _mm256_sub_ps(f1, f3);
+        lo[6] = _mm256_add_ps(f1, f3);
+
+        /* i = 1, fi[] = 1, 5, 9, 13 and gi[] = 3, 7, 11, 15 */
+        b = _mm256_sub_ps(_mm256_mul_ps(s2, lo[5]), _mm256_mul_ps(c2, lo[7]));
+        a = _mm256_add_ps(_mm256_mul_ps(c2, lo[5]), _mm256_mul_ps(s2, lo[7]));
+        f1 = _mm256_sub_ps(lo[1], a);
+        f0 = _mm256_add_ps(lo[1], a);
+        g1 = _mm256_sub_ps(lo[3], b);
+        g0 = _mm256_add_ps(lo[3], b);
+        b = _mm256_sub_ps(_mm256_mul_ps(s2, hi[5]), _mm256_mul_ps(c2, hi[7]));
+        a = _mm256_add_ps(_mm256_mul_ps(c2, hi[5]), _mm256_mul_ps(s2, hi[7]));
+        f3 = _mm256_sub_ps(hi[1], a);
+        f2 = _mm256_add_ps(hi[1], a);
+        g3 = _mm256_sub_ps(hi[3], b);
+        g2 = _mm256_add_ps(hi[3], b);
+        b = _mm256_sub_ps(_mm256_mul_ps(s1, f2), _mm256_mul_ps(c1, g3));
+        a = _mm256_add_ps(_mm256_mul_ps(c1, f2), _mm256_mul_ps(s1, g3));
+        hi[1] = _mm256_sub_ps(f0, a);
+        lo[1] = _mm256_add_ps(f0, a);
+        hi[7] = _mm256_sub_ps(g1, b);
+        lo[7] = _mm256_add_ps(g1, b);
+        b = _mm256_sub_ps(_mm256_mul_ps(c1, g2), _mm256_mul_ps(s1, f3));
+        a = _mm256_add_ps(_mm256_mul_ps(s1, g2), _mm256_mul_ps(c1, f3));
+        hi[3] = _mm256_sub_ps(g0, a);
+        lo[3] = _mm256_add_ps(g0, a);
+        hi[5] = _mm256_sub_ps(f1, b);
+        lo[5] = _mm256_add_ps(f1, b);
+
+        transpose8_avx2(lo);
+        transpose8_avx2(hi);
+        for (j = 0; j < 8; j++) {
+            _mm256_storeu_ps(fz + 16 * j, lo[j]);
+            _mm256_storeu_ps(fz + 16 * j + 8, hi[j]);
+        }
+    }
+}
+
+
+AVX2_FUNCTION void
+fht_AVX2(FLOAT * fz, int n)
+{
+    __m256i const reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    int     k4, pass;
+    FLOAT  *fi, *gi;
+    FLOAT const *fn;
+
+    n <<= 1;            /* to get BLKSIZE, because of 3DNow! ASM routine */
+    fn = fz + n;
+    fht_first_pass_avx2(fz, fn);
+    k4 = 16;
+    pass = 1;
+    while (k4 < n) {
+        int     i, k1, k2, k3, kx;
+        kx = k4 >> 1;
+        k1 = k4;
+        k2 = k4 << 1;
+        k3 = k2 + k1;
+        k4 = k2 << 1;
+        fi = fz;
+        gi = fi + kx;
+        do {
+            FLOAT   f0, f1, f2, f3;
+            f1 = fi[0] - fi[k1];
+            f0 = fi[0] + fi[k1];
+            f3 = fi[k2] - fi[k3];
+            f2 = fi[k2] + fi[k3];
+            fi[k2] = f0 - f2;
+            fi[0] = f0 + f2;
+            fi[k3] = f1 - f3;
+            fi[k1] = f1 + f3;
+            f1 = gi[0] - gi[k1];
+            f0 = gi[0] + gi[k1];
+            f3 = SQRT2 * gi[k3];
+            f2 = SQRT2 * gi[k2];
+            gi[k2] = f0 - f2;
+            gi[0] = f0 + f2;
+            gi[k3] = f1 - f3;
+            gi[k1] = f1 + f3;
+            gi += k4;
+            fi += k4;
+        } while (fi < fn);
+
+        /* kx - 1 is 7 modulo 8, the last lane of the last step is index
+         * kx, which belongs to i = 0 and has to be left alone */
+        for (i = 1; i < kx; i += 8) {
+            __m256 const c1 = _mm256_loadu_ps(&fht_twiddle[pass][0][i]);
+            __m256 const s1 = _mm256_loadu_ps(&fht_twiddle[pass][1][i]);
+            __m256 const c2 = _mm256_loadu_ps(&fht_twiddle[pass][2][i]);
+            __m256 const s2 = _mm256_loadu_ps(&fht_twiddle[pass][3][i]);
+            __m256 const keep = (i + 8 > kx)
+                ? _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, 0, 0, 0, 0, -1))
+                : _mm256_setzero_ps();
+            fi = fz + i;
+            gi = fz + k1 - i - 7;
+            do {
+                __m256  a, b, f0, f1, f2, f3, g0, g1, g2, g3;
+                __m256 const fi0 = _mm256_loadu_ps(fi);
+                __m256 const fi1 = _mm256_loadu_ps(fi + k1);
+                __m256 const fi2 = _mm256_loadu_ps(fi + k2);
+                __m256 const fi3 = _mm256_loadu_ps(fi + k3);
+                __m256 const gi0 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gi), reverse);
+                __m256 const gi1 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gi + k1), reverse);
+                __m256 const gi2 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gi + k2), reverse);
+                __m256 const gi3 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gi + k3), reverse);
+
+                b = _mm256_sub_ps(_mm256_mul_ps(s2, fi1), _mm256_mul_ps(c2, gi1));
+                a = _mm256_add_ps(_mm256_mul_ps(c2, fi1), _mm256_mul_ps(s2, gi1));
+                f1 = _mm256_sub_ps(fi0, a);
+                f0 = _mm256_add_ps(fi0, a);
+                g1 = _mm256_sub_ps(gi0, b);
+                g0 = _mm256_add_ps(gi0, b);
+                b = _mm256_sub_ps(_mm256_mul_ps(s2, fi3), _mm256_mul_ps(c2, gi3));
+                a = _mm256_add_ps(_mm256_mul_ps(c2, fi3), _mm256_mul_ps(s2, gi3));
+                f3 = _mm256_sub_ps(fi2, a);
+                f2 = _mm256_add_ps(fi2, a);
+                g3 = _mm256_sub_ps(gi2, b);
+                g2 = _mm256_add_ps(gi2, b);
+                b = _mm256_sub_ps(_mm256_mul_ps(s1, f2), _mm256_mul_ps(c1, g3));
+                a = _mm256_add_ps(_mm256_mul_ps(c1, f2), _mm256_mul_ps(s1, g3));
+                _mm256_storeu_ps(fi + k2, _mm256_blendv_ps(_mm256_sub_ps(f0, a), fi2, keep));
+                _mm256_storeu_ps(fi, _mm256_blendv_ps(_mm256_add_ps(f0, a), fi0, keep));
+                _mm256_storeu_ps(gi + k3, _mm256_permutevar8x32_ps(
+                                     _mm256_blendv_ps(_mm256_sub_ps(g1, b), gi3, keep), reverse));
+                _mm256_storeu_ps(gi + k1, _mm256_permutevar8x32_ps(
+                                     _mm256_blendv_ps(_mm256_add_ps(g1, b), gi1, keep), reverse));
+                b = _mm256_sub_ps(_mm256_mul_ps(c1, g2), _mm256_mul_ps(s1, f3));
+                a = _mm256_add_ps(_mm256_mul_ps(s1, g2), _mm256_mul_ps(c1, f3));
+                _mm256_storeu_ps(gi + k2, _mm256_permutevar8x32_ps(
+                                     _mm256_blendv_ps(_mm256_sub_ps(g0, a), gi2, keep), reverse));
+                _mm256_storeu_ps(gi, _mm256_permutevar8x32_ps(
+                                     _mm256_blendv_ps(_mm256_add_ps(g0, a), gi0, keep), reverse));
+                _mm256_storeu_ps(fi + k3, _mm256_blendv_ps(_mm256_sub_ps(f1, b), fi3, keep));
+                _mm256_storeu_ps(fi + k1, _mm256_blendv_ps(_mm256_add_ps(f1, b), fi1, keep));
+                gi += k4;
+                fi += k4;
+            } while (fi < fn);
+        }
+        pass++;
+    }
+}
+
+
+
+/*********************************************************************
+ * polyphase filterbank and MDCT, see newmdct.c
+ *
+ * window_subband_core_avx2() computes the 15 subband pairs of the
+ * windowing loop of window_subband() eight at a time, the window is
+ * transposed by mdct_avx2_init() for that.  mdct_bands_avx2() runs the
+ * MDCT of eight subbands at once, one subband per lane, and stores
+ * them transposed.  Both do the same operations in the same order as
+ * the C versions, including the double precision constants of
+ * mdct_short().
+ *********************************************************************/
+
+static FLOAT enwindow_t[18][16];    /* 15 subband pairs, the last one is zero */
+static FLOAT const (*mdct_win)[36];
+static int mdct_order[SBLIMIT];
+static int mdct_band_of[SBLIMIT];
+
+void
+mdct_avx2_init(FLOAT const *enwindow, FLOAT const win[4][36], int const order[SBLIMIT])
+{
+    int     i, m;
+
+    for (m = 0; m < 18; m++) {
+        for (i = 0; i < 15; i++)
+            enwindow_t[m][i] = enwindow[18 * i + m];
+        enwindow_t[m][15] = 0;
+    }
+    mdct_win = win;
+    for (i = 0; i < SBLIMIT; i++) {
+        mdct_order[i] = order[i];
+        mdct_band_of[order[i]] = i;
+    }
+}
+
+
+/* lane j of pair l + j reads x1[o - l - j] and x2[o + l + j] */
+#define X1(o) _mm256_permutevar8x32_ps(_mm256_loadu_ps(x1 - l - 7 + (o)), reverse)
+#define X2(o) _mm256_loadu_ps(x2 + l + (o))
+#define W(m)  _mm256_loadu_ps(&enwindow_t[m][l])
+
+AVX2_FUNCTION void
+window_subband_core_avx2(const sample_t * x1, FLOAT a[SBLIMIT])
+{
+    static const int off[8] = { -224, -160, -96, -32, 32, 96, 160, 224 };
+    __m256i const reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const sample_t *x2 = &x1[238 - 14 - 286];
+    int     l, m;
+
+    /* the 16th lane reads one sample more than the C version, which is
+     * still inside the buffer; its a[30] and a[31] get overwritten later */
+    for (l = 0; l < 16; l += 8) {
+        __m256  s, t, w, lo, hi;
+
+        s = _mm256_mul_ps(X2(off[0]), W(0));
+        t = _mm256_mul_ps(X1(-off[0]), W(0));
+        for (m = 1; m < 8; m++) {
+            s = _mm256_add_ps(s, _mm256_mul_ps(X2(off[m]), W(m)));
+            t = _mm256_add_ps(t, _mm256_mul_ps(X1(-off[m]), W(m)));
+        }
+        for (m = 0; m < 8; m++) {
+            s = _mm256_add_ps(s, _mm256_mul_ps(X1(off[m] - 32), W(8 + m)));
+            t = _mm256_sub_ps(t, _mm256_mul_ps(X2(32 - off[m]), W(8 + m)));
+        }
+        s = _mm256_mul_ps(s, W(16));
+        w = _mm256_sub_ps(t, s);
+        t = _mm256_add_ps(t, s);
+        w = _mm256_mul_ps(W(17), w);
+
+        /* a[2 * i] = t, a[2 * i + 1] = w */
+        lo = _mm256_unpacklo_ps(t, w);
+        hi = _mm256_unpackhi_ps(t, w);
+        _mm256_storeu_ps(a + 2 * l, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(a + 2 * l + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+}
+
+#undef X1
+#undef X2
+#undef W
+
+
+#define ADD(a, b) _mm256_add_ps(a, b)
+#define SUB(a, b) _mm256_sub_ps(a, b)
+#define MUL(a, b) _mm256_mul_ps(a, b)
+#define NEG(a)    _mm256_xor_ps(a, sign)
+
+/* (FLOAT) (x * k1 * k2), evaluated in double like the C expression */
+AVX2_FUNCTION static __m256
+dmul_avx2(__m256 x, double k1, double k2)
+{
+    __m256d const v1 = _mm256_set1_pd(k1), v2 = _mm256_set1_pd(k2);
+    __m256d const lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+    __m256d const hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+    __m128 const rlo = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_mul_pd(lo, v1), v2));
+    __m128 const rhi = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_mul_pd(hi, v1), v2));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(rlo), rhi, 1);
+}
+
+/* (FLOAT) (x * k1 * k2 + y), evaluated in double like the C expression */
+AVX2_FUNCTION static __m256
+dmul_add_avx2(__m256 x, double k1, double k2, __m256 y)
+{
+    __m256d const v1 = _mm256_set1_pd(k1), v2 = _mm256_set1_pd(k2);
+    __m256d const lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+    __m256d const hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+    __m256d const ylo = _mm256_cvtps_pd(_mm256_castps256_ps128(y));
+    __m256d const yhi = _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1));
+    __m128 const rlo = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(lo, v1), v2), ylo));
+    __m128 const rhi = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(hi, v1), v2), yhi));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(rlo), rhi, 1);
+}
+
+
+/* mdct_short(), io[3 * m + l] */
+AVX2_FUNCTION static void
+mdct_short_avx2(__m256 * io)
+{
+    __m256 const sign = _mm256_set1_ps(-0.0f);
+    __m256 const w0 = _mm256_set1_ps(mdct_win[SHORT_TYPE][0]);
+    __m256 const w1 = _mm256_set1_ps(mdct_win[SHORT_TYPE][1]);
+    __m256 const w2 = _mm256_set1_ps(mdct_win[SHORT_TYPE][2]);
+    int     l;
+
+    for (l = 0; l < 3; l++, io++) {
+        __m256  tc0, tc1, tc2, ts0, ts1, ts2;
+
+        ts0 = SUB(MUL(io[2 * 3], w0), io[5 * 3]);
+        tc0 = SUB(MUL(io[0 * 3], w2), io[3 * 3]);
+        tc1 = ADD(ts0, tc0);
+        tc2 = SUB(ts0, tc0);
+
+        ts0 = ADD(MUL(io[5 * 3], w0), io[2 * 3]);
+        tc0 = ADD(MUL(io[3 * 3], w2), io[0 * 3]);
+        ts1 = ADD(ts0, tc0);
+        ts2 = ADD(NEG(ts0), tc0);
+
+        tc0 = dmul_avx2(SUB(MUL(io[1 * 3], w1), io[4 * 3]), 2.069978111953089e-11, 1.0);
+        ts0 = dmul_avx2(ADD(MUL(io[4 * 3], w1), io[1 * 3]), 2.069978111953089e-11, 1.0);
+
+        io[3 * 0] = dmul_add_avx2(tc1, 1.907525191737280e-11, 1.0, tc0);
+        io[3 * 5] = dmul_add_avx2(NEG(ts1), 1.907525191737280e-11, 1.0, ts0);
+
+        tc2 = dmul_avx2(tc2, 0.86602540378443870761, 1.907525191737281e-11);
+        ts1 = dmul_add_avx2(ts1, 0.5, 1.907525191737281e-11, ts0);
+        io[3 * 1] = SUB(tc2, ts1);
+        io[3 * 2] = ADD(tc2, ts1);
+
+        tc1 = dmul_add_avx2(tc1, 0.5, 1.907525191737281e-11, NEG(tc0));
+        ts2 = dmul_avx2(ts2, 0.86602540378443870761, 1.907525191737281e-11);
+        io[3 * 3] = ADD(tc1, ts2);
+        io[3 * 4] = SUB(tc1, ts2);
+    }
+}
+
+
+/* mdct_long() */
+AVX2_FUNCTION static void
+mdct_long_avx2(__m256 * out, __m256 const *in)
+{
+    __m256 const sign = _mm256_set1_ps(-0.0f);
+    FLOAT const *const cx_ = mdct_win[SHORT_TYPE] + 12;
+    __m256  cx[8];
+    __m256  ct, st;
+    int     i;
+
+    for (i = 0; i < 8; i++)
+        cx[i] = _mm256_set1_ps(cx_[i]);
+    {
+        __m256  tc1, tc2, tc3, tc4, ts5, ts6, ts7, ts8;
+        /* 1,2, 5,6, 9,10, 13,14, 17 */
+        tc1 = SUB(in[17], in[9]);
+        tc3 = SUB(in[15], in[11]);
+        tc4 = SUB(in[14], in[12]);
+        ts5 = ADD(in[0], in[8]);
+        ts6 = ADD(in[1], in[7]);
+        ts7 = ADD(in[2], in[6]);
+        ts8 = ADD(in[3], in[5]);
+
+        out[17] = SUB(SUB(ADD(ts5, ts7), ts8), SUB(ts6, in[4]));
+        st = ADD(MUL(SUB(ADD(ts5, ts7), ts8), cx[7]), SUB(ts6, in[4]));
+        ct = MUL(SUB(SUB(tc1, tc3), tc4), cx[6]);
+        out[5] = ADD(ct, st);
+        out[6] = SUB(ct, st);
+
+        tc2 = MUL(SUB(in[16], in[10]), cx[6]);
+        ts6 = ADD(MUL(ts6, cx[7]), in[4]);
+        ct = ADD(ADD(ADD(MUL(tc1, cx[0]), tc2), MUL(tc3, cx[1])), MUL(tc4, cx[2]));
+        st = ADD(SUB(ADD(MUL(NEG(ts5), cx[4]), ts6), MUL(ts7, cx[5])), MUL(ts8, cx[3]));
+        out[1] = ADD(ct, st);
+        out[2] = SUB(ct, st);
+
+        ct = ADD(SUB(SUB(MUL(tc1, cx[1]), tc2), MUL(tc3, cx[2])), MUL(tc4, cx[0]));
+        st = ADD(SUB(ADD(MUL(NEG(ts5), cx[5]), ts6), MUL(ts7, cx[3])), MUL(ts8, cx[4]));
+        out[9] = ADD(ct, st);
+        out[10] = SUB(ct, st);
+
+        ct = SUB(ADD(SUB(MUL(tc1, cx[2]), tc2), MUL(tc3, cx[0])), MUL(tc4, cx[1]));
+        st = SUB(ADD(SUB(MUL(ts5, cx[3]), ts6), MUL(ts7, cx[4])), MUL(ts8, cx[5]));
+        out[13] = ADD(ct, st);
+        out[14] = SUB(ct, st);
+    }
+    {
+        __m256  ts1, ts2, ts3, ts4, tc5, tc6, tc7, tc8;
+
+        ts1 = SUB(in[8], in[0]);
+        ts3 = SUB(in[6], in[2]);
+        ts4 = SUB(in[5], in[3]);
+        tc5 = ADD(in[17], in[9]);
+        tc6 = ADD(in[16], in[10]);
+        tc7 = ADD(in[15], in[11]);
+        tc8 = ADD(in[14], in[12]);
+
+        out[0] = ADD(ADD(ADD(tc5, tc7), tc8), ADD(tc6, in[13]));
+        ct = SUB(MUL(ADD(ADD(tc5, tc7), tc8), cx[7]), ADD(tc6, in[13]));
+        st = MUL(ADD(SUB(ts1, ts3), ts4), cx[6]);
+        out[11] = ADD(ct, st);
+        out[12] = SUB(ct, st);
+
+        ts2 = MUL(SUB(in[7], in[1]), cx[6]);
+        tc6 = SUB(in[13], MUL(tc6, cx[7]));
+        ct = ADD(ADD(SUB(MUL(tc5, cx[3]), tc6), MUL(tc7, cx[4])), MUL(tc8, cx[5]));
+        st = ADD(ADD(ADD(MUL(ts1, cx[2]), ts2), MUL(ts3, cx[0])), MUL(ts4, cx[1]));
+        out[3] = ADD(ct, st);
+        out[4] = SUB(ct, st);
+
+        ct = SUB(SUB(ADD(MUL(NEG(tc5), cx[5]), tc6), MUL(tc7, cx[3])), MUL(tc8, cx[4]));
+        st = SUB(SUB(ADD(MUL(ts1, cx[1]), ts2), MUL(ts3, cx[2])), MUL(ts4, cx[0]));
+        out[7] = ADD(ct, st);
+        out[8] = SUB(ct, st);
+
+        ct = SUB(SUB(ADD(MUL(NEG(tc5), cx[4]), tc6), MUL(tc7, cx[5])), MUL(tc8, cx[3]));
+        st = SUB(ADD(SUB(MUL(ts1, cx[0]), ts2), MUL(ts3, cx[1])), MUL(ts4, cx[2]));
+        out[15] = ADD(ct, st);
+        out[16] = SUB(ct, st);
+    }
+}
+
+
+AVX2_FUNCTION void
+mdct_bands_avx2(FLOAT const *sb0, FLOAT * sb1, FLOAT const amp_filter[SBLIMIT], int type,
+                FLOAT * mdct_enc)
+{
+    int     band, k, p;
+
+    for (band = 0; band < SBLIMIT; band++) {
+        if (!(amp_filter[band] < 1e-12) && amp_filter[band] < 1.0) {
+            for (k = 0; k < 18; k++)
+                sb1[k * 32 + mdct_order[band]] *= amp_filter[band];
+        }
+    }
+
+    /* eight subbands at once, in the order they are stored in sb0 and sb1 */
+    for (p = 0; p < SBLIMIT; p += 8) {
+        __m256  b0[18], b1[18], e[18];
+        FLOAT   e16[8], e17[8];
+
+        for (k = 0; k < 18; k++) {
+            b0[k] = _mm256_loadu_ps(sb0 + k * 32 + p);
+            b1[k] = _mm256_loadu_ps(sb1 + k * 32 + p);
+        }
+        if (type == SHORT_TYPE) {
+            for (k = 0; k < 3; k++) {
+                __m256 const w = _mm256_set1_ps(mdct_win[SHORT_TYPE][k]);
+                e[3 * k + 0] = SUB(MUL(b0[6 + k], w), b0[11 - k]);
+                e[3 * k + 9] = ADD(MUL(b0[17 - k], w), b0[12 + k]);
+                e[3 * k + 1] = SUB(MUL(b0[12 + k], w), b0[17 - k]);
+                e[3 * k + 10] = ADD(MUL(b1[5 - k], w), b1[k]);
+                e[3 * k + 2] = SUB(MUL(b1[k], w), b1[5 - k]);
+                e[3 * k + 11] = ADD(MUL(b1[11 - k], w), b1[6 + k]);
+            }
+            mdct_short_avx2(e);
+        }
+        else {
+            FLOAT const *const w = mdct_win[type];
+            FLOAT const *const tantab_l = mdct_win[SHORT_TYPE] + 3;
+            __m256  work[18];
+            for (k = 0; k < 9; k++) {
+                __m256 const t = _mm256_set1_ps(tantab_l[k]);
+                __m256 const a = ADD(MUL(_mm256_set1_ps(w[k + 18]), b1[k]),
+                                     MUL(_mm256_set1_ps(w[k + 27]), b1[17 - k]));
+                __m256 const b = SUB(MUL(_mm256_set1_ps(w[k]), b0[k]),
+                                     MUL(_mm256_set1_ps(w[k + 9]), b0[17 - k]));
+                work[k] = SUB(a, MUL(b, t));
+                work[k + 9] = ADD(MUL(a, t), b);
+            }
+            mdct_long_avx2(e, work);
+        }
+
+        /* lane k is the subband of sb0[p + k], 18 lines per subband */
+        transpose8_avx2(e);
+        transpose8_avx2(e + 8);
+        _mm256_storeu_ps(e16, e[16]);
+        _mm256_storeu_ps(e17, e[17]);
+        for (k = 0; k < 8; k++) {
+            FLOAT  *const out = mdct_enc + 18 * mdct_band_of[p + k];
+            _mm256_storeu_ps(out, e[k]);
+            _mm256_storeu_ps(out + 8, e[8 + k]);
+            out[16] = e16[k];
+            out[17] = e17[k];
+        }
+    }
+
+    for (band = 0; band < SBLIMIT; band++) {
+        if (amp_filter[band] < 1e-12)
+            memset(mdct_enc + 18 * band, 0, 18 * sizeof(FLOAT));
+    }
+
+    /* aliasing reduction butterfly */
+    if (type != SHORT_TYPE) {
+        __m256i const reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        __m256 const ca = _mm256_loadu_ps(mdct_win[SHORT_TYPE] + 20);
+        __m256 const cs = _mm256_loadu_ps(mdct_win[SHORT_TYPE] + 28);
+        for (band = 1; band < SBLIMIT; band++) {
+            FLOAT  *const enc = mdct_enc + 18 * band;
+            __m256 const u = _mm256_loadu_ps(enc);
+            __m256 const d = _mm256_permutevar8x32_ps(_mm256_loadu_ps(enc - 8), reverse);
+            __m256 const bu = ADD(MUL(u, ca), MUL(d, cs));
+            __m256 const bd = SUB(MUL(u, cs), MUL(d, ca));
+            _mm256_storeu_ps(enc - 8, _mm256_permutevar8x32_ps(bu, reverse));
+            _mm256_storeu_ps(enc, bd);
+        }
+    }
+}
+
+#undef ADD
+#undef SUB
+#undef MUL
+#undef NEG
+
+
+
+/*********************************************************************
+ * spreading function convolution, see psymodel.c
+ *
+ * The masking of each partition is a running vbrpsy_mask_add() over the
+ * partitions spreading into it, which can't be vectorized along the
+ * sum.  s3_convolve_avx2() does eight partitions at once instead, one
+ * per lane, stepping through the banded s3_band layout; the padding is
+ * zero, which leaves the masking of the shorter partitions unchanged.
+ *********************************************************************/
+
+#ifdef USE_FAST_LOG
+
+static FLOAT psy_tab[9];
+static FLOAT psy_table2[16]; /* padded for two permutes */
+static int psy_delta[9];
+static FLOAT psy_ma_max_i1, psy_ma_max_i2;
+
+void
+s3_convolve_avx2_init(FLOAT const tab[9], FLOAT const table2[10], int const delta[9],
+                      FLOAT ma_max_i1, FLOAT ma_max_i2)
+{
+    memcpy(psy_tab, tab, sizeof(psy_tab));
+    memcpy(psy_table2, table2, 10 * sizeof(FLOAT));
+    memcpy(psy_delta, delta, sizeof(psy_delta));
+    psy_ma_max_i1 = ma_max_i1;
+    psy_ma_max_i2 = ma_max_i2;
+}
+
+
+/* (int) FAST_LOG10_X(x, 16.0f), fast_log2() evaluated as in util.c */
+AVX2_FUNCTION static __m256i
+log10_x16_avx2(__m256 x)
+{
+    __m256i const bits = _mm256_castps_si256(x);
+    __m256i const mantisse = _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff));
+    __m256i const m = _mm256_srli_epi32(mantisse, 23 - LOG2_SIZE_L2);
+    __m256  partial, log2val, lo, hi;
+    __m256d const k = _mm256_set1_pd(LOG2 / LOG10 * (16.0f));
+
+    log2val = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23),
+                                                                   _mm256_set1_epi32(0xff)),
+                                                  _mm256_set1_epi32(0x7f)));
+    partial = _mm256_cvtepi32_ps(_mm256_and_si256(mantisse,
+                                                  _mm256_set1_epi32((1 << (23 - LOG2_SIZE_L2)) - 1)));
+    partial = _mm256_mul_ps(partial, _mm256_set1_ps(1.0f / ((1 << (23 - LOG2_SIZE_L2)))));
+    lo = _mm256_i32gather_ps(log_table, m, 4);
+    hi = _mm256_i32gather_ps(log_table + 1, m, 4);
+    log2val = _mm256_add_ps(log2val,
+                            _mm256_add_ps(_mm256_mul_ps(lo, _mm256_sub_ps(_mm256_set1_ps(1.0f), partial)),
+                                          _mm256_mul_ps(hi, partial)));
+
+    return _mm256_setr_m128i(_mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(log2val)), k)),
+                             _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(log2val, 1)), k)));
+}
+
+
+/* vbrpsy_mask_add() of eight partitions */
+AVX2_FUNCTION static __m256
+mask_add_avx2(__m256 m1, __m256 m2, __m256i dist, __m256i delta)
+{
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const table2_lo = _mm256_loadu_ps(psy_table2);
+    __m256 const table2_hi = _mm256_loadu_ps(psy_table2 + 8);
+    __m256  hi, ratio, sum, near_r, far_r, r;
+    __m256i i;
+
+    m1 = _mm256_max_ps(m1, zero);
+    m2 = _mm256_max_ps(m2, zero);
+    hi = _mm256_max_ps(m1, m2);
+    ratio = _mm256_div_ps(hi, _mm256_min_ps(m1, m2));
+    sum = _mm256_add_ps(m1, m2);
+
+    i = log10_x16_avx2(ratio);
+    i = _mm256_max_epi32(_mm256_min_epi32(i, _mm256_set1_epi32(9)), _mm256_setzero_si256());
+    near_r = _mm256_blendv_ps(_mm256_permutevar8x32_ps(table2_lo, i),
+                              _mm256_permutevar8x32_ps(table2_hi, i),
+                              _mm256_castsi256_ps(_mm256_cmpgt_epi32(i, _mm256_set1_epi32(7))));
+    near_r = _mm256_mul_ps(sum, near_r);
+    near_r = _mm256_blendv_ps(near_r, sum,
+                              _mm256_cmp_ps(ratio, _mm256_set1_ps(psy_ma_max_i1), _CMP_GE_OQ));
+    far_r = _mm256_blendv_ps(hi, sum,
+                             _mm256_cmp_ps(ratio, _mm256_set1_ps(psy_ma_max_i2), _CMP_LT_OQ));
+    r = _mm256_blendv_ps(near_r, far_r,
+                         _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_abs_epi32(dist), delta)));
+    r = _mm256_blendv_ps(r, m1, _mm256_cmp_ps(m2, zero, _CMP_LE_OQ));
+    r = _mm256_blendv_ps(r, m2, _mm256_cmp_ps(m1, zero, _CMP_LE_OQ));
+    return r;
+}
+
+
+AVX2_FUNCTION void
+s3_convolve_avx2(PsyConst_CB2SB_t const *gd, FLOAT const *eb, unsigned char const *mask_idx,
+                 FLOAT * ecb_out, int *dd_out)
+{
+    __m256i first[CBANDS / S3_LANES], last[CBANDS / S3_LANES];
+    __m256i delta[CBANDS / S3_LANES];
+    __m256  ecb[CBANDS / S3_LANES];
+    FLOAT   w[CBANDS];
+    int     idx[CBANDS], idx_sum[CBANDS + 1];
+    int const ngroups = (gd->npart + S3_LANES - 1) / S3_LANES;
+    int     g, k, t;
+
+    assert(gd->npart < CBANDS);
+    idx_sum[0] = 0;
+    for (k = 0; k < gd->npart; k++) {
+        idx[k] = mask_idx[k];
+        idx_sum[k + 1] = idx_sum[k] + idx[k];
+        w[k] = psy_tab[mask_idx[k]];
+    }
+    for (; k < CBANDS; k++)
+        idx[k] = 0;
+
+    /* the groups are independent, step through them together to keep
+       the latency of the running mask_add() of each one hidden */
+    for (g = 0; g < ngroups; g++) {
+        FLOAT const *const s3 = gd->s3_band + g * S3_LANES * gd->s3_width;
+        __m256i const b2 = _mm256_add_epi32(_mm256_set1_epi32(2 * S3_LANES * g),
+                                            _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14));
+        __m256i kk;
+
+        first[g] = _mm256_i32gather_epi32(&gd->s3ind[0][0], b2, 4);
+        last[g] = _mm256_i32gather_epi32(&gd->s3ind[0][1], b2, 4);
+        delta[g] = _mm256_i32gather_epi32(psy_delta,
+                                          _mm256_loadu_si256((__m256i const *) (idx + g * S3_LANES)), 4);
+        kk = first[g];
+        /* the mask indices spread into b are a sum over s3ind[b] */
+        _mm256_storeu_si256((__m256i *) (dd_out + g * S3_LANES),
+                            _mm256_sub_epi32(_mm256_i32gather_epi32(idx_sum + 1, last[g], 4),
+                                             _mm256_i32gather_epi32(idx_sum, kk, 4)));
+        ecb[g] = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(s3), _mm256_i32gather_ps(eb, kk, 4)),
+                               _mm256_i32gather_ps(w, kk, 4));
+    }
+    for (t = 1; t < gd->s3_width; t++) {
+        __m256i const tv = _mm256_set1_epi32(t);
+        for (g = 0; g < ngroups; g++) {
+            FLOAT const *const s3 = gd->s3_band + (g * gd->s3_width + t) * S3_LANES;
+            __m256i const b = _mm256_add_epi32(_mm256_set1_epi32(S3_LANES * g),
+                                               _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            __m256i const kk = _mm256_min_epi32(_mm256_add_epi32(first[g], tv), last[g]);
+            __m256 const x = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(s3),
+                                                         _mm256_i32gather_ps(eb, kk, 4)),
+                                           _mm256_i32gather_ps(w, kk, 4));
+
+            ecb[g] = mask_add_avx2(ecb[g], x, _mm256_sub_epi32(kk, b), delta[g]);
+        }
+    }
+    for (g = 0; g < ngroups; g++)
+        _mm256_storeu_ps(ecb_out + g * S3_LANES, ecb[g]);
+}
+
+#endif /* USE_FAST_LOG */
+
+#endif /* HAVE_IMMINTRIN_H */
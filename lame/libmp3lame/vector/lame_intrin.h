@@ -30,4 +30,64 @@ init_xrpow_core_sse(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT
 void
 fht_SSE2(FLOAT* , int);
 
+void
+init_xrpow_core_avx2(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT * sum);
+
+void
+init_xrpow_core_avx512(gr_info * const cod_info, FLOAT xrpow[576], int upper, FLOAT * sum);
+
+void
+quantize_lines_xrpow_avx2(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix);
+
+void
+quantize_lines_xrpow_avx512(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix);
+
+void
+quantize_lines_xrpow_01_avx2(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix);
+
+void
+quantize_lines_xrpow_01_avx512(unsigned int l, FLOAT istep, const FLOAT * xr, int *ix);
+
+FLOAT
+calc_noise_core_avx2(const gr_info * const cod_info, int *startline, int l, FLOAT step);
+
+FLOAT
+calc_noise_core_avx512(const gr_info * const cod_info, int *startline, int l, FLOAT step);
+
+void
+choose_table_avx2_init(void);
+
+int
+choose_table_avx2(const int *ix, const int *const end, int *const s);
+
+void
+fht_avx2_init(void);
+
+void
+fht_AVX2(FLOAT * fz, int n);
+
+void
+mdct_avx2_init(FLOAT const *enwindow, FLOAT const win[4][36], int const order[SBLIMIT]);
+
+void
+window_subband_core_avx2(const sample_t * x1, FLOAT a[SBLIMIT]);
+
+void
+mdct_bands_avx2(FLOAT const *sb0, FLOAT * sb1, FLOAT const amp_filter[SBLIMIT], int type,
+                FLOAT * mdct_enc);
+
+void
+s3_convolve_avx2_init(FLOAT const tab[9], FLOAT const table2[10], int const delta[9],
+                      FLOAT ma_max_i1, FLOAT ma_max_i2);
+
+void
+s3_convolve_avx2(PsyConst_CB2SB_t const *gd, FLOAT const *eb, unsigned char const *mask_idx,
+                 FLOAT * ecb, int *dd);
+
+void
+fht_neon_init(void);
+
+void
+fht_NEON(FLOAT * fz, int n);
+
 #endif
@@ -0,0 +1,280 @@
+/*
+ * Hartley transform, AArch64 NEON intrinsics version
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_intrin.h"
+
+
+
+#ifdef HAVE_ARM_NEON_H
+
+#include <arm_neon.h>
+
+/*********************************************************************
+ * Hartley transform of fft_long() and fft_short(), see fht() in fft.c
+ * and fht_AVX2() in avx_quantize_sub.c, which this follows with four
+ * lanes: the first pass works on four 16 value blocks at once, the
+ * later passes run the twiddle loop over four indices at once.
+ *********************************************************************/
+
+#define TRI_SIZE (5-1)  /* 1024 =  4**5 */
+static const FLOAT costab[TRI_SIZE * 2] = {
+    9.238795325112867e-01, 3.826834323650898e-01,
+    9.951847266721969e-01, 9.801714032956060e-02,
+    9.996988186962042e-01, 2.454122852291229e-02,
+    9.999811752826011e-01, 6.135884649154475e-03
+};
+
+/* c1, s1, c2, s2 of index i of each pass, one spare entry for the last lane */
+static FLOAT fht_twiddle[TRI_SIZE][4][BLKSIZE / 8 + 4];
+
+void
+fht_neon_init(void)
+{
+    int     pass, i, kx;
+
+    for (pass = 0, kx = 2; pass < TRI_SIZE; pass++, kx <<= 2) {
+        FLOAT const *const tri = &costab[2 * pass];
+        FLOAT   c1 = tri[0], s1 = tri[1];
+        for (i = 1; i <= kx; i++) {
+            FLOAT   c2 = 1 - (2 * s1) * s1;
+            FLOAT   s2 = (2 * s1) * c1;
+            fht_twiddle[pass][0][i] = c1;
+            fht_twiddle[pass][1][i] = s1;
+            fht_twiddle[pass][2][i] = c2;
+            fht_twiddle[pass][3][i] = s2;
+            c2 = c1;
+            c1 = c2 * tri[0] - s1 * tri[1];
+            s1 = c2 * tri[1] + s1 * tri[0];
+        }
+    }
+}
+
+
+static void
+transpose4_neon(float32x4_t * r)
+{
+    float32x4x2_t const t01 = vtrnq_f32(r[0], r[1]);
+    float32x4x2_t const t23 = vtrnq_f32(r[2], r[3]);
+    r[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+
+static float32x4_t
+reverse_neon(float32x4_t x)
+{
+    x = vrev64q_f32(x);
+    return vextq_f32(x, x, 2);
+}
+
+
+/* SQRT2 * x, multiplied in double precision like the C expression */
+static float32x4_t
+mul_sqrt2_neon(float32x4_t x)
+{
+    float64x2_t const vec_sqrt2 = vdupq_n_f64(SQRT2);
+    float32x2_t const lo = vcvt_f32_f64(vmulq_f64(vec_sqrt2, vcvt_f64_f32(vget_low_f32(x))));
+    return vcvt_high_f32_f64(lo, vmulq_f64(vec_sqrt2, vcvt_high_f64_f32(x)));
+}
+
+
+/* first pass, k1 = 4, on blocks of 16 values */
+static void
+fht_first_pass_neon(FLOAT * fz, FLOAT const *fn)
+{
+    float32x4_t const c1 = vdupq_n_f32(fht_twiddle[0][0][1]);
+    float32x4_t const s1 = vdupq_n_f32(fht_twiddle[0][1][1]);
+    float32x4_t const c2 = vdupq_n_f32(fht_twiddle[0][2][1]);
+    float32x4_t const s2 = vdupq_n_f32(fht_twiddle[0][3][1]);
+
+    for (; fz < fn; fz += 4 * 16) {
+        float32x4_t v[4][4];    /* value 4 * k + j of block 0-3 is v[k][j] */
+        float32x4_t a, b, f0, f1, f2, f3, g0, g1, g2, g3;
+        int     j, k;
+
+        for (k = 0; k < 4; k++) {
+            for (j = 0; j < 4; j++)
+                v[k][j] = vld1q_f32(fz + 16 * j + 4 * k);
+            transpose4_neon(v[k]);
+        }
+
+        /* i = 0, fi[] */
+        f1 = vsubq_f32(v[0][0], v[1][0]);
+        f0 = vaddq_f32(v[0][0], v[1][0]);
+        f3 = vsubq_f32(v[2][0], v[3][0]);
+        f2 = vaddq_f32(v[2][0], v[3][0]);
+        v[2][0] = vsubq_f32(f0, f2);
+        v[0][0] = vaddq_f32(f0, f2);
+        v[3][0] = vsubq_f32(f1, f3);
+        v[1][0] = vaddq_f32(f1, f3);
+
+        /* i = 0, gi[] */
+        f1 = vsubq_f32(v[0][2], v[1][2]);
+        f0 = vaddq_f32(v[0][2], v[1][2]);
+        f3 = mul_sqrt2_neon(v[3][2]);
+        f2 = mul_sqrt2_neon(v[2][2]);
+        v[2][2] = vsubq_f32(f0, f2);
+        v[0][2] = vaddq_f32(f0, f2);
+        v[3][2] = vsubq_f32(f1, f3);
+        v[1][2] = vaddq_f32(f1, f3);
+
+        /* i = 1, fi[] = v[][1] and gi[] = v[][3] */
+        b = vsubq_f32(vmulq_f32(s2, v[1][1]), vmulq_f32(c2, v[1][3]));
+        a = vaddq_f32(vmulq_f32(c2, v[1][1]), vmulq_f32(s2, v[1][3]));
+        f1 = vsubq_f32(v[0][1], a);
+        f0 = vaddq_f32(v[0][1], a);
+        g1 = vsubq_f32(v[0][3], b);
+        g0 = vaddq_f32(v[0][3], b);
+        b = vsubq_f32(vmulq_f32(s2, v[3][1]), vmulq_f32(c2, v[3][3]));
+        a = vaddq_f32(vmulq_f32(c2, v[3][1]), vmulq_f32(s2, v[3][3]));
+        f3 = vsubq_f32(v[2][1], a);
+        f2 = vaddq_f32(v[2][1], a);
+        g3 = vsubq_f32(v[2][3], b);
+        g2 = vaddq_f32(v[2][3], b);
+        b = vsubq_f32(vmulq_f32(s1, f2), vmulq_f32(c1, g3));
+        a = vaddq_f32(vmulq_f32(c1, f2), vmulq_f32(s1, g3));
+        v[2][1] = vsubq_f32(f0, a);
+        v[0][1] = vaddq_f32(f0, a);
+        v[3][3] = vsubq_f32(g1, b);
+        v[1][3] = vaddq_f32(g1, b);
+        b = vsubq_f32(vmulq_f32(c1, g2), vmulq_f32(s1, f3));
+        a = vaddq_f32(vmulq_f32(s1, g2), vmulq_f32(c1, f3));
+        v[2][3] = vsubq_f32(g0, a);
+        v[0][3] = vaddq_f32(g0, a);
+        v[3][1] = vsubq_f32(f1, b);
+        v[1][1] = vaddq_f32(f1, b);
+
+        for (k = 0; k < 4; k++) {
+            transpose4_neon(v[k]);
+            for (j = 0; j < 4; j++)
+                vst1q_f32(fz + 16 * j + 4 * k, v[k][j]);
+        }
+    }
+}
+
+
+void
+fht_NEON(FLOAT * fz, int n)
+{
+    int     k4, pass;
+    FLOAT  *fi, *gi;
+    FLOAT const *fn;
+
+    n <<= 1;            /* to get BLKSIZE, because of 3DNow! ASM routine */
+    fn = fz + n;
+    fht_first_pass_neon(fz, fn);
+    k4 = 16;
+    pass = 1;
+    while (k4 < n) {
+        int     i, k1, k2, k3, kx;
+        kx = k4 >> 1;
+        k1 = k4;
+        k2 = k4 << 1;
+        k3 = k2 + k1;
+        k4 = k2 << 1;
+        fi = fz;
+        gi = fi + kx;
+        do {
+            FLOAT   f0, f1, f2, f3;
+            f1 = fi[0] - fi[k1];
+            f0 = fi[0] + fi[k1];
+            f3 = fi[k2] - fi[k3];
+            f2 = fi[k2] + fi[k3];
+            fi[k2] = f0 - f2;
+            fi[0] = f0 + f2;
+            fi[k3] = f1 - f3;
+            fi[k1] = f1 + f3;
+            f1 = gi[0] - gi[k1];
+            f0 = gi[0] + gi[k1];
+            f3 = SQRT2 * gi[k3];
+            f2 = SQRT2 * gi[k2];
+            gi[k2] = f0 - f2;
+            gi[0] = f0 + f2;
+            gi[k3] = f1 - f3;
+            gi[k1] = f1 + f3;
+            gi += k4;
+            fi += k4;
+        } while (fi < fn);
+
+        /* kx - 1 is 3 modulo 4, the last lane of the last step is index
+         * kx, which belongs to i = 0 and has to be left alone */
+        for (i = 1; i < kx; i += 4) {
+            static const uint32_t last_lane[4] = { 0, 0, 0, 0xffffffff };
+            float32x4_t const c1 = vld1q_f32(&fht_twiddle[pass][0][i]);
+            float32x4_t const s1 = vld1q_f32(&fht_twiddle[pass][1][i]);
+            float32x4_t const c2 = vld1q_f32(&fht_twiddle[pass][2][i]);
+            float32x4_t const s2 = vld1q_f32(&fht_twiddle[pass][3][i]);
+            uint32x4_t const keep = (i + 4 > kx) ? vld1q_u32(last_lane) : vdupq_n_u32(0);
+            fi = fz + i;
+            gi = fz + k1 - i - 3;
+            do {
+                float32x4_t a, b, f0, f1, f2, f3, g0, g1, g2, g3;
+                float32x4_t const fi0 = vld1q_f32(fi);
+                float32x4_t const fi1 = vld1q_f32(fi + k1);
+                float32x4_t const fi2 = vld1q_f32(fi + k2);
+                float32x4_t const fi3 = vld1q_f32(fi + k3);
+                float32x4_t const gi0 = reverse_neon(vld1q_f32(gi));
+                float32x4_t const gi1 = reverse_neon(vld1q_f32(gi + k1));
+                float32x4_t const gi2 = reverse_neon(vld1q_f32(gi + k2));
+                float32x4_t const gi3 = reverse_neon(vld1q_f32(gi + k3));
+
+                b = vsubq_f32(vmulq_f32(s2, fi1), vmulq_f32(c2, gi1));
+                a = vaddq_f32(vmulq_f32(c2, fi1), vmulq_f32(s2, gi1));
+                f1 = vsubq_f32(fi0, a);
+                f0 = vaddq_f32(fi0, a);
+                g1 = vsubq_f32(gi0, b);
+                g0 = vaddq_f32(gi0, b);
+                b = vsubq_f32(vmulq_f32(s2, fi3), vmulq_f32(c2, gi3));
+                a = vaddq_f32(vmulq_f32(c2, fi3), vmulq_f32(s2, gi3));
+                f3 = vsubq_f32(fi2, a);
+                f2 = vaddq_f32(fi2, a);
+                g3 = vsubq_f32(gi2, b);
+                g2 = vaddq_f32(gi2, b);
+                b = vsubq_f32(vmulq_f32(s1, f2), vmulq_f32(c1, g3));
+                a = vaddq_f32(vmulq_f32(c1, f2), vmulq_f32(s1, g3));
+                vst1q_f32(fi + k2, vbslq_f32(keep, fi2, vsubq_f32(f0, a)));
+                vst1q_f32(fi, vbslq_f32(keep, fi0, vaddq_f32(f0, a)));
+                vst1q_f32(gi + k3, reverse_neon(vbslq_f32(keep, gi3, vsubq_f32(g1, b))));
+                vst1q_f32(gi + k1, reverse_neon(vbslq_f32(keep, gi1, vaddq_f32(g1, b))));
+                b = vsubq_f32(vmulq_f32(c1, g2), vmulq_f32(s1, f3));
+                a = vaddq_f32(vmulq_f32(s1, g2), vmulq_f32(c1, f3));
+                vst1q_f32(gi + k2, reverse_neon(vbslq_f32(keep, gi2, vsubq_f32(g0, a))));
+                vst1q_f32(gi, reverse_neon(vbslq_f32(keep, gi0, vaddq_f32(g0, a))));
+                vst1q_f32(fi + k3, vbslq_f32(keep, fi3, vsubq_f32(f1, b)));
+                vst1q_f32(fi + k1, vbslq_f32(keep, fi1, vaddq_f32(f1, b)));
+                gi += k4;
+                fi += k4;
+            } while (fi < fn);
+        }
+        pass++;
+    }
+}
+
+#endif /* HAVE_ARM_NEON_H */
@@ -0,0 +1,91 @@
+/*
+ *  16 bit PCM WAV reader for the benchmarks in misc/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchwav.h"
+
+
+static unsigned int
+get_le(const unsigned char *p, int n)
+{
+    unsigned int v = 0;
+    while (n-- > 0)
+        v = (v << 8) | p[n];
+    return v;
+}
+
+
+/* minimal RIFF WAVE reader, 16 bit PCM only */
+short  *
+read_wav(const char *name, int *channels, int *samplerate, int *samples)
+{
+    FILE   *f = fopen(name, "rb");
+    unsigned char hdr[12], chunk[8], fmt[16];
+    short  *pcm = 0;
+
+    if (f == 0) {
+        perror(name);
+        return 0;
+    }
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAVE file\n", name);
+        fclose(f);
+        return 0;
+    }
+    *channels = 0;
+    while (fread(chunk, 1, 8, f) == 8) {
+        unsigned int const len = get_le(chunk + 4, 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && len >= 16) {
+            if (fread(fmt, 1, 16, f) != 16)
+                break;
+            if (get_le(fmt, 2) != 1 || get_le(fmt + 14, 2) != 16)
+                break;
+            *channels = get_le(fmt + 2, 2);
+            *samplerate = get_le(fmt + 4, 4);
+            fseek(f, (long) (len - 16 + (len & 1)), SEEK_CUR);
+        }
+        else if (memcmp(chunk, "data", 4) == 0 && *channels > 0) {
+            unsigned char *raw = malloc(len);
+            unsigned int i;
+            if (raw == 0)
+                break;
+            *samples = fread(raw, 1, len, f) / (2 * *channels);
+            pcm = malloc(sizeof(short) * *samples * *channels + 1);
+            if (pcm != 0) {
+                for (i = 0; i < (unsigned int) (*samples * *channels); ++i)
+                    pcm[i] = (short) get_le(raw + 2 * i, 2);
+            }
+            free(raw);
+            break;
+        }
+        else
+            fseek(f, (long) (len + (len & 1)), SEEK_CUR);
+    }
+    fclose(f);
+    if (pcm == 0)
+        fprintf(stderr, "%s: no 16 bit PCM data found\n", name);
+    return pcm;
+}
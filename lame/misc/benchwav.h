@@ -0,0 +1,27 @@
+/*
+ *  16 bit PCM WAV reader for the benchmarks in misc/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_BENCHWAV_H
+#define LAME_BENCHWAV_H
+
+/* returns the interleaved samples of a 16 bit PCM WAV file, to be freed
+   by the caller, or 0 with a message on stderr */
+short  *read_wav(const char *name, int *channels, int *samplerate, int *samples);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ *  Bitstream formatting benchmark
+ *
+ *  Encodes a 16 bit PCM WAV file and keeps the side info and quantized
+ *  spectra of every frame.  Then it times format_bitstream() over these
+ *  frames, starting from an empty bit stream in every round, and checks
+ *  that the result is the same as the mp3 data of the encode.
+ *
+ *  usage: bitbench file.wav [kbps [rounds]]
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "bitstream.h"
+#include "benchwav.h"
+
+
+typedef struct {
+    III_side_info_t l3_side;    /* as format_bitstream() saw it */
+    EncResult_t ov_enc;
+    int     ResvSize;
+} frame_t;
+
+
+/* remember the last encoded frame.  format_bitstream() has moved
+ * main_data_begin on to the next frame already, so move it back */
+static void
+collect_frame(lame_internal_flags * gfc, frame_t * f)
+{
+    III_side_info_t *const l3_side = &f->l3_side;
+    int     gr, ch, bits;
+
+    *l3_side = gfc->l3_side;
+    f->ov_enc = gfc->ov_enc;
+    f->ResvSize = gfc->sv_enc.ResvSize;
+
+    bits = 8 * gfc->cfg.sideinfo_len + l3_side->resvDrain_post;
+    for (gr = 0; gr < gfc->cfg.mode_gr; gr++)
+        for (ch = 0; ch < gfc->cfg.channels_out; ch++)
+            bits += l3_side->tt[gr][ch].part2_3_length + l3_side->tt[gr][ch].part2_length;
+    l3_side->main_data_begin -= (getframebits(gfc) - bits) / 8;
+}
+
+
+static double
+run(lame_internal_flags * gfc, frame_t const *f, int n, int rounds,
+    unsigned char *out, int out_size, int *out_len)
+{
+    clock_t const start = clock();
+    int     r, i, len = 0;
+
+    for (r = 0; r < rounds; r++) {
+        init_bit_stream_w(gfc);
+        gfc->sv_enc.ancillary_flag = 0;
+        len = 0;
+        for (i = 0; i < n; i++) {
+            gfc->l3_side = f[i].l3_side;
+            gfc->ov_enc = f[i].ov_enc;
+            gfc->sv_enc.ResvSize = f[i].ResvSize;
+            format_bitstream(gfc);
+            len += copy_buffer(gfc, out + len, out_size - len, 0);
+        }
+    }
+    *out_len = len;
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    lame_global_flags *gfp;
+    lame_internal_flags *gfc;
+    frame_t *f;
+    short  *pcm;
+    unsigned char *mp3, *out;
+    int     channels, samplerate = 0, samples = 0, pos, n = 0, max, size, mp3_len = 0, out_len;
+    int     kbps = (argc > 2) ? atoi(argv[2]) : 128;
+    int     rounds = (argc > 3) ? atoi(argv[3]) : 20;
+    double  t;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.wav [kbps [rounds]]\n", argv[0]);
+        return 1;
+    }
+    pcm = read_wav(argv[1], &channels, &samplerate, &samples);
+    if (pcm == 0)
+        return 1;
+
+    gfp = lame_init();
+    lame_set_num_channels(gfp, channels);
+    lame_set_in_samplerate(gfp, samplerate);
+    lame_set_out_samplerate(gfp, samplerate);
+    lame_set_brate(gfp, kbps);
+    lame_set_bWriteVbrTag(gfp, 0);
+    lame_set_quality(gfp, 2);
+    if (lame_init_params(gfp) < 0) {
+        fprintf(stderr, "lame_init_params failed\n");
+        return 1;
+    }
+    gfc = gfp->internal_flags;
+
+    max = samples / 1152 + 2;
+    size = 2048 * max + LAME_MAXMP3BUFFER; /* frames are at most 1441 bytes */
+    f = calloc(max, sizeof(frame_t));
+    mp3 = malloc(size);
+    out = malloc(size);
+    if (f == 0 || mp3 == 0 || out == 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (pos = 0; pos < samples; pos += 1152) {
+        int const nsamples = Min(1152, samples - pos);
+        int     ret;
+        if (channels == 2)
+            ret = lame_encode_buffer_interleaved(gfp, pcm + 2 * pos, nsamples,
+                                                 mp3 + mp3_len, size - mp3_len);
+        else
+            ret = lame_encode_buffer(gfp, pcm + pos, pcm + pos, nsamples,
+                                     mp3 + mp3_len, size - mp3_len);
+        if (ret < 0) {
+            fprintf(stderr, "encoding failed\n");
+            return 1;
+        }
+        mp3_len += ret;
+        if (lame_get_frameNum(gfp) > n + 1) {
+            fprintf(stderr, "more than one frame from 1152 samples\n");
+            return 1;
+        }
+        if (lame_get_frameNum(gfp) > n)
+            collect_frame(gfc, &f[n++]);
+    }
+    printf("%d frames, %d bytes\n", n, mp3_len);
+
+    t = run(gfc, f, n, rounds, out, size, &out_len);
+    printf("format_bitstream:  %8.2f us/frame  %8.2f MB/s\n",
+           1e6 * t / ((double) n * rounds), out_len * (double) rounds / (t * 1e6));
+    if (out_len != mp3_len || memcmp(out, mp3, out_len) != 0) {
+        printf("MISMATCH with the encoded mp3 data\n");
+        return 1;
+    }
+
+    lame_close(gfp);
+    free(out);
+    free(mp3);
+    free(f);
+    free(pcm);
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ *  Huffman bit counting benchmark
+ *
+ *  Encodes a 16 bit PCM WAV file, keeps the quantized spectra of the
+ *  encoded granules and then times gfc->choose_table() over their
+ *  big_values regions, once with the portable C version and once with
+ *  the version selected for this CPU.  Both have to agree on every
+ *  table choice and bit count.
+ *
+ *  usage: huffbench file.wav [kbps [rounds]]
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "quantize_pvt.h"
+#include "benchwav.h"
+
+
+typedef struct {
+    int     ix[576];
+    int     region[4];      /* 0, a1, a2, big_values */
+} granule_t;
+
+
+/* remember the big_values regions of the granules of the last encoded frame */
+static int
+collect_granules(lame_internal_flags const *gfc, granule_t * g, int n, int max)
+{
+    int     gr, ch;
+
+    for (gr = 0; gr < gfc->cfg.mode_gr; gr++) {
+        for (ch = 0; ch < gfc->cfg.channels_out; ch++) {
+            gr_info const *const gi = &gfc->l3_side.tt[gr][ch];
+            int     a1, a2;
+
+            if (n >= max || gi->big_values == 0)
+                continue;
+            if (gi->block_type == SHORT_TYPE) {
+                a1 = 3 * gfc->scalefac_band.s[3];
+                a2 = gi->big_values;
+            }
+            else {
+                a1 = gfc->scalefac_band.l[gi->region0_count + 1];
+                a2 = gfc->scalefac_band.l[gi->region0_count + gi->region1_count + 2];
+            }
+            a1 = Min(a1, gi->big_values);
+            a2 = Min(a2, gi->big_values);
+            memcpy(g[n].ix, gi->l3_enc, sizeof(g[n].ix));
+            g[n].region[0] = 0;
+            g[n].region[1] = a1;
+            g[n].region[2] = a2;
+            g[n].region[3] = gi->big_values;
+            n++;
+        }
+    }
+    return n;
+}
+
+
+static double
+run(lame_internal_flags const *gfc, granule_t const *g, int n, int rounds,
+    unsigned long *checksum, long *calls)
+{
+    clock_t const start = clock();
+    unsigned long sum = 0;
+    long    c = 0;
+    int     r, i, k;
+
+    /* the encoder counts the same granule many times in a row, so do we */
+    for (i = 0; i < n; i++) {
+        for (r = 0; r < rounds; r++) {
+            for (k = 0; k < 3; k++) {
+                int     bits = 0;
+                int     table;
+                if (g[i].region[k] >= g[i].region[k + 1])
+                    continue;
+                table = gfc->choose_table(g[i].ix + g[i].region[k],
+                                          g[i].ix + g[i].region[k + 1], &bits);
+                sum = sum * 31 + (unsigned long) (table * 65536 + bits);
+                c++;
+            }
+        }
+    }
+    *checksum = sum;
+    *calls = c;
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    lame_global_flags *gfp;
+    lame_internal_flags *gfc;
+    unsigned char mp3buf[LAME_MAXMP3BUFFER];
+    granule_t *g;
+    short  *pcm;
+    int     channels, samplerate = 0, samples = 0, pos, n = 0, max;
+    int     kbps = (argc > 2) ? atoi(argv[2]) : 128;
+    int     rounds = (argc > 3) ? atoi(argv[3]) : 20;
+    int     frames = 0;
+    unsigned long sum_c, sum_opt;
+    long    calls_c, calls_opt;
+    double  t_c, t_opt;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.wav [kbps [rounds]]\n", argv[0]);
+        return 1;
+    }
+    pcm = read_wav(argv[1], &channels, &samplerate, &samples);
+    if (pcm == 0)
+        return 1;
+
+    gfp = lame_init();
+    lame_set_num_channels(gfp, channels);
+    lame_set_in_samplerate(gfp, samplerate);
+    lame_set_brate(gfp, kbps);
+    lame_set_quality(gfp, 2);
+    if (lame_init_params(gfp) < 0) {
+        fprintf(stderr, "lame_init_params failed\n");
+        return 1;
+    }
+    gfc = gfp->internal_flags;
+
+    max = 2 * 2 * (samples / 576 + 2);
+    g = calloc(max, sizeof(granule_t));
+    if (g == 0)
+        return 1;
+    for (pos = 0; pos < samples; pos += 1152) {
+        int const nsamples = Min(1152, samples - pos);
+        if (channels == 2)
+            lame_encode_buffer_interleaved(gfp, pcm + 2 * pos, nsamples, mp3buf, sizeof(mp3buf));
+        else
+            lame_encode_buffer(gfp, pcm + pos, pcm + pos, nsamples, mp3buf, sizeof(mp3buf));
+        if (lame_get_frameNum(gfp) != frames) {
+            frames = lame_get_frameNum(gfp);
+            n = collect_granules(gfc, g, n, max);
+        }
+    }
+    printf("%d frames, %d granules\n", frames, n);
+
+    t_opt = run(gfc, g, n, rounds, &sum_opt, &calls_opt);
+    {
+        /* the portable C version, as selected on a CPU without extensions */
+        unsigned int const mmx = gfc->CPU_features.MMX, avx2 = gfc->CPU_features.AVX2;
+        gfc->CPU_features.MMX = 0;
+        gfc->CPU_features.AVX2 = 0;
+        huffman_init(gfc);
+        t_c = run(gfc, g, n, rounds, &sum_c, &calls_c);
+        gfc->CPU_features.MMX = mmx;
+        gfc->CPU_features.AVX2 = avx2;
+        huffman_init(gfc);
+    }
+
+    printf("C version:         %8.2f ns/call\n", 1e9 * t_c / (calls_c ? calls_c : 1));
+    printf("selected version:  %8.2f ns/call\n", 1e9 * t_opt / (calls_opt ? calls_opt : 1));
+    if (t_opt > 0)
+        printf("speed-up:          %8.2f\n", t_c / t_opt);
+    if (sum_c != sum_opt || calls_c != calls_opt) {
+        printf("MISMATCH between C and selected version\n");
+        return 1;
+    }
+
+    lame_close(gfp);
+    free(g);
+    free(pcm);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ *  Encoder startup benchmark
+ *
+ *  Times lame_init(), lame_init_params() and lame_close() for each MPEG
+ *  samplerate, once for CBR and once for VBR, which is what a server
+ *  encoding many short streams pays for every new stream.  The first
+ *  encoder of the process also sets up the global tables, it is
+ *  reported separately.  For comparison, the cost of preparing an
+ *  existing encoder for the next stream with lame_reset() is shown last.
+ *
+ *  usage: initbench [rounds]
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lame.h"
+
+
+static int
+start_encoder(int samplerate, int vbr)
+{
+    lame_global_flags *gfp = lame_init();
+    int     ret;
+
+    if (gfp == 0)
+        return -1;
+    lame_set_in_samplerate(gfp, samplerate);
+    lame_set_out_samplerate(gfp, samplerate);
+    if (vbr) {
+        lame_set_VBR(gfp, vbr_default);
+        lame_set_VBR_q(gfp, 2);
+    }
+    else {
+        lame_set_brate(gfp, samplerate >= 32000 ? 128 : 64);
+    }
+    ret = lame_init_params(gfp);
+    lame_close(gfp);
+    return ret;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    static const int rates[] = { 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000 };
+    int const nrates = (int) (sizeof(rates) / sizeof(rates[0]));
+    int     rounds = (argc > 1) ? atoi(argv[1]) : 200;
+    int     r, vbr, i;
+    double  total = 0;
+    lame_global_flags *gfp;
+    clock_t start;
+
+    start = clock();
+    if (start_encoder(44100, 0) < 0) {
+        fprintf(stderr, "lame_init_params failed\n");
+        return 1;
+    }
+    printf("first encoder:  %8.1f us\n", 1e6 * (clock() - start) / CLOCKS_PER_SEC);
+
+    printf("samplerate        CBR us      VBR us\n");
+    for (r = 0; r < nrates; r++) {
+        printf("%10d", rates[r]);
+        for (vbr = 0; vbr < 2; vbr++) {
+            double  t;
+            start = clock();
+            for (i = 0; i < rounds; i++) {
+                if (start_encoder(rates[r], vbr) < 0) {
+                    fprintf(stderr, "lame_init_params failed\n");
+                    return 1;
+                }
+            }
+            t = (double) (clock() - start) / CLOCKS_PER_SEC / rounds;
+            total += t;
+            printf("  %10.1f", 1e6 * t);
+        }
+        printf("\n");
+    }
+    printf("average:        %8.1f us per encoder\n", 1e6 * total / (2 * nrates));
+
+    gfp = lame_init();
+    if (gfp == 0 || lame_init_params(gfp) < 0) {
+        fprintf(stderr, "lame_init_params failed\n");
+        return 1;
+    }
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        (void) lame_reset(gfp);
+    }
+    printf("lame_reset:     %8.1f us\n", 1e6 * (clock() - start) / CLOCKS_PER_SEC / rounds);
+    lame_close(gfp);
+    return 0;
+}
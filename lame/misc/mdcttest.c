@@ -0,0 +1,158 @@
+/*
+ *  Filterbank and MDCT test
+ *
+ *  Runs mdct_sub48() on a synthetic stereo signal with all block types
+ *  and a subband filter with stop, transition and pass bands, once with
+ *  the portable C version and once with the version selected for this
+ *  CPU, and compares the spectra and the subband samples.  Both are
+ *  timed as well.
+ *
+ *  usage: mdcttest [frames]
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "newmdct.h"
+
+
+#define BUFSIZE (286 + 1152 + 576)
+
+/* a few partials, some noise and an occasional click */
+static void
+make_signal(sample_t * buf, int frame, int ch)
+{
+    int     i;
+    for (i = 0; i < BUFSIZE; i++) {
+        double const t = (double) (frame * 1152 + i) / 44100;
+        double  x = 8000 * sin(2 * PI * (220 + 50 * ch) * t)
+            + 3000 * sin(2 * PI * 3130 * t) + 500 * sin(2 * PI * 14000 * t)
+            + 200 * ((rand() & 0xffff) / 32768.0 - 1);
+        if (i % 397 == frame % 397)
+            x += 20000;
+        buf[i] = (sample_t) x;
+    }
+}
+
+
+static void
+set_functions(lame_internal_flags * gfc, unsigned int avx2)
+{
+    gfc->CPU_features.AVX2 = avx2;
+    init_mdct(gfc);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    static const int types[4] = { NORM_TYPE, START_TYPE, SHORT_TYPE, STOP_TYPE };
+    static FLOAT xr_c[2][2][576], xr_opt[2][2][576];
+    static FLOAT sb_c[2][2][18][SBLIMIT], sb_save[2][2][18][SBLIMIT];
+    static sample_t buf[2][BUFSIZE];
+    lame_global_flags *gfp;
+    lame_internal_flags *gfc;
+    EncStateVar_t *esv;
+    int     frames = (argc > 1) ? atoi(argv[1]) : 2000;
+    int     frame, band, ch, gr, i, exact = 1;
+    unsigned int avx2;
+    double  maxdiff = 0, maxval = 0, t_c = 0, t_opt = 0;
+
+    gfp = lame_init();
+    lame_set_num_channels(gfp, 2);
+    lame_set_in_samplerate(gfp, 44100);
+    lame_set_mode(gfp, STEREO);
+    if (lame_init_params(gfp) < 0) {
+        fprintf(stderr, "lame_init_params failed\n");
+        return 1;
+    }
+    gfc = gfp->internal_flags;
+    esv = &gfc->sv_enc;
+    avx2 = gfc->CPU_features.AVX2;
+    printf("selected version: %s\n", avx2 ? "AVX2" : "C");
+
+    /* stop band, transition band and pass band */
+    for (band = 0; band < SBLIMIT; band++)
+        esv->amp_filter[band] = band < 20 ? 1.0 : band < 26 ? 1.0 - (band - 19) / 7.0 : 0.0;
+
+    for (frame = 0; frame < frames; frame++) {
+        int     block_type[2][2];
+        clock_t start;
+
+        for (gr = 0; gr < 2; gr++)
+            for (ch = 0; ch < 2; ch++)
+                block_type[gr][ch] = types[(frame / 3 + 2 * gr + ch) % 4];
+        for (ch = 0; ch < 2; ch++)
+            make_signal(buf[ch], frame, ch);
+        memcpy(sb_save, esv->sb_sample, sizeof(sb_save));
+
+        set_functions(gfc, 0);
+        start = clock();
+        mdct_sub48(gfc, buf[0], buf[1], block_type, xr_c);
+        t_c += clock() - start;
+        memcpy(sb_c, esv->sb_sample, sizeof(sb_c));
+
+        memcpy(esv->sb_sample, sb_save, sizeof(sb_save));
+        set_functions(gfc, avx2);
+        start = clock();
+        mdct_sub48(gfc, buf[0], buf[1], block_type, xr_opt);
+        t_opt += clock() - start;
+
+        if (memcmp(xr_c, xr_opt, sizeof(xr_c)) || memcmp(sb_c, esv->sb_sample, sizeof(sb_c)))
+            exact = 0;
+        for (i = 0; i < 2 * 2 * 576; i++) {
+            double const a = (&xr_c[0][0][0])[i], b = (&xr_opt[0][0][0])[i];
+            if (fabs(a) > maxval)
+                maxval = fabs(a);
+            if (fabs(a - b) > maxdiff)
+                maxdiff = fabs(a - b);
+        }
+        /* continue with the same state for both */
+        memcpy(esv->sb_sample, sb_c, sizeof(sb_c));
+    }
+
+    printf("C version:         %8.2f us/frame\n", 1e6 * t_c / CLOCKS_PER_SEC / frames);
+    printf("selected version:  %8.2f us/frame\n", 1e6 * t_opt / CLOCKS_PER_SEC / frames);
+    if (t_opt > 0)
+        printf("speed-up:          %8.2f\n", t_c / t_opt);
+    lame_close(gfp);
+
+    if (exact) {
+        printf("bit exact\n");
+        return 0;
+    }
+    printf("max difference %g of %g\n", maxdiff, maxval);
+    /* the library may be built with -ffast-math, allow for reassociation */
+    if (maxdiff > 1e-5 * maxval) {
+        printf("MISMATCH between C and selected version\n");
+        return 1;
+    }
+    return 0;
+}
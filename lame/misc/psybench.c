@@ -0,0 +1,151 @@
+/*
+ *  Spreading function convolution benchmark
+ *
+ *  Times gfc->s3_convolve() on synthetic partition energies and mask
+ *  indices for the long and short block partitions of several sample
+ *  rates, once with the portable C version and once with the version
+ *  selected for this CPU.  Both have to produce the same masking.
+ *
+ *  usage: psybench [rounds]
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "psymodel.h"
+
+
+#define NSETS 64
+
+typedef struct {
+    FLOAT   eb[CBANDS];
+    unsigned char mask_idx[CBANDS + 2];
+} psy_input_t;
+
+
+/* energies over a wide dynamic range, with some silent partitions */
+static void
+make_inputs(psy_input_t * in, int npart)
+{
+    int     i, b;
+    for (i = 0; i < NSETS; i++) {
+        for (b = 0; b < npart; b++) {
+            int const r = rand();
+            in[i].eb[b] = (r % 7 == 0) ? 0 : (FLOAT) pow(10.0, (r % 1000) / 100.0 - 2);
+            in[i].mask_idx[b] = (unsigned char) (rand() % 9);
+        }
+    }
+}
+
+
+static double
+run(lame_internal_flags const *gfc, PsyConst_CB2SB_t const *gd, psy_input_t const *in,
+    int rounds, FLOAT(*ecb)[CBANDS], int (*dd)[CBANDS])
+{
+    clock_t const start = clock();
+    int     r, i;
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < NSETS; i++)
+            gfc->s3_convolve(gd, in[i].eb, in[i].mask_idx, ecb[i], dd[i]);
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    static const int rates[] = { 48000, 44100, 32000, 24000, 16000, 8000 };
+    static psy_input_t in[NSETS];
+    static FLOAT ecb_c[NSETS][CBANDS], ecb_opt[NSETS][CBANDS];
+    static int dd_c[NSETS][CBANDS], dd_opt[NSETS][CBANDS];
+    int     rounds = (argc > 1) ? atoi(argv[1]) : 200;
+    int     r, blk, i, b, calls = 0, exact = 1;
+    double  t_c = 0, t_opt = 0, maxdiff = 0;
+
+    for (r = 0; r < (int) (sizeof(rates) / sizeof(rates[0])); r++) {
+        lame_global_flags *gfp = lame_init();
+        lame_internal_flags *gfc;
+        unsigned int avx2;
+
+        lame_set_in_samplerate(gfp, rates[r]);
+        lame_set_out_samplerate(gfp, rates[r]);
+        if (lame_init_params(gfp) < 0) {
+            fprintf(stderr, "lame_init_params failed\n");
+            return 1;
+        }
+        gfc = gfp->internal_flags;
+        avx2 = gfc->CPU_features.AVX2;
+
+        for (blk = 0; blk < 2; blk++) {
+            PsyConst_CB2SB_t const *const gd = blk ? &gfc->cd_psy->s : &gfc->cd_psy->l;
+            make_inputs(in, gd->npart);
+
+            gfc->CPU_features.AVX2 = 0;
+            init_s3_convolve(gfc);
+            t_c += run(gfc, gd, in, rounds, ecb_c, dd_c);
+            gfc->CPU_features.AVX2 = avx2;
+            init_s3_convolve(gfc);
+            t_opt += run(gfc, gd, in, rounds, ecb_opt, dd_opt);
+            calls += rounds * NSETS;
+
+            for (i = 0; i < NSETS; i++) {
+                for (b = 0; b < gd->npart; b++) {
+                    double const a = ecb_c[i][b], o = ecb_opt[i][b];
+                    if (dd_c[i][b] != dd_opt[i][b])
+                        maxdiff = 1;
+                    if (a != o) {
+                        exact = 0;
+                        if (fabs(a - o) > maxdiff * fabs(a))
+                            maxdiff = fabs(a - o) / fabs(a);
+                    }
+                }
+            }
+            printf("%5d Hz %s blocks: %2d partitions, %2d spreading rows\n", rates[r],
+                   blk ? "short" : "long ", gd->npart, gd->s3_width);
+        }
+        lame_close(gfp);
+    }
+
+    printf("C version:         %8.2f ns/call\n", 1e9 * t_c / calls);
+    printf("selected version:  %8.2f ns/call\n", 1e9 * t_opt / calls);
+    if (t_opt > 0)
+        printf("speed-up:          %8.2f\n", t_c / t_opt);
+    if (exact) {
+        printf("bit exact\n");
+        return 0;
+    }
+    printf("max relative difference %g\n", maxdiff);
+    /* the library may be built with -ffast-math, allow for reassociation */
+    if (maxdiff > 1e-5) {
+        printf("MISMATCH between C and selected version\n");
+        return 1;
+    }
+    return 0;
+}